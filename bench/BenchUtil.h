@@ -0,0 +1,111 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <sys/resource.h> // For getrusage
+
+// Helpers shared by the benchmark tools. Results are written as JSON lines (one object
+// per measurement), so runs can be appended to one file and compared over time.
+
+// One JSON object, built field by field. Only the types the benchmarks need.
+class JsonRecord {
+public:
+    JsonRecord& add(const std::string& key, const std::string& value) {
+        separate(key);
+        body_ += '"';
+        for (char c : value) {
+            if (c == '"' || c == '\\') body_ += '\\';
+            if (static_cast<unsigned char>(c) < 0x20) continue;
+            body_ += c;
+        }
+        body_ += '"';
+        return *this;
+    }
+    JsonRecord& add(const std::string& key, const char* value) { return add(key, std::string(value)); }
+    JsonRecord& add(const std::string& key, unsigned long long value) {
+        separate(key);
+        body_ += std::to_string(value);
+        return *this;
+    }
+    JsonRecord& add(const std::string& key, long long value) {
+        separate(key);
+        body_ += std::to_string(value);
+        return *this;
+    }
+    JsonRecord& add(const std::string& key, int value) { return add(key, static_cast<long long>(value)); }
+    JsonRecord& add(const std::string& key, double value) {
+        separate(key);
+        char text[64];
+        std::snprintf(text, sizeof(text), "%.6g", value);
+        body_ += text;
+        return *this;
+    }
+
+    // Writes the record as one line and flushes it.
+    void write(std::FILE* out) const {
+        std::fprintf(out, "{%s}\n", body_.c_str());
+        std::fflush(out);
+    }
+
+private:
+    void separate(const std::string& key) {
+        if (!body_.empty()) body_ += ',';
+        body_ += '"';
+        body_ += key;
+        body_ += "\":";
+    }
+
+    std::string body_;
+};
+
+#ifndef ZSH_HISTORY_CLEANER_VERSION
+#define ZSH_HISTORY_CLEANER_VERSION "unknown"
+#endif
+
+// Starts a record with the fields that identify a measurement over time
+inline JsonRecord benchRecord(const char* kind) {
+    JsonRecord record;
+    record.add("bench", kind).add("version", ZSH_HISTORY_CLEANER_VERSION)
+          .add("time", static_cast<long long>(std::time(nullptr)));
+    return record;
+}
+
+// Throughput fields every benchmark reports
+inline JsonRecord& addThroughput(JsonRecord& record, unsigned long long bytes,
+                                 unsigned long long items, double seconds) {
+    record.add("bytes", bytes).add("items", items).add("seconds", seconds);
+    if (seconds > 0) {
+        record.add("mb_per_s", static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds);
+        record.add("items_per_s", static_cast<double>(items) / seconds);
+    }
+    return record;
+}
+
+// Peak resident set size of this process (who == RUSAGE_SELF) or of its waited-for
+// children (RUSAGE_CHILDREN), in KiB.
+inline long long peakRssKb(int who = RUSAGE_SELF) {
+    struct rusage usage;
+    if (getrusage(who, &usage) != 0) return -1;
+    return static_cast<long long>(usage.ru_maxrss);
+}
+
+class Stopwatch {
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Opens path for appending, or returns stdout for an empty path / "-".
+inline std::FILE* openResults(const std::string& path) {
+    if (path.empty() || path == "-") return stdout;
+    return std::fopen(path.c_str(), "a");
+}
+
+#endif // BENCH_UTIL_H
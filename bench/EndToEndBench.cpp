@@ -0,0 +1,235 @@
+// End-to-end benchmark: runs the zsh_history_cleaner binary over a copy of a history
+// file for every cleaning mode, with and without content filters, and reports wall time,
+// throughput and the child's peak RSS as JSON lines.
+//
+// Dates and day counts are derived from the timestamps in the input, so every mode
+// selects a non-trivial part of a generated history regardless of when it was generated.
+
+#include "BenchUtil.h"
+
+#include "zsh_history_cleaner/HistoryParser.h"
+#include "zsh_history_cleaner/HistoryReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>        // For open
+#include <unistd.h>       // For fork, execv, dup2
+#include <sys/wait.h>     // For wait4
+#include <sys/resource.h> // For struct rusage
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    std::string cli;                // zsh_history_cleaner binary
+    std::string input;              // History file (copied before every run)
+    std::string workDir = ".";      // Where the working copy lives
+    std::string results;            // JSON lines output (default: stdout)
+    int passes = 1;                 // --passes for non-dry runs
+    bool dryRun = false;
+    std::vector<std::string> extra; // Passed through to every run (after "--")
+};
+
+[[noreturn]] void usage(const char* prog, int code) {
+    std::fprintf(code == 0 ? stdout : stderr,
+        "Usage: %s --cli <BINARY> --input <HISTFILE> [OPTIONS] [-- CLI-ARGS...]\n"
+        "  --work-dir <DIR>       Directory for the working copy (default: .)\n"
+        "  --results <FILE>       Append JSON lines to FILE (default: stdout)\n"
+        "  --passes <N>           Secure deletion passes (default: 1)\n"
+        "  --dry-run              Benchmark dry runs (no rewrite, no shredding)\n"
+        "Arguments after \"--\" are added to every run, e.g. -- --threads 4\n", prog);
+    std::exit(code);
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") usage(argv[0], 0);
+        if (arg == "--") {
+            options.extra.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        if (arg == "--dry-run") {
+            options.dryRun = true;
+            continue;
+        }
+        if (i + 1 >= argc) usage(argv[0], 1);
+        const char* value = argv[++i];
+        if (arg == "--cli") options.cli = value;
+        else if (arg == "--input") options.input = value;
+        else if (arg == "--work-dir") options.workDir = value;
+        else if (arg == "--results") options.results = value;
+        else if (arg == "--passes") options.passes = std::atoi(value);
+        else usage(argv[0], 1);
+    }
+    if (options.cli.empty() || options.input.empty() || options.passes <= 0) usage(argv[0], 1);
+    return options;
+}
+
+struct InputStats {
+    unsigned long long bytes = 0;
+    unsigned long long entries = 0;
+    std::time_t first = 0;          // Oldest timestamp
+    std::time_t last = 0;           // Newest timestamp
+};
+
+bool scanInput(const std::string& path, InputStats& stats) {
+    HistoryFileView view;
+    if (!view.open(path, std::cerr)) return false;
+    std::string_view data = view.data();
+    stats.bytes = data.size();
+    HistoryBlockReader reader(data);
+    HistoryBlock block;
+    bool seen = false;
+    while (reader.next(block)) {
+        if (!block.hasHeader) continue;
+        HistoryHeader header;
+        if (!parseHistoryHeader(stripLineEnding(block.text.substr(0, block.firstLineLength)), header) ||
+            !header.timestampInRange) {
+            continue;
+        }
+        ++stats.entries;
+        stats.first = seen ? std::min(stats.first, header.timestamp) : header.timestamp;
+        stats.last = seen ? std::max(stats.last, header.timestamp) : header.timestamp;
+        seen = true;
+    }
+    return seen;
+}
+
+std::string localDate(std::time_t t) {
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    char text[16];
+    std::strftime(text, sizeof(text), "%Y-%m-%d", &tm);
+    return text;
+}
+
+struct Run {
+    std::string mode;
+    std::string filter;
+    std::vector<std::string> args;
+};
+
+std::vector<Run> buildRuns(const InputStats& stats) {
+    const std::time_t span = stats.last - stats.first;
+    const std::time_t middle = stats.first + span / 2;
+    const long long daysAgo = std::max<long long>(1, (std::time(nullptr) - middle) / (24 * 60 * 60));
+
+    const std::vector<std::pair<std::string, std::vector<std::string>>> modes = {
+        {"today", {"--mode", "today"}},
+        {"last_7_days", {"--mode", "last_7_days"}},
+        {"last_30_days", {"--mode", "last_30_days"}},
+        {"specific_day", {"--mode", "specific_day", "--date", localDate(stats.last)}},
+        {"between", {"--mode", "between", "--start-date", localDate(stats.first + span / 4), "--end-date", localDate(middle)}},
+        {"before", {"--mode", "before", "--date", localDate(middle)}},
+        {"after", {"--mode", "after", "--date", localDate(middle)}},
+        {"older_than", {"--mode", "older_than", "--days", std::to_string(daysAgo)}},
+        {"newer_than", {"--mode", "newer_than", "--days", std::to_string(daysAgo)}},
+        {"all", {"--mode", "all"}},
+    };
+    const std::vector<std::pair<std::string, std::vector<std::string>>> filters = {
+        {"none", {}},
+        {"keyword", {"--keyword", "AWS_SECRET", "password", "Bearer"}},
+        {"regex", {"--regex", "git\\s+(commit|push)", "export\\s+AWS_[A-Z_]+="}},
+    };
+
+    std::vector<Run> runs;
+    for (const auto& mode : modes) {
+        for (const auto& filter : filters) {
+            Run run{mode.first, filter.first, mode.second};
+            run.args.insert(run.args.end(), filter.second.begin(), filter.second.end());
+            runs.push_back(run);
+        }
+    }
+    return runs;
+}
+
+// Runs the CLI with output discarded. Returns its exit status (-1 if it could not be run).
+int runCli(const std::string& cli, const std::vector<std::string>& args, struct rusage& usage) {
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(cli.c_str()));
+    for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == -1) return -1;
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_RDWR);
+        if (devNull != -1) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+        execv(cli.c_str(), argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    while (wait4(pid, &status, 0, &usage) == -1) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
+    std::FILE* out = openResults(options.results);
+    if (out == nullptr) {
+        std::perror(options.results.c_str());
+        return 1;
+    }
+
+    InputStats stats;
+    if (!scanInput(options.input, stats)) {
+        std::cerr << "Error: No history entries found in " << options.input << std::endl;
+        return 1;
+    }
+
+    const fs::path workCopy = fs::absolute(options.workDir) / "bench_history";
+    int failures = 0;
+    for (const Run& run : buildRuns(stats)) {
+        std::error_code ec;
+        fs::copy_file(options.input, workCopy, fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            std::cerr << "Error: Cannot copy " << options.input << " to " << workCopy << ": " << ec.message() << std::endl;
+            return 1;
+        }
+
+        std::vector<std::string> args = run.args;
+        args.insert(args.end(), {"--histfile", workCopy.string(), "--passes", std::to_string(options.passes)});
+        if (options.dryRun) args.push_back("--dry-run");
+        args.insert(args.end(), options.extra.begin(), options.extra.end());
+
+        struct rusage usage{};
+        Stopwatch watch;
+        int status = runCli(options.cli, args, usage);
+        double seconds = watch.seconds();
+        if (status != 0) ++failures;
+
+        std::uintmax_t remaining = fs::file_size(workCopy, ec);
+        JsonRecord record = benchRecord("e2e");
+        record.add("mode", run.mode).add("filter", run.filter)
+              .add("dry_run", options.dryRun ? "yes" : "no").add("passes", options.passes)
+              .add("exit", status);
+        addThroughput(record, stats.bytes, stats.entries, seconds);
+        record.add("bytes_after", static_cast<unsigned long long>(ec ? 0 : remaining))
+              .add("peak_rss_kb", static_cast<long long>(usage.ru_maxrss));
+        record.write(out);
+    }
+
+    std::error_code ec;
+    fs::remove(workCopy, ec);
+    if (out != stdout) std::fclose(out);
+    return failures == 0 ? 0 : 1;
+}
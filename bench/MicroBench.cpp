@@ -0,0 +1,228 @@
+// Microbenchmarks for the hot paths of the engine: header parsing, block splitting,
+// keyword and regex matching over a history file, and secure overwrite throughput.
+// Each measurement is repeated and the fastest run is reported as one JSON line.
+
+#include "BenchUtil.h"
+
+#include "zsh_history_cleaner/HistoryParser.h"
+#include "zsh_history_cleaner/HistoryReader.h"
+#include "zsh_history_cleaner/KeywordMatcher.h"
+#include "zsh_history_cleaner/RegexMatcher.h"
+#include "zsh_history_cleaner/SecureDelete.h"
+
+#include <algorithm>  // For std::min
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>      // For open
+#include <unistd.h>     // For write, close, getpid
+
+namespace {
+
+// Keeps benchmarked results alive so the work cannot be optimized away
+volatile unsigned long long resultSink = 0;
+
+struct Options {
+    std::string input;              // History file to run the parsing/matching benchmarks on
+    std::string results;            // JSON lines output (default: stdout)
+    std::string scratchDir = ".";   // Where the secureDelete test file is created
+    double shredMb = 64;            // Size of the secureDelete test file
+    int passes = 3;                 // Overwrite passes for secureDelete
+    int repeat = 3;                 // Runs per measurement (fastest is reported)
+};
+
+[[noreturn]] void usage(const char* prog, int code) {
+    std::fprintf(code == 0 ? stdout : stderr,
+        "Usage: %s --input <HISTFILE> [OPTIONS]\n"
+        "  --results <FILE>       Append JSON lines to FILE (default: stdout)\n"
+        "  --scratch-dir <DIR>    Directory for the secureDelete test file (default: .)\n"
+        "  --shred-mb <N>         secureDelete test file size in MiB, 0 to skip (default: 64)\n"
+        "  --passes <N>           secureDelete passes (default: 3)\n"
+        "  --repeat <N>           Runs per measurement (default: 3)\n", prog);
+    std::exit(code);
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") usage(argv[0], 0);
+        if (i + 1 >= argc) usage(argv[0], 1);
+        const char* value = argv[++i];
+        if (arg == "--input") options.input = value;
+        else if (arg == "--results") options.results = value;
+        else if (arg == "--scratch-dir") options.scratchDir = value;
+        else if (arg == "--shred-mb") options.shredMb = std::atof(value);
+        else if (arg == "--passes") options.passes = std::atoi(value);
+        else if (arg == "--repeat") options.repeat = std::atoi(value);
+        else usage(argv[0], 1);
+    }
+    if (options.input.empty() || options.passes <= 0 || options.repeat <= 0) usage(argv[0], 1);
+    return options;
+}
+
+// Runs body repeat times and reports the fastest run. body returns the item count.
+void measure(std::FILE* out, const std::string& name, unsigned long long bytes, int repeat,
+             const std::function<unsigned long long()>& body) {
+    double best = -1;
+    unsigned long long items = 0;
+    for (int i = 0; i < repeat; ++i) {
+        Stopwatch watch;
+        items = body();
+        double seconds = watch.seconds();
+        if (best < 0 || seconds < best) best = seconds;
+    }
+    JsonRecord record = benchRecord("micro");
+    record.add("name", name).add("repeat", repeat);
+    addThroughput(record, bytes, items, best);
+    record.add("peak_rss_kb", peakRssKb());
+    record.write(out);
+}
+
+// Command part of every header line in the file, for the matching benchmarks
+std::vector<std::string_view> extractCommands(std::string_view data, unsigned long long& commandBytes) {
+    std::vector<std::string_view> commands;
+    commandBytes = 0;
+    HistoryBlockReader reader(data);
+    HistoryBlock block;
+    while (reader.next(block)) {
+        if (!block.hasHeader) continue;
+        std::string_view line = stripLineEnding(block.text.substr(0, block.firstLineLength));
+        HistoryHeader header;
+        if (parseHistoryHeader(line, header)) {
+            commands.push_back(line.substr(header.commandOffset));
+            commandBytes += commands.back().size();
+        }
+    }
+    return commands;
+}
+
+bool benchSecureDelete(std::FILE* out, const Options& options) {
+    const size_t size = static_cast<size_t>(options.shredMb * 1024 * 1024);
+    const std::string path = options.scratchDir + "/.zsh_history_bench_shred_" + std::to_string(getpid());
+    std::vector<char> chunk(1 << 20, 'x');
+
+    double best = -1;
+    for (int i = 0; i < options.repeat; ++i) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd == -1) {
+            std::perror(path.c_str());
+            return false;
+        }
+        for (size_t done = 0; done < size;) {
+            size_t n = std::min(chunk.size(), size - done);
+            if (write(fd, chunk.data(), n) != static_cast<ssize_t>(n)) {
+                std::perror("write");
+                close(fd);
+                return false;
+            }
+            done += n;
+        }
+        fsync(fd);
+        close(fd);
+
+        std::ostringstream log;
+        Stopwatch watch;
+        if (!secureDelete(path, options.passes, log)) {
+            std::cerr << log.str();
+            return false;
+        }
+        double seconds = watch.seconds();
+        if (best < 0 || seconds < best) best = seconds;
+    }
+
+    // Throughput counts every pass: bytes overwritten, not bytes of file
+    JsonRecord record = benchRecord("micro");
+    record.add("name", "secure_delete").add("repeat", options.repeat)
+          .add("passes", options.passes).add("file_bytes", static_cast<unsigned long long>(size));
+    addThroughput(record, static_cast<unsigned long long>(size) * options.passes,
+                  static_cast<unsigned long long>(options.passes), best);
+    record.add("peak_rss_kb", peakRssKb());
+    record.write(out);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
+    std::FILE* out = openResults(options.results);
+    if (out == nullptr) {
+        std::perror(options.results.c_str());
+        return 1;
+    }
+
+    HistoryFileView view;
+    if (!view.open(options.input, std::cerr)) {
+        return 1;
+    }
+    const std::string_view data = view.data();
+    const unsigned long long bytes = data.size();
+
+    measure(out, "block_reader", bytes, options.repeat, [&]() {
+        HistoryBlockReader reader(data);
+        HistoryBlock block;
+        unsigned long long blocks = 0;
+        while (reader.next(block)) ++blocks;
+        return blocks;
+    });
+
+    measure(out, "header_parse", bytes, options.repeat, [&]() {
+        unsigned long long headers = 0;
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t eol = data.find('\n', pos);
+            size_t next = eol == std::string_view::npos ? data.size() : eol + 1;
+            HistoryHeader header;
+            if (parseHistoryHeader(stripLineEnding(data.substr(pos, next - pos)), header)) ++headers;
+            pos = next;
+        }
+        return headers;
+    });
+
+    unsigned long long commandBytes = 0;
+    const std::vector<std::string_view> commands = extractCommands(data, commandBytes);
+
+    KeywordMatcher keywords;
+    keywords.build({"AWS_SECRET", "password", "Bearer", "hunter2", "-p", "token", "api_key", "PRIVATE"});
+    measure(out, "keyword_match", commandBytes, options.repeat, [&]() {
+        unsigned long long matches = 0;
+        for (std::string_view command : commands) matches += keywords.matchesAny(command);
+        resultSink = matches;
+        return static_cast<unsigned long long>(commands.size());
+    });
+
+    RegexMatcher literalRegexes;    // Every pattern has a required literal (prefilterable)
+    literalRegexes.add("git\\s+(commit|push)");
+    literalRegexes.add("export\\s+AWS_[A-Z_]+=");
+    literalRegexes.compile();
+    measure(out, std::string("regex_match_literal_") + RegexMatcher::backendName(), commandBytes, options.repeat, [&]() {
+        unsigned long long matches = 0;
+        for (std::string_view command : commands) matches += literalRegexes.matchesAny(command);
+        resultSink = matches;
+        return static_cast<unsigned long long>(commands.size());
+    });
+
+    RegexMatcher openRegexes;       // No required literal: the engine runs on every command
+    openRegexes.add("^[a-z]+\\s+-[a-zA-Z]{2,}");
+    openRegexes.compile();
+    measure(out, std::string("regex_match_open_") + RegexMatcher::backendName(), commandBytes, options.repeat, [&]() {
+        unsigned long long matches = 0;
+        for (std::string_view command : commands) matches += openRegexes.matchesAny(command);
+        resultSink = matches;
+        return static_cast<unsigned long long>(commands.size());
+    });
+
+    if (options.shredMb > 0 && !benchSecureDelete(out, options)) {
+        return 1;
+    }
+
+    if (out != stdout) std::fclose(out);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <filesystem> // Requires C++17
+#include <string>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <iosfwd>     // For std::ostream forward declaration
+#include <ctime>
+#include <cstdint>    // For uintmax_t
+
+#include "Constants.h"
+#include "SpscQueue.h"
+
+namespace fs = std::filesystem;
+
+// --archive: deleted entries are appended to an archive file instead of backing up the
+// whole history. The archive is a sequence of segments, each a header followed by a
+// payload of raw history entries, compressed with zstd where the build has it (see
+// ZSH_HISTORY_CLEANER_USE_ZSTD) and stored as they are otherwise:
+//
+//     "ZHCA" | version u8 | codec u8 | reserved u16 | entries u32 | first timestamp i64 |
+//     last timestamp i64 | raw size u32 | payload size u32 | XXH64 of the raw bytes u64 |
+//     source path size u32 | source path | payload
+//
+// (little-endian). Timestamps are the smallest and largest in the segment, so a restore
+// skips the segments outside its window without decompressing them. Segments are only
+// ever appended, each with one write() under an flock(), so several runs (or batch
+// workers) may share an archive.
+
+// Whether segments are compressed by this build
+bool archiveCompresses();
+
+// Appends the entries it is given to an archive as segments. add() is called from one
+// thread (the classifier); a writer thread of its own parses, compresses and writes each
+// segment, so the classifier only copies bytes.
+class ArchiveWriter {
+public:
+    ArchiveWriter() = default;
+    // Without finish(), segments not written yet are dropped
+    ~ArchiveWriter();
+
+    ArchiveWriter(const ArchiveWriter&) = delete;
+    ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+    // Opens (creating, owner-only) the archive for appending segments taken from source.
+    bool open(const fs::path& archive, const fs::path& source, std::ostream& log);
+
+    // Adds whole entries (raw bytes, one or more blocks), in file order
+    void add(std::string_view entries);
+
+    // Writes what is left, waits for the writer thread and syncs the archive. Returns false
+    // and logs if any segment could not be written.
+    bool finish(std::ostream& log);
+
+    uintmax_t bytesAdded() const { return bytesAdded_; }
+    uintmax_t bytesWritten() const { return bytesWritten_.load(); }
+
+private:
+    struct Segment {
+        std::string entries;
+        bool last = false;
+    };
+
+    void writeSegments();                       // Writer thread
+    bool writeSegment(const std::string& entries);
+
+    int fd_ = -1;
+    fs::path path_;
+    std::string source_;
+    std::string current_;                       // Segment being filled by add()
+    uintmax_t bytesAdded_ = 0;
+    SpscQueue<Segment, ARCHIVE_QUEUE_DEPTH> queue_;
+    std::thread writer_;
+    std::atomic<bool> abandon_{false};          // Destroyed without finish(): drop the rest
+    std::atomic<int> error_{0};                 // errno of the first failed write; 0 if none
+    std::atomic<uintmax_t> bytesWritten_{0};    // Segment bytes appended to the archive
+};
+
+// What extractArchive() went through
+struct ArchiveExtractResult {
+    unsigned long long segments = 0;            // Segments in the archive
+    unsigned long long segmentsRead = 0;        // Of those, read (the rest were skipped)
+    unsigned long long entries = 0;             // Entries written to out
+};
+
+// Writes the archived entries timestamped in [start, end] to out, as raw history lines in
+// archive order. With a non-empty source, only segments taken from that history file are
+// read. Returns false and logs on an unreadable or corrupt archive, or on a compressed
+// segment this build cannot decompress.
+bool extractArchive(const fs::path& archive, std::time_t start, std::time_t end, const std::string& source,
+                    std::ostream& out, std::ostream& log, ArchiveExtractResult& result);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,109 @@
+#ifndef BUFFERED_WRITER_H
+#define BUFFERED_WRITER_H
+
+#include <filesystem> // Requires C++17
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iosfwd>     // For std::ostream forward declaration
+#include <charconv>   // For std::to_chars
+#include <type_traits> // For std::is_integral
+#include <cstddef>    // For size_t
+#include <cstdint>    // For uint64_t
+
+namespace fs = std::filesystem;
+
+class RunStats;
+
+// Large-buffer writer on top of a raw file descriptor.
+// Used to stream kept history entries to the temporary file as they are classified,
+// so memory use does not depend on the size of the history.
+class BufferedFileWriter {
+public:
+    explicit BufferedFileWriter(size_t bufferSize);
+    ~BufferedFileWriter(); // Closes the descriptor (unless attached) without syncing
+
+    BufferedFileWriter(const BufferedFileWriter&) = delete;
+    BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+    // Creates path exclusively (O_EXCL) with owner-only permissions.
+    // Returns false and logs to log on failure; errno is preserved for the caller.
+    bool create(const fs::path& path, std::ostream& log);
+
+    // Writes to fd, an open descriptor the writer does not own (stdout): close() flushes
+    // and leaves it open.
+    void attach(int fd);
+
+    // Appends data. Returns false once any write has failed.
+    bool write(std::string_view data);
+
+    // Writes out buffered data to the descriptor.
+    bool flush();
+
+    // Flushes and fsyncs, keeping the file open. Returns false if anything failed.
+    bool sync();
+
+    // Flushes, optionally fsyncs, and closes. Returns false if anything failed.
+    bool close(bool sync);
+
+    bool isOpen() const { return fd_ != -1; }
+    bool failed() const { return failed_; }
+    int lastError() const { return lastError_; }   // errno of the first failure
+    uint64_t bytesWritten() const { return bytesWritten_; }
+
+    // Times every write and the fsync as the write phase of stats (null: untimed).
+    void trackWrites(RunStats* stats) { stats_ = stats; }
+
+private:
+    bool writeAll(const char* data, size_t size);
+
+    int fd_ = -1;
+    bool owned_ = true;                 // fd_ is closed by close() and the destructor
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+    bool failed_ = false;
+    int lastError_ = 0;
+    uint64_t bytesWritten_ = 0;
+    RunStats* stats_ = nullptr;
+};
+
+// Collects text for an ostream and passes it on in large writes, so reports made of many
+// small pieces (dry-run listings, per-line warnings) cost a string append each rather than
+// a stream call, or with std::endl a flush. Flushed once it holds capacity bytes, and on
+// destruction.
+class BufferedStreamWriter {
+public:
+    BufferedStreamWriter(std::ostream& out, size_t capacity) : out_(out), capacity_(capacity) {}
+    ~BufferedStreamWriter() { flush(); }
+
+    BufferedStreamWriter(const BufferedStreamWriter&) = delete;
+    BufferedStreamWriter& operator=(const BufferedStreamWriter&) = delete;
+
+    BufferedStreamWriter& operator<<(std::string_view text) {
+        buffer_.append(text.data(), text.size());
+        if (buffer_.size() >= capacity_) flush();
+        return *this;
+    }
+
+    BufferedStreamWriter& operator<<(char c) {
+        return *this << std::string_view(&c, 1);
+    }
+
+    // Integers in decimal
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    BufferedStreamWriter& operator<<(T value) {
+        char text[24];
+        std::to_chars_result end = std::to_chars(text, text + sizeof(text), value);
+        return *this << std::string_view(text, static_cast<size_t>(end.ptr - text));
+    }
+
+    // Hands the buffered text to the stream
+    void flush();
+
+private:
+    std::ostream& out_;
+    size_t capacity_;
+    std::string buffer_;
+};
+
+#endif // BUFFERED_WRITER_H
@@ -0,0 +1,34 @@
+#ifndef CHACHA20_H
+#define CHACHA20_H
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint8_t, uint32_t, uint64_t
+
+// ChaCha20 keystream generator (D. J. Bernstein's layout: 64-bit block counter,
+// 64-bit nonce), used to produce overwrite data for secure deletion. Only the
+// keystream is exposed; there is no need to encrypt anything here.
+// Four blocks are computed at a time with SSE2 where available.
+class ChaCha20 {
+public:
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t NONCE_SIZE = 8;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    ChaCha20(const uint8_t (&key)[KEY_SIZE], const uint8_t (&nonce)[NONCE_SIZE], uint64_t counter = 0);
+    ~ChaCha20(); // Wipes the key material
+
+    ChaCha20(const ChaCha20&) = delete;
+    ChaCha20& operator=(const ChaCha20&) = delete;
+
+    // Writes the next length keystream bytes to out. If length is not a multiple of
+    // BLOCK_SIZE the unused remainder of the last block is discarded.
+    void keystream(uint8_t* out, size_t length);
+
+private:
+    void block(uint8_t* out);   // One block, advances the counter by 1
+    void blocks4(uint8_t* out); // Four blocks, advances the counter by 4
+
+    uint32_t state_[16];
+};
+
+#endif // CHACHA20_H
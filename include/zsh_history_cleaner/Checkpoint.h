@@ -0,0 +1,48 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <filesystem> // Requires C++17
+#include <string>
+#include <vector>
+#include <ctime>
+#include <utility>    // For std::pair
+#include <iosfwd>     // For std::ostream forward declaration
+#include <cstdint>    // For uint64_t
+
+#include "Policy.h"
+
+namespace fs = std::filesystem;
+
+// What an earlier run of --incremental established about a history file: its first
+// offset bytes (hashing to prefixHash) hold only entries that were kept when cleaning
+// with the given time window and filters. A later run with the same filters only has
+// to classify the bytes appended since, plus whatever part of the prefix its own time
+// window reaches beyond the recorded one.
+struct HistoryCheckpoint {
+    uint64_t offset = 0;                // Length of the cleaned prefix (ends at a line boundary)
+    uint64_t prefixHash = 0;            // XXH64 of the prefix
+    std::time_t startTimestamp = 0;     // Time window the prefix was cleaned with (inclusive)
+    std::time_t endTimestamp = 0;
+    uint64_t filterFingerprint = 0;     // filterFingerprint() of the content filters applied
+    std::vector<std::pair<std::time_t, std::time_t>> ruleWindows; // --policy: each rule's window, in evaluation order
+};
+
+// Sidecar file next to the history file: "<history>.cleaner-checkpoint"
+fs::path checkpointPath(const fs::path& historyFile);
+
+// Reads historyFile's checkpoint. Returns false if there is none or it is malformed.
+bool loadCheckpoint(const fs::path& historyFile, HistoryCheckpoint& checkpoint);
+
+// Atomically replaces historyFile's checkpoint (owner-only permissions). Returns false
+// and logs to log on failure.
+bool saveCheckpoint(const fs::path& historyFile, const HistoryCheckpoint& checkpoint, std::ostream& log);
+
+// Identifies a content filter configuration; equal configurations classify identically.
+// It covers the keywords, regexes, --whitelist and --multiline, and the policy rules with
+// their actions and filters, in evaluation order, but without their windows (a checkpoint
+// records those separately).
+uint64_t filterFingerprint(const std::vector<std::string>& keywords,
+                           const std::vector<std::string>& regexes, bool whitelist,
+                           const std::vector<PolicyRule>& rules, bool multiline);
+
+#endif // CHECKPOINT_H
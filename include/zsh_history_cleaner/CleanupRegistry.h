@@ -0,0 +1,41 @@
+#ifndef CLEANUP_REGISTRY_H
+#define CLEANUP_REGISTRY_H
+
+#include <filesystem> // Requires C++17
+#include <cstddef>    // For size_t
+
+namespace fs = std::filesystem;
+
+// Process-wide state that the termination signal handler (SIGINT, SIGTERM, SIGHUP) acts
+// on. It is shared by every history file being processed: the temp files to unlink, and
+// critical sections that must not be cut short because the history file would be left
+// inconsistent. All functions are thread-safe; the handler itself is async-signal-safe.
+
+// Maximum number of temp files tracked at once (bounds batch-mode concurrency)
+constexpr size_t MAX_TRACKED_TEMP_FILES = 64;
+
+// Installs the termination signal handlers.
+void installTerminationHandlers();
+
+// True once a termination signal has been received.
+bool terminationRequested();
+
+// Records path for removal if the process is terminated. Returns a slot id, or -1 if the
+// registry is full or the path is too long.
+int registerTempFile(const fs::path& path);
+
+// Forgets a slot without touching the file (after it was renamed or removed). -1 is ignored.
+void unregisterTempFile(int slot);
+
+// While at least one guard is alive, termination signals are held back; the process is
+// terminated (with the usual temp file cleanup) as soon as the last guard goes away.
+class TerminationGuard {
+public:
+    TerminationGuard();
+    ~TerminationGuard();
+
+    TerminationGuard(const TerminationGuard&) = delete;
+    TerminationGuard& operator=(const TerminationGuard&) = delete;
+};
+
+#endif // CLEANUP_REGISTRY_H
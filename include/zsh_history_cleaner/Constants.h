@@ -7,6 +7,33 @@
 // --- Configuration Constants ---
 const int SHRED_PASSES = 32; // Number of overwrite passes
 const std::string TMP_PREFIX = ".zsh_history_cleaner_"; // Prefix for temp file
-const size_t SHRED_BUFFER_SIZE = 4096; // Buffer size for shredding
+const size_t SHRED_BUFFER_SIZE = 4 << 20; // Buffer size for shredding (fresh random data per chunk)
+const size_t SHRED_BUFFER_ALIGNMENT = 4096; // Buffer/offset alignment for O_DIRECT overwrites
+const size_t URING_QUEUE_DEPTH = 4; // Overwrite chunks kept in flight by the io_uring backend
+const size_t SHIFT_BUFFER_SIZE = 1 << 20; // Buffer size for compacting a file after in-place removal
+const size_t IN_PLACE_MAX_SHIFT = 64 << 10; // --in-place: most bytes after the cut range moved down over it
+const size_t WRITE_BUFFER_SIZE = 1 << 20; // Buffer size for streaming kept entries to the temp file
+const size_t COPY_BUFFER_SIZE = 1 << 20; // Buffer size for backups where the kernel cannot copy by itself
+const size_t CLASSIFY_CHUNK_SIZE = 8 << 20; // Bytes of input per worker per round with --threads
+const size_t PIPELINE_CHUNK_SIZE = 1 << 20; // Bytes of input per reader/classifier hand-off with --pipeline
+const size_t PIPELINE_QUEUE_DEPTH = 8; // Chunks each --pipeline stage may run ahead of the next (power of two)
+const long SEEK_ORDER_SLACK_SECONDS = 24 * 60 * 60; // Timestamp disorder tolerated by --seek
+const int BATCH_IO_JOBS = 2; // Default number of files in their sync/backup/shred phase at once in batch mode
+const int WATCH_QUIET_MS = 250; // --watch: a burst of history writes ends after this long without one
+const int WATCH_MAX_DELAY_MS = 2000; // --watch: longest a pass is put off while writes keep coming
+const int HISTORY_LOCK_TIMEOUT_MS = 15000; // Longest wait for zsh's history lock (beyond its stale age)
+const int HISTORY_LOCK_RETRY_MS = 10; // Interval between attempts to take zsh's history lock
+const long HISTORY_LOCK_STALE_SECONDS = 10; // Age at which zsh (and we) break a $HISTFILE.LOCK
+const int HISTORY_REPLACED_RETRIES = 3; // Attempts when a shell replaces the history file mid-run
+const size_t DEDUP_INITIAL_SLOTS = 1 << 12; // Initial --dedup table size (power of two; doubles at 3/4 full)
+const size_t DEDUP_ARENA_BLOCK_SIZE = 1 << 20; // --dedup in a merge: bytes per block of copied commands
+const size_t ARCHIVE_SEGMENT_SIZE = 1 << 20; // Bytes of deleted entries per --archive segment
+const size_t ARCHIVE_QUEUE_DEPTH = 4; // --archive segments the classifier may run ahead of the writer (power of two)
+const int ARCHIVE_ZSTD_LEVEL = 3; // zstd compression level of --archive segments
+const size_t STREAM_BUFFER_SIZE = 1 << 20; // --stdin/--stdout read buffer (grows only to fit a longer entry)
+const size_t PROGRESS_PUBLISH_BYTES = 256 << 10; // Bytes classified between updates of the shared progress counters
+const int PROGRESS_INTERVAL_MS = 1000; // --progress: time between progress lines
+const size_t REPORT_BUFFER_SIZE = 1 << 20; // Dry-run report and warning text collected per stream write
+const size_t MERGE_BUFFER_SIZE = 256 << 10; // --merge: initial read buffer per input (grows only to fit a longer entry)
 
 #endif // CONSTANTS_H
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef DUPLICATE_INDEX_H
+#define DUPLICATE_INDEX_H
+
+#include <string_view>
+#include <vector>
+#include <memory>     // For unique_ptr
+#include <cstddef>    // For size_t
+#include <cstdint>    // For uint64_t
+
+// Which entry of a repeated command --dedup keeps
+enum class DedupMode {
+    None,
+    KeepFirst,      // The oldest one
+    KeepLast,       // The newest one, as zsh's HIST_IGNORE_ALL_DUPS does
+};
+
+const char* dedupModeName(DedupMode mode);
+
+// The distinct commands of a history, for --dedup. An open-addressing table of views into
+// the text being classified (the memory-mapped history file), so nothing is copied and
+// memory grows with the number of distinct commands rather than with the history.
+// Entries are fed to isDuplicate() in file order, once per pass; the text they point into
+// has to outlive the index, unless it keeps copies of the commands (a merge's buffers are
+// reused as it goes).
+//
+// KeepFirst decides in one pass: an entry goes if its command was seen before. KeepLast
+// needs a recording pass first, which notes where each command comes last; in the passes
+// after it, an entry goes if its command comes again later.
+class DuplicateIndex {
+public:
+    explicit DuplicateIndex(DedupMode mode, bool copies = false);
+
+    // Starts the KeepLast recording pass: isDuplicate() only records, and returns false
+    void startRecording();
+
+    // Starts a pass that decides, over the same entries as the previous one (KeepFirst
+    // forgets what it saw; KeepLast keeps what it recorded)
+    void startPass();
+
+    // True if the entry with this command is a repeat to delete. Under KeepLast, entries
+    // past the ones recorded (appended since) are always kept.
+    bool isDuplicate(std::string_view command);
+
+    // Distinct commands in the table
+    size_t size() const { return used_; }
+
+private:
+    struct Slot {
+        uint64_t hash = 0;
+        const char* data = nullptr;     // Null for an empty slot
+        size_t size = 0;
+        unsigned long long last = 0;    // KeepLast: the command's last entry, counted from the pass start
+    };
+
+    // The slot holding command, or the empty one where it belongs
+    Slot& find(std::string_view command, uint64_t hash);
+
+    // Doubles the table, rehashing every command
+    void grow();
+
+    // A copy of command in the arena, for an index keeping copies
+    const char* store(std::string_view command);
+
+    DedupMode mode_;
+    bool recording_ = false;
+    unsigned long long entries_ = 0;    // Entries fed in this pass
+    std::vector<Slot> slots_;           // Power-of-two size, linear probing
+    size_t used_ = 0;
+    bool copies_;
+    std::vector<std::unique_ptr<char[]>> arena_; // Blocks of DEDUP_ARENA_BLOCK_SIZE (or one command)
+    size_t arenaFree_ = 0;              // Unused bytes at the end of the last block
+};
+
+#endif // DUPLICATE_INDEX_H
@@ -0,0 +1,106 @@
+#ifndef ENTRY_TEXT_H
+#define ENTRY_TEXT_H
+
+#include <string_view>
+#include <iterator>  // For std::bidirectional_iterator_tag
+#include <cstddef>   // For size_t, ptrdiff_t
+
+// zsh writes each newline inside a command as a backslash-newline join and turns the join
+// back into a plain newline when it reads the history. These helpers present the raw
+// bytes of a multiline entry as that command without copying them: the backslash of every
+// join, and a '\r' before any newline, are skipped.
+
+// True if byte pos of text is skipped in the command's logical form
+inline bool isJoinByte(std::string_view text, size_t pos) {
+    const size_t size = text.size();
+    if (text[pos] == '\r') return pos + 1 < size && text[pos + 1] == '\n';
+    if (text[pos] != '\\') return false;
+    return (pos + 1 < size && text[pos + 1] == '\n') ||
+           (pos + 2 < size && text[pos + 1] == '\r' && text[pos + 2] == '\n');
+}
+
+// True if text's logical form differs from its bytes (it has a join or a CRLF)
+inline bool hasLineJoins(std::string_view text) {
+    for (size_t eol = text.find('\n'); eol != std::string_view::npos; eol = text.find('\n', eol + 1)) {
+        if (eol > 0 && (text[eol - 1] == '\\' || text[eol - 1] == '\r')) return true;
+    }
+    return false;
+}
+
+// Calls emit(std::string_view) with the logical form of text, piece by piece: the bytes
+// between joins, and a "\n" for each of them. emit returns false to stop early; the
+// return value is false if it did.
+template <typename Emit>
+bool forEachJoinedPiece(std::string_view text, Emit&& emit) {
+    static constexpr std::string_view newline("\n", 1);
+    size_t pos = 0;
+    for (size_t eol = text.find('\n'); eol != std::string_view::npos; eol = text.find('\n', pos)) {
+        size_t end = eol;
+        if (end > pos && text[end - 1] == '\r') --end;
+        if (end > pos && text[end - 1] == '\\') --end;
+        if (end > pos && !emit(text.substr(pos, end - pos))) return false;
+        if (!emit(newline)) return false;
+        pos = eol + 1;
+    }
+    return pos == text.size() || emit(text.substr(pos));
+}
+
+// Bidirectional iterator over the logical form of text, for algorithms that need one
+// sequence (std::regex_search). It only ever rests on bytes that are not skipped.
+class JoinedTextIterator {
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+
+    JoinedTextIterator() = default;
+
+    static JoinedTextIterator begin(std::string_view text) {
+        JoinedTextIterator it(text, 0);
+        it.skipForward();
+        return it;
+    }
+    static JoinedTextIterator end(std::string_view text) { return JoinedTextIterator(text, text.size()); }
+
+    reference operator*() const { return text_[pos_]; }
+    pointer operator->() const { return text_.data() + pos_; }
+
+    JoinedTextIterator& operator++() {
+        ++pos_;
+        skipForward();
+        return *this;
+    }
+    JoinedTextIterator operator++(int) {
+        JoinedTextIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+    JoinedTextIterator& operator--() {
+        do {
+            --pos_;
+        } while (pos_ > 0 && isJoinByte(text_, pos_));
+        return *this;
+    }
+    JoinedTextIterator operator--(int) {
+        JoinedTextIterator previous = *this;
+        --*this;
+        return previous;
+    }
+
+    bool operator==(const JoinedTextIterator& other) const { return pos_ == other.pos_; }
+    bool operator!=(const JoinedTextIterator& other) const { return pos_ != other.pos_; }
+
+private:
+    JoinedTextIterator(std::string_view text, size_t pos) : text_(text), pos_(pos) {}
+
+    void skipForward() {
+        while (pos_ < text_.size() && isJoinByte(text_, pos_)) ++pos_;
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+#endif // ENTRY_TEXT_H
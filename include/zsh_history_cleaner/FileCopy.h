@@ -0,0 +1,24 @@
+#ifndef FILE_COPY_H
+#define FILE_COPY_H
+
+#include <filesystem> // Requires C++17
+#include <iosfwd>     // For std::ostream forward declaration
+#include <cstdint>    // For uintmax_t
+
+namespace fs = std::filesystem;
+
+// How copyFile() copied the data, cheapest first
+enum class CopyStrategy {
+    Reflink,        // FICLONE: the copy shares the source's extents (btrfs, XFS, ...)
+    CopyFileRange,  // copy_file_range(): copied inside the kernel (server-side on NFS 4.2)
+    Buffered,       // read()/write() through a user-space buffer
+};
+
+const char* copyStrategyName(CopyStrategy strategy);
+
+// Copies from into a new file to (created exclusively, with from's permission bits) and
+// syncs it, trying the strategies in the order above. Returns false and logs to log on
+// failure, leaving no partial copy behind; strategy and bytes are only set on success.
+bool copyFile(const fs::path& from, const fs::path& to, CopyStrategy& strategy, uintmax_t& bytes, std::ostream& log);
+
+#endif // FILE_COPY_H
@@ -3,27 +3,31 @@
 
 #include <filesystem> // Requires C++17
 #include <string>
+#include <string_view>
 #include <vector>
-#include <regex>
 #include <ctime>
-#include <csignal>     // For sig_atomic_t
 #include <iosfwd>      // For std::ostream forward declaration
-#include <optional>    // For std::optional (used for filterRegex_)
+
+#include "HistoryEngine.h"
+#include "Policy.h"
+#include "RunStats.h"
 
 namespace fs = std::filesystem;
 
+// Command-line front end: turns arguments (or the interactive menu) into an EngineConfig
+// and reports the HistoryEngine's results on stdout/stderr.
 class HistoryCleaner {
 public:
     // Defines the different cleaning operations available
     enum class Mode { NONE, TODAY, LAST_7_DAYS, LAST_30_DAYS, SPECIFIC_DAY, BETWEEN, BEFORE, AFTER, OLDER_THAN, NEWER_THAN, ALL_TIME }; // Added NEWER_THAN
 
+    // Output format of the --stats report
+    enum class StatsFormat { NONE, TEXT, JSON };
+
     // Constructor: Parses command-line arguments to configure the cleaner.
     HistoryCleaner(int argc, char* argv[]);
 
-    // Destructor: Ensures cleanup, especially of temporary files.
-    ~HistoryCleaner();
-
-    // Prevent copy/move operations to avoid issues with resource management (temp files, signals)
+    // Prevent copy/move operations to avoid issues with resource management (signals)
     HistoryCleaner(const HistoryCleaner&) = delete;
     HistoryCleaner& operator=(const HistoryCleaner&) = delete;
     HistoryCleaner(HistoryCleaner&&) = delete;
@@ -32,19 +36,15 @@ public:
     // Main entry point to start the cleaning process based on configuration.
     void run();
 
-    // Public signal handler callback (static version needed for C-style signal registration)
-    // Made public for simplicity, could be refactored with a dedicated SignalHandler class.
-    static void staticSignalHandler(int signal);
-
 private:
-    // Path to temporary file being processed (if any)
-    fs::path tempFilePath_;
-    // Path to backup file (if created)
-    fs::path backupFilePath_;
+    HistoryEngine engine_;              // Configured by configureEngine() once the settings are final
 
     // --- Configuration Members ---
     fs::path historyFilePath_;          // Path provided by user or default
     fs::path effectiveHistoryFilePath_; // Resolved absolute path of the history file
+    bool histfileGiven_ = false;        // --histfile was on the command line
+    fs::path archivePath_;              // --archive: append deleted entries here
+    fs::path extractPath_;              // --extract-archive: print this archive's entries instead of cleaning
     Mode mode_ = Mode::NONE;            // Selected cleaning mode
     std::string startDateStr_;          // Start date for 'between' mode (YYYY-MM-DD)
     std::string endDateStr_;            // End date for 'between' mode (YYYY-MM-DD)
@@ -55,19 +55,43 @@ private:
     bool interactive_ = true;           // Flag indicating interactive mode (vs. command-line args)
     bool preciseTime_ = false;          // Flag indicating if precise time should be used/required for dates
     bool isWhitelistMode_ = false;      // Flag indicating if filters act as a whitelist (keep matches) instead of blacklist (delete matches)
+    bool multiline_ = false;            // Flag to match filters against continuation lines of multiline entries too
+    DedupMode dedup_ = DedupMode::None; // --dedup: which entry of a repeated command to keep
     int shredPasses_ = 32;              // Number of passes for secure delete (read from Constants.h)
+    int threads_ = 1;                   // Number of classification threads for processHistory
+    bool pipeline_ = false;             // Flag to run reading, classification and writing as a pipeline
+    bool seekByTime_ = false;           // Flag to binary-search the time window instead of parsing everything
+    bool inPlace_ = false;              // Flag to shred and cut a single deleted range in place instead of rewriting
+    bool incremental_ = false;          // Flag to skip the prefix recorded in the checkpoint sidecar
+    bool watch_ = false;                // Flag to stay resident and clean after every change (--watch)
+    bool deferShred_ = false;           // Flag to queue originals for a background shred (--defer-shred)
+    bool drainShredQueue_ = false;      // Flag to shred the queued originals instead of cleaning (--shred-queue)
+    bool streamIn_ = false;             // Flag to filter stdin to stdout (--stdin)
+    bool streamOut_ = false;            // Flag to filter the history file to stdout, leaving it alone (--stdout)
+    std::vector<fs::path> mergeInputs_; // --merge: histories merged into the history file
+    StatsFormat statsFormat_ = StatsFormat::NONE; // --stats[=json]: report per-phase timings on stderr
+    bool progress_ = false;             // Flag to report progress on stderr while running (--progress)
+    ReportFormat report_ = ReportFormat::Text; // --report: how a dry run lists what it would delete
+
+    // Batch mode (--histfile-list / --histfile-glob)
+    std::vector<std::string> histfileLists_;  // Files listing one history path per line
+    std::vector<std::string> histfileGlobs_;  // Glob patterns matching history files
+    int jobs_ = 0;                      // Files classified concurrently (0: one per hardware thread)
+    int ioJobs_ = 0;                    // Files synced/backed up/shredded concurrently (0: BATCH_IO_JOBS)
 
     // --- State Members ---
     std::time_t startTimestamp_ = 0;    // Start timestamp for filtering (inclusive)
     std::time_t endTimestamp_ = 0;      // End timestamp for filtering (inclusive)
-    std::regex historyEntryRegex_;      // Regex to parse Zsh history entries
 
     // Content Filters
     std::vector<std::string> filterKeywords_;      // Multiple keywords to filter entries by
-    std::vector<std::string> filterRegexStrs_;     // Multiple regex patterns to filter entries by
-    std::vector<std::regex> filterRegexes_;        // Compiled regex objects
+    std::vector<std::string> filterRegexStrs_;     // Multiple regex patterns to filter entries by (validated)
+
+    // Policy (--policy FILE): prioritized rules instead of --mode and the filters above
+    std::vector<PolicyRuleSpec> policySpecs_;      // As read from the file (modes validated)
+    std::vector<PolicyRule> policyRules_;          // Same, with windows resolved by calculateTimestamps()
 
-    volatile sig_atomic_t interrupted_ = 0; // Flag set by signal handler for graceful shutdown
+    RunStats stats_;                    // Timings of this run (only filled in with --stats)
 
     // --- Private Helper Methods ---
 
@@ -80,16 +104,13 @@ private:
     // Resolves the history file path to an absolute path and checks existence.
     void resolveHistoryPath();
 
-    // Sets up signal handlers for SIGINT, SIGTERM, SIGHUP.
+    // Sets up signal handlers for SIGINT, SIGTERM, SIGHUP, and SIGUSR1 (progress line).
+    // Temp files are tracked in the process-wide cleanup registry, so the handler can
+    // remove every one of them however many files are in flight.
     void setupSignalHandlers();
 
-    // Instance-specific signal handler logic.
-    // Ensures proper cleanup of resources before exiting on signal.
-    // This is critical for maintaining filesystem consistency and security.
-    void cleanupAndExit(int signal);
-
-    // Cleanup any temporary files or resources
-    void cleanup();
+    // True once a termination signal has been received
+    static bool interrupted();
 
     // Runs the interactive menu-driven mode.
     void runInteractive();
@@ -97,31 +118,82 @@ private:
     // Runs the non-interactive mode based on command-line arguments.
     void runNonInteractive();
 
-    // Calculates the start and end timestamps based on the selected mode.
+    // Runs --watch: cleans once, then again whenever the history file changes, until
+    // terminated. Passes are incremental and in place, so each costs about what was appended.
+    void runWatch();
+
+    // Runs batch mode: every file from --histfile-list / --histfile-glob, with the filters
+    // compiled once, on a bounded worker pool, followed by one aggregated summary.
+    void runBatch();
+
+    // Filters stdin (or, with --stdout alone, the history file) to stdout (--stdin/--stdout).
+    void runStream();
+
+    // Merges mergeInputs_ into the history file, cleaning as it goes (--merge).
+    void runMerge();
+
+    // Shreds everything in the shred queue, then exits (--shred-queue).
+    void runShredQueue();
+
+    // Starts a detached --shred-queue process for what this run queued. Returns at once.
+    void startShredDrainer();
+
+    // Writes the entries of extractPath_ in the time window (and, with --histfile, taken
+    // from that file) to stdout (--extract-archive).
+    void runExtract();
+
+    // Collects the batch history files (resolved, de-duplicated, in order).
+    std::vector<fs::path> collectBatchFiles() const;
+
+    // Per-file equivalent of checkPermissions() that reports instead of exiting.
+    bool checkBatchFile(const fs::path& historyPath, std::ostream& log) const;
+
+    // Calculates the start and end timestamps based on the selected mode (for a policy:
+    // every rule's window, and their span).
     void calculateTimestamps();
 
-    // Core logic: Reads history, filters entries, writes to new file.
-    // Returns true if processing was successful.
-    bool processHistory(std::ostream& output);
+    // Maps a --mode name to its Mode; false if there is none by that name.
+    static bool parseMode(const std::string& name, Mode& mode);
+
+    // The window of mode with its arguments, relative to now where the mode is.
+    // Throws std::runtime_error for an invalid date.
+    static void windowFor(Mode mode, const std::string& specificDate, const std::string& startDate,
+                          const std::string& endDate, int days, bool precise,
+                          std::time_t& start, std::time_t& end);
 
-    // Creates a backup of the original history file.
-    bool backupHistoryFile();
+    // Reads --policy FILE into policySpecs_, exiting on an invalid file or rule.
+    void loadPolicy(const std::string& path);
 
-    // Performs the final steps: backup (if requested), secure delete.
-    bool performCleanup(std::ostream& output);
+    // Hands the rules' current windows to the configured engine (--watch).
+    void updatePolicyWindows();
+
+    // Hands the final configuration to the engine (compiling its filters).
+    void configureEngine();
+
+    // Cleans effectiveHistoryFilePath_, reporting on stdout/stderr (dry runs list the
+    // entries that would be deleted). Returns false if the engine failed.
+    bool cleanHistoryFile();
 
     // Validates necessary permissions (read history, write directory).
     void checkPermissions();
 
-    // Process a single command block and determine if it should be deleted
-    // Returns true if the block should be deleted, false if it should be kept
-    bool processCommandBlock(const std::string& block, unsigned long long lineNum,
-                           std::ostream& output, unsigned long long& keptCount,
-                           unsigned long long& deletedCount);
+    // --dedup (or --merge) without --mode or --policy: only repeated commands are deleted, if any
+    bool dedupOnly() const {
+        return (dedup_ != DedupMode::None || !mergeInputs_.empty()) && mode_ == Mode::NONE && policySpecs_.empty();
+    }
+
+    // Prints which entries the run deletes: the time window (or the policy's), and --dedup's mode.
+    void printSelection(std::ostream& out) const;
+
+    // stats_ if --stats was given, otherwise null (timers are then disabled)
+    RunStats* statsTarget() { return statsFormat_ == StatsFormat::NONE ? nullptr : &stats_; }
+
+    // Dry run: writes the per-reason counts of result for file to out (--report=summary), or
+    // the NDJSON summary record after the entry records (--report=ndjson).
+    void printReport(std::ostream& out, const fs::path& file, const CleanResult& result) const;
 
-    // Static pointer to the current instance for the static signal handler.
-    // This is a common pattern but has limitations (only one instance).
-    static HistoryCleaner* g_cleaner_instance;
+    // Finishes stats and writes the --stats report to stderr.
+    void reportStats(RunStats& stats) const;
 };
 
 #endif // HISTORY_CLEANER_H
\ No newline at end of file
@@ -0,0 +1,482 @@
+#ifndef HISTORY_ENGINE_H
+#define HISTORY_ENGINE_H
+
+#include <filesystem> // Requires C++17
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ctime>
+#include <limits>             // For numeric_limits
+#include <memory>             // For unique_ptr
+#include <iosfwd>             // For std::ostream forward declaration
+#include <functional>         // For std::function
+#include <atomic>             // For std::atomic (cancellation flag)
+#include <mutex>              // For IoLimiter
+#include <condition_variable> // For IoLimiter
+#include <cstdint>            // For uintmax_t
+#include <array>              // For the kernel table
+#include <utility>            // For std::index_sequence
+
+#include "Constants.h"
+#include "KeywordMatcher.h"
+#include "RegexMatcher.h"
+#include "TimeSeek.h"
+#include "XxHash64.h"
+#include "Checkpoint.h"
+#include "Policy.h"
+#include "DuplicateIndex.h"
+
+namespace fs = std::filesystem;
+
+class ArchiveWriter;
+class BufferedFileWriter;
+class BufferedStreamWriter;
+class HistoryLock;
+class RunStats;
+struct HistoryBlock;
+
+// How a dry run lists the entries it would delete (--report)
+enum class ReportFormat {
+    Text,       // Each entry as it would leave the history, between marker lines
+    Ndjson,     // One JSON object per entry: its lines, byte range, timestamp and reason
+    Summary,    // Nothing per entry; the caller reports CleanResult's counts
+};
+
+// What deleted an entry. deleteReasonName() gives the names --report uses.
+enum class DeleteReason {
+    Window,     // The time window, with no content filter
+    Keyword,    // A keyword filter matched
+    Regex,      // A regex filter matched (and no keyword did)
+    Whitelist,  // No filter matched in whitelist mode
+    Rule,       // A policy rule with action = delete matched first
+    Duplicate,  // A repeat of a command (--dedup)
+};
+constexpr size_t DELETE_REASON_COUNT = 6;
+
+const char* deleteReasonName(DeleteReason reason);
+
+// Everything that decides what a cleaning run does. Cleaning modes and dates are
+// resolved to the timestamp window by the caller (see HistoryCleaner::calculateTimestamps).
+// With policy rules, each rule has a window of its own and the content filters stay
+// empty; the engine's window becomes the span of the rules' windows.
+struct EngineConfig {
+    std::time_t startTimestamp = 0;                                         // Inclusive
+    std::time_t endTimestamp = std::numeric_limits<std::time_t>::max();     // Inclusive
+    std::vector<std::string> keywords;   // Delete entries containing any of these strings
+    std::vector<std::string> regexes;    // Delete entries matching any of these ECMAScript patterns
+    bool whitelist = false;              // Keep filter matches instead of deleting them
+    std::vector<PolicyRule> rules;       // --policy: prioritized keep/delete rules instead of the filters above
+    bool multiline = false;              // Match the whole entry, continuation lines included (--multiline)
+    fs::path archive;                    // Append the deleted entries to this archive (--archive); empty for none
+    DedupMode dedup = DedupMode::None;   // Also delete repeats of a command among the entries kept (--dedup)
+    bool dedupOnly = false;              // Delete nothing but the repeats, if any (--dedup or --merge without --mode)
+    bool dryRun = false;                 // Classify only; the history file is not touched
+    ReportFormat report = ReportFormat::Text; // How a dry run lists what it would delete (--report)
+    bool backup = false;                 // Copy the original history file before modifying it
+    int shredPasses = SHRED_PASSES;      // Overwrite passes for the original (or the cut range)
+    fs::path shredQueue;                 // Queue the original here instead of shredding it (--defer-shred); empty for now
+    int threads = 1;                     // Classification threads per history file
+    bool pipeline = false;               // Overlap reading, classifying and writing (--pipeline)
+    bool seekByTime = false;             // Binary-search the time window (--seek)
+    bool inPlace = false;                // Cut a single contiguous deleted range in place (--in-place)
+    bool incremental = false;            // Skip the prefix an earlier run cleaned (--incremental checkpoint)
+};
+
+// Counting semaphore (C++17 has none) capping how many clean() calls are in their
+// I/O-heavy phase (sync, backup, shred) at once. Shared by the calls it should limit.
+class IoLimiter {
+public:
+    explicit IoLimiter(int count) : free_(count) {}
+
+    IoLimiter(const IoLimiter&) = delete;
+    IoLimiter& operator=(const IoLimiter&) = delete;
+
+    // Holds one slot for its lifetime. A null limiter means no limit.
+    class Lease {
+    public:
+        explicit Lease(IoLimiter* limiter) : limiter_(limiter) {
+            if (limiter_ != nullptr) limiter_->acquire();
+        }
+        ~Lease() {
+            if (limiter_ != nullptr) limiter_->release();
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+    private:
+        IoLimiter* limiter_;
+    };
+
+private:
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        available_.wait(lock, [this]() { return free_ > 0; });
+        --free_;
+    }
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++free_;
+        }
+        available_.notify_one();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable available_;
+    int free_;
+};
+
+// Where one clean() call reports, and how it can be stopped. Every member is optional;
+// a null stream discards what would have been written to it.
+struct CleanOptions {
+    std::ostream* info = nullptr;              // Progress messages and the final counts
+    std::ostream* log = nullptr;               // Warnings and errors
+    std::ostream* listing = nullptr;           // Dry run: the entries that would be deleted
+    const std::atomic<bool>* cancel = nullptr; // Checked between entries; set to abort the call
+    IoLimiter* ioLimiter = nullptr;            // Shared cap on concurrent sync/backup/shred phases
+    RunStats* stats = nullptr;                 // Per-phase timings (--stats); null leaves the call untimed
+};
+
+// Outcome of cleaning one history file
+struct CleanResult {
+    bool ok = false;
+    bool interrupted = false;            // A termination signal or options.cancel stopped the call
+    unsigned long long lines = 0;        // Lines read
+    unsigned long long kept = 0;         // Entries kept
+    unsigned long long deleted = 0;      // Entries deleted (to be deleted in a dry run)
+    unsigned long long duplicates = 0;   // Of those, repeats deleted by --dedup
+    std::array<unsigned long long, DELETE_REASON_COUNT> reasons{}; // Deleted entries by DeleteReason
+    std::vector<unsigned long long> ruleMatches; // Policy: entries each rule (by config().rules index) decided
+    fs::path backupPath;                 // Backup file, if one was created
+    bool shredQueued = false;            // The original was queued to config().shredQueue, not shredded yet
+    uintmax_t archived = 0;              // Bytes of deleted entries appended to config().archive
+    std::string error;                   // Why the call failed (details went to options.log)
+};
+
+// The history cleaning engine: classifies entries by time window and content filters and
+// rewrites (or, with inPlace, compacts) the history file, securely deleting the original.
+// It never exits the process, never reads stdin and writes only to the streams it is given.
+//
+// Thread safety: after configure(), clean() only reads the engine, so any number of
+// calls may run concurrently on one engine or on several, as long as no two of them
+// target the same history file. Temp files are tracked in the process-wide cleanup
+// registry; installing the termination handlers (installTerminationHandlers()) is left
+// to the application.
+class HistoryEngine {
+public:
+    HistoryEngine();
+    ~HistoryEngine();
+
+    HistoryEngine(const HistoryEngine&) = delete;
+    HistoryEngine& operator=(const HistoryEngine&) = delete;
+
+    // Validates config and compiles its filters. Returns false and sets error (e.g. for an
+    // invalid regex), leaving the engine unconfigured. Not thread-safe against clean().
+    bool configure(const EngineConfig& config, std::string& error);
+
+    // Moves the time window of a configured engine, keeping the compiled filters (for
+    // long-running callers whose window is relative to the current time). Returns false
+    // and sets error if start is after end. Not thread-safe against clean().
+    bool setTimeWindow(std::time_t startTimestamp, std::time_t endTimestamp, std::string& error);
+
+    // Same for policy rule number rule (an index into config().rules); the engine's window
+    // follows the span of the rules' windows. Not thread-safe against clean().
+    bool setRuleWindow(size_t rule, std::time_t startTimestamp, std::time_t endTimestamp, std::string& error);
+
+    const EngineConfig& config() const { return config_; }
+
+    // Cleans one history file according to the configuration.
+    CleanResult clean(const fs::path& historyFile, const CleanOptions& options = CleanOptions()) const;
+
+    // Filters a history read from inFd (a pipe, say) until end of input, writing the kept
+    // entries to outFd as a rewrite would (nothing in a dry run) and archiving the deleted
+    // ones with config().archive. Memory stays at STREAM_BUFFER_SIZE plus the longest entry
+    // (with pipeline, PIPELINE_QUEUE_DEPTH buffers of PIPELINE_CHUNK_SIZE), and nothing goes
+    // to disk but the archive. source names the input in messages and archive segments. The
+    // file options (backup, in-place, incremental, seek, threads, shred queue) do not
+    // apply; dedup, which needs the whole history, fails.
+    CleanResult filter(int inFd, int outFd, const fs::path& source, const CleanOptions& options = CleanOptions()) const;
+
+    // Merges the histories inputs into historyFile: each input is read as a stream in
+    // timestamp order, and a k-way merge by timestamp (ties in input order) feeds the
+    // classification as it goes. The kept entries replace historyFile as a rewrite would
+    // (nothing in a dry run); line numbers and offsets in messages refer to the merged
+    // history. historyFile has to be missing, empty or one of the inputs, so none of its
+    // entries is replaced unseen; the other inputs are only read. Memory stays at
+    // MERGE_BUFFER_SIZE per input plus STREAM_BUFFER_SIZE (and dedup's distinct commands).
+    // Backup, archive and shred queue apply; in-place, incremental, seek, threads and
+    // pipeline do not, and dedup, done in the same single pass, only keeps the first.
+    CleanResult merge(const std::vector<fs::path>& inputs, const fs::path& historyFile,
+                      const CleanOptions& options = CleanOptions()) const;
+
+private:
+    // Time spent in one matcher, measured per call by the timed kernels
+    struct MatchTiming {
+        uint64_t ns = 0;
+        uint64_t bytes = 0;             // Command bytes matched
+        uint64_t calls = 0;
+    };
+
+    // Outcome of classifying a range of the history file
+    struct ClassifyResult {
+        unsigned long long lines = 0;
+        unsigned long long kept = 0;
+        unsigned long long deleted = 0;
+        unsigned long long duplicates = 0;
+        std::array<unsigned long long, DELETE_REASON_COUNT> reasons{};
+        std::vector<unsigned long long> ruleMatches; // Policy kernels only
+        bool interrupted = false;
+        bool writeFailed = false;
+        MatchTiming keywordTiming;      // Timed kernels only
+        MatchTiming regexTiming;
+
+        // Adds from's counts and timings (not its flags), for results of consecutive ranges
+        void add(const ClassifyResult& from);
+    };
+
+    // --dedup=keep-last: what the filters decided for each entry of the recording pass, so
+    // the passes after it consult only this and the duplicate index instead of matching
+    // again. Entries in the time window are counted in file order from the start of each
+    // pass; those past the recorded ones (appended since) are matched as usual.
+    struct FilterVerdicts {
+        static constexpr uint32_t NO_RULE = UINT32_MAX;
+        struct Verdict {
+            uint32_t rule;                  // Position in rules_, or NO_RULE
+            DeleteReason reason;
+            bool deleteEntry;
+        };
+        bool recording = false;
+        size_t entry = 0;                   // Entries counted in this pass
+        size_t next = 0;                    // In verdicts, for the next decided entry
+        std::vector<bool> decided;          // By entry: the filters deleted it or a rule matched it
+        std::vector<Verdict> verdicts;      // The decided entries', in file order
+
+        void startPass() {
+            recording = false;
+            entry = next = 0;
+        }
+    };
+
+    // State of one clean() call
+    struct FileJob {
+        fs::path historyPath;           // Path of the history file
+        fs::path tempPath;              // New history file while it is being written
+        int tempSlot = -1;              // tempPath's entry in the cleanup registry
+        fs::path backupPath;            // Backup file (if created)
+        std::ostream* info = nullptr;   // Progress messages
+        std::ostream* log = nullptr;    // Warnings and errors
+        const std::atomic<bool>* cancel = nullptr;
+        IoLimiter* ioLimiter = nullptr;
+        RunStats* stats = nullptr;      // Null unless the caller asked for timings
+        DuplicateIndex* duplicates = nullptr; // --dedup: the commands of the current pass
+        FilterVerdicts* verdicts = nullptr; // --dedup=keep-last with filters: the recorded decisions
+        const char* reportBase = nullptr; // --report=ndjson: the classified text starts at input byte reportOffset
+        uintmax_t reportOffset = 0;
+        uintmax_t archived = 0;         // Bytes of deleted entries appended to the archive
+        uintmax_t shredOffset = 0;      // --in-place rewrite: the original's only deleted bytes
+        uintmax_t shredLength = 0;      // (and what follows scannedSize); 0 shreds all of it
+        bool shredQueued = false;       // The original went to config_.shredQueue
+        bool readWhole = false;         // --pipeline, but the history was read, not mapped: classified sequentially
+        ClassifyResult totals;
+        std::string error;              // First failure reason, for CleanResult::error
+
+        // The history file as the unlocked pass read it, checked again under zsh's lock
+        bool scannedExists = false;
+        uint64_t scannedDevice = 0;
+        uint64_t scannedInode = 0;
+        uintmax_t scannedSize = 0;
+        bool replaced = false;          // A shell replaced or truncated it meanwhile; worth a retry
+    };
+
+    EngineConfig config_;
+    bool configured_ = false;
+    KeywordMatcher keywordMatcher_;                // config_.keywords
+    std::unique_ptr<RegexMatcher> regexMatcher_;   // config_.regexes
+    uint64_t filterFingerprint_ = 0;               // Of the filters, for --incremental checkpoints
+
+    // A policy rule with its filters compiled
+    struct CompiledRule {
+        size_t index = 0;                          // Position in config_.rules
+        bool deleteMatches = true;
+        std::string reportName;                    // The rule's name as a JSON string
+        std::time_t startTimestamp = 0;
+        std::time_t endTimestamp = 0;
+        KeywordMatcher keywords;
+        std::unique_ptr<RegexMatcher> regexes;
+    };
+    std::vector<CompiledRule> rules_;              // config_.rules in evaluation order (priority, then file order)
+
+    // Sets config_'s window to the span of the rules' windows
+    void spanRuleWindows();
+
+    // Where an --incremental run starts
+    struct IncrementalStart {
+        bool usable = false;            // The checkpoint applies: only the new ranges are classified
+        size_t hashed = 0;              // Verified checkpoint prefix length (0 if none)
+        XxHash64 hash;                  // Of input[0, hashed)
+    };
+
+    // True once a termination signal was received or the job's cancel flag was set
+    static bool interrupted(const FileJob& job);
+
+    // Records reason as the job's failure (the first one wins) and returns false.
+    static bool fail(FileJob& job, const std::string& reason);
+
+    // Removes the job's temp file, if any
+    void cleanup(FileJob& job) const;
+
+    // Matches input against the history file's checkpoint. If it applies, bodies is set to
+    // the ranges that still need classifying: the appended tail, plus the parts of the
+    // prefix the time window reaches beyond the checkpoint's window.
+    void planIncremental(FileJob& job, std::string_view input, IncrementalStart& start,
+                         std::vector<TimeWindowRange>& bodies) const;
+
+    // Checkpoint covering content (the cleaned history) up to its last complete line.
+    // hash already covers content[0, hashed).
+    HistoryCheckpoint checkpointFor(std::string_view content, XxHash64 hash, size_t hashed) const;
+
+    // Saves the checkpoint of the first cleanedSize bytes of the rewritten history file.
+    void saveCheckpointAfterRewrite(FileJob& job, uintmax_t cleanedSize) const;
+
+    // Core logic: Reads history, filters entries, streams kept entries to a new file.
+    // Returns true if processing was successful; job.totals holds the counts.
+    bool processHistory(FileJob& job, std::ostream& output) const;
+
+    // filter(): a bounded buffer is refilled from inFd and classified up to the last entry
+    // boundary in it; the incomplete entry after that waits for more input. With
+    // config_.pipeline, through classifyStreamPipelined().
+    bool filterStream(FileJob& job, int inFd, int outFd, std::ostream& output) const;
+
+    // merge(): reads the inputs, merges and classifies them, and installs the result.
+    bool mergeHistories(FileJob& job, const std::vector<fs::path>& inputs, std::ostream& output) const;
+
+    // --archive: opens config_.archive for job (archive stays null without one, or in a
+    // dry run). Returns false, failing the job, if it cannot be opened.
+    bool openArchive(FileJob& job, std::unique_ptr<ArchiveWriter>& archive) const;
+
+    // Writes out and syncs what job gave archive (if not null), reporting the bytes. Returns
+    // false, failing the job, if the archive could not be written.
+    bool finishArchive(FileJob& job, ArchiveWriter* archive) const;
+
+    // Removes the single deleted byte range [offset, offset + length) from the history file
+    // in place (backup first, if requested): overwrites it, then takes zsh's history lock
+    // only to cut it out. length == 0 leaves the file untouched.
+    bool removeInPlace(FileJob& job, uintmax_t offset, uintmax_t length, std::ostream& output) const;
+
+    // Takes zsh's lock on the job's history file and checks that it is still the file the
+    // unlocked pass read, at most grown by appends; currentSize is its size now. If it was
+    // replaced or truncated, sets job.replaced, drops the lock and returns false.
+    bool lockHistory(FileJob& job, HistoryLock& lock, uintmax_t& currentSize) const;
+
+    // Creates the randomly named temp file next to the history file and registers it.
+    bool createTempFile(FileJob& job, BufferedFileWriter& writer) const;
+
+    // Creates a backup of the original history file.
+    bool backupHistoryFile(FileJob& job) const;
+
+    // Securely deletes original, the replaced history file (reported as the job's history
+    // file; it may be a link to it that outlived the rename).
+    bool performCleanup(FileJob& job, const fs::path& original, std::ostream& output) const;
+
+    // Process a single command block and determine if it should be deleted
+    // Returns true if the block should be deleted, false if it should be kept
+    // Dry-run listings go to output, warnings to log; counts (and timings) go to result.
+    // Filters match the unmetafied command, decoded into scratch when it contains Meta
+    // bytes; entries they keep are checked against job.duplicates, if not null. Policy fixes
+    // the filter configuration at compile time (see ClassifyPolicy in HistoryEngine.cpp).
+    template <typename Policy>
+    bool processCommandBlock(const FileJob& job, const HistoryBlock& block,
+                           BufferedStreamWriter& output, BufferedStreamWriter& log,
+                           ClassifyResult& result, std::string& scratch) const;
+
+    // Policy rules' verdict on an entry: the first rule matching it (counted in result),
+    // or null. Matcher timings go to result if Timed; Multiline commands are matched joined.
+    template <bool Timed, bool Multiline>
+    const CompiledRule* policyMatch(std::time_t timestamp, std::string_view command, ClassifyResult& result) const;
+
+    // Dry run: lists a deleted entry in config_.report's format (nothing for Summary)
+    void reportDeletion(const FileJob& job, BufferedStreamWriter& output, const HistoryBlock& block,
+                        std::time_t timestamp, DeleteReason reason, const CompiledRule* rule) const;
+
+    // Receives each kept block (raw bytes) in file order; returns false on write failure.
+    using KeepFunction = std::function<bool(std::string_view)>;
+
+    // Receives each deleted block (raw bytes) in file order, if not empty (--archive).
+    using DropFunction = std::function<void(std::string_view)>;
+
+    // The end of a rewrite, once newFile holds the kept entries of the history file as it
+    // was scanned (job.scanned*, ending in a complete line if wholeLines): syncs newFile,
+    // makes the backup, takes zsh's lock, classifies what shells appended meanwhile into
+    // newFile through keep and drop (adding to totals), makes newFile and archive durable,
+    // renames newFile over the history file and shreds (or queues) the original. report is
+    // called once the lock is released. Returns false, the job failed and its temp file
+    // removed, if any step fails.
+    bool installRewrite(FileJob& job, BufferedFileWriter& newFile, ArchiveWriter* archive, bool wholeLines,
+                        const KeepFunction& keep, const DropFunction& drop, ClassifyResult& totals,
+                        const std::function<void()>& report, std::ostream& output) const;
+
+    // Classifies every block in data, numbering lines from firstLineNum, with the kernel
+    // configure() picked for the filter configuration (its timed variant if job has stats).
+    ClassifyResult classifyRange(const FileJob& job, std::string_view data, unsigned long long firstLineNum,
+                                 std::ostream& output, std::ostream& log,
+                                 const KeepFunction& keep, const DropFunction& drop) const;
+
+    // classifyRange specialized for one filter configuration
+    template <typename Policy>
+    ClassifyResult classifyRangeWith(const FileJob& job, std::string_view data, unsigned long long firstLineNum,
+                                     std::ostream& output, std::ostream& log,
+                                     const KeepFunction& keep, const DropFunction& drop) const;
+
+    using ClassifyKernel = ClassifyResult (HistoryEngine::*)(const FileJob&, std::string_view, unsigned long long,
+                                                             std::ostream&, std::ostream&,
+                                                             const KeepFunction&, const DropFunction&) const;
+
+    // Returns the classifyRangeWith instantiation for a filter configuration (or for policy
+    // rules). Timed kernels measure every matcher call; the others contain no timing code.
+    static ClassifyKernel selectKernel(bool keywords, bool regexes, bool whitelist, bool rules, bool multiline,
+                                       bool dryRun, bool timed);
+
+    template <size_t... Index>
+    static std::array<ClassifyKernel, sizeof...(Index)> kernelTable(std::index_sequence<Index...>);
+    template <size_t... Index>
+    static std::array<ClassifyKernel, sizeof...(Index)> rulesKernelTable(std::index_sequence<Index...>);
+
+    ClassifyKernel classifyKernel_ = nullptr;      // Picked by configure()
+    ClassifyKernel timedClassifyKernel_ = nullptr; // Same, for clean() calls with stats
+
+    // Same as classifyRange over the whole input, split at entry boundaries across
+    // config_.threads workers. Results are replayed in file order.
+    ClassifyResult classifyParallel(const FileJob& job, std::string_view data, unsigned long long firstLineNum,
+                                    std::ostream& output, std::ostream& log,
+                                    const KeepFunction& keep, const DropFunction& drop) const;
+
+    // Same as classifyRange, run as a reader -> classifier -> writer pipeline: a reader
+    // thread faults the input in ahead of the classifier (this thread), and a writer thread
+    // passes the kept spans to keep. The stages are linked by bounded SPSC queues.
+    ClassifyResult classifyPipelined(const FileJob& job, std::string_view data, unsigned long long firstLineNum,
+                                     std::ostream& output, std::ostream& log,
+                                     const KeepFunction& keep, const DropFunction& drop) const;
+
+    // What classifyStreamPipelined() read: bytes, whether it reached the end of the input,
+    // and the errno of a failed read() (0 if none)
+    struct StreamRead {
+        uintmax_t bytes = 0;
+        bool eof = false;
+        int error = 0;
+    };
+
+    // filterStream() with --pipeline: a reader thread read()s inFd into a ring of
+    // PIPELINE_CHUNK_SIZE buffers, cut at entry boundaries, which pass through this thread
+    // (the classifier) to a writer thread calling keep and back, over SPSC queues.
+    ClassifyResult classifyStreamPipelined(FileJob& job, int inFd, std::ostream& output, const KeepFunction& keep,
+                                           const DropFunction& drop, StreamRead& stream) const;
+
+    // Classifies the (sorted, disjoint) byte ranges bodies of input and passes everything
+    // between them to keep unparsed (the --seek head and tail, an --incremental prefix).
+    // Line totals cover the whole input.
+    ClassifyResult classifyRanges(const FileJob& job, std::string_view input,
+                                  const std::vector<TimeWindowRange>& bodies,
+                                  std::ostream& output, std::ostream& log,
+                                  const KeepFunction& keep, const DropFunction& drop) const;
+};
+
+#endif // HISTORY_ENGINE_H
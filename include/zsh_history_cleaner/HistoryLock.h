@@ -0,0 +1,42 @@
+#ifndef HISTORY_LOCK_H
+#define HISTORY_LOCK_H
+
+#include <filesystem> // Requires C++17
+#include <iosfwd>     // For std::ostream forward declaration
+
+namespace fs = std::filesystem;
+
+// zsh's lock on a history file, held while the cleaned file is swapped in so no shell
+// appends to (or rewrites) the history in between. zsh locks in one of two ways,
+// depending on HIST_FCNTL_LOCK: by linking "$HISTFILE.LOCK" into place (a lock older
+// than HISTORY_LOCK_STALE_SECONDS is taken to be stale and broken), or with an fcntl()
+// write lock on the history file itself. Both are taken, in that order, so the lock is
+// exclusive against shells using either.
+class HistoryLock {
+public:
+    HistoryLock() = default;
+    ~HistoryLock(); // Releases the lock
+
+    HistoryLock(const HistoryLock&) = delete;
+    HistoryLock& operator=(const HistoryLock&) = delete;
+
+    // Waits up to HISTORY_LOCK_TIMEOUT_MS for the lock. Returns false and logs to log if
+    // it could not be taken. A history file that does not exist yet is locked through
+    // "$HISTFILE.LOCK" alone (fd() is then -1).
+    bool acquire(const fs::path& historyFile, std::ostream& log);
+
+    // Drops both locks. Safe to call more than once.
+    void release();
+
+    // Read/write descriptor of the locked history file. fcntl() locks go away when the
+    // process closes any descriptor of the file, so while the lock is held the history
+    // file must only be read and written through this one.
+    int fd() const { return fd_; }
+
+private:
+    int fd_ = -1;
+    fs::path lockPath_;                 // "$HISTFILE.LOCK" while it is ours
+    int lockSlot_ = -1;                 // lockPath_'s entry in the cleanup registry
+};
+
+#endif // HISTORY_LOCK_H
@@ -0,0 +1,27 @@
+#ifndef HISTORY_PARSER_H
+#define HISTORY_PARSER_H
+
+#include <string_view>
+#include <ctime>
+#include <cstddef> // For size_t
+
+// Parsed fields of a Zsh extended-history header line: ": <timestamp>:<duration>;<command>"
+struct HistoryHeader {
+    std::time_t timestamp = 0;      // Start time of the command (epoch seconds)
+    long long duration = 0;         // Elapsed seconds (saturates instead of overflowing)
+    size_t commandOffset = 0;       // Offset of the first byte after ';' within the line
+    bool timestampInRange = true;   // False if the timestamp digits do not fit in a time_t
+};
+
+// Parses a single history line (without its trailing newline) in one forward pass.
+// Accepts exactly the lines matched by the former ECMAScript regex
+//     ^\s*:\s*(\d+):\d+\s*;.*$
+// i.e. optional whitespace before ':' and around the digits/';', and a command part
+// that contains no '\r' or '\n'. Never allocates.
+// Returns true if the line is an entry header; header is only filled in that case.
+bool parseHistoryHeader(std::string_view line, HistoryHeader& header);
+
+// Convenience overload when only the header/non-header distinction is needed.
+bool isHistoryHeader(std::string_view line);
+
+#endif // HISTORY_PARSER_H
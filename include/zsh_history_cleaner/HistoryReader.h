@@ -0,0 +1,167 @@
+#ifndef HISTORY_READER_H
+#define HISTORY_READER_H
+
+#include <filesystem> // Requires C++17
+#include <string_view>
+#include <vector>
+#include <iosfwd>     // For std::ostream forward declaration
+#include <cstddef>    // For size_t
+#include <cstdint>    // For uint64_t
+
+namespace fs = std::filesystem;
+
+// Read-only view of an entire history file.
+// The file is memory-mapped when possible so that no bytes are copied into user space;
+// files that cannot be mapped (pipes, special files, mmap failures) are read with read()
+// into an owned buffer instead. All string_views handed out stay valid until close().
+class HistoryFileView {
+public:
+    HistoryFileView() = default;
+    ~HistoryFileView();
+
+    HistoryFileView(const HistoryFileView&) = delete;
+    HistoryFileView& operator=(const HistoryFileView&) = delete;
+    HistoryFileView(HistoryFileView&&) = delete;
+    HistoryFileView& operator=(HistoryFileView&&) = delete;
+
+    // Opens and maps (or reads) the file. A missing file yields an empty view.
+    // Returns false and logs to log on any other failure.
+    bool open(const fs::path& path, std::ostream& log);
+
+    // Releases the mapping/buffer. Invalidates all views into the file.
+    void close();
+
+    std::string_view data() const { return {data_, size_}; }
+    bool isMapped() const { return mapping_ != nullptr; }
+
+    // Identity of the file that was opened (all zero if it did not exist)
+    bool exists() const { return exists_; }
+    uint64_t device() const { return device_; }
+    uint64_t inode() const { return inode_; }
+
+private:
+    bool readFallback(int fd, std::ostream& log);
+
+    void* mapping_ = nullptr;   // Non-null when data_ points into an mmap'ed region
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<char> buffer_;  // Backing store for the read() fallback
+    bool exists_ = false;
+    uint64_t device_ = 0;
+    uint64_t inode_ = 0;
+};
+
+// One history entry (or one stray line before the first entry) as a view into the file.
+struct HistoryBlock {
+    std::string_view text;              // Raw bytes, including line terminators
+    size_t firstLineLength = 0;         // Bytes of the first line within text, terminator included
+    unsigned long long firstLine = 0;   // 1-based line number of the first line
+    unsigned long long lastLine = 0;    // 1-based line number of the last line
+    bool hasHeader = false;             // False for lines found before the first header
+};
+
+// Splits a history buffer into entry blocks without copying.
+// A block starts at a header line and extends until the next header line; any lines
+// that precede the first header are returned one at a time with hasHeader == false.
+class HistoryBlockReader {
+public:
+    explicit HistoryBlockReader(std::string_view data, unsigned long long firstLineNum = 1);
+
+    // Fetches the next block. Returns false once the input is exhausted.
+    bool next(HistoryBlock& block);
+
+    // Number of lines consumed so far.
+    unsigned long long linesRead() const { return lineNum_ - firstLineNum_; }
+
+private:
+    // Returns the line starting at pos_ (terminator included) and advances past it.
+    std::string_view nextLine();
+
+    std::string_view data_;
+    size_t pos_ = 0;
+    unsigned long long firstLineNum_;
+    unsigned long long lineNum_;        // Number of the next line to be read
+    bool pendingHeader_ = false;        // A header line was read but not yet returned
+    std::string_view pendingLine_;
+    bool seenHeader_ = false;
+};
+
+// Splits a history read from a descriptor (a file or a pipe) into the same blocks as
+// HistoryBlockReader, one at a time, without reading it all: the buffer holds the block
+// being returned and what was read after it, starting at bufferSize and growing only to
+// fit a longer block. A block's text stays valid until the next call to next().
+class HistoryStreamReader {
+public:
+    HistoryStreamReader(int fd, size_t bufferSize);
+
+    // Fetches the next block. Returns false at the end of the input or when a read fails;
+    // error() then tells them apart. After EINTR, calling next() again resumes the read.
+    bool next(HistoryBlock& block);
+
+    // errno of the read that failed, 0 at the end of the input
+    int error() const { return error_; }
+
+    uint64_t bytesRead() const { return bytesRead_; }
+
+    // The input read so far is empty or ends with a line terminator
+    bool endsWithNewline() const { return endsWithNewline_; }
+
+private:
+    // Moves the unreturned bytes to the front of the buffer (growing it if they fill it)
+    // and reads more after them. False if the read failed.
+    bool fill();
+
+    // Length of the line starting at offset (unreturned bytes), terminator included, or 0
+    // while it is incomplete and more input can come
+    size_t lineAt(size_t offset) const;
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t pos_ = 0;                    // Start of the bytes not returned yet
+    size_t used_ = 0;                   // End of the bytes read
+    bool eof_ = false;
+    int error_ = 0;
+    uint64_t bytesRead_ = 0;
+    bool endsWithNewline_ = true;
+    unsigned long long lineNum_ = 1;    // Number of the next line to be returned
+    bool seenHeader_ = false;
+};
+
+// Returns the offset of the first entry header line starting at or after offset, or
+// data.size() if there is none. Used to split a buffer into independently parseable
+// chunks: a continuation line is never a header, so every such offset begins a block.
+size_t findEntryBoundary(std::string_view data, size_t offset);
+
+// Number of lines in data, counting a final line without '\n'.
+unsigned long long countLines(std::string_view data);
+
+// Strips the terminator (and a single '\r' before it) from a raw line.
+inline std::string_view stripLineEnding(std::string_view line) {
+    if (!line.empty() && line.back() == '\n') line.remove_suffix(1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return line;
+}
+
+// Calls emit(std::string_view) with the block's bytes in normalized form: one trailing
+// '\r' removed per line and every line terminated by '\n', which is what the history
+// rewrite has always produced. The common case emits the block unchanged in one piece.
+template <typename Emit>
+void forEachNormalizedPiece(std::string_view block, Emit&& emit) {
+    if (block.empty()) return;
+    if (block.back() == '\n' && block.find('\r') == std::string_view::npos) {
+        emit(block);
+        return;
+    }
+    static constexpr std::string_view newline("\n", 1);
+    size_t pos = 0;
+    while (pos < block.size()) {
+        size_t eol = block.find('\n', pos);
+        size_t next = (eol == std::string_view::npos) ? block.size() : eol + 1;
+        std::string_view line = stripLineEnding(block.substr(pos, next - pos));
+        if (!line.empty()) emit(line);
+        emit(newline);
+        pos = next;
+    }
+}
+
+#endif // HISTORY_READER_H
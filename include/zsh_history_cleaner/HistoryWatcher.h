@@ -0,0 +1,40 @@
+#ifndef HISTORY_WATCHER_H
+#define HISTORY_WATCHER_H
+
+#include <filesystem> // Requires C++17
+#include <string>
+#include <iosfwd>     // For std::ostream forward declaration
+
+namespace fs = std::filesystem;
+
+// Waits for a history file to change (--watch), using inotify on its directory: zsh
+// saves by appending (INC_APPEND_HISTORY, SHARE_HISTORY) but also by writing a new file
+// and renaming it over the old one, which a watch on the file itself would not survive.
+// Only events for the history file's name count; the sidecars next to it are ignored.
+class HistoryWatcher {
+public:
+    HistoryWatcher() = default;
+    ~HistoryWatcher();
+
+    HistoryWatcher(const HistoryWatcher&) = delete;
+    HistoryWatcher& operator=(const HistoryWatcher&) = delete;
+
+    // Starts watching historyFile. Returns false and logs to log on failure.
+    bool open(const fs::path& historyFile, std::ostream& log);
+
+    // Blocks (without polling) until the history file was written to, closed after
+    // writing or replaced, then keeps collecting events until WATCH_QUIET_MS pass without
+    // one, or WATCH_MAX_DELAY_MS since the first, so a burst costs one pass. Returns
+    // false and logs to log if the watch failed.
+    bool waitForChange(std::ostream& log);
+
+private:
+    // Reads the pending events; sets changed if one concerned the history file.
+    // Returns false on a read error.
+    bool drain(bool& changed, std::ostream& log);
+
+    int fd_ = -1;
+    std::string name_;                  // History file name within the watched directory
+};
+
+#endif // HISTORY_WATCHER_H
@@ -0,0 +1,59 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <cstddef> // For size_t
+#include <cstdint> // For uint64_t
+
+// Minimal io_uring instance driven through the raw system calls (no liburing needed).
+// Supports just what the overwrite engine uses: positioned writes and fdatasync.
+// Only built when configured with -DZSH_HISTORY_CLEANER_USE_IO_URING=ON.
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Sets up a ring with room for entries submissions. Returns false (errno set) if the
+    // kernel lacks io_uring or it is disabled, e.g. by seccomp or kernel.io_uring_disabled.
+    bool init(unsigned entries);
+
+    // Queue a positioned write / an fdatasync. flags are IOSQE_* values such as
+    // IOSQE_IO_LINK or IOSQE_IO_DRAIN. Return false if the submission queue is full.
+    bool prepareWrite(int fd, const void* buf, unsigned length, uint64_t offset,
+                      uint64_t userData, unsigned flags = 0);
+    bool prepareFdatasync(int fd, uint64_t userData, unsigned flags = 0);
+
+    // Hands everything queued to the kernel. Returns false on failure (errno set).
+    bool submit();
+
+    // Blocks until a completion is available and pops it. result is the operation's
+    // return value (bytes written, or -errno). Returns false on failure (errno set).
+    bool waitCompletion(uint64_t& userData, int& result);
+
+private:
+    struct io_uring_sqe* nextSqe();
+
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    void* cqRing_ = nullptr;        // Same as sqRing_ with IORING_FEAT_SINGLE_MMAP
+    size_t cqRingSize_ = 0;
+    struct io_uring_sqe* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    struct io_uring_cqe* cqes_ = nullptr;
+
+    unsigned pending_ = 0;          // Queued but not yet submitted
+};
+
+#endif // IO_URING_H
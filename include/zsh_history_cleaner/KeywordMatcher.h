@@ -0,0 +1,49 @@
+#ifndef KEYWORD_MATCHER_H
+#define KEYWORD_MATCHER_H
+
+#include <array>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>    // For size_t
+#include <cstdint>    // For int32_t, uint16_t, uint8_t
+
+// Multi-keyword substring matcher (Aho–Corasick, compiled to a full DFA).
+// Answers "does text contain ANY of the keywords" in a single pass over text, independent
+// of the number of keywords. Bytes that occur in no keyword share one alphabet class to
+// keep the transition table small. While the automaton is in its start state, a
+// first-byte prefilter (memchr / SSE2 / table) skips ahead to the next candidate byte,
+// which makes the common no-match case run at close to memory speed.
+class KeywordMatcher {
+public:
+    // Compiles the automaton. Replaces any previously compiled keyword set.
+    void build(const std::vector<std::string>& keywords);
+
+    bool empty() const { return !matchesEverything_ && acceptingStates_.empty(); }
+
+    // Returns true if text contains at least one keyword (same result as looping over
+    // text.find(keyword) for every keyword).
+    bool matchesAny(std::string_view text) const;
+
+    // Same for the logical form of a multiline entry (see EntryText.h), without joining it.
+    bool matchesAnyJoined(std::string_view text) const;
+
+private:
+    // Runs the automaton over text from state; returns -1 once a keyword matched, else
+    // the state reached at the end of text.
+    int32_t scan(std::string_view text, int32_t state) const;
+
+    // Returns the first position >= pos whose byte can start a keyword, or text.size().
+    size_t nextCandidate(std::string_view text, size_t pos) const;
+
+    std::array<uint16_t, 256> byteClass_{};      // Byte -> alphabet class (0 = unused byte)
+    size_t classCount_ = 0;
+    std::vector<int32_t> transitions_;           // state * classCount_ + class -> state
+    std::vector<uint8_t> acceptingStates_;       // Non-zero if any keyword ends here
+    std::array<bool, 256> isFirstByte_{};        // Bytes that start at least one keyword
+    std::vector<unsigned char> firstBytes_;      // Same set, as a list (for SIMD/memchr)
+    size_t minLength_ = 0;                       // Length of the shortest keyword
+    bool matchesEverything_ = false;             // An empty keyword matches every text
+};
+
+#endif // KEYWORD_MATCHER_H
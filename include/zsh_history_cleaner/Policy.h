@@ -0,0 +1,47 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <filesystem> // Requires C++17
+#include <string>
+#include <vector>
+#include <ctime>
+#include <limits>     // For numeric_limits
+
+namespace fs = std::filesystem;
+
+// One rule of a --policy, as the engine evaluates it. An entry matches the rule if its
+// timestamp is in the window and it contains a keyword or matches a regex (or the rule
+// has neither, in which case the window alone decides). The first matching rule, by
+// descending priority and then in file order, decides whether the entry goes; an entry
+// no rule matches is kept.
+struct PolicyRule {
+    std::string name;                                                       // Section name, for messages
+    bool deleteMatches = true;                                              // action = delete, or keep
+    int priority = 0;
+    std::time_t startTimestamp = 0;                                         // Inclusive
+    std::time_t endTimestamp = std::numeric_limits<std::time_t>::max();     // Inclusive
+    std::vector<std::string> keywords;
+    std::vector<std::string> regexes;    // ECMAScript patterns
+};
+
+// A rule as written in the policy file: the time window is still a cleaning mode and its
+// arguments, resolved by the caller like --mode (see HistoryCleaner::calculateTimestamps).
+struct PolicyRuleSpec {
+    PolicyRule rule;                     // Window not set yet
+    int line = 0;                        // Line of the section header, for messages
+    std::string mode = "all";            // Same names as --mode
+    std::string date;                    // For specific_day, before, after
+    std::string startDate;               // For between
+    std::string endDate;
+    int days = -1;                       // For older_than, newer_than
+    bool precise = false;                // Dates include a time of day
+};
+
+// Reads a policy file: "[name]" starts a rule, followed by "key = value" lines (action,
+// priority, mode, date, start-date, end-date, days, precise, and any number of keyword
+// and regex lines). Blank lines and lines starting with '#' or ';' are ignored. Returns
+// false and sets error ("FILE:LINE: reason") if the file cannot be read, is malformed,
+// has an invalid regex or defines no rule.
+bool loadPolicyFile(const fs::path& path, std::vector<PolicyRuleSpec>& rules, std::string& error);
+
+#endif // POLICY_H
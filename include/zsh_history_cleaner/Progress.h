@@ -0,0 +1,58 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>    // For size_t
+#include <cstdint>    // For uint64_t
+
+// Process-wide progress counters, shared by every history file being processed (like the
+// cleanup registry). The engine updates them with relaxed atomic adds, in batches of
+// about PROGRESS_PUBLISH_BYTES of input or one shred chunk, so the hot loops hardly
+// notice. They are read by the --progress reporter and by the SIGUSR1 handler; counts
+// only ever grow, so a batch run shows its files together.
+
+// A classification pass over bytes of history starts
+void progressClassifyStart(uint64_t bytes);
+
+// bytes of history holding entries (kept or deleted) were classified
+void progressClassified(uint64_t bytes, uint64_t entries);
+
+// An overwrite of bytes with passes rounds starts (bytes * passes to write)
+void progressShredStart(uint64_t bytes, int passes);
+
+// Overwrite pass (1-based) of the current shred starts
+void progressShredPass(int pass);
+
+// bytes of random data were written by a shred
+void progressShredded(uint64_t bytes);
+
+// Formats the counters as one line without a newline ("Progress: read ..., ETA ...") and
+// returns its length. Async-signal-safe; the line is cut short if buffer is too small.
+size_t formatProgress(char* buffer, size_t size);
+
+// Installs the SIGUSR1 handler, which writes the current line to stderr. System calls
+// in progress are restarted, so the run goes on as if nothing happened.
+void installProgressHandler();
+
+// --progress: while alive (and enabled), a thread writes the line to stderr every
+// PROGRESS_INTERVAL_MS, if the counters moved. A run shorter than that prints nothing.
+class ProgressReporter {
+public:
+    explicit ProgressReporter(bool enabled);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+private:
+    void report();                      // Reporter thread
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+};
+
+#endif // PROGRESS_H
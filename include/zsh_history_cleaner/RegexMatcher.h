@@ -0,0 +1,70 @@
+#ifndef REGEX_MATCHER_H
+#define REGEX_MATCHER_H
+
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>    // For size_t
+
+#include "KeywordMatcher.h"
+
+// Set of --regex filters answering "does text match ANY pattern" (regex_search semantics).
+//
+// Patterns are always validated as ECMAScript std::regex, so accepted syntax and error
+// messages do not depend on the build. compile() then prepares the fastest engine:
+//  - Each pattern's required literal (a substring every match must contain) is extracted;
+//    texts that contain none of the literals are rejected without running any engine.
+//  - When built with ZSH_HISTORY_CLEANER_USE_RE2, patterns that RE2 can express are
+//    translated to byte-exact equivalents and combined into one linear-time RE2::Set;
+//    the rest (backreferences, lookahead, ...) stay on std::regex.
+class RegexMatcher {
+public:
+    RegexMatcher();
+    ~RegexMatcher();
+
+    RegexMatcher(const RegexMatcher&) = delete;
+    RegexMatcher& operator=(const RegexMatcher&) = delete;
+
+    // Throws std::regex_error if pattern is not a valid ECMAScript regex.
+    static void validate(const std::string& pattern);
+
+    // Validates and records an ECMAScript pattern. Throws std::regex_error if invalid.
+    void add(const std::string& pattern);
+
+    // Builds the combined engine and prefilters. Must be called after the last add().
+    void compile();
+
+    bool empty() const { return patterns_.empty(); }
+    size_t size() const { return patterns_.size(); }
+
+    // Returns true if any pattern matches somewhere in text.
+    bool matchesAny(std::string_view text) const;
+
+    // Same for the logical form of a multiline entry (see EntryText.h), without joining it.
+    bool matchesAnyJoined(std::string_view text) const;
+
+    // Name of the engine used for patterns that do not need std::regex.
+    static const char* backendName();
+
+    // Longest literal every match of the ECMAScript pattern must contain (may be empty).
+    // Exposed for diagnostics and benchmarks.
+    static std::string requiredLiteral(const std::string& pattern);
+
+private:
+    struct Pattern {
+        std::string source;
+        std::regex regex;
+        std::string literal;        // Required literal, empty if none could be derived
+        bool inCombinedSet = false; // Handled by the combined engine instead of std::regex
+    };
+    struct CombinedEngine;          // Defined in RegexMatcher.cpp (RE2::Set when enabled)
+
+    std::vector<Pattern> patterns_;
+    std::unique_ptr<CombinedEngine> combined_;
+    KeywordMatcher combinedLiterals_;   // Literals of all combined-set patterns
+    bool combinedNeedsNoLiteral_ = false; // Some combined pattern has no literal: always run it
+};
+
+#endif // REGEX_MATCHER_H
@@ -0,0 +1,109 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <array>
+#include <chrono>   // For steady_clock
+#include <cstddef>  // For size_t
+#include <cstdint>  // For uint64_t
+#include <iosfwd>   // For std::ostream forward declaration
+#include <string>
+
+// Phases of a cleaning run reported by --stats. The names (runPhaseName) are part of the
+// --stats=json format, so existing ones must not change.
+enum class RunPhase {
+    Resolve,        // History path resolution and permission checks
+    ReadParse,      // Mapping and classifying the history (includes the filter phases)
+    FilterKeyword,  // Keyword matching (summed over classification threads)
+    FilterRegex,    // Regex matching (summed over classification threads)
+    Write,          // Temp file creation, writes and the final fsync
+    Backup,         // Copying the original history file
+    Shred,          // Secure deletion of the original (or of the cut range with --in-place)
+    Rename,         // Moving the new history file into place
+    Lock,           // Holding zsh's history lock (from acquiring to releasing it)
+};
+constexpr size_t RUN_PHASE_COUNT = 9;
+
+const char* runPhaseName(RunPhase phase);
+
+// Accumulated measurements of one phase
+struct PhaseTotals {
+    uint64_t wallNs = 0;
+    uint64_t cpuNs = 0;            // Process CPU time (all threads)
+    uint64_t bytes = 0;            // Bytes the phase processed
+    uint64_t count = 0;            // Measured intervals (matcher calls for the filter phases)
+};
+
+// Per-phase timings and counters of one run (or, merged, of a batch). Filled in by
+// PhaseTimer and by the engine; not thread-safe, except that distinct phases may be
+// updated from different threads.
+class RunStats {
+public:
+    PhaseTotals& operator[](RunPhase phase) { return phases_[static_cast<size_t>(phase)]; }
+    const PhaseTotals& operator[](RunPhase phase) const { return phases_[static_cast<size_t>(phase)]; }
+
+    // Starts and ends the run's total wall and CPU time
+    void start();
+    void finish();
+
+    // Adds other's phases and counters (batch mode)
+    void merge(const RunStats& other);
+
+    std::string file;              // History file, empty for a batch
+    unsigned long long files = 0;  // History files covered
+    bool ok = true;                // Every file was processed successfully
+    bool dryRun = false;
+    unsigned long long lines = 0;
+    unsigned long long kept = 0;
+    unsigned long long deleted = 0;
+
+    // Human-readable table
+    void writeText(std::ostream& out) const;
+
+    // One JSON object on one line. Every phase is always present (zeros if it did not run).
+    void writeJson(std::ostream& out) const;
+
+private:
+    std::array<PhaseTotals, RUN_PHASE_COUNT> phases_{};
+    uint64_t startWallNs_ = 0;
+    uint64_t startCpuNs_ = 0;
+    uint64_t wallNs_ = 0;
+    uint64_t cpuNs_ = 0;
+};
+
+// Monotonic clock in nanoseconds, for the per-call filter timings
+inline uint64_t monotonicNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// CPU time consumed by the process so far, in nanoseconds
+uint64_t processCpuNs();
+
+// Adds the wall and CPU time of its scope to one phase of stats. With null stats it does
+// nothing, so untimed runs pay one branch per timer.
+class PhaseTimer {
+public:
+    PhaseTimer(RunStats* stats, RunPhase phase) : totals_(stats ? &(*stats)[phase] : nullptr) {
+        if (totals_ != nullptr) begin();
+    }
+    ~PhaseTimer() { stop(); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    // Ends the measurement before the end of the scope
+    void stop() {
+        if (totals_ != nullptr) end();
+        totals_ = nullptr;
+    }
+
+private:
+    void begin();
+    void end();
+
+    PhaseTotals* totals_;
+    uint64_t wallStart_ = 0;
+    uint64_t cpuStart_ = 0;
+};
+
+#endif // RUN_STATS_H
@@ -6,6 +6,7 @@
 #include <iosfwd>     // For forward declaration of std::ostream
 #include <cstring>    // For strerror
 #include <cerrno>     // For errno
+#include <cstdint>    // For uintmax_t
 
 namespace fs = std::filesystem;
 
@@ -14,4 +15,27 @@ namespace fs = std::filesystem;
 // Logs warnings/errors to the provided ostream.
 bool secureDelete(const fs::path& filepath, int passes, std::ostream& log = std::cerr);
 
+// Like secureDelete, but only overwrites bytes [offset, offset + length) and everything
+// from tailOffset to the end of the file before removing it: for a file whose other bytes
+// were copied unchanged into its replacement (--in-place with too much to shift).
+bool secureDeletePart(const fs::path& filepath, uintmax_t offset, uintmax_t length, uintmax_t tailOffset,
+                      int passes, std::ostream& log = std::cerr);
+
+// Overwrites bytes [offset, offset + length) of an open, writable file with passes rounds
+// of random data, syncing after every pass. The file size is unchanged.
+bool secureOverwriteRange(int fd, uintmax_t offset, uintmax_t length, int passes, std::ostream& log = std::cerr);
+
+// Removes bytes [offset, offset + length) from an open, writable file in place: the range
+// is overwritten as by secureOverwriteRange, then cut out as by cutRange. Cost scales with
+// the removed bytes plus the bytes after them.
+bool secureRemoveRange(int fd, uintmax_t offset, uintmax_t length, int passes, std::ostream& log = std::cerr);
+
+// Cuts bytes [offset, offset + length) out of an open, writable file without overwriting
+// them: the data after the range, up to the size the file has when called, is shifted
+// down over it and the file is truncated and synced. Not crash-safe: a crash during the
+// shift or before the truncation leaves the shifted bytes duplicated (with an entry torn
+// where the copy stopped), and there is no other copy to go back to. Callers keep the
+// bytes after the range small (IN_PLACE_MAX_SHIFT for --in-place).
+bool cutRange(int fd, uintmax_t offset, uintmax_t length, std::ostream& log = std::cerr);
+
 #endif // SECURE_DELETE_H
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef SHRED_QUEUE_H
+#define SHRED_QUEUE_H
+
+#include <filesystem> // Requires C++17
+#include <iosfwd>     // For std::ostream forward declaration
+#include <cstdint>    // For uint64_t
+
+namespace fs = std::filesystem;
+
+// --defer-shred: originals swapped out of the way are queued for secure deletion instead
+// of being shredded before the run returns. The queue is a directory of small entry files,
+// one per pending file ("<time>-<random>.shred": a magic line, the passes, the file's
+// device and inode, and its path), each written and synced before it is renamed into
+// place, so it outlives a crash. drainShredQueue() (--shred-queue, usually a detached
+// process) works through it; an entry is only removed once its file is gone.
+
+// The per-user queue: $XDG_STATE_HOME/zsh_history_cleaner/shred-queue, or
+// ~/.local/state/zsh_history_cleaner/shred-queue
+fs::path defaultShredQueueDir();
+
+// Queues file (as it is now: a file later found at the path with another inode is left
+// alone) for passes rounds of secure deletion. Creates the queue owner-only if needed.
+// Returns false and logs on failure; the caller then has to shred the file itself.
+bool enqueueShred(const fs::path& queueDir, const fs::path& file, int passes, std::ostream& log);
+
+// What drainShredQueue() did
+struct ShredQueueResult {
+    bool busy = false;                  // Another drainer holds the queue; it takes care of everything queued
+    unsigned long long shredded = 0;    // Files securely deleted
+    unsigned long long stale = 0;       // Entries dropped: file already gone or replaced
+    unsigned long long failed = 0;      // Entries kept for the next drain, their secure delete failed
+};
+
+// Shreds every queued file, oldest first, until the queue is empty (entries queued while
+// it runs included) or termination is requested. One drainer runs at a time, under an
+// flock() on the queue's lock file. Returns false if any entry failed.
+bool drainShredQueue(const fs::path& queueDir, std::ostream& log, ShredQueueResult& result);
+
+// The rewrite keeps the original reachable under a hidden name in the history's directory
+// while the cleaned file is renamed in, and shreds (or queues) it after. Before that name
+// exists it is recorded in $HISTFILE.cleaner-pending (the fields of a queue entry), so a
+// run killed in between leaves a record rather than an unlisted copy of the history. The
+// record is flock()ed for as long as its run lives.
+fs::path pendingShredPath(const fs::path& historyFile);
+
+class PendingShred {
+public:
+    PendingShred() = default;
+    ~PendingShred();                    // Unlocks, leaving the record for recoverPendingShred()
+
+    PendingShred(const PendingShred&) = delete;
+    PendingShred& operator=(const PendingShred&) = delete;
+
+    // Durably records original (the history file's device and inode, to be shredded with
+    // passes rounds) before it is created. Returns false and logs on failure; the caller
+    // must then not create it.
+    bool record(const fs::path& historyFile, const fs::path& original, uint64_t device, uint64_t inode,
+                int passes, std::ostream& log);
+
+    // The original is shredded, queued or back in place: removes the record
+    void clear();
+
+private:
+    fs::path path_;
+    int fd_ = -1;
+};
+
+// Resolves a record an interrupted run left for historyFile (one a live run holds is left
+// alone). If the cleaned file was not renamed in yet, the history is the recorded file: a
+// second name of it is removed, or it is put back if it was moved aside. Otherwise the
+// recorded file is the replaced original and is shredded. A dry run only reports it.
+// Returns false and logs on failure; the record is then kept.
+bool recoverPendingShred(const fs::path& historyFile, bool dryRun, std::ostream& info, std::ostream& log);
+
+#endif // SHRED_QUEUE_H
@@ -0,0 +1,72 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <chrono>     // For the backoff sleep
+#include <cstddef>    // For size_t
+#include <thread>     // For std::this_thread
+#include <utility>    // For std::move
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Slots are reused in a ring; head_ and tail_ only ever grow and are kept on separate
+// cache lines so the two sides do not contend. push()/pop() wait by yielding and then
+// sleeping briefly, so an idle stage does not burn a core while the other one is blocked
+// in I/O.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. Returns false (leaving value untouched) if the queue is full.
+    bool tryPush(T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        slots_[head & (Capacity - 1)] = std::move(value);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool tryPop(T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots_[tail & (Capacity - 1)]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(T value) {
+        for (unsigned spins = 0; !tryPush(value); ++spins) {
+            backoff(spins);
+        }
+    }
+
+    void pop(T& value) {
+        for (unsigned spins = 0; !tryPop(value); ++spins) {
+            backoff(spins);
+        }
+    }
+
+private:
+    static void backoff(unsigned spins) {
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    alignas(64) std::atomic<size_t> head_{0}; // Next slot to fill (written by the producer)
+    alignas(64) std::atomic<size_t> tail_{0}; // Next slot to drain (written by the consumer)
+    alignas(64) T slots_[Capacity];
+};
+
+#endif // SPSC_QUEUE_H
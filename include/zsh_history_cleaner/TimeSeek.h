@@ -0,0 +1,33 @@
+#ifndef TIME_SEEK_H
+#define TIME_SEEK_H
+
+#include <string_view>
+#include <utility>    // For std::pair
+#include <vector>
+#include <ctime>
+#include <cstddef>    // For size_t
+
+// Byte range of a history buffer that can contain entries inside a time window.
+struct TimeWindowRange {
+    size_t begin = 0;   // Offset of the first block that may fall inside the window
+    size_t end = 0;     // Offset just past the last such block
+};
+
+// Locates the entries timestamped in [start, end] by binary-searching the buffer on
+// header timestamps (probing at byte offsets and resyncing to the next header line): the
+// range runs from the first header timestamped at or after start - slackSeconds to the
+// first one after end + slackSeconds. Everything outside it is guaranteed to lie outside
+// the window as long as the history is time-ordered up to slackSeconds of local disorder
+// (which concurrent shells produce). The order is checked over the whole range, at a few
+// headers past it and at each probe; returns false if any of them is out of order by
+// more than the slack, and callers must then fall back to a full scan. Disorder elsewhere
+// goes unseen. Headers with out-of-range timestamps are stepped over.
+bool locateTimeWindow(std::string_view data, std::time_t start, std::time_t end,
+                      std::time_t slackSeconds, TimeWindowRange& range);
+
+// The same for several windows ([first, second] each), checking the order where ranges
+// overlap once; ranges[i] is the range of windows[i].
+bool locateTimeWindows(std::string_view data, const std::vector<std::pair<std::time_t, std::time_t>>& windows,
+                       std::time_t slackSeconds, std::vector<TimeWindowRange>& ranges);
+
+#endif // TIME_SEEK_H
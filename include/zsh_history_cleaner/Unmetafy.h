@@ -0,0 +1,22 @@
+#ifndef UNMETAFY_H
+#define UNMETAFY_H
+
+#include <string>
+#include <string_view>
+#include <cstddef> // For size_t
+
+// zsh writes NUL and the bytes it uses internally as tokens (0x83-0xa2, which includes
+// many UTF-8 continuation bytes) to the history file "metafied": as Meta (0x83)
+// followed by the byte XOR 0x20. Filters have to see the real bytes.
+const unsigned char ZSH_META = 0x83;
+
+// Returns the offset of the first Meta byte in text, or text.size() if there is none.
+// Scans 64 bytes per step where SIMD is available.
+size_t findMeta(std::string_view text);
+
+// Returns text with every Meta pair decoded. Text without a Meta byte (almost all of it)
+// is returned as is; otherwise the decoded bytes are written to scratch, which is reused
+// from call to call, and a view of it is returned. A Meta byte ending text stays as is.
+std::string_view unmetafy(std::string_view text, std::string& scratch);
+
+#endif // UNMETAFY_H
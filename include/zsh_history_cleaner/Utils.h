@@ -3,6 +3,7 @@
 
 #include <string>
 #include <ctime>
+#include <cstddef>   // For size_t
 #include <stdexcept> // For runtime_error in dateToEpoch
 
 // Get environment variable safely
@@ -22,6 +23,12 @@ std::time_t nowEpoch();
 // Format epoch time to string (for debugging/output)
 std::string epochToString(std::time_t epoch);
 
+// Random string of [0-9A-Z] characters, used for temp/backup file names
+std::string randomString(size_t length);
+
+// JSON string literal of value: quoted, with '"', '\\' and control characters escaped
+std::string jsonString(const std::string& value);
+
 // Ask Yes/No question
 bool askYesNo(const std::string& prompt, bool defaultYes);
 
@@ -0,0 +1,30 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <string_view>
+#include <cstddef>    // For size_t
+#include <cstdint>    // For uint64_t
+
+// Streaming XXH64 (non-cryptographic, several GB/s), used to recognize content that was
+// already processed. Feeding data in any split yields the same digest as one update().
+class XxHash64 {
+public:
+    explicit XxHash64(uint64_t seed = 0);
+
+    void update(std::string_view data);
+
+    // Digest of everything fed so far; the hash can keep being updated afterwards.
+    uint64_t digest() const;
+
+    // One-shot convenience
+    static uint64_t of(std::string_view data, uint64_t seed = 0);
+
+private:
+    uint64_t acc_[4];
+    uint64_t seed_;
+    uint64_t totalLength_ = 0;
+    unsigned char pending_[32];   // Input not yet consumed as a full 32-byte stripe
+    size_t pendingSize_ = 0;
+};
+
+#endif // XXHASH64_H
@@ -0,0 +1,299 @@
+#include "../../include/zsh_history_cleaner/Archive.h"
+#include "../../include/zsh_history_cleaner/Constants.h"
+#include "../../include/zsh_history_cleaner/HistoryParser.h"
+#include "../../include/zsh_history_cleaner/HistoryReader.h"
+#include "../../include/zsh_history_cleaner/XxHash64.h"
+
+#include <iostream>
+#include <string>
+#include <limits>       // For numeric_limits
+#include <algorithm>    // For std::min, std::max
+#include <cerrno>       // For errno
+#include <cstring>      // For strerror, memcmp
+#include <fcntl.h>      // For open, O_* flags
+#include <unistd.h>     // For read, write, close, fsync, lseek
+#include <sys/file.h>   // For flock
+
+#ifdef ZSH_HISTORY_CLEANER_USE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr char SEGMENT_MAGIC[4] = {'Z', 'H', 'C', 'A'};
+constexpr unsigned char SEGMENT_VERSION = 1;
+constexpr unsigned char CODEC_STORED = 0;
+constexpr unsigned char CODEC_ZSTD = 1;
+constexpr size_t SEGMENT_HEADER_SIZE = 48;   // Up to and including the source path size
+
+void put(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint64_t get(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) value = (value << 8) | in[i];
+    return value;
+}
+
+// Reads exactly size bytes. 1 on success, 0 at end of file before the first byte, -1 on
+// an error or a file ending early (errno set).
+int readExactly(int fd, void* buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = read(fd, static_cast<char*>(buffer) + done, size - done);
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (got == 0) {
+            if (done == 0) return 0;
+            errno = EIO;
+            return -1;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return 1;
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t written = write(fd, data.data() + done, data.size() - done);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Timestamp of a block's header line; false for a block without a valid one
+bool blockTimestamp(const HistoryBlock& block, std::time_t& timestamp) {
+    HistoryHeader header;
+    if (!block.hasHeader ||
+        !parseHistoryHeader(stripLineEnding(block.text.substr(0, block.firstLineLength)), header) ||
+        !header.timestampInRange) {
+        return false;
+    }
+    timestamp = header.timestamp;
+    return true;
+}
+
+} // namespace
+
+bool archiveCompresses() {
+#ifdef ZSH_HISTORY_CLEANER_USE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+ArchiveWriter::~ArchiveWriter() {
+    if (writer_.joinable()) {
+        abandon_.store(true);
+        queue_.push(Segment{std::string(), true});
+        writer_.join();
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+bool ArchiveWriter::open(const fs::path& archive, const fs::path& source, std::ostream& log) {
+    fd_ = ::open(archive.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd_ == -1) {
+        log << "Error: Cannot open archive " << archive.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    path_ = archive;
+    source_ = source.string();
+    current_.reserve(ARCHIVE_SEGMENT_SIZE);
+    writer_ = std::thread(&ArchiveWriter::writeSegments, this);
+    return true;
+}
+
+void ArchiveWriter::add(std::string_view entries) {
+    if (error_.load(std::memory_order_relaxed) != 0) return; // finish() reports it
+    // Stored as the rewrite would have written them, so a restore yields valid history lines
+    forEachNormalizedPiece(entries, [this](std::string_view piece) {
+        current_.append(piece.data(), piece.size());
+        bytesAdded_ += piece.size();
+    });
+    if (current_.size() >= ARCHIVE_SEGMENT_SIZE) {
+        queue_.push(Segment{std::move(current_), false});
+        current_ = std::string();
+        current_.reserve(ARCHIVE_SEGMENT_SIZE);
+    }
+}
+
+bool ArchiveWriter::finish(std::ostream& log) {
+    if (!writer_.joinable()) return false;
+    if (!current_.empty()) {
+        queue_.push(Segment{std::move(current_), false});
+        current_.clear();
+    }
+    queue_.push(Segment{std::string(), true});
+    writer_.join();
+
+    int error = error_.load();
+    if (error == 0 && fsync(fd_) == -1) error = errno;
+    if (close(fd_) == -1 && error == 0) error = errno;
+    fd_ = -1;
+    if (error != 0) {
+        log << "Error: Cannot write archive " << path_.string() << " (" << std::strerror(error) << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ArchiveWriter::writeSegments() {
+    Segment segment;
+    for (queue_.pop(segment); !segment.last; queue_.pop(segment)) {
+        if (abandon_.load() || error_.load() != 0) continue;
+        if (!writeSegment(segment.entries)) {
+            error_.store(errno != 0 ? errno : EIO);
+        }
+    }
+}
+
+bool ArchiveWriter::writeSegment(const std::string& entries) {
+    if (entries.size() > std::numeric_limits<uint32_t>::max()) {
+        errno = EFBIG;
+        return false;
+    }
+    // The time range is what lets a restore skip the segment
+    unsigned long long count = 0;
+    std::time_t first = std::numeric_limits<std::time_t>::max();
+    std::time_t last = std::numeric_limits<std::time_t>::min();
+    HistoryBlockReader reader(entries);
+    HistoryBlock block;
+    while (reader.next(block)) {
+        std::time_t timestamp = 0;
+        if (!blockTimestamp(block, timestamp)) continue;
+        ++count;
+        first = std::min(first, timestamp);
+        last = std::max(last, timestamp);
+    }
+    if (count == 0) first = last = 0;
+
+    unsigned char codec = CODEC_STORED;
+    std::string compressed;
+#ifdef ZSH_HISTORY_CLEANER_USE_ZSTD
+    compressed.resize(ZSTD_compressBound(entries.size()));
+    size_t size = ZSTD_compress(&compressed[0], compressed.size(), entries.data(), entries.size(), ARCHIVE_ZSTD_LEVEL);
+    if (ZSTD_isError(size)) {
+        errno = EIO;
+        return false;
+    }
+    compressed.resize(size);
+    codec = CODEC_ZSTD;
+#endif
+    const std::string& payload = codec == CODEC_STORED ? entries : compressed;
+
+    std::string segment;
+    segment.reserve(SEGMENT_HEADER_SIZE + source_.size() + payload.size());
+    segment.append(SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    put(segment, SEGMENT_VERSION, 1);
+    put(segment, codec, 1);
+    put(segment, 0, 2);
+    put(segment, count, 4);
+    put(segment, static_cast<uint64_t>(static_cast<int64_t>(first)), 8);
+    put(segment, static_cast<uint64_t>(static_cast<int64_t>(last)), 8);
+    put(segment, entries.size(), 4);
+    put(segment, payload.size(), 4);
+    put(segment, XxHash64::of(entries), 8);
+    put(segment, source_.size(), 4);
+    segment += source_;
+    segment += payload;
+
+    // One write per segment, under the lock, so runs sharing the archive never interleave
+    if (flock(fd_, LOCK_EX) == -1) return false;
+    bool ok = writeAll(fd_, segment);
+    int error = errno;
+    flock(fd_, LOCK_UN);
+    errno = error;
+    if (ok) {
+        bytesWritten_ += segment.size();
+    }
+    return ok;
+}
+
+bool extractArchive(const fs::path& archive, std::time_t start, std::time_t end, const std::string& source,
+                    std::ostream& out, std::ostream& log, ArchiveExtractResult& result) {
+    int fd = ::open(archive.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        log << "Error: Cannot open archive " << archive.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    auto failWith = [&](const std::string& reason) {
+        log << "Error: " << reason << " in archive " << archive.string() << " (segment "
+            << result.segments << ")" << std::endl;
+        close(fd);
+        return false;
+    };
+
+    std::string segmentSource;
+    std::string payload;
+    std::string entries;
+    for (;;) {
+        unsigned char header[SEGMENT_HEADER_SIZE];
+        int got = readExactly(fd, header, sizeof(header));
+        if (got == 0) break;
+        if (got == -1) return failWith(std::string("Truncated segment header (") + std::strerror(errno) + ")");
+        ++result.segments;
+        if (std::memcmp(header, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0) return failWith("Bad segment magic");
+        if (header[4] != SEGMENT_VERSION) return failWith("Unsupported segment version");
+        const unsigned char codec = header[5];
+        const std::time_t first = static_cast<std::time_t>(static_cast<int64_t>(get(header + 12, 8)));
+        const std::time_t last = static_cast<std::time_t>(static_cast<int64_t>(get(header + 20, 8)));
+        const size_t rawSize = static_cast<size_t>(get(header + 28, 4));
+        const size_t payloadSize = static_cast<size_t>(get(header + 32, 4));
+        const uint64_t checksum = get(header + 36, 8);
+        const size_t sourceSize = static_cast<size_t>(get(header + 44, 4));
+
+        segmentSource.resize(sourceSize);
+        if (sourceSize > 0 && readExactly(fd, &segmentSource[0], sourceSize) != 1) {
+            return failWith("Truncated segment");
+        }
+        if (last < start || first > end || get(header + 8, 4) == 0 || (!source.empty() && segmentSource != source)) {
+            if (lseek(fd, static_cast<off_t>(payloadSize), SEEK_CUR) == -1) return failWith("Cannot skip segment");
+            continue;
+        }
+
+        payload.resize(payloadSize);
+        if (payloadSize > 0 && readExactly(fd, &payload[0], payloadSize) != 1) {
+            return failWith("Truncated segment");
+        }
+        if (codec == CODEC_STORED) {
+            entries.swap(payload);
+        } else if (codec == CODEC_ZSTD) {
+#ifdef ZSH_HISTORY_CLEANER_USE_ZSTD
+            entries.resize(rawSize);
+            size_t size = ZSTD_decompress(&entries[0], entries.size(), payload.data(), payload.size());
+            if (ZSTD_isError(size) || size != rawSize) return failWith("Corrupt compressed segment");
+#else
+            return failWith("zstd-compressed segment (this build has no ZSH_HISTORY_CLEANER_USE_ZSTD)");
+#endif
+        } else {
+            return failWith("Unknown segment codec");
+        }
+        if (entries.size() != rawSize || XxHash64::of(entries) != checksum) return failWith("Checksum mismatch");
+        ++result.segmentsRead;
+
+        HistoryBlockReader reader(entries);
+        HistoryBlock block;
+        while (reader.next(block)) {
+            std::time_t timestamp = 0;
+            if (!blockTimestamp(block, timestamp) || timestamp < start || timestamp > end) continue;
+            out.write(block.text.data(), static_cast<std::streamsize>(block.text.size()));
+            ++result.entries;
+        }
+    }
+    close(fd);
+    return true;
+}
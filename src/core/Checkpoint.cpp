@@ -0,0 +1,187 @@
+#include "../../include/zsh_history_cleaner/Checkpoint.h"
+#include "../../include/zsh_history_cleaner/BufferedWriter.h"
+#include "../../include/zsh_history_cleaner/CleanupRegistry.h"
+#include "../../include/zsh_history_cleaner/Utils.h"
+#include "../../include/zsh_history_cleaner/XxHash64.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <cerrno>      // For errno
+#include <cstring>     // For strerror
+#include <cstdlib>     // For strtoull, strtoll
+
+namespace {
+
+const char* const CHECKPOINT_MAGIC = "zsh_history_cleaner checkpoint v1";
+const size_t CHECKPOINT_MAX_SIZE = 64 * 1024; // Room for a window per policy rule
+
+std::string hex64(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i, value >>= 4) {
+        text[static_cast<size_t>(i)] = digits[value & 0xF];
+    }
+    return text;
+}
+
+// Parses the whole of text as a number in base; false on anything else
+bool parseUnsigned(const std::string& text, int base, uint64_t& value) {
+    if (text.empty() || text[0] == '-' || text[0] == '+') return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, base);
+    if (errno != 0 || *end != '\0') return false;
+    value = parsed;
+    return true;
+}
+
+bool parseSigned(const std::string& text, std::time_t& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') return false;
+    value = static_cast<std::time_t>(parsed);
+    return true;
+}
+
+} // namespace
+
+fs::path checkpointPath(const fs::path& historyFile) {
+    return historyFile.parent_path() / (historyFile.filename().string() + ".cleaner-checkpoint");
+}
+
+bool loadCheckpoint(const fs::path& historyFile, HistoryCheckpoint& checkpoint) {
+    std::ifstream in(checkpointPath(historyFile));
+    if (!in) return false;
+
+    std::string line;
+    if (!std::getline(in, line) || line != CHECKPOINT_MAGIC) return false;
+
+    // Every field must be present exactly once, except for the optional rule windows
+    HistoryCheckpoint parsed;
+    unsigned seen = 0;
+    size_t read = line.size();
+    while (std::getline(in, line)) {
+        read += line.size() + 1;
+        if (read > CHECKPOINT_MAX_SIZE) return false;
+        std::istringstream fields(line);
+        std::string key, first, second, extra;
+        fields >> key >> first >> second >> extra;
+        if (!extra.empty()) return false;
+        bool ok;
+        unsigned bit;
+        if (key == "offset") {
+            ok = second.empty() && parseUnsigned(first, 10, parsed.offset);
+            bit = 1;
+        } else if (key == "prefix_xxh64") {
+            ok = second.empty() && first.size() == 16 && parseUnsigned(first, 16, parsed.prefixHash);
+            bit = 2;
+        } else if (key == "window") {
+            ok = parseSigned(first, parsed.startTimestamp) && parseSigned(second, parsed.endTimestamp);
+            bit = 4;
+        } else if (key == "filters") {
+            ok = second.empty() && first.size() == 16 && parseUnsigned(first, 16, parsed.filterFingerprint);
+            bit = 8;
+        } else if (key == "rule_window") {
+            std::pair<std::time_t, std::time_t> window;
+            if (!parseSigned(first, window.first) || !parseSigned(second, window.second)) return false;
+            parsed.ruleWindows.push_back(window);
+            continue;
+        } else {
+            return false;
+        }
+        if (!ok || (seen & bit) != 0) return false;
+        seen |= bit;
+    }
+    if (seen != 15) return false;
+    checkpoint = parsed;
+    return true;
+}
+
+bool saveCheckpoint(const fs::path& historyFile, const HistoryCheckpoint& checkpoint, std::ostream& log) {
+    const fs::path path = checkpointPath(historyFile);
+    std::string text = std::string(CHECKPOINT_MAGIC) + "\n"
+        + "offset " + std::to_string(checkpoint.offset) + "\n"
+        + "prefix_xxh64 " + hex64(checkpoint.prefixHash) + "\n"
+        + "window " + std::to_string(static_cast<long long>(checkpoint.startTimestamp)) + " "
+        + std::to_string(static_cast<long long>(checkpoint.endTimestamp)) + "\n"
+        + "filters " + hex64(checkpoint.filterFingerprint) + "\n";
+    for (const auto& window : checkpoint.ruleWindows) {
+        text += "rule_window " + std::to_string(static_cast<long long>(window.first)) + " "
+            + std::to_string(static_cast<long long>(window.second)) + "\n";
+    }
+
+    // Written next to the checkpoint and renamed over it, so readers never see a torn file
+    BufferedFileWriter writer(text.size());
+    fs::path tempPath;
+    int slot = -1;
+    for (int attempt = 0; attempt < 8 && tempPath.empty(); ++attempt) {
+        fs::path candidate = path.parent_path() / (path.filename().string() + "." + randomString(8));
+        slot = registerTempFile(candidate);
+        if (slot == -1) break;
+        if (writer.create(candidate, log)) {
+            tempPath = candidate;
+        } else {
+            int error = errno;
+            unregisterTempFile(slot);
+            slot = -1;
+            if (error != EEXIST) break;
+        }
+    }
+    if (tempPath.empty()) {
+        log << "Warning: Cannot create checkpoint file: " << path.string() << std::endl;
+        return false;
+    }
+
+    std::error_code ec;
+    if (!writer.write(text) || !writer.close(false)) {
+        log << "Warning: Cannot write checkpoint file: " << path.string()
+            << " (" << std::strerror(writer.lastError()) << ")" << std::endl;
+        fs::remove(tempPath, ec);
+        unregisterTempFile(slot);
+        return false;
+    }
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        log << "Warning: Cannot replace checkpoint file: " << path.string() << " (" << ec.message() << ")" << std::endl;
+        fs::remove(tempPath, ec);
+        unregisterTempFile(slot);
+        return false;
+    }
+    unregisterTempFile(slot);
+    return true;
+}
+
+uint64_t filterFingerprint(const std::vector<std::string>& keywords,
+                           const std::vector<std::string>& regexes, bool whitelist,
+                           const std::vector<PolicyRule>& rules, bool multiline) {
+    // Length-prefixed, so no two different lists serialize alike
+    XxHash64 hash;
+    auto addList = [&hash](char tag, const std::vector<std::string>& list) {
+        std::string header = std::string(1, tag) + std::to_string(list.size()) + ":";
+        hash.update(header);
+        for (const std::string& item : list) {
+            std::string length = std::to_string(item.size()) + ":";
+            hash.update(length);
+            hash.update(item);
+        }
+    };
+    addList('k', keywords);
+    addList('r', regexes);
+    hash.update(whitelist ? "w1" : "w0");
+    hash.update(multiline ? "m1" : "m0"); // Filters see continuation lines joined
+    if (!rules.empty()) {
+        std::string count = "p" + std::to_string(rules.size()) + ":";
+        hash.update(count);
+        for (const PolicyRule& rule : rules) {
+            hash.update(rule.deleteMatches ? "d" : "k");
+            addList('k', rule.keywords);
+            addList('r', rule.regexes);
+        }
+    }
+    return hash.digest();
+}
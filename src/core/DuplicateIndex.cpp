@@ -0,0 +1,106 @@
+#include "../../include/zsh_history_cleaner/DuplicateIndex.h"
+#include "../../include/zsh_history_cleaner/Constants.h"
+#include "../../include/zsh_history_cleaner/XxHash64.h"
+
+#include <algorithm>   // For std::fill
+#include <cstring>     // For memcmp, memcpy
+
+const char* dedupModeName(DedupMode mode) {
+    switch (mode) {
+        case DedupMode::None:      return "none";
+        case DedupMode::KeepFirst: return "keep-first";
+        case DedupMode::KeepLast:  return "keep-last";
+    }
+    return "unknown";
+}
+
+DuplicateIndex::DuplicateIndex(DedupMode mode, bool copies)
+    : mode_(mode), slots_(DEDUP_INITIAL_SLOTS), copies_(copies) {}
+
+void DuplicateIndex::startRecording() {
+    recording_ = true;
+    entries_ = 0;
+}
+
+void DuplicateIndex::startPass() {
+    recording_ = false;
+    entries_ = 0;
+    if (mode_ == DedupMode::KeepFirst && used_ != 0) {
+        std::fill(slots_.begin(), slots_.end(), Slot());
+        used_ = 0;
+        arena_.clear();
+        arenaFree_ = 0;
+    }
+}
+
+bool DuplicateIndex::isDuplicate(std::string_view command) {
+    const unsigned long long entry = entries_++;
+    if (command.data() == nullptr) command = std::string_view("", 0); // Null marks an empty slot
+    const uint64_t hash = XxHash64::of(command);
+    Slot* slot = &find(command, hash);
+
+    if (slot->data == nullptr) {
+        // First entry of this command. Under KeepLast, only the recording pass adds any:
+        // an unrecorded one was appended after it, and is the newest by definition.
+        if (mode_ == DedupMode::KeepLast && !recording_) return false;
+        if ((used_ + 1) * 4 > slots_.size() * 3) {
+            grow();
+            slot = &find(command, hash);
+        }
+        slot->hash = hash;
+        slot->data = copies_ ? store(command) : command.data();
+        slot->size = command.size();
+        slot->last = entry;
+        ++used_;
+        return false;
+    }
+
+    if (mode_ == DedupMode::KeepFirst) return true;
+    if (recording_) {
+        slot->last = entry;
+        return false;
+    }
+    return entry < slot->last;
+}
+
+DuplicateIndex::Slot& DuplicateIndex::find(std::string_view command, uint64_t hash) {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+        Slot& slot = slots_[i];
+        if (slot.data == nullptr) return slot;
+        if (slot.hash == hash && slot.size == command.size() &&
+            std::memcmp(slot.data, command.data(), command.size()) == 0) {
+            return slot;
+        }
+    }
+}
+
+void DuplicateIndex::grow() {
+    std::vector<Slot> old(slots_.size() * 2);
+    old.swap(slots_);
+    const size_t mask = slots_.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.data == nullptr) continue;
+        size_t i = static_cast<size_t>(slot.hash) & mask;
+        while (slots_[i].data != nullptr) i = (i + 1) & mask;
+        slots_[i] = slot;
+    }
+}
+
+const char* DuplicateIndex::store(std::string_view command) {
+    if (command.size() > DEDUP_ARENA_BLOCK_SIZE / 4) {
+        // A long command gets a block of its own; what the current one had left goes unused
+        arena_.push_back(std::make_unique<char[]>(command.size() + 1));
+        arenaFree_ = 0;
+        std::memcpy(arena_.back().get(), command.data(), command.size());
+        return arena_.back().get();
+    }
+    if (arenaFree_ < command.size() + 1) {
+        arena_.push_back(std::make_unique<char[]>(DEDUP_ARENA_BLOCK_SIZE));
+        arenaFree_ = DEDUP_ARENA_BLOCK_SIZE;
+    }
+    char* copy = arena_.back().get() + (DEDUP_ARENA_BLOCK_SIZE - arenaFree_);
+    std::memcpy(copy, command.data(), command.size());
+    arenaFree_ -= command.size() + 1; // Never empty: an empty command still needs a non-null pointer
+    return copy;
+}
@@ -1,11 +1,18 @@
 #include "../../include/zsh_history_cleaner/HistoryCleaner.h"
+#include "../../include/zsh_history_cleaner/HistoryEngine.h"
 #include "../../include/zsh_history_cleaner/Constants.h"
 #include "../../include/zsh_history_cleaner/Utils.h"
-#include "../../include/zsh_history_cleaner/SecureDelete.h"
+#include "../../include/zsh_history_cleaner/RegexMatcher.h"
+#include "../../include/zsh_history_cleaner/CleanupRegistry.h"
+#include "../../include/zsh_history_cleaner/HistoryWatcher.h"
+#include "../../include/zsh_history_cleaner/Archive.h"
+#include "../../include/zsh_history_cleaner/ShredQueue.h"
+#include "../../include/zsh_history_cleaner/Progress.h"
 
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <filesystem>
 #include <chrono>
@@ -13,9 +20,10 @@
 #include <regex>
 #include <stdexcept>
 #include <system_error>
-#include <csignal>
-#include <unistd.h>     // For geteuid, access
+#include <unistd.h>     // For geteuid, access, close
+#include <fcntl.h>      // For open, O_RDWR
 #include <sys/stat.h>   // For access mode constants
+#include <sys/wait.h>   // For waitpid
 #include <cstdio>       // For std::remove
 #include <cstdlib>      // For std::exit
 #include <limits>       // For numeric_limits
@@ -23,118 +31,73 @@
 #include <random>       // For random_device, mt19937
 #include <cstring>      // For strerror
 #include <cerrno>       // For errno
+#include <algorithm>    // For std::count, std::min, std::max
+#include <sstream>      // For per-file batch output buffers
+#include <thread>       // For std::thread
+#include <atomic>       // For std::atomic (batch work queue)
+#include <mutex>        // For std::mutex, std::lock_guard
+#include <set>          // For de-duplicating batch paths
+#include <glob.h>       // For glob (--histfile-glob)
 
 namespace fs = std::filesystem;
 
-// Define the static member variable
-HistoryCleaner* HistoryCleaner::g_cleaner_instance = nullptr;
-
 // --- Constructor ---
 HistoryCleaner::HistoryCleaner(int argc, char* argv[]) {
     // Initialize shred passes from constant
     shredPasses_ = SHRED_PASSES;
-
-    // Basic regex for Zsh history: : <timestamp>:<duration>;<command>
-    // Allows optional spaces around ':' and ';'
-    // Captures the timestamp (group 1)
-    try {
-         // Make regex slightly more robust to leading/trailing whitespace on line
-         historyEntryRegex_ = std::regex(R"(^\s*:\s*(\d+):\d+\s*;.*$)");
-    } catch (const std::regex_error& e) {
-         // Use errorExit from Utils.h
-         errorExit(std::string("Regex compilation failed: ") + e.what());
-    }
+    stats_.start();
 
     parseArguments(argc, argv); // Parse arguments first
-    resolveHistoryPath();       // Then resolve path based on potential --histfile arg
-    checkPermissions();         // Check permissions early before potentially lengthy operations
-
-    g_cleaner_instance = this; // Set global instance for signal handler
-    setupSignalHandlers();
-}
-
-// --- Destructor ---
-HistoryCleaner::~HistoryCleaner() {
-    cleanup();
-    g_cleaner_instance = nullptr; // Clear global instance
-}
-
-// --- Resource Management ---
-void HistoryCleaner::cleanup() {
-    // Clean up any temporary files that may exist
-    try {
-        std::error_code ec;
-        
-        // Clean up temporary processing file if it exists
-        if (!tempFilePath_.empty() && fs::exists(tempFilePath_, ec)) {
-            fs::remove(tempFilePath_, ec);
-            if (ec) {
-                std::cerr << "Warning: Failed to remove temporary file: " << tempFilePath_.string()
-                         << " (" << ec.message() << ")" << std::endl;
-            }
-            tempFilePath_.clear();
-        }
-
-        // Note: We don't automatically clean up backup files as they should be preserved
-        // The user might want to recover from them in case of issues
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error during cleanup: " << e.what() << std::endl;
-    } catch (...) {
-        std::cerr << "Unknown error during cleanup" << std::endl;
+    if (drainShredQueue_ || streamIn_) {
+        // Works on the queue, or on stdin, alone
+    } else if (streamOut_) {
+        PhaseTimer timer(statsTarget(), RunPhase::Resolve);
+        resolveHistoryPath(); // Only read, so only the open has to succeed
+    } else if (!extractPath_.empty()) {
+        // Only reads the archive; the history file is just a name to select segments by
+        if (histfileGiven_) resolveHistoryPath();
+    } else if (histfileLists_.empty() && histfileGlobs_.empty()) {
+        PhaseTimer timer(statsTarget(), RunPhase::Resolve);
+        resolveHistoryPath();   // Then resolve path based on potential --histfile arg
+        checkPermissions();     // Check permissions early before potentially lengthy operations
     }
-}
 
-void HistoryCleaner::cleanupAndExit(int signal) {
-    const char* signame = "";
-    switch (signal) {
-        case SIGINT:  signame = "SIGINT";  break;
-        case SIGTERM: signame = "SIGTERM"; break;
-        case SIGHUP:  signame = "SIGHUP";  break;
-        default:      signame = "Unknown";  break;
-    }
-    
-    // Use write() for signal safety
-    const char msg[] = "\nReceived signal: ";
-    write(STDERR_FILENO, msg, sizeof(msg) - 1);
-    write(STDERR_FILENO, signame, strlen(signame));
-    write(STDERR_FILENO, "\nCleaning up...\n", 15);
-
-    cleanup();  // Clean up resources
-
-    // Reset signal to default handler and re-raise
-    std::signal(signal, SIG_DFL);
-    raise(signal);
+    setupSignalHandlers();
 }
 
 // --- Signal Handling ---
 void HistoryCleaner::setupSignalHandlers() {
-    std::signal(SIGINT, HistoryCleaner::staticSignalHandler);  // Ctrl+C
-    std::signal(SIGTERM, HistoryCleaner::staticSignalHandler); // Termination request
-    std::signal(SIGHUP, HistoryCleaner::staticSignalHandler);  // Hangup
+    installTerminationHandlers(); // SIGINT, SIGTERM, SIGHUP
+    installProgressHandler();     // SIGUSR1
 }
 
-void HistoryCleaner::staticSignalHandler(int signal) {
-    if (g_cleaner_instance) {
-        g_cleaner_instance->interrupted_ = 1; // Set the flag (volatile ensures visibility)
-        g_cleaner_instance->cleanupAndExit(signal); // Perform cleanup and exit
-    } else {
-        const char msg[] = "\nTermination signal received, but no active cleaner instance. Forcing exit.\n";
-        write(STDERR_FILENO, msg, sizeof(msg) - 1); // Use write for signal safety
-        _Exit(128 + signal); // Use _Exit for signal safety
-    }
+bool HistoryCleaner::interrupted() {
+    return terminationRequested();
 }
 
 // --- Core Logic ---
 void HistoryCleaner::run() {
     // Check interruption flag at the beginning
-    if (interrupted_) {
+    if (interrupted()) {
         std::cerr << "Interrupted before starting main execution. Exiting." << std::endl;
         return;
     }
 
+    ProgressReporter progress(progress_); // --progress: lines on stderr until the run ends
     try {
-        if (interactive_) {
+        if (drainShredQueue_) {
+            runShredQueue();
+        } else if (streamIn_ || streamOut_) {
+            runStream();
+        } else if (!extractPath_.empty()) {
+            runExtract();
+        } else if (!mergeInputs_.empty()) {
+            runMerge();
+        } else if (!histfileLists_.empty() || !histfileGlobs_.empty()) {
+            runBatch();
+        } else if (watch_) {
+            runWatch();
+        } else if (interactive_) {
             runInteractive();
         } else {
             runNonInteractive();
@@ -148,7 +111,7 @@ void HistoryCleaner::run() {
     }
 
     // Check interruption flag again at the end
-     if (interrupted_) {
+     if (interrupted()) {
         std::cerr << "Operation interrupted during execution." << std::endl;
     }
 }
@@ -162,38 +125,494 @@ void HistoryCleaner::runNonInteractive() {
     } catch (const std::exception& e) {
         errorExit(std::string("Error calculating timestamps: ") + e.what());
     }
+    configureEngine();
 
     // Check for interruption after potentially slow date parsing
-    if (interrupted_) { std::cerr << "Interrupted after timestamp calculation.\n"; return; }
+    if (interrupted()) { std::cerr << "Interrupted after timestamp calculation.\n"; return; }
 
-    std::cout << "Processing entries between: " << epochToString(startTimestamp_)
-              << " and " << epochToString(endTimestamp_) << std::endl;
+    printSelection(std::cout);
 
     if (dryRun_) {
         std::cout << "\n--- Dry Run Mode ---" << std::endl;
-        if (!processHistory(std::cout)) { // Process and print to cout
+        if (!cleanHistoryFile()) { // Process and print to cout
              errorExit("Dry run failed during history processing.");
         }
         std::cout << "--- End Dry Run ---" << std::endl;
     } else {
         // Process history, writing kept entries to temp file
-        std::ofstream null_stream; // Effectively /dev/null for processHistory output
-        null_stream.setstate(std::ios_base::badbit); // Ensure it's not writable
-
-        if (!processHistory(null_stream)) {
+        if (!cleanHistoryFile()) {
              errorExit("Failed to process history file.");
         }
 
         // Check for interruption after processing
-        if (interrupted_) { std::cerr << "Interrupted after processing history.\n"; return; }
+        if (interrupted()) { std::cerr << "Interrupted after processing history.\n"; return; }
 
         std::cout << "History cleaning complete." << std::endl;
     }
 }
 
+namespace {
+
+// What a pass of --watch left the history file as, to tell its own writes from the shell's
+struct FileIdentity {
+    bool valid = false;
+    dev_t device = 0;
+    ino_t inode = 0;
+    off_t size = 0;
+    struct timespec modified = {0, 0};
+
+    bool operator==(const FileIdentity& other) const {
+        return valid && other.valid && device == other.device && inode == other.inode &&
+               size == other.size && modified.tv_sec == other.modified.tv_sec &&
+               modified.tv_nsec == other.modified.tv_nsec;
+    }
+};
+
+FileIdentity identify(const fs::path& path) {
+    FileIdentity identity;
+    struct stat info;
+    if (::stat(path.c_str(), &info) == 0) {
+        identity.valid = true;
+        identity.device = info.st_dev;
+        identity.inode = info.st_ino;
+        identity.size = info.st_size;
+        identity.modified = info.st_mtim;
+    }
+    return identity;
+}
+
+} // namespace
+
+void HistoryCleaner::printSelection(std::ostream& out) const {
+    if (dedupOnly() && dedup_ == DedupMode::None) {
+        out << "Merging only; no entry is deleted." << std::endl;
+    } else if (dedupOnly()) {
+        out << "Deleting repeated commands only." << std::endl;
+    } else if (policyRules_.empty()) {
+        out << "Processing entries between: " << epochToString(startTimestamp_)
+                  << " and " << epochToString(endTimestamp_) << std::endl;
+    }
+    for (const PolicyRule& rule : policyRules_) {
+        out << "Policy rule '" << rule.name << "' (" << (rule.deleteMatches ? "delete" : "keep")
+                  << ", priority " << rule.priority << "): entries between " << epochToString(rule.startTimestamp)
+                  << " and " << epochToString(rule.endTimestamp) << std::endl;
+    }
+    if (dedup_ != DedupMode::None) {
+        out << "Duplicates: of the entries kept, only the "
+                  << (dedup_ == DedupMode::KeepFirst ? "first" : "last") << " of each command stays ("
+                  << dedupModeName(dedup_) << ")." << std::endl;
+    }
+}
+
+void HistoryCleaner::runWatch() {
+    std::cout << "Running in watch mode." << std::endl;
+    std::cout << "History file: " << effectiveHistoryFilePath_.string() << std::endl;
+
+    // Watching starts before the first pass, so nothing written during it is missed
+    HistoryWatcher watcher;
+    if (!watcher.open(effectiveHistoryFilePath_, std::cerr)) {
+        errorExit("Cannot watch the history file.");
+    }
+
+    try {
+        calculateTimestamps();
+    } catch (const std::exception& e) {
+        errorExit(std::string("Error calculating timestamps: ") + e.what());
+    }
+    configureEngine();
+
+    // Runs until a termination signal ends the process (between passes, or once the
+    // current one has left the history file consistent)
+    for (bool first = true;; first = false) {
+        if (!first && statsTarget() != nullptr) {
+            stats_ = RunStats(); // One report per pass
+            stats_.start();
+        }
+        std::cout << "Watch: cleaning at " << epochToString(nowEpoch()) << std::endl;
+        if (!cleanHistoryFile()) {
+            std::cerr << "Warning: Cleaning failed; trying again after the next change." << std::endl;
+        }
+        std::cout << std::flush;
+
+        // The pass's own writes raise events too; they are told apart by the file being
+        // exactly as the pass left it
+        const FileIdentity cleaned = identify(effectiveHistoryFilePath_);
+        do {
+            if (!watcher.waitForChange(std::cerr)) {
+                errorExit("Watching the history file failed.");
+            }
+        } while (identify(effectiveHistoryFilePath_) == cleaned);
+
+        // Windows relative to now (older_than, last_7_days, ...) move with the clock
+        calculateTimestamps();
+        if (!policyRules_.empty()) {
+            updatePolicyWindows();
+        } else {
+            std::string error;
+            if (!engine_.setTimeWindow(startTimestamp_, endTimestamp_, error)) {
+                errorExit(error);
+            }
+        }
+    }
+}
+
+void HistoryCleaner::runStream() {
+    // stdout carries the filtered history, so everything else goes to stderr
+    try {
+        calculateTimestamps();
+    } catch (const std::exception& e) {
+        errorExit(std::string("Error calculating timestamps: ") + e.what());
+    }
+    configureEngine();
+    printSelection(std::cerr);
+
+    int inFd = STDIN_FILENO;
+    fs::path source = "(stdin)";
+    if (!streamIn_) {
+        source = effectiveHistoryFilePath_;
+        inFd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        if (inFd == -1) {
+            errorExit("Cannot open " + source.string() + " (" + std::strerror(errno) + ")");
+        }
+    }
+
+    CleanOptions options;
+    options.info = &std::cerr;
+    options.log = &std::cerr;
+    options.listing = dryRun_ ? &std::cerr : nullptr;
+    options.stats = statsTarget();
+    std::cout << std::flush; // The engine writes to the descriptor itself
+    CleanResult result = engine_.filter(inFd, STDOUT_FILENO, source, options);
+    if (inFd != STDIN_FILENO) close(inFd);
+    if (result.ok && dryRun_) {
+        printReport(std::cerr, source, result);
+    }
+    if (options.stats != nullptr) {
+        stats_.file = source.string();
+        stats_.files = 1;
+        stats_.ok = result.ok;
+        stats_.lines = result.lines;
+        stats_.kept = result.kept;
+        stats_.deleted = result.deleted;
+        reportStats(stats_);
+    }
+    if (!result.ok) {
+        errorExit(result.error);
+    }
+}
+
+void HistoryCleaner::runMerge() {
+    std::cout << "Running in merge mode." << std::endl;
+    std::cout << "History file: " << effectiveHistoryFilePath_.string() << std::endl;
+    try {
+        calculateTimestamps();
+    } catch (const std::exception& e) {
+        errorExit(std::string("Error calculating timestamps: ") + e.what());
+    }
+    configureEngine();
+    printSelection(std::cout);
+    std::cout << "Merging " << mergeInputs_.size() << " histories into the history file." << std::endl;
+    if (dryRun_) {
+        std::cout << "\n--- Dry Run Mode ---" << std::endl;
+    }
+
+    CleanOptions options;
+    options.info = &std::cout;
+    options.log = &std::cerr;
+    options.listing = dryRun_ ? &std::cout : nullptr;
+    options.stats = statsTarget();
+    CleanResult result = engine_.merge(mergeInputs_, effectiveHistoryFilePath_, options);
+    if (result.ok && dryRun_) {
+        printReport(std::cout, effectiveHistoryFilePath_, result);
+    }
+    if (result.shredQueued) {
+        startShredDrainer();
+    }
+    if (options.stats != nullptr) {
+        stats_.file = effectiveHistoryFilePath_.string();
+        stats_.files = mergeInputs_.size();
+        stats_.ok = result.ok;
+        stats_.lines = result.lines;
+        stats_.kept = result.kept;
+        stats_.deleted = result.deleted;
+        reportStats(stats_);
+    }
+    if (!result.ok) {
+        errorExit(result.error);
+    }
+    std::cout << (dryRun_ ? "--- End Dry Run ---" : "History merge complete.") << std::endl;
+}
+
+void HistoryCleaner::runShredQueue() {
+    // The default history's record of an original a killed run left behind, if any (runs on
+    // other history files find theirs themselves)
+    resolveHistoryPath();
+    bool recovered = recoverPendingShred(effectiveHistoryFilePath_, false, std::cout, std::cerr);
+
+    const fs::path queueDir = defaultShredQueueDir();
+    ShredQueueResult result;
+    bool ok = drainShredQueue(queueDir, std::cerr, result) && recovered;
+    if (result.busy) {
+        std::cout << "Shred queue: another --shred-queue is working through " << queueDir.string() << "." << std::endl;
+    }
+    std::cout << "Shred queue: " << result.shredded << " files shredded, " << result.stale
+              << " already gone, " << result.failed << " failed." << std::endl;
+    if (interrupted()) { std::cerr << "Interrupted; the rest stays queued.\n"; return; }
+    if (!ok) {
+        errorExit("Some queued files could not be shredded; they stay queued.");
+    }
+}
+
+void HistoryCleaner::startShredDrainer() {
+    // Double fork: the drainer is reparented to init, in a session of its own, so neither
+    // this process exiting nor the terminal closing stops it. Between fork() and exec only
+    // async-signal-safe calls are made (batch mode has threads running).
+    std::cout << std::flush;
+    pid_t child = fork();
+    if (child == 0) {
+        setsid();
+        if (fork() == 0) {
+            int null = ::open("/dev/null", O_RDWR);
+            if (null != -1) {
+                dup2(null, STDIN_FILENO);
+                dup2(null, STDOUT_FILENO);
+                dup2(null, STDERR_FILENO);
+            }
+            execl("/proc/self/exe", "zsh_history_cleaner", "--shred-queue", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        _exit(0);
+    }
+    int status = 0;
+    if (child == -1 || waitpid(child, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Warning: Cannot start the background shredder; run --shred-queue to shred the queued files." << std::endl;
+        return;
+    }
+    std::cout << "Shredding continues in the background (queue: " << defaultShredQueueDir().string() << ")." << std::endl;
+}
+
+void HistoryCleaner::runExtract() {
+    try {
+        calculateTimestamps();
+    } catch (const std::exception& e) {
+        errorExit(std::string("Error calculating timestamps: ") + e.what());
+    }
+    // stdout carries nothing but the entries, so it can be redirected into a history file
+    std::cerr << "Extracting entries between " << epochToString(startTimestamp_) << " and "
+              << epochToString(endTimestamp_) << " from " << extractPath_.string() << std::endl;
+
+    ArchiveExtractResult result;
+    const std::string source = histfileGiven_ ? effectiveHistoryFilePath_.string() : std::string();
+    bool ok = extractArchive(extractPath_, startTimestamp_, endTimestamp_, source, std::cout, std::cerr, result);
+    std::cout << std::flush;
+    std::cerr << "Archive: " << result.segmentsRead << " of " << result.segments << " segments read, "
+              << result.entries << " entries extracted." << std::endl;
+    if (!ok || !std::cout) {
+        errorExit("Failed to extract the archive.");
+    }
+}
+
+std::vector<fs::path> HistoryCleaner::collectBatchFiles() const {
+    std::vector<std::string> candidates;
+    for (const std::string& listPath : histfileLists_) {
+        std::ifstream list(listPath);
+        if (!list) {
+            errorExit("Cannot read history file list: " + listPath);
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#') {
+                candidates.push_back(line);
+            }
+        }
+    }
+    for (const std::string& pattern : histfileGlobs_) {
+        glob_t matches;
+        int rc = glob(pattern.c_str(), 0, nullptr, &matches);
+        if (rc == 0) {
+            for (size_t i = 0; i < matches.gl_pathc; ++i) {
+                candidates.push_back(matches.gl_pathv[i]);
+            }
+        } else if (rc != GLOB_NOMATCH) {
+            std::cerr << "Warning: Failed to expand glob pattern: " << pattern << std::endl;
+        }
+        globfree(&matches);
+    }
+
+    // The same file listed twice (or reached through a symlink) must not be processed twice
+    // concurrently, so paths are compared after resolution.
+    std::vector<fs::path> files;
+    std::set<std::string> seen;
+    for (const std::string& candidate : candidates) {
+        std::error_code ec;
+        fs::path resolved = fs::weakly_canonical(candidate, ec);
+        if (ec) {
+            ec.clear();
+            resolved = fs::absolute(candidate, ec);
+            if (ec) resolved = candidate;
+        }
+        if (!fs::exists(resolved, ec)) {
+            std::cerr << "Warning: Skipping missing history file: " << candidate << std::endl;
+            continue;
+        }
+        if (seen.insert(resolved.string()).second) {
+            files.push_back(resolved);
+        }
+    }
+    return files;
+}
+
+bool HistoryCleaner::checkBatchFile(const fs::path& historyPath, std::ostream& log) const {
+    std::error_code ec;
+    auto status = fs::status(historyPath, ec);
+    if (ec || !fs::is_regular_file(status)) {
+        log << "Error: History file path is not a regular file: " << historyPath.string() << std::endl;
+        return false;
+    }
+    if (access(historyPath.c_str(), R_OK | W_OK) != 0) {
+        log << "Error: Cannot read and write history file (check permissions): " << historyPath.string()
+            << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    fs::path parentDir = historyPath.parent_path();
+    if (access(parentDir.c_str(), W_OK) != 0) {
+        log << "Error: Cannot write to history file directory (check permissions): " << parentDir.string()
+            << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void HistoryCleaner::runBatch() {
+    std::vector<fs::path> files = collectBatchFiles();
+    if (files.empty()) {
+        errorExit("No history files found for --histfile-list / --histfile-glob.");
+    }
+
+    try {
+        calculateTimestamps(); // Calculate based on command-line args
+    } catch (const std::exception& e) {
+        errorExit(std::string("Error calculating timestamps: ") + e.what());
+    }
+    configureEngine(); // Once, shared read-only by all workers
+
+    size_t workers = jobs_ > 0 ? static_cast<size_t>(jobs_) : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::min({workers, files.size(), MAX_TRACKED_TEMP_FILES});
+    int ioJobs = ioJobs_ > 0 ? ioJobs_ : BATCH_IO_JOBS;
+
+    std::cout << "Running in batch mode: " << files.size() << " history files, "
+              << workers << " worker(s), " << ioJobs << " I/O slot(s)." << std::endl;
+    printSelection(std::cout);
+
+    // Each file's messages are buffered and printed as one block when it finishes
+    struct BatchEntry {
+        std::ostringstream info;
+        std::ostringstream log;
+        CleanResult result;
+        RunStats stats;
+    };
+    std::vector<BatchEntry> entries(files.size());
+    IoLimiter ioLimiter(ioJobs);
+    std::atomic<size_t> nextFile{0};
+    std::mutex printMutex;
+
+    auto worker = [&]() {
+        while (!interrupted()) {
+            size_t index = nextFile.fetch_add(1);
+            if (index >= entries.size()) break;
+
+            BatchEntry& entry = entries[index];
+            RunStats* stats = statsFormat_ == StatsFormat::NONE ? nullptr : &entry.stats;
+            PhaseTimer checkTimer(stats, RunPhase::Resolve);
+            bool usable = checkBatchFile(files[index], entry.log);
+            checkTimer.stop();
+            if (usable) {
+                CleanOptions options;
+                options.info = &entry.info;
+                options.log = &entry.log;
+                options.listing = dryRun_ ? &entry.info : nullptr;
+                options.ioLimiter = &ioLimiter;
+                options.stats = stats;
+                entry.result = engine_.clean(files[index], options);
+                if (entry.result.ok && dryRun_) {
+                    printReport(entry.info, files[index], entry.result);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(printMutex);
+            std::cout << "\n==> " << files[index].string() << " <==\n" << entry.info.str() << std::flush;
+            std::string log = entry.log.str();
+            if (!log.empty()) {
+                std::cerr << "==> " << files[index].string() << " <==\n" << log << std::flush;
+            }
+            entry.info.str(std::string());
+            entry.log.str(std::string());
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto& thread : pool) thread.join();
+
+    // --- Aggregated summary ---
+    CleanResult totals;
+    std::vector<const fs::path*> failed;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const CleanResult& result = entries[i].result;
+        if (!result.ok) {
+            failed.push_back(&files[i]);
+            continue;
+        }
+        totals.lines += result.lines;
+        totals.kept += result.kept;
+        totals.deleted += result.deleted;
+        totals.duplicates += result.duplicates;
+        totals.shredQueued = totals.shredQueued || result.shredQueued;
+    }
+    if (totals.shredQueued) {
+        startShredDrainer(); // One for the whole batch
+    }
+    if (RunStats* stats = statsTarget()) {
+        // Phases of files processed concurrently overlap, so their sums can exceed the total
+        for (BatchEntry& entry : entries) {
+            entry.stats.files = 1;
+            entry.stats.ok = entry.result.ok;
+            entry.stats.lines = entry.result.lines;
+            entry.stats.kept = entry.result.kept;
+            entry.stats.deleted = entry.result.deleted;
+            stats->merge(entry.stats);
+        }
+    }
+    std::cout << "\nBatch summary: " << files.size() << " history files, "
+              << (files.size() - failed.size()) << " " << (dryRun_ ? "checked" : "cleaned")
+              << ", " << failed.size() << " failed." << std::endl;
+    std::cout << "Lines read: " << totals.lines << ", Entries kept: " << totals.kept
+              << ", Entries " << (dryRun_ ? "to be deleted" : "deleted") << ": " << totals.deleted;
+    if (dedup_ != DedupMode::None) {
+        std::cout << " (duplicates: " << totals.duplicates << ")";
+    }
+    std::cout << std::endl;
+    for (const fs::path* path : failed) {
+        std::cerr << "Failed: " << path->string() << std::endl;
+    }
+    if (RunStats* stats = statsTarget()) {
+        reportStats(*stats);
+    }
+
+    if (interrupted()) { std::cerr << "Interrupted during batch processing.\n"; return; }
+    if (!failed.empty()) {
+        errorExit(std::to_string(failed.size()) + " of " + std::to_string(files.size()) + " history files could not be processed.");
+    }
+}
+
 void HistoryCleaner::checkPermissions() {
     // Check for interruption
-    if (interrupted_) { throw std::runtime_error("Interrupted during permission check."); }
+    if (interrupted()) { throw std::runtime_error("Interrupted during permission check."); }
 
     std::error_code ec;
     bool needNewPath = false;
@@ -296,7 +715,7 @@ void HistoryCleaner::checkPermissions() {
             if (!std::getline(std::cin, newPath)) {
                 errorExit("Input error or EOF detected during path input.");
             }
-            if (interrupted_) {
+            if (interrupted()) {
                 throw std::runtime_error("Interrupted during path input.");
             }
 
@@ -322,89 +741,138 @@ void HistoryCleaner::checkPermissions() {
 }
 
 void HistoryCleaner::calculateTimestamps() {
+    if (dedupOnly()) {
+        startTimestamp_ = 0;
+        endTimestamp_ = std::numeric_limits<std::time_t>::max();
+        return;
+    }
+    if (policySpecs_.empty()) {
+        windowFor(mode_, specificDateStr_, startDateStr_, endDateStr_, olderThanDays_, preciseTime_,
+                  startTimestamp_, endTimestamp_);
+        return;
+    }
+
+    // Every rule has a window of its own; the span is what gets reported
+    policyRules_.clear();
+    startTimestamp_ = std::numeric_limits<std::time_t>::max();
+    endTimestamp_ = 0;
+    for (const PolicyRuleSpec& spec : policySpecs_) {
+        PolicyRule rule = spec.rule;
+        Mode mode = Mode::NONE;
+        parseMode(spec.mode, mode); // Validated by loadPolicy()
+        try {
+            windowFor(mode, spec.date, spec.startDate, spec.endDate, spec.days, spec.precise,
+                      rule.startTimestamp, rule.endTimestamp);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("Policy rule '" + rule.name + "': " + e.what());
+        }
+        startTimestamp_ = std::min(startTimestamp_, rule.startTimestamp);
+        endTimestamp_ = std::max(endTimestamp_, rule.endTimestamp);
+        policyRules_.push_back(rule);
+    }
+}
+
+bool HistoryCleaner::parseMode(const std::string& name, Mode& mode) {
+    if (name == "today") mode = Mode::TODAY;
+    else if (name == "last_7_days") mode = Mode::LAST_7_DAYS;
+    else if (name == "last_30_days") mode = Mode::LAST_30_DAYS;
+    else if (name == "between") mode = Mode::BETWEEN;
+    else if (name == "specific_day") mode = Mode::SPECIFIC_DAY;
+    else if (name == "before") mode = Mode::BEFORE;
+    else if (name == "after") mode = Mode::AFTER;
+    else if (name == "all") mode = Mode::ALL_TIME;
+    else if (name == "older_than") mode = Mode::OLDER_THAN;
+    else if (name == "newer_than") mode = Mode::NEWER_THAN;
+    else return false;
+    return true;
+}
+
+void HistoryCleaner::windowFor(Mode mode, const std::string& specificDate, const std::string& startDate,
+                               const std::string& endDate, int days, bool precise,
+                               std::time_t& start, std::time_t& end) {
     // Calculate timestamps based on mode
     std::time_t now = nowEpoch();
     std::tm timeinfo;
     localtime_r(&now, &timeinfo);
 
-    switch (mode_) {
+    switch (mode) {
         case Mode::TODAY:
             // Set start to beginning of today
             timeinfo.tm_hour = 0;
             timeinfo.tm_min = 0;
             timeinfo.tm_sec = 0;
-            startTimestamp_ = std::mktime(&timeinfo);
-            endTimestamp_ = std::numeric_limits<std::time_t>::max();
+            start = std::mktime(&timeinfo);
+            end = std::numeric_limits<std::time_t>::max();
             break;
 
         case Mode::LAST_7_DAYS:
             // Set start to 7 days ago
-            startTimestamp_ = now - (7 * 24 * 60 * 60);
-            endTimestamp_ = std::numeric_limits<std::time_t>::max();
+            start = now - (7 * 24 * 60 * 60);
+            end = std::numeric_limits<std::time_t>::max();
             break;
 
         case Mode::LAST_30_DAYS:
             // Set start to 30 days ago
-            startTimestamp_ = now - (30 * 24 * 60 * 60);
-            endTimestamp_ = std::numeric_limits<std::time_t>::max();
+            start = now - (30 * 24 * 60 * 60);
+            end = std::numeric_limits<std::time_t>::max();
             break;
 
         case Mode::SPECIFIC_DAY:
-            startTimestamp_ = dateToEpoch(specificDateStr_, preciseTime_);
-            if (preciseTime_) {
-                endTimestamp_ = startTimestamp_; // Exact time match
+            start = dateToEpoch(specificDate, precise);
+            if (precise) {
+                end = start; // Exact time match
             } else {
                 // End at end of the day
                 std::tm date_tm;
-                localtime_r(&startTimestamp_, &date_tm);
+                localtime_r(&start, &date_tm);
                 date_tm.tm_hour = 23;
                 date_tm.tm_min = 59;
                 date_tm.tm_sec = 59;
-                endTimestamp_ = std::mktime(&date_tm);
+                end = std::mktime(&date_tm);
             }
             break;
 
         case Mode::BETWEEN:
-            startTimestamp_ = dateToEpoch(startDateStr_, preciseTime_);
-            endTimestamp_ = dateToEpoch(endDateStr_, preciseTime_);
-            if (!preciseTime_) {
+            start = dateToEpoch(startDate, precise);
+            end = dateToEpoch(endDate, precise);
+            if (!precise) {
                 // Adjust end to end of day
                 std::tm end_tm;
-                localtime_r(&endTimestamp_, &end_tm);
+                localtime_r(&end, &end_tm);
                 end_tm.tm_hour = 23;
                 end_tm.tm_min = 59;
                 end_tm.tm_sec = 59;
-                endTimestamp_ = std::mktime(&end_tm);
+                end = std::mktime(&end_tm);
             }
             break;
 
         case Mode::BEFORE:
-            startTimestamp_ = 0;
-            endTimestamp_ = dateToEpoch(specificDateStr_, preciseTime_);
-            if (!preciseTime_) {
+            start = 0;
+            end = dateToEpoch(specificDate, precise);
+            if (!precise) {
                 // Adjust to end of previous day
-                endTimestamp_ -= 1; // One second before midnight
+                end -= 1; // One second before midnight
             }
             break;
 
         case Mode::AFTER:
-            startTimestamp_ = dateToEpoch(specificDateStr_, preciseTime_);
-            endTimestamp_ = std::numeric_limits<std::time_t>::max();
+            start = dateToEpoch(specificDate, precise);
+            end = std::numeric_limits<std::time_t>::max();
             break;
 
         case Mode::OLDER_THAN:
-            startTimestamp_ = 0;
-            endTimestamp_ = now - (olderThanDays_ * 24 * 60 * 60);
+            start = 0;
+            end = now - (days * 24 * 60 * 60);
             break;
 
         case Mode::NEWER_THAN:
-            startTimestamp_ = now - (olderThanDays_ * 24 * 60 * 60);
-            endTimestamp_ = std::numeric_limits<std::time_t>::max();
+            start = now - (days * 24 * 60 * 60);
+            end = std::numeric_limits<std::time_t>::max();
             break;
 
         case Mode::ALL_TIME:
-            startTimestamp_ = 0;
-            endTimestamp_ = std::numeric_limits<std::time_t>::max();
+            start = 0;
+            end = std::numeric_limits<std::time_t>::max();
             break;
 
         case Mode::NONE:
@@ -412,9 +880,170 @@ void HistoryCleaner::calculateTimestamps() {
     }
 }
 
+void HistoryCleaner::loadPolicy(const std::string& path) {
+    std::string error;
+    if (!loadPolicyFile(path, policySpecs_, error)) {
+        errorExit(error);
+    }
+    // Same requirements as the command line has for --mode
+    for (const PolicyRuleSpec& spec : policySpecs_) {
+        const std::string where = path + ":" + std::to_string(spec.line) + ": Rule '" + spec.rule.name + "': ";
+        Mode mode = Mode::NONE;
+        if (!parseMode(spec.mode, mode)) {
+            errorExit(where + "Invalid mode: '" + spec.mode + "'.");
+        }
+        switch (mode) {
+            case Mode::BETWEEN:
+                if (spec.startDate.empty() || spec.endDate.empty()) {
+                    errorExit(where + "'start-date' and 'end-date' are required for 'between' mode.");
+                }
+                break;
+            case Mode::SPECIFIC_DAY:
+            case Mode::BEFORE:
+            case Mode::AFTER:
+                if (spec.date.empty()) {
+                    errorExit(where + "'date' is required for 'specific_day', 'before', or 'after' mode.");
+                }
+                break;
+            case Mode::OLDER_THAN:
+            case Mode::NEWER_THAN:
+                if (spec.days <= 0) {
+                    errorExit(where + "'days' is required for 'older_than' and 'newer_than' mode.");
+                }
+                break;
+            default: // TODAY, LAST_7_DAYS, LAST_30_DAYS, ALL_TIME
+                break;
+        }
+    }
+}
+
+void HistoryCleaner::updatePolicyWindows() {
+    std::string error;
+    for (size_t i = 0; i < policyRules_.size(); ++i) {
+        if (!engine_.setRuleWindow(i, policyRules_[i].startTimestamp, policyRules_[i].endTimestamp, error)) {
+            errorExit(error);
+        }
+    }
+}
+
+void HistoryCleaner::configureEngine() {
+    EngineConfig config;
+    config.startTimestamp = startTimestamp_;
+    config.endTimestamp = endTimestamp_;
+    config.keywords = filterKeywords_;
+    config.regexes = filterRegexStrs_;
+    config.whitelist = isWhitelistMode_;
+    config.rules = policyRules_;
+    config.multiline = multiline_;
+    config.dedup = dedup_;
+    config.dedupOnly = dedupOnly();
+    config.dryRun = dryRun_;
+    config.report = report_;
+    config.backup = doBackup_;
+    config.archive = archivePath_;
+    if (deferShred_ && !dryRun_) {
+        config.shredQueue = defaultShredQueueDir();
+    }
+    config.shredPasses = shredPasses_;
+    config.threads = threads_;
+    config.pipeline = pipeline_;
+    config.seekByTime = seekByTime_;
+    config.inPlace = inPlace_;
+    config.incremental = incremental_;
+
+    std::string error;
+    if (!engine_.configure(config, error)) {
+        errorExit(error);
+    }
+}
+
+bool HistoryCleaner::cleanHistoryFile() {
+    CleanOptions options;
+    options.info = &std::cout;
+    options.log = &std::cerr;
+    options.listing = dryRun_ ? &std::cout : nullptr; // Only dry runs list entries
+    options.stats = statsTarget();
+    CleanResult result = engine_.clean(effectiveHistoryFilePath_, options);
+    if (result.ok && dryRun_) {
+        printReport(std::cout, effectiveHistoryFilePath_, result);
+    }
+    if (result.shredQueued) {
+        startShredDrainer();
+    }
+    if (options.stats != nullptr) {
+        stats_.file = effectiveHistoryFilePath_.string();
+        stats_.files = 1;
+        stats_.ok = result.ok;
+        stats_.lines = result.lines;
+        stats_.kept = result.kept;
+        stats_.deleted = result.deleted;
+        reportStats(stats_);
+    }
+    return result.ok;
+}
+
+void HistoryCleaner::reportStats(RunStats& stats) const {
+    stats.dryRun = dryRun_;
+    stats.finish();
+    std::cout << std::flush; // Keep the report after the run's own output on a shared terminal
+    if (statsFormat_ == StatsFormat::JSON) {
+        stats.writeJson(std::cerr);
+    } else {
+        stats.writeText(std::cerr);
+    }
+}
+
+void HistoryCleaner::printReport(std::ostream& out, const fs::path& file, const CleanResult& result) const {
+    const EngineConfig& config = engine_.config();
+    auto reasonCount = [&result](DeleteReason reason) { return result.reasons[static_cast<size_t>(reason)]; };
+    auto ruleCount = [&result](size_t rule) { return rule < result.ruleMatches.size() ? result.ruleMatches[rule] : 0; };
+    const bool filters = !config.keywords.empty() || !config.regexes.empty();
+
+    if (report_ == ReportFormat::Ndjson) {
+        std::string json = "{\"type\":\"summary\",\"file\":" + jsonString(file.string());
+        json += ",\"lines\":" + std::to_string(result.lines);
+        json += ",\"kept\":" + std::to_string(result.kept);
+        json += ",\"deleted\":" + std::to_string(result.deleted);
+        json += ",\"reasons\":{";
+        for (size_t i = 0; i < DELETE_REASON_COUNT; ++i) {
+            if (i > 0) json += ',';
+            json += std::string("\"") + deleteReasonName(static_cast<DeleteReason>(i)) + "\":" + std::to_string(result.reasons[i]);
+        }
+        json += "},\"rules\":[";
+        for (size_t i = 0; i < config.rules.size(); ++i) {
+            if (i > 0) json += ',';
+            json += "{\"name\":" + jsonString(config.rules[i].name);
+            json += std::string(",\"action\":\"") + (config.rules[i].deleteMatches ? "delete" : "keep") + "\"";
+            json += ",\"entries\":" + std::to_string(ruleCount(i)) + "}";
+        }
+        out << json << "]}\n";
+    } else if (report_ == ReportFormat::Summary) {
+        out << "Report for " << file.string() << ":\n"
+            << "  Lines read: " << result.lines << ", entries kept: " << result.kept
+            << ", entries to be deleted: " << result.deleted << "\n";
+        if (!config.rules.empty()) {
+            for (size_t i = 0; i < config.rules.size(); ++i) {
+                out << "  Rule [" << config.rules[i].name << "] (" << (config.rules[i].deleteMatches ? "delete" : "keep")
+                    << "): " << ruleCount(i) << " entries\n";
+            }
+        } else if (config.whitelist && filters) {
+            out << "  Not matching the whitelist: " << reasonCount(DeleteReason::Whitelist) << "\n";
+        } else if (filters) {
+            if (!config.keywords.empty()) out << "  Keyword filters: " << reasonCount(DeleteReason::Keyword) << "\n";
+            if (!config.regexes.empty()) out << "  Regex filters: " << reasonCount(DeleteReason::Regex) << "\n";
+        } else if (!config.dedupOnly) {
+            out << "  Time window: " << reasonCount(DeleteReason::Window) << "\n";
+        }
+        if (config.dedup != DedupMode::None) {
+            out << "  Duplicates: " << reasonCount(DeleteReason::Duplicate) << "\n";
+        }
+    }
+    out << std::flush;
+}
+
 void HistoryCleaner::resolveHistoryPath() {
     // Check for interruption
-    if (interrupted_) { throw std::runtime_error("Interrupted during path resolution."); }
+    if (interrupted()) { throw std::runtime_error("Interrupted during path resolution."); }
 
     std::error_code ec;
     fs::path initialPath = historyFilePath_; // Keep original for messages
@@ -459,6 +1088,8 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
 
     // Track if any mode-affecting arguments were provided
     bool hasNonHistfileArgs = false;
+    bool reportGiven = false;
+    std::string policyPath;
     // Start in interactive mode unless changed by mode-affecting arguments
     interactive_ = true;
 
@@ -472,17 +1103,11 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
         } else if (arg == "--mode") {
             if (i + 1 >= args.size()) errorExit("--mode requires an argument.");
             std::string modeStr = args[++i];
-            if (modeStr == "today") mode_ = Mode::TODAY;
-            else if (modeStr == "last_7_days") mode_ = Mode::LAST_7_DAYS;
-            else if (modeStr == "last_30_days") mode_ = Mode::LAST_30_DAYS;
-            else if (modeStr == "between") mode_ = Mode::BETWEEN;
-            else if (modeStr == "specific_day") mode_ = Mode::SPECIFIC_DAY;
-            else if (modeStr == "before") mode_ = Mode::BEFORE;
-            else if (modeStr == "after") mode_ = Mode::AFTER;
-            else if (modeStr == "all") mode_ = Mode::ALL_TIME;
-            else if (modeStr == "older_than") mode_ = Mode::OLDER_THAN;
-            else if (modeStr == "newer_than") mode_ = Mode::NEWER_THAN;
-            else errorExit("Invalid mode: '" + modeStr + "'. Use -h for options.");
+            if (!parseMode(modeStr, mode_)) errorExit("Invalid mode: '" + modeStr + "'. Use -h for options.");
+            hasNonHistfileArgs = true;
+        } else if (arg == "--policy") {
+            if (i + 1 >= args.size()) errorExit("--policy requires a FILE argument.");
+            policyPath = args[++i];
             hasNonHistfileArgs = true;
         } else if (arg == "--precise") {
             preciseTime_ = true;
@@ -501,12 +1126,39 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
         } else if (arg == "--backup") {
             doBackup_ = true;
             hasNonHistfileArgs = true;
+        } else if (arg == "--archive") {
+            if (i + 1 >= args.size()) errorExit("--archive requires a PATH argument.");
+            archivePath_ = args[++i];
+            hasNonHistfileArgs = true;
+        } else if (arg == "--extract-archive") {
+            if (i + 1 >= args.size()) errorExit("--extract-archive requires a PATH argument.");
+            extractPath_ = args[++i];
+            hasNonHistfileArgs = true;
+        } else if (arg == "--defer-shred") {
+            deferShred_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--shred-queue") {
+            drainShredQueue_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--stdin") {
+            streamIn_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--stdout") {
+            streamOut_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--merge") {
+            if (i + 1 >= args.size() || args[i + 1][0] == '-') errorExit("--merge requires one or more FILE arguments.");
+            while (i + 1 < args.size() && args[i + 1][0] != '-') {
+                mergeInputs_.push_back(args[++i]);
+            }
+            hasNonHistfileArgs = true;
         } else if (arg == "--dry-run") {
             dryRun_ = true;
             hasNonHistfileArgs = true;
         } else if (arg == "--histfile") {
             if (i + 1 >= args.size()) errorExit("--histfile requires a PATH argument.");
             historyFilePath_ = args[++i];
+            histfileGiven_ = true;
             // Don't set interactive_ = false here, allow --histfile alone to work in interactive mode
         } else if (arg == "--keyword") {
             if (i + 1 >= args.size()) errorExit("--keyword requires one or more STRING arguments.");
@@ -519,9 +1171,8 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
             while (i + 1 < args.size() && args[i + 1][0] != '-') {
                 std::string regexStr = args[++i];
                 try {
-                    std::regex compiled(regexStr, std::regex::ECMAScript);
+                    RegexMatcher::validate(regexStr);
                     filterRegexStrs_.push_back(regexStr);
-                    filterRegexes_.push_back(compiled);
                 } catch (const std::regex_error& e) {
                     errorExit(std::string("Invalid regex pattern provided to --regex: ") + e.what());
                 }
@@ -552,6 +1203,84 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
                 errorExit("Invalid number provided for --passes: '" + passesStr + "'.");
             }
             hasNonHistfileArgs = true;
+        } else if (arg == "--threads") {
+            if (i + 1 >= args.size()) errorExit("--threads requires a positive integer argument.");
+            std::string threadsStr = args[++i];
+            try {
+                int threads = std::stoi(threadsStr);
+                if (threads <= 0) {
+                    errorExit("--threads requires a positive integer.");
+                }
+                threads_ = threads;
+            } catch (...) {
+                errorExit("Invalid number provided for --threads: '" + threadsStr + "'.");
+            }
+            hasNonHistfileArgs = true;
+        } else if (arg == "--pipeline") {
+            pipeline_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--seek") {
+            seekByTime_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--in-place") {
+            inPlace_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--incremental") {
+            incremental_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--watch") {
+            watch_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg.rfind("--report=", 0) == 0) {
+            std::string format = arg.substr(9);
+            if (format == "text") report_ = ReportFormat::Text;
+            else if (format == "ndjson") report_ = ReportFormat::Ndjson;
+            else if (format == "summary") report_ = ReportFormat::Summary;
+            else errorExit("Invalid --report format: '" + format + "'. Use --report=text, --report=ndjson or --report=summary.");
+            reportGiven = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--progress") {
+            progress_ = true;
+            hasNonHistfileArgs = true;
+        } else if (arg == "--stats" || arg.rfind("--stats=", 0) == 0) {
+            std::string format = arg == "--stats" ? "text" : arg.substr(8);
+            if (format == "text") statsFormat_ = StatsFormat::TEXT;
+            else if (format == "json") statsFormat_ = StatsFormat::JSON;
+            else errorExit("Invalid --stats format: '" + format + "'. Use --stats or --stats=json.");
+            hasNonHistfileArgs = true;
+        } else if (arg == "--histfile-list") {
+            if (i + 1 >= args.size()) errorExit("--histfile-list requires a FILE argument.");
+            histfileLists_.push_back(args[++i]);
+            hasNonHistfileArgs = true;
+        } else if (arg == "--histfile-glob") {
+            if (i + 1 >= args.size()) errorExit("--histfile-glob requires a PATTERN argument.");
+            histfileGlobs_.push_back(args[++i]);
+            hasNonHistfileArgs = true;
+        } else if (arg == "--jobs" || arg == "--io-jobs") {
+            if (i + 1 >= args.size()) errorExit(arg + " requires a positive integer argument.");
+            std::string jobsStr = args[++i];
+            try {
+                int jobs = std::stoi(jobsStr);
+                if (jobs <= 0) {
+                    errorExit(arg + " requires a positive integer.");
+                }
+                (arg == "--jobs" ? jobs_ : ioJobs_) = jobs;
+            } catch (...) {
+                errorExit("Invalid number provided for " + arg + ": '" + jobsStr + "'.");
+            }
+            hasNonHistfileArgs = true;
+        } else if (arg == "--dedup") {
+            dedup_ = DedupMode::KeepLast;
+            if (i + 1 < args.size() && args[i + 1][0] != '-') {
+                std::string keep = args[++i];
+                if (keep == "keep-last") dedup_ = DedupMode::KeepLast;
+                else if (keep == "keep-first") dedup_ = DedupMode::KeepFirst;
+                else errorExit("Invalid --dedup mode: '" + keep + "'. Use keep-last or keep-first.");
+            }
+            hasNonHistfileArgs = true;
+        } else if (arg == "--multiline") {
+            multiline_ = true;
+            hasNonHistfileArgs = true;
         } else if (arg == "--whitelist") {
             isWhitelistMode_ = true;
             hasNonHistfileArgs = true; // Treat whitelist as a mode-affecting arg
@@ -563,8 +1292,89 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
     // Set interactive mode based on arguments
     interactive_ = !hasNonHistfileArgs;
 
+    if (drainShredQueue_ && args.size() > 1) {
+        errorExit("--shred-queue cannot be combined with other options.");
+    }
+    if (drainShredQueue_) return;
+
+    bool batch = !histfileLists_.empty() || !histfileGlobs_.empty();
+    if (batch && histfileGiven_) {
+        errorExit("--histfile cannot be combined with --histfile-list or --histfile-glob.");
+    }
+    if ((streamIn_ || streamOut_) &&
+        (batch || watch_ || doBackup_ || inPlace_ || incremental_ || seekByTime_ || threads_ > 1 ||
+         deferShred_ || dedup_ != DedupMode::None || !extractPath_.empty())) {
+        errorExit("--stdin/--stdout cannot be combined with batch mode, --watch, --backup, --in-place, --incremental,"
+                  " --seek, --threads, --defer-shred, --dedup or --extract-archive.");
+    }
+    if (streamIn_ && histfileGiven_) {
+        errorExit("--stdin reads the history from stdin; it cannot be combined with --histfile.");
+    }
+    if (pipeline_ && threads_ > 1) {
+        errorExit("--pipeline cannot be combined with --threads.");
+    }
+    if (!mergeInputs_.empty() &&
+        (batch || watch_ || streamIn_ || streamOut_ || inPlace_ || incremental_ || seekByTime_ || threads_ > 1 ||
+         pipeline_ || !extractPath_.empty())) {
+        errorExit("--merge cannot be combined with batch mode, --watch, --stdin, --stdout, --in-place, --incremental,"
+                  " --seek, --threads, --pipeline or --extract-archive.");
+    }
+    if (!mergeInputs_.empty() && dedup_ == DedupMode::KeepLast) {
+        errorExit("--merge decides in a single pass, so it only supports --dedup keep-first.");
+    }
+    if (watch_ && batch) {
+        errorExit("--watch cannot be combined with --histfile-list or --histfile-glob.");
+    }
+    if (watch_ && dryRun_) {
+        errorExit("--watch cannot be combined with --dry-run.");
+    }
+    if (reportGiven && !dryRun_) {
+        errorExit("--report only applies to --dry-run.");
+    }
+    if (dedup_ != DedupMode::None && threads_ > 1) {
+        errorExit("--dedup cannot be combined with --threads.");
+    }
+    if (dedup_ != DedupMode::None && (seekByTime_ || incremental_ || watch_)) {
+        errorExit("--dedup cannot be combined with --seek, --incremental or --watch.");
+    }
+    if (watch_) {
+        // Each pass only classifies what was appended and cuts matches out in place
+        incremental_ = true;
+        inPlace_ = true;
+    }
+    if (!batch && (jobs_ > 0 || ioJobs_ > 0)) {
+        std::cerr << "Warning: --jobs and --io-jobs only apply with --histfile-list or --histfile-glob." << std::endl;
+    }
+
+    if (!extractPath_.empty()) {
+        // Selects archived entries by time (and source) only; nothing is cleaned
+        if (batch || watch_ || !policyPath.empty() || dedup_ != DedupMode::None || !archivePath_.empty() ||
+            !filterKeywords_.empty() || !filterRegexStrs_.empty() || isWhitelistMode_ || doBackup_ || dryRun_) {
+            errorExit("--extract-archive can only be combined with --mode, its date options and --histfile.");
+        }
+        if (mode_ == Mode::NONE) mode_ = Mode::ALL_TIME;
+    }
+
+    if (!policyPath.empty()) {
+        // The policy stands in for --mode and the filters
+        if (mode_ != Mode::NONE || !startDateStr_.empty() || !endDateStr_.empty() || !specificDateStr_.empty() ||
+            olderThanDays_ > 0 || preciseTime_ || !filterKeywords_.empty() || !filterRegexStrs_.empty() || isWhitelistMode_) {
+            errorExit("--policy cannot be combined with --mode, its date options, --keyword, --regex or --whitelist.");
+        }
+        loadPolicy(policyPath);
+    }
+
     // Validation for non-interactive mode
-    if (hasNonHistfileArgs) {
+    if (hasNonHistfileArgs && policySpecs_.empty() && mode_ == Mode::NONE &&
+        (dedup_ != DedupMode::None || !mergeInputs_.empty())) {
+        // --dedup (or --merge) on its own: nothing goes but the repeats, if any
+        if (!filterKeywords_.empty() || !filterRegexStrs_.empty() || isWhitelistMode_) {
+            errorExit("--keyword, --regex and --whitelist require --mode (or --policy).");
+        }
+        if (!startDateStr_.empty() || !endDateStr_.empty() || !specificDateStr_.empty() || olderThanDays_ > 0 || preciseTime_) {
+            std::cerr << "Warning: Date/days arguments are ignored without --mode." << std::endl;
+        }
+    } else if (hasNonHistfileArgs && policySpecs_.empty()) {
         if (mode_ == Mode::NONE) {
             errorExit("The --mode option is required when running non-interactively. Use -h for options.");
         }
@@ -600,12 +1410,16 @@ void HistoryCleaner::parseArguments(int argc, char* argv[]) {
                 }
                 break;
         }
+    }
 
-        // Dry run implies no backup needed
-        if (dryRun_ && doBackup_) {
-            std::cout << "Info: --backup option ignored when --dry-run is specified." << std::endl;
-            doBackup_ = false;
-        }
+    // Dry run implies no backup needed
+    if (hasNonHistfileArgs && dryRun_ && doBackup_) {
+        std::cout << "Info: --backup option ignored when --dry-run is specified." << std::endl;
+        doBackup_ = false;
+    }
+    if (hasNonHistfileArgs && dryRun_ && !archivePath_.empty()) {
+        std::cout << "Info: --archive option ignored when --dry-run is specified." << std::endl;
+        archivePath_.clear();
     }
 }
 
@@ -642,7 +1456,7 @@ void HistoryCleaner::runInteractive() {
     int choice = 0;
     int max_choice = static_cast<int>(options.size());
     while (choice < 1 || choice > max_choice) {
-        if (interrupted_) { std::cerr << "\nInterrupted during interactive input.\n"; return; }
+        if (interrupted()) { std::cerr << "\nInterrupted during interactive input.\n"; return; }
 
         std::cout << "\nEnter choice (1-" << max_choice << "): ";
         std::string choiceStr;
@@ -651,7 +1465,7 @@ void HistoryCleaner::runInteractive() {
             return;
         }
 
-        if (interrupted_) { std::cerr << "\nInterrupted during interactive input.\n"; return; }
+        if (interrupted()) { std::cerr << "\nInterrupted during interactive input.\n"; return; }
 
         try {
             choiceStr.erase(0, choiceStr.find_first_not_of(" \t"));
@@ -680,7 +1494,7 @@ void HistoryCleaner::runInteractive() {
     auto getDateInput = [&](const std::string& prompt, bool isSpecificDay = false) -> std::string {
         std::string inputStr;
         while (true) {
-            if (interrupted_) throw std::runtime_error("Interrupted during date input.");
+            if (interrupted()) throw std::runtime_error("Interrupted during date input.");
             
             // For specific day mode, we don't need time input as it covers the whole day
             if (isSpecificDay) {
@@ -692,7 +1506,7 @@ void HistoryCleaner::runInteractive() {
             if (!std::getline(std::cin, inputStr)) {
                 throw std::runtime_error("Input error or EOF detected during date input.");
             }
-            if (interrupted_) throw std::runtime_error("Interrupted during date input.");
+            if (interrupted()) throw std::runtime_error("Interrupted during date input.");
 
             inputStr.erase(0, inputStr.find_first_not_of(" \t"));
             inputStr.erase(inputStr.find_last_not_of(" \t") + 1);
@@ -721,7 +1535,7 @@ void HistoryCleaner::runInteractive() {
             specificDateStr_ = getDateInput("❓ Enter Date", false);
         } else if (mode_ == Mode::OLDER_THAN || mode_ == Mode::NEWER_THAN) {
             while (olderThanDays_ <= 0) {
-                if (interrupted_) throw std::runtime_error("Interrupted during days input.");
+                if (interrupted()) throw std::runtime_error("Interrupted during days input.");
                 std::string prompt = mode_ == Mode::OLDER_THAN ?
                     "❓ Enter number of days (e.g., 90 to delete entries older than 90 days): " :
                     "❓ Enter number of days (e.g., 90 to delete entries newer than 90 days): ";
@@ -730,7 +1544,7 @@ void HistoryCleaner::runInteractive() {
                 if (!std::getline(std::cin, daysStr)) {
                     throw std::runtime_error("Input error or EOF detected during days input.");
                 }
-                if (interrupted_) throw std::runtime_error("Interrupted during days input.");
+                if (interrupted()) throw std::runtime_error("Interrupted during days input.");
                 try {
                     daysStr.erase(0, daysStr.find_first_not_of(" \t"));
                     daysStr.erase(daysStr.find_last_not_of(" \t") + 1);
@@ -760,7 +1574,7 @@ void HistoryCleaner::runInteractive() {
         if (!std::getline(std::cin, filterChoiceStr)) {
             throw std::runtime_error("Input error or EOF detected during filter choice.");
         }
-        if (interrupted_) throw std::runtime_error("Interrupted during filter choice.");
+        if (interrupted()) throw std::runtime_error("Interrupted during filter choice.");
         if (!filterChoiceStr.empty()) {
             filterChoiceStr.erase(0, filterChoiceStr.find_first_not_of(" \t"));
             if (!filterChoiceStr.empty()) {
@@ -774,7 +1588,7 @@ void HistoryCleaner::runInteractive() {
             if (!std::getline(std::cin, keyword)) {
                 throw std::runtime_error("Input error or EOF detected during keyword input.");
             }
-            if (interrupted_) throw std::runtime_error("Interrupted during keyword input.");
+            if (interrupted()) throw std::runtime_error("Interrupted during keyword input.");
             keyword.erase(0, keyword.find_first_not_of(" \t"));
             keyword.erase(keyword.find_last_not_of(" \t") + 1);
             if (keyword.empty()) {
@@ -796,7 +1610,7 @@ void HistoryCleaner::runInteractive() {
                     if (!std::getline(std::cin, additionalKeyword)) {
                         break;
                     }
-                    if (interrupted_) throw std::runtime_error("Interrupted during keyword input.");
+                    if (interrupted()) throw std::runtime_error("Interrupted during keyword input.");
                     
                     additionalKeyword.erase(0, additionalKeyword.find_first_not_of(" \t"));
                     additionalKeyword.erase(additionalKeyword.find_last_not_of(" \t") + 1);
@@ -821,7 +1635,7 @@ void HistoryCleaner::runInteractive() {
             if (!std::getline(std::cin, regexStr)) {
                 throw std::runtime_error("Input error or EOF detected during regex input.");
             }
-            if (interrupted_) throw std::runtime_error("Interrupted during regex input.");
+            if (interrupted()) throw std::runtime_error("Interrupted during regex input.");
             
             regexStr.erase(0, regexStr.find_first_not_of(" \t"));
             regexStr.erase(regexStr.find_last_not_of(" \t") + 1);
@@ -830,9 +1644,8 @@ void HistoryCleaner::runInteractive() {
                 std::cout << "⚠️ Regex pattern cannot be empty. No filter applied." << std::endl;
             } else {
                 try {
-                    std::regex compiled(regexStr, std::regex::ECMAScript);
+                    RegexMatcher::validate(regexStr);
                     filterRegexStrs_.push_back(regexStr);
-                    filterRegexes_.push_back(compiled);
                     std::cout << "   Regex compiled successfully: /" << regexStr << "/" << std::endl;
                     
                     char addMore = 'n';
@@ -848,16 +1661,15 @@ void HistoryCleaner::runInteractive() {
                         if (!std::getline(std::cin, additionalRegex)) {
                             break;
                         }
-                        if (interrupted_) throw std::runtime_error("Interrupted during regex input.");
+                        if (interrupted()) throw std::runtime_error("Interrupted during regex input.");
                         
                         additionalRegex.erase(0, additionalRegex.find_first_not_of(" \t"));
                         additionalRegex.erase(additionalRegex.find_last_not_of(" \t") + 1);
                         
                         if (!additionalRegex.empty()) {
                             try {
-                                std::regex additionalCompiled(additionalRegex, std::regex::ECMAScript);
+                                RegexMatcher::validate(additionalRegex);
                                 filterRegexStrs_.push_back(additionalRegex);
-                                filterRegexes_.push_back(additionalCompiled);
                                 std::cout << "   Regex compiled successfully: /" << additionalRegex << "/" << std::endl;
                             } catch (const std::regex_error& e) {
                                 std::cerr << "⚠️ Invalid regex pattern: " << e.what() << ". Skipped." << std::endl;
@@ -883,7 +1695,7 @@ void HistoryCleaner::runInteractive() {
     }
 
     // --- Ask about Whitelist Mode if Filters Exist ---
-    if (!filterKeywords_.empty() || !filterRegexes_.empty()) {
+    if (!filterKeywords_.empty() || !filterRegexStrs_.empty()) {
         std::cout << "\n❓ Treat these filters as a whitelist (keep matching entries)? (y/[N]): ";
         std::string whitelistStr;
         if (std::getline(std::cin, whitelistStr) && !whitelistStr.empty()) {
@@ -948,6 +1760,7 @@ void HistoryCleaner::runInteractive() {
     } catch (const std::exception& e) {
         errorExit(std::string("Error calculating timestamps: ") + e.what());
     }
+    configureEngine();
 
     // --- Process History ---
     std::cout << "\nProcessing entries between: " << epochToString(startTimestamp_)
@@ -955,307 +1768,21 @@ void HistoryCleaner::runInteractive() {
 
     if (dryRun_) {
         std::cout << "\n--- Dry Run Mode ---" << std::endl;
-        if (!processHistory(std::cout)) {
+        if (!cleanHistoryFile()) {
             errorExit("Dry run failed during history processing.");
         }
         std::cout << "--- End Dry Run ---" << std::endl;
     } else {
-        std::ofstream null_stream;
-        null_stream.setstate(std::ios_base::badbit);
-
-        if (!processHistory(null_stream)) {
+        if (!cleanHistoryFile()) {
             errorExit("Failed to process history file.");
         }
 
-        if (interrupted_) { std::cerr << "Interrupted after processing history.\n"; return; }
+        if (interrupted()) { std::cerr << "Interrupted after processing history.\n"; return; }
 
         std::cout << "History cleaning complete." << std::endl;
     }
 }
 
-bool HistoryCleaner::processCommandBlock(const std::string& block, unsigned long long lineNum,
-                                       std::ostream& output, unsigned long long& keptCount,
-                                       unsigned long long& deletedCount) {
-    std::smatch match;
-    
-    // Extract timestamp from the first line of the block
-    size_t firstLineEnd = block.find('\n');
-    if (firstLineEnd == std::string::npos) {
-        std::cerr << "Warning: Malformed history entry near line " << lineNum << ". Keeping block." << std::endl;
-        keptCount++;
-        return false;
-    }
-
-    std::string firstLine = block.substr(0, firstLineEnd);
-    if (!std::regex_match(firstLine, match, historyEntryRegex_)) {
-        std::cerr << "Warning: Invalid history entry format near line " << lineNum << ". Keeping block." << std::endl;
-        keptCount++;
-        return false;
-    }
-
-    try {
-        std::time_t timestamp = std::stoll(match[1].str());
-        if (timestamp >= startTimestamp_ && timestamp <= endTimestamp_) {
-            // Time matches, now check content filters (if any)
-            bool shouldDelete = false; // Don't delete unless filters match
-
-            // Extract command part for both keyword and regex matching
-            size_t cmdStart = firstLine.find(';');
-            if (cmdStart != std::string::npos) {
-                std::string command = firstLine.substr(cmdStart + 1);
-                command.erase(0, command.find_first_not_of(" \t"));
-
-                // If no filters are present, we should delete based on time only
-                if (filterKeywords_.empty() && filterRegexes_.empty()) {
-                    shouldDelete = true;
-                } else {
-                    // Check keywords (ANY keyword must match)
-                    if (!filterKeywords_.empty()) {
-                        for (const auto& keyword : filterKeywords_) {
-                            if (command.find(keyword) != std::string::npos) {
-                                shouldDelete = true;
-                                break;
-                            }
-                        }
-                    }
-
-                    // Check regexes (ANY regex must match)
-                    if (!filterRegexes_.empty() && !shouldDelete) { // Only check if not already marked for deletion
-                        for (const auto& regex : filterRegexes_) {
-                            if (std::regex_search(command, regex)) {
-                                shouldDelete = true;
-                                break;
-                            }
-                        }
-                    }
-
-                    // In whitelist mode, we keep matching entries instead of deleting them
-                    if (isWhitelistMode_) {
-                        shouldDelete = !shouldDelete;
-                    }
-                }
-            }
-
-            if (shouldDelete) {
-                deletedCount++;
-                if (dryRun_) {
-                    output << "--- Would delete (Entry ending line " << lineNum << "): ---\n"
-                           << block
-                           << "-------------------------------------------\n";
-                }
-                return true;
-            }
-        }
-    } catch (const std::out_of_range& oor) {
-        std::cerr << "Warning: Timestamp out of range near line " << lineNum << ". Keeping entry." << std::endl;
-        keptCount++;
-        return false;
-    } catch (const std::invalid_argument& ia) {
-        std::cerr << "Warning: Invalid timestamp format near line " << lineNum << ". Keeping entry." << std::endl;
-        keptCount++;
-        return false;
-    }
-
-    keptCount++;
-    return false;
-}
-
-bool HistoryCleaner::processHistory(std::ostream& output) {
-    // Check for interruption before opening files
-    if (interrupted_) { std::cerr << "Interrupted before processing history.\n"; return false; }
-
-    // First pass: Read and identify entries to keep
-    std::vector<std::string> keptEntries;
-    std::ifstream historyIn(effectiveHistoryFilePath_, std::ios::binary);
-    if (!historyIn && fs::exists(effectiveHistoryFilePath_)) {
-        std::cerr << "Error: Cannot open history file for reading: " << effectiveHistoryFilePath_.string() << std::endl;
-        return false;
-    }
-
-    std::string line;
-    unsigned long long lineNum = 0;
-    unsigned long long keptCount = 0;
-    unsigned long long deletedCount = 0;
-    std::string currentCommandBlock; // Stores the lines of the current history entry
-
-    while (true) {
-        // Check for interruption in the loop
-        if (interrupted_) { std::cerr << "\nInterrupted during history processing.\n"; return false; }
-
-        if (!std::getline(historyIn, line)) {
-            // End of file or read error
-            if (historyIn.eof()) {
-                break; // Normal end of file
-            } else {
-                std::cerr << "Error reading history file near line " << lineNum << std::endl;
-                return false; // File read error
-            }
-        }
-
-        lineNum++;
-
-        // Handle potential \r line endings (Windows/mixed environments)
-        if (!line.empty() && line.back() == '\r') {
-            line.pop_back();
-        }
-
-        // Check if the line starts a new history entry
-        std::smatch match;
-        bool isNewEntry = std::regex_match(line, match, historyEntryRegex_);
-
-        if (isNewEntry) {
-            // --- Process the PREVIOUS command block ---
-            if (!currentCommandBlock.empty()) {
-                bool shouldDelete = processCommandBlock(currentCommandBlock, lineNum - 1, output, keptCount, deletedCount);
-                if (!shouldDelete && !dryRun_) {
-                    keptEntries.push_back(currentCommandBlock);
-                }
-            }
-            // --- Start the NEW command block ---
-            currentCommandBlock = line + '\n';
-        } else {
-            // --- Append to the CURRENT command block ---
-            // This line is a continuation (multiline command) or part of a malformed entry
-            if (!currentCommandBlock.empty()) { // Only append if we are inside a block
-                currentCommandBlock += line + '\n';
-            } else {
-                // This line appears before the first valid timestamp entry
-                // Treat it as a block to be kept (cannot determine its timestamp)
-                std::cerr << "Warning: Line found before first valid history entry timestamp at line " << lineNum << ". Keeping line." << std::endl;
-                if (!dryRun_) {
-                    keptEntries.push_back(line + '\n');
-                }
-                keptCount++;
-            }
-        }
-    }
-
-    // Process the last block if any
-    if (!currentCommandBlock.empty()) {
-        bool shouldDelete = processCommandBlock(currentCommandBlock, lineNum, output, keptCount, deletedCount);
-        if (!shouldDelete && !dryRun_) {
-            keptEntries.push_back(currentCommandBlock);
-        }
-    }
-
-    historyIn.close();
-
-    std::cout << "Processing complete. Lines read: " << lineNum
-              << ", Entries kept: " << keptCount
-              << ", Entries " << (dryRun_ ? "to be deleted" : "deleted") << ": " << deletedCount << std::endl;
-
-    if (dryRun_) {
-        return true;
-    }
-
-    // Generate random filename for the new history file
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(0, 35); // 0-9, A-Z
-    const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    std::string randomStr;
-    for (int i = 0; i < 15; ++i) {
-        randomStr += charset[dist(gen)];
-    }
-    tempFilePath_ = effectiveHistoryFilePath_.parent_path() / randomStr;
-
-    // Write kept entries to the new file
-    std::ofstream newFile(tempFilePath_, std::ios::binary);
-    if (!newFile) {
-        std::cerr << "Error: Cannot create new history file" << std::endl;
-        return false;
-    }
-
-    for (const auto& entry : keptEntries) {
-        newFile << entry;
-        if (!newFile) {
-            std::cerr << "Error: Failed to write to new history file" << std::endl;
-            newFile.close();
-            cleanup();  // This will handle removing the temp file
-            return false;
-        }
-    }
-
-    newFile.close();
-
-    // Now we can safely replace the original file
-    if (!performCleanup(output)) {
-        cleanup();  // This will handle removing the temp file
-        return false;
-    }
-
-    // Rename new file to original name
-    std::error_code ec;
-    fs::rename(tempFilePath_, effectiveHistoryFilePath_, ec);
-    if (ec) {
-        std::cerr << "Error: Failed to rename new history file" << std::endl;
-        cleanup();  // This will handle removing the temp file
-        return false;
-    }
-    tempFilePath_.clear();  // Successfully renamed, clear the path
-
-    return true;
-}
-
-bool HistoryCleaner::backupHistoryFile() {
-    // Check for interruption
-    if (interrupted_) { std::cerr << "Interrupted before backup.\n"; return false; }
-
-    // Generate random filename for backup
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist(0, 35); // 0-9, A-Z
-    const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    std::string randomStr;
-    for (int i = 0; i < 15; ++i) {
-        randomStr += charset[dist(gen)];
-    }
-    backupFilePath_ = effectiveHistoryFilePath_.parent_path() / (effectiveHistoryFilePath_.filename().string() + ".backup_" + randomStr);
-
-    std::error_code ec;
-    fs::copy_file(effectiveHistoryFilePath_, backupFilePath_, fs::copy_options::overwrite_existing, ec);
-
-    if (ec) {
-        std::cerr << "Error: Failed to create backup file: " << backupFilePath_.string()
-                   << " (" << ec.message() << ")" << std::endl;
-        backupFilePath_.clear();  // Clear the path since backup failed
-        return false;
-    }
-    std::cout << "Backup created: " << backupFilePath_.string() << std::endl;
-    return true;
-}
-
-bool HistoryCleaner::performCleanup(std::ostream& output) {
-    // Check for interruption
-    if (interrupted_) { std::cerr << "Interrupted before final cleanup steps.\n"; return false; }
-
-    if (dryRun_) {
-        output << "Dry run: No changes made." << std::endl;
-        return true;
-    }
-
-    // 1. Backup original file if requested
-    if (doBackup_) {
-        if (!backupHistoryFile()) {
-            std::cerr << "Backup failed. Aborting cleanup to preserve original file." << std::endl;
-            return false;
-        }
-         // Check for interruption after backup
-         if (interrupted_) { std::cerr << "Interrupted after backup.\n"; return false; }
-    }
-
-    // 2. Securely delete the original history file
-    output << "Securely deleting original history file: " << effectiveHistoryFilePath_.string() << std::endl;
-    if (!secureDelete(effectiveHistoryFilePath_, shredPasses_, std::cerr)) {
-        std::cerr << "Error: Secure delete of original history file failed." << std::endl;
-        std::cerr << "The original file might still exist (potentially overwritten or partially deleted)." << std::endl;
-        return false;
-    }
-    output << "Original history file securely deleted." << std::endl;
-
-    return true;
-}
-
 void HistoryCleaner::usage(const std::string& progName) {
     std::cout << "Usage: " << progName << " [OPTIONS]\n\n"
               << "✨ Securely cleans Zsh history file entries based on time criteria. ✨\n\n"
@@ -1281,13 +1808,87 @@ void HistoryCleaner::usage(const std::string& progName) {
               << " --whitelist           Treat filters as a whitelist (keep matching entries)\n"
               << "                      instead of blacklist (delete matching entries).\n"
               << "                      Cannot be used with --keyword. Applies after time filtering.\n"
+              << " --multiline          Match keywords and regexes against the whole entry, not just\n"
+              << "                      its first line: continuation lines (multiline commands,\n"
+              << "                      heredocs) too, with each backslash-newline read as a newline.\n"
+              << " --policy <FILE>      Apply the prioritized keep/delete rules in FILE (each with a\n"
+              << "                      mode, keywords and regexes) in one pass, with one rewrite\n"
+              << "                      and one shred. Replaces --mode and the filters.\n"
+              << " --dedup [keep-last|keep-first] Also delete repeated commands, keeping the last\n"
+              << "                      (default) or the first entry of each. Without --mode,\n"
+              << "                      only repeats are deleted. Cannot be used with --threads,\n"
+              << "                      --seek, --incremental or --watch.\n"
               << " --backup             Create a backup of the original history file before deletion.\n"
               << "                      Ignored if --dry-run is used.\n"
+              << " --archive <PATH>     Append the deleted entries to the archive at PATH (created\n"
+              << "                      if missing, owner-only), in segments indexed by time.\n"
+              << "                      Ignored if --dry-run is used.\n"
+              << " --extract-archive <PATH> Write the archived entries in the --mode window (default:\n"
+              << "                      all) to stdout instead of cleaning; with --histfile, only\n"
+              << "                      those taken from that file.\n"
               << " --dry-run            Simulate the process. Shows which entries would be deleted\n"
               << "                      without modifying the actual history file.\n"
+              << " --report=FORMAT      How --dry-run lists the entries: text (default, the entries\n"
+              << "                      themselves), ndjson (one JSON record per entry with its lines,\n"
+              << "                      byte offset and length, timestamp and reason, then a summary\n"
+              << "                      record) or summary (counts per rule and filter only).\n"
+              << " --merge <FILE...>    Merge these histories (each in timestamp order; pipes work)\n"
+              << "                      into the history file in one pass, oldest first, applying\n"
+              << "                      --mode, the filters or --policy as it goes. The history file\n"
+              << "                      must be one of them, empty or missing. Without --mode only\n"
+              << "                      --dedup keep-first deletes anything.\n"
+              << " --stdin              Filter a history read from stdin (a pipe) instead of a file,\n"
+              << "                      writing the kept entries to stdout. Nothing touches the disk.\n"
+              << " --stdout             Write the kept entries of the history file to stdout, leaving\n"
+              << "                      the file as it is. Messages go to stderr in both modes.\n"
               << " --histfile <PATH>    Specify a different history file path.\n"
               << "                      (Default: $HISTFILE env var, or $HOME/.zsh_history)\n"
               << " --passes <N>         Number of secure deletion passes (default: 32).\n"
+              << " --defer-shred        Swap the cleaned file in and return; the original is queued\n"
+              << "                      (hidden, crash-safe) and shredded by a detached --shred-queue.\n"
+              << " --shred-queue        Shred every queued original (and one a killed run left of\n"
+              << "                      the default history), then exit. Needed only if a\n"
+              << "                      background shred was interrupted (crash, reboot).\n"
+              << " --threads <N>        Classify the history on N threads (default: 1).\n"
+              << " --pipeline           Overlap reading, filtering and writing on three threads\n"
+              << "                      (reader, classifier, writer). Cannot be used with --threads.\n"
+              << "                      A history file that cannot be memory-mapped is classified\n"
+              << "                      sequentially; with --stdin/--stdout the reader read()s\n"
+              << "                      ahead into a ring of 1 MiB buffers.\n"
+              << " --seek               Binary-search the (time-ordered) history for the time window\n"
+              << "                      and only parse that range. Falls back to a full scan if\n"
+              << "                      timestamps in the range or at a probe are out of order.\n"
+              << " --in-place           If the deleted entries form one contiguous range followed by\n"
+              << "                      at most 64 KiB, shred and cut just that range out of the\n"
+              << "                      history file instead of rewriting it and shredding the whole\n"
+              << "                      original. Not crash-safe: a crash while the bytes after the\n"
+              << "                      range move down can leave them duplicated, with one entry\n"
+              << "                      torn, and there is no other copy (the rewrite always has\n"
+              << "                      one). A single range with more after it (the oldest\n"
+              << "                      entries) is rewritten, but only that range of the original\n"
+              << "                      is shredded. Anything else is rewritten as usual.\n"
+              << " --incremental        Keep a checkpoint next to the history file and, on later runs,\n"
+              << "                      only classify what was appended since (plus entries the\n"
+              << "                      time window newly reaches). Falls back to a full pass if\n"
+              << "                      the file was rewritten or the filters changed.\n"
+              << " --watch              Stay resident and clean again (incrementally, in place) a\n"
+              << "                      moment after each change to the history file, via inotify.\n"
+              << "                      Runs until terminated. Cannot be used with --dry-run.\n"
+              << " --stats[=json]       After the run, report wall/CPU time and bytes per phase\n"
+              << "                      (resolve, read+parse, keyword/regex filtering, write,\n"
+              << "                      backup, shred, rename), peak RSS and throughput on stderr,\n"
+              << "                      as a table or as one line of JSON.\n"
+              << " --progress           Report bytes read, entries/s, the current shred pass and an\n"
+              << "                      ETA on stderr every second while the run lasts. SIGUSR1\n"
+              << "                      prints the line once at any time, with or without it.\n"
+              << " --histfile-list <FILE> Batch mode: clean every history file listed in FILE\n"
+              << "                      (one path per line, '#' starts a comment).\n"
+              << " --histfile-glob <PATTERN> Batch mode: clean every history file matching PATTERN,\n"
+              << "                      e.g. '/home/*/.zsh_history' (quote it from the shell).\n"
+              << " --jobs <N>           Batch mode: files processed concurrently\n"
+              << "                      (default: one per hardware thread).\n"
+              << " --io-jobs <N>        Batch mode: files syncing, backing up or shredding at once\n"
+              << "                      (default: 2).\n"
               << " -h, --help           Show this help message and exit.\n\n"
               << "Examples:\n"
               << "  " << progName << "                     # Run in interactive mode\n"
@@ -1300,7 +1901,14 @@ void HistoryCleaner::usage(const std::string& progName) {
               << "  " << progName << " --mode today --regex \"git\\s+(commit|push)\" \"sudo\\s+-E\"\n"
               << "  " << progName << " --mode all --backup\n"
               << "  " << progName << " --mode older_than --days 90 --backup\n"
-              << "  " << progName << " --mode newer_than --days 90 --backup\n\n"
+              << "  " << progName << " --mode newer_than --days 90 --backup\n"
+              << "  " << progName << " --mode older_than --days 365 --histfile-glob '/home/*/.zsh_history' --io-jobs 4\n"
+              << "  " << progName << " --policy ~/.config/zsh_history_cleaner/retention.policy\n"
+              << "  " << progName << " --dedup keep-last --backup\n"
+              << "  " << progName << " --mode older_than --days 90 --defer-shred\n"
+              << "  ssh host cat .zsh_history | " << progName << " --stdin --mode all --regex 'AKIA[0-9A-Z]{16}' > scrubbed\n"
+              << "  " << progName << " --mode older_than --days 365 --archive ~/.zsh_history.archive\n"
+              << "  " << progName << " --extract-archive ~/.zsh_history.archive --mode specific_day --date 2024-03-15\n\n"
               << "Notes:\n"
               << "- Date format is YYYY-MM-DD.\n"
               << "- Time format (with --precise) is HH:MM or HH:MM:SS.\n"
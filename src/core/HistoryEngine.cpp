@@ -0,0 +1,2228 @@
+#include "../../include/zsh_history_cleaner/HistoryEngine.h"
+#include "../../include/zsh_history_cleaner/Constants.h"
+#include "../../include/zsh_history_cleaner/Utils.h"
+#include "../../include/zsh_history_cleaner/SecureDelete.h"
+#include "../../include/zsh_history_cleaner/HistoryParser.h"
+#include "../../include/zsh_history_cleaner/HistoryReader.h"
+#include "../../include/zsh_history_cleaner/BufferedWriter.h"
+#include "../../include/zsh_history_cleaner/TimeSeek.h"
+#include "../../include/zsh_history_cleaner/CleanupRegistry.h"
+#include "../../include/zsh_history_cleaner/SpscQueue.h"
+#include "../../include/zsh_history_cleaner/RunStats.h"
+#include "../../include/zsh_history_cleaner/Checkpoint.h"
+#include "../../include/zsh_history_cleaner/XxHash64.h"
+#include "../../include/zsh_history_cleaner/HistoryLock.h"
+#include "../../include/zsh_history_cleaner/FileCopy.h"
+#include "../../include/zsh_history_cleaner/EntryText.h"
+#include "../../include/zsh_history_cleaner/Unmetafy.h"
+#include "../../include/zsh_history_cleaner/DuplicateIndex.h"
+#include "../../include/zsh_history_cleaner/Archive.h"
+#include "../../include/zsh_history_cleaner/ShredQueue.h"
+#include "../../include/zsh_history_cleaner/Progress.h"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <regex>
+#include <system_error>
+#include <unistd.h>     // For close
+#include <fcntl.h>      // For open, O_RDWR
+#include <sys/stat.h>   // For fstat
+#include <poll.h>       // For poll
+#include <cstdio>       // For rename
+#include <cstring>      // For strerror
+#include <cerrno>       // For errno
+#include <algorithm>    // For std::min, std::max, std::remove_if
+#include <sstream>      // For per-chunk output buffers
+#include <thread>       // For std::thread
+#include <future>       // For std::promise, std::future
+#include <array>        // For the kernel table
+#include <utility>      // For std::index_sequence
+
+namespace fs = std::filesystem;
+
+const char* deleteReasonName(DeleteReason reason) {
+    static const char* const names[DELETE_REASON_COUNT] = {
+        "window", "keyword", "regex", "whitelist", "rule", "duplicate",
+    };
+    return names[static_cast<size_t>(reason)];
+}
+
+HistoryEngine::HistoryEngine() : regexMatcher_(std::make_unique<RegexMatcher>()) {}
+
+HistoryEngine::~HistoryEngine() = default;
+
+bool HistoryEngine::configure(const EngineConfig& config, std::string& error) {
+    configured_ = false;
+    if (config.startTimestamp > config.endTimestamp) {
+        error = "Start of the time window is after its end.";
+        return false;
+    }
+    if (config.shredPasses <= 0) {
+        error = "Number of secure deletion passes must be positive.";
+        return false;
+    }
+    if (config.threads <= 0) {
+        error = "Number of classification threads must be positive.";
+        return false;
+    }
+    if (config.pipeline && config.threads > 1) {
+        error = "Pipelined classification runs on a single classifier thread.";
+        return false;
+    }
+    if (config.dedup != DedupMode::None && config.threads > 1) {
+        // Whether an entry repeats an earlier one depends on every entry before it
+        error = "Duplicate elimination runs on a single classifier thread.";
+        return false;
+    }
+    if (config.dedup != DedupMode::None && (config.seekByTime || config.incremental)) {
+        error = "Duplicate elimination reads every entry, so it cannot skip parts of the history.";
+        return false;
+    }
+    if (config.dedupOnly && (!config.keywords.empty() || !config.regexes.empty() || config.whitelist ||
+                             !config.rules.empty())) {
+        error = "Deleting only duplicates requires no filters.";
+        return false;
+    }
+
+    if (!config.rules.empty() && (!config.keywords.empty() || !config.regexes.empty() || config.whitelist)) {
+        error = "Policy rules cannot be combined with keyword, regex or whitelist filters.";
+        return false;
+    }
+    for (const PolicyRule& rule : config.rules) {
+        if (rule.startTimestamp > rule.endTimestamp) {
+            error = "Start of the time window of policy rule '" + rule.name + "' is after its end.";
+            return false;
+        }
+    }
+
+    auto regexMatcher = std::make_unique<RegexMatcher>();
+    for (const std::string& pattern : config.regexes) {
+        try {
+            regexMatcher->add(pattern);
+        } catch (const std::regex_error& e) {
+            error = std::string("Invalid regex pattern: ") + e.what();
+            return false;
+        }
+    }
+    // Regexes get literal prefilters and, if enabled at build time, a combined RE2 set
+    regexMatcher->compile();
+
+    // Each rule gets matchers of its own; evaluation order is fixed here, once
+    std::vector<CompiledRule> rules(config.rules.size());
+    bool ruleFilters = false;
+    for (size_t i = 0; i < config.rules.size(); ++i) {
+        const PolicyRule& rule = config.rules[i];
+        CompiledRule& compiled = rules[i];
+        compiled.index = i;
+        compiled.deleteMatches = rule.deleteMatches;
+        compiled.reportName = jsonString(rule.name);
+        compiled.startTimestamp = rule.startTimestamp;
+        compiled.endTimestamp = rule.endTimestamp;
+        compiled.keywords.build(rule.keywords);
+        compiled.regexes = std::make_unique<RegexMatcher>();
+        for (const std::string& pattern : rule.regexes) {
+            try {
+                compiled.regexes->add(pattern);
+            } catch (const std::regex_error& e) {
+                error = "Invalid regex pattern in policy rule '" + rule.name + "': " + e.what();
+                return false;
+            }
+        }
+        compiled.regexes->compile();
+        ruleFilters = ruleFilters || !rule.keywords.empty() || !rule.regexes.empty();
+    }
+    std::stable_sort(rules.begin(), rules.end(), [&config](const CompiledRule& a, const CompiledRule& b) {
+        return config.rules[a.index].priority > config.rules[b.index].priority;
+    });
+    std::vector<PolicyRule> orderedRules;
+    for (const CompiledRule& rule : rules) {
+        orderedRules.push_back(config.rules[rule.index]);
+    }
+
+    regexMatcher_ = std::move(regexMatcher);
+    rules_ = std::move(rules);
+    // Keywords are matched through one automaton instead of one find() per keyword
+    keywordMatcher_.build(config.keywords);
+    filterFingerprint_ = filterFingerprint(config.keywords, config.regexes, config.whitelist, orderedRules,
+                                           config.multiline);
+    // For picking a policy's kernel, rule filters count as keywords: all that matters
+    // there is whether anything is matched (and worth timing)
+    const bool keywords = !config.keywords.empty() || ruleFilters;
+    const bool regexes = !regexMatcher_->empty();
+    const bool policy = !rules_.empty();
+    classifyKernel_ = selectKernel(keywords, regexes, config.whitelist, policy, config.multiline, config.dryRun, false);
+    timedClassifyKernel_ = selectKernel(keywords, regexes, config.whitelist, policy, config.multiline, config.dryRun, true);
+
+    config_ = config;
+    if (policy) {
+        spanRuleWindows();
+    }
+    configured_ = true;
+    return true;
+}
+
+bool HistoryEngine::setTimeWindow(std::time_t startTimestamp, std::time_t endTimestamp, std::string& error) {
+    if (startTimestamp > endTimestamp) {
+        error = "Start of the time window is after its end.";
+        return false;
+    }
+    if (!rules_.empty()) {
+        error = "Policy rules have time windows of their own.";
+        return false;
+    }
+    config_.startTimestamp = startTimestamp;
+    config_.endTimestamp = endTimestamp;
+    return true;
+}
+
+bool HistoryEngine::setRuleWindow(size_t rule, std::time_t startTimestamp, std::time_t endTimestamp, std::string& error) {
+    if (rule >= config_.rules.size()) {
+        error = "No such policy rule.";
+        return false;
+    }
+    if (startTimestamp > endTimestamp) {
+        error = "Start of the time window of policy rule '" + config_.rules[rule].name + "' is after its end.";
+        return false;
+    }
+    config_.rules[rule].startTimestamp = startTimestamp;
+    config_.rules[rule].endTimestamp = endTimestamp;
+    for (CompiledRule& compiled : rules_) {
+        if (compiled.index == rule) {
+            compiled.startTimestamp = startTimestamp;
+            compiled.endTimestamp = endTimestamp;
+        }
+    }
+    spanRuleWindows();
+    return true;
+}
+
+void HistoryEngine::spanRuleWindows() {
+    // Entries outside every rule's window are kept, so --seek may skip them
+    config_.startTimestamp = std::numeric_limits<std::time_t>::max();
+    config_.endTimestamp = 0;
+    for (const CompiledRule& rule : rules_) {
+        config_.startTimestamp = std::min(config_.startTimestamp, rule.startTimestamp);
+        config_.endTimestamp = std::max(config_.endTimestamp, rule.endTimestamp);
+    }
+}
+
+CleanResult HistoryEngine::clean(const fs::path& historyFile, const CleanOptions& options) const {
+    std::ostream discard(nullptr); // Stands in for every stream the caller left out
+    FileJob job;
+    job.historyPath = historyFile;
+    job.info = options.info ? options.info : &discard;
+    job.log = options.log ? options.log : &discard;
+    job.cancel = options.cancel;
+    job.ioLimiter = options.ioLimiter;
+    job.stats = options.stats;
+
+    CleanResult result;
+    if (!configured_) {
+        result.error = "Engine is not configured.";
+        return result;
+    }
+
+    // A run killed between swapping the original out and shredding it left a record of it
+    if (!recoverPendingShred(historyFile, config_.dryRun, *job.info, *job.log)) {
+        result.error = "Secure delete of the original an interrupted run left failed.";
+        return result;
+    }
+
+    // A shell replacing the history file (e.g. trimming it to SAVEHIST) during the unlocked
+    // pass makes that pass's result useless; it is redone against the new file
+    for (int attempt = 1;; ++attempt) {
+        result.ok = processHistory(job, options.listing ? *options.listing : discard);
+        cleanup(job); // No-op unless a failure path left the temp file behind
+        if (result.ok || !job.replaced || attempt == HISTORY_REPLACED_RETRIES || interrupted(job)) break;
+        *job.info << "History file was replaced while it was being cleaned; starting over." << std::endl;
+        if (!job.backupPath.empty()) {
+            secureDelete(job.backupPath, config_.shredPasses, *job.log); // Superseded by the next attempt's
+            job.backupPath.clear();
+        }
+        job.replaced = false;
+        job.error.clear();
+        job.totals = ClassifyResult();
+        job.archived = 0;
+    }
+
+    result.interrupted = job.totals.interrupted || (!result.ok && interrupted(job));
+    result.lines = job.totals.lines;
+    result.kept = job.totals.kept;
+    result.deleted = job.totals.deleted;
+    result.duplicates = job.totals.duplicates;
+    result.reasons = job.totals.reasons;
+    result.ruleMatches = job.totals.ruleMatches;
+    result.archived = job.archived;
+    result.shredQueued = job.shredQueued;
+    result.backupPath = job.backupPath;
+    if (!result.ok) {
+        result.error = job.error.empty() ? "Failed to process history file." : job.error;
+    }
+    return result;
+}
+
+CleanResult HistoryEngine::filter(int inFd, int outFd, const fs::path& source, const CleanOptions& options) const {
+    std::ostream discard(nullptr); // Stands in for every stream the caller left out
+    FileJob job;
+    job.historyPath = source;
+    job.info = options.info ? options.info : &discard;
+    job.log = options.log ? options.log : &discard;
+    job.cancel = options.cancel;
+    job.stats = options.stats;
+
+    CleanResult result;
+    if (!configured_) {
+        result.error = "Engine is not configured.";
+        return result;
+    }
+    if (config_.dedup != DedupMode::None) {
+        result.error = "Duplicates cannot be removed from a stream.";
+        return result;
+    }
+
+    result.ok = filterStream(job, inFd, outFd, options.listing ? *options.listing : discard);
+    result.interrupted = job.totals.interrupted || (!result.ok && interrupted(job));
+    result.lines = job.totals.lines;
+    result.kept = job.totals.kept;
+    result.deleted = job.totals.deleted;
+    result.reasons = job.totals.reasons;
+    result.ruleMatches = job.totals.ruleMatches;
+    result.archived = job.archived;
+    if (!result.ok) {
+        result.error = job.error.empty() ? "Failed to filter the history." : job.error;
+    }
+    return result;
+}
+
+CleanResult HistoryEngine::merge(const std::vector<fs::path>& inputs, const fs::path& historyFile,
+                                 const CleanOptions& options) const {
+    std::ostream discard(nullptr); // Stands in for every stream the caller left out
+    FileJob job;
+    job.historyPath = historyFile;
+    job.info = options.info ? options.info : &discard;
+    job.log = options.log ? options.log : &discard;
+    job.cancel = options.cancel;
+    job.ioLimiter = options.ioLimiter;
+    job.stats = options.stats;
+
+    CleanResult result;
+    if (!configured_) {
+        result.error = "Engine is not configured.";
+        return result;
+    }
+    if (inputs.empty()) {
+        result.error = "No histories to merge.";
+        return result;
+    }
+    if (config_.dedup == DedupMode::KeepLast) {
+        result.error = "A merge decides in a single pass, so it can only keep the first of repeated commands.";
+        return result;
+    }
+
+    if (!recoverPendingShred(historyFile, config_.dryRun, *job.info, *job.log)) {
+        result.error = "Secure delete of the original an interrupted run left failed.";
+        return result;
+    }
+
+    result.ok = mergeHistories(job, inputs, options.listing ? *options.listing : discard);
+    cleanup(job); // No-op unless a failure path left the temp file behind
+    result.interrupted = job.totals.interrupted || (!result.ok && interrupted(job));
+    result.lines = job.totals.lines;
+    result.kept = job.totals.kept;
+    result.deleted = job.totals.deleted;
+    result.duplicates = job.totals.duplicates;
+    result.reasons = job.totals.reasons;
+    result.ruleMatches = job.totals.ruleMatches;
+    result.archived = job.archived;
+    result.shredQueued = job.shredQueued;
+    result.backupPath = job.backupPath;
+    if (!result.ok) {
+        result.error = job.error.empty() ? "Failed to merge the histories." : job.error;
+    }
+    return result;
+}
+
+bool HistoryEngine::interrupted(const FileJob& job) {
+    return terminationRequested() ||
+           (job.cancel != nullptr && job.cancel->load(std::memory_order_relaxed));
+}
+
+bool HistoryEngine::fail(FileJob& job, const std::string& reason) {
+    if (job.error.empty()) {
+        job.error = reason;
+    }
+    return false;
+}
+
+// --- Resource Management ---
+void HistoryEngine::cleanup(FileJob& job) const {
+    // Clean up any temporary files that may exist
+    try {
+        std::error_code ec;
+
+        // Clean up temporary processing file if it exists
+        if (!job.tempPath.empty() && fs::exists(job.tempPath, ec)) {
+            fs::remove(job.tempPath, ec);
+            if (ec) {
+                *job.log << "Warning: Failed to remove temporary file: " << job.tempPath.string()
+                         << " (" << ec.message() << ")" << std::endl;
+            }
+        }
+        job.tempPath.clear();
+        unregisterTempFile(job.tempSlot);
+        job.tempSlot = -1;
+
+        // Note: We don't automatically clean up backup files as they should be preserved
+        // The user might want to recover from them in case of issues
+
+    } catch (const std::exception& e) {
+        *job.log << "Error during cleanup: " << e.what() << std::endl;
+    } catch (...) {
+        *job.log << "Unknown error during cleanup" << std::endl;
+    }
+}
+
+void HistoryEngine::ClassifyResult::add(const ClassifyResult& from) {
+    lines += from.lines;
+    kept += from.kept;
+    deleted += from.deleted;
+    duplicates += from.duplicates;
+    for (size_t i = 0; i < DELETE_REASON_COUNT; ++i) {
+        reasons[i] += from.reasons[i];
+    }
+    if (ruleMatches.size() < from.ruleMatches.size()) {
+        ruleMatches.resize(from.ruleMatches.size());
+    }
+    for (size_t i = 0; i < from.ruleMatches.size(); ++i) {
+        ruleMatches[i] += from.ruleMatches[i];
+    }
+    keywordTiming.ns += from.keywordTiming.ns;
+    keywordTiming.bytes += from.keywordTiming.bytes;
+    keywordTiming.calls += from.keywordTiming.calls;
+    regexTiming.ns += from.regexTiming.ns;
+    regexTiming.bytes += from.regexTiming.bytes;
+    regexTiming.calls += from.regexTiming.calls;
+}
+
+namespace {
+
+// Compile-time description of a filter configuration. classifyRangeWith is instantiated
+// once per combination, so the per-entry decision contains only the checks that apply.
+template <bool Keywords, bool Regexes, bool Whitelist, bool DryRun, bool Timed, bool Multiline, bool Rules = false>
+struct ClassifyPolicy {
+    static constexpr bool keywords = Keywords;
+    static constexpr bool regexes = Regexes;
+    static constexpr bool whitelist = Whitelist;
+    static constexpr bool dryRun = DryRun;
+    static constexpr bool timed = Timed;           // Measure every matcher call (--stats)
+    static constexpr bool multiline = Multiline;   // Match the whole entry, joined (--multiline)
+    static constexpr bool rules = Rules;           // Policy rules decide instead of the filters above
+};
+
+// Kernel table index layout: one bit per policy flag
+constexpr size_t KERNEL_MULTILINE = 32;
+constexpr size_t KERNEL_TIMED = 16;
+constexpr size_t KERNEL_KEYWORDS = 8;
+constexpr size_t KERNEL_REGEXES = 4;
+constexpr size_t KERNEL_WHITELIST = 2;
+constexpr size_t KERNEL_DRY_RUN = 1;
+constexpr size_t KERNEL_COUNT = 64;
+
+template <size_t Index>
+using PolicyAt = ClassifyPolicy<(Index & KERNEL_KEYWORDS) != 0, (Index & KERNEL_REGEXES) != 0,
+                                (Index & KERNEL_WHITELIST) != 0, (Index & KERNEL_DRY_RUN) != 0,
+                                (Index & KERNEL_TIMED) != 0, (Index & KERNEL_MULTILINE) != 0>;
+
+// Policy rules carry their own filters, so only the dry run, timing and multiline flags apply
+template <size_t Index>
+using RulesPolicyAt = ClassifyPolicy<false, false, false, (Index & 1) != 0, (Index & 2) != 0, (Index & 4) != 0, true>;
+
+// Command part of an entry (after the header's ';'), as stored and without leading
+// blanks. With Multiline, it runs to the end of the entry's last line instead of its first.
+template <bool Multiline>
+std::string_view rawCommandOf(const HistoryBlock& block, std::string_view firstLine, const HistoryHeader& header) {
+    std::string_view command = Multiline ? stripLineEnding(block.text) : firstLine;
+    command.remove_prefix(header.commandOffset);
+    size_t commandStart = command.find_first_not_of(" \t");
+    command.remove_prefix(commandStart == std::string_view::npos ? command.size() : commandStart);
+    return command;
+}
+
+// Same, unmetafied (decoded into scratch if it has to be), as the filters match it
+template <bool Multiline>
+std::string_view commandOf(const HistoryBlock& block, std::string_view firstLine, const HistoryHeader& header,
+                           std::string& scratch) {
+    return unmetafy(rawCommandOf<Multiline>(block, firstLine, header), scratch);
+}
+
+
+// Matcher's verdict on command, joined first if it may span lines (see EntryText.h)
+template <bool Multiline, typename Matcher>
+bool matchCommand(const Matcher& matcher, std::string_view command) {
+    if constexpr (Multiline) {
+        return matcher.matchesAnyJoined(command);
+    } else {
+        return matcher.matchesAny(command);
+    }
+}
+
+// Runs match(command), adding its duration to timing if Timed
+template <bool Timed, typename Timing, typename Match>
+bool timedMatch(Timing& timing, std::string_view command, const Match& match) {
+    if constexpr (Timed) {
+        uint64_t start = monotonicNs();
+        bool matched = match(command);
+        timing.ns += monotonicNs() - start;
+        timing.bytes += command.size();
+        timing.calls++;
+        return matched;
+    } else {
+        (void)timing;
+        return match(command);
+    }
+}
+
+// Adds a matcher's timing to a filter phase. Matching is pure computation on the
+// classifying thread, so its CPU time is taken to be its wall time.
+template <typename Timing>
+void addMatchTiming(RunStats& stats, RunPhase phase, const Timing& timing) {
+    stats[phase].wallNs += timing.ns;
+    stats[phase].cpuNs += timing.ns;
+    stats[phase].bytes += timing.bytes;
+    stats[phase].count += timing.calls;
+}
+
+// Reads length bytes at offset of fd into out. Returns false (errno set) on failure or
+// if the file ended early.
+bool readRange(int fd, uintmax_t offset, uintmax_t length, std::string& out) {
+    out.resize(static_cast<size_t>(length));
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t got = pread(fd, &out[done], out.size() - done, static_cast<off_t>(offset + done));
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (got == 0) {
+            errno = EIO;
+            return false;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// One merge() input: its reader, and its next entry while that waits in the merge heap
+struct MergeSource {
+    fs::path path;
+    int fd = -1;
+    std::unique_ptr<HistoryStreamReader> reader;
+    HistoryBlock block;
+    // Of block; a line without a valid header takes the previous entry's, so it stays with it
+    std::time_t timestamp = std::numeric_limits<std::time_t>::min();
+    bool disordered = false;            // Timestamps were found going back (warned once)
+
+    MergeSource() = default;
+    MergeSource(const MergeSource&) = delete;
+    MergeSource& operator=(const MergeSource&) = delete;
+    ~MergeSource() {
+        if (fd != -1) close(fd);
+    }
+};
+
+// An entry in the merge heap: the oldest comes out first, ties in input order
+struct MergeHead {
+    std::time_t timestamp;
+    size_t input;
+
+    bool operator<(const MergeHead& other) const { // Reversed for std::push_heap's max heap
+        return timestamp != other.timestamp ? timestamp > other.timestamp : input > other.input;
+    }
+};
+
+} // namespace
+
+template <size_t... Index>
+std::array<HistoryEngine::ClassifyKernel, sizeof...(Index)>
+HistoryEngine::kernelTable(std::index_sequence<Index...>) {
+    return {{&HistoryEngine::classifyRangeWith<PolicyAt<Index>>...}};
+}
+
+template <size_t... Index>
+std::array<HistoryEngine::ClassifyKernel, sizeof...(Index)>
+HistoryEngine::rulesKernelTable(std::index_sequence<Index...>) {
+    return {{&HistoryEngine::classifyRangeWith<RulesPolicyAt<Index>>...}};
+}
+
+HistoryEngine::ClassifyKernel HistoryEngine::selectKernel(bool keywords, bool regexes, bool whitelist, bool rules, bool multiline,
+                                                          bool dryRun, bool timed) {
+    static const auto kernels = kernelTable(std::make_index_sequence<KERNEL_COUNT>());
+    static const auto ruleKernels = rulesKernelTable(std::make_index_sequence<8>());
+    // Without filters every entry in the time window goes, whitelist or not, and there
+    // is nothing to time or to match across lines
+    if (!keywords && !regexes) whitelist = timed = multiline = false;
+    if (rules) {
+        return ruleKernels[(multiline ? 4 : 0) | (timed ? 2 : 0) | (dryRun ? 1 : 0)];
+    }
+    return kernels[(multiline ? KERNEL_MULTILINE : 0) | (timed ? KERNEL_TIMED : 0) | (keywords ? KERNEL_KEYWORDS : 0) |
+                   (regexes ? KERNEL_REGEXES : 0) | (whitelist ? KERNEL_WHITELIST : 0) | (dryRun ? KERNEL_DRY_RUN : 0)];
+}
+
+template <bool Timed, bool Multiline>
+const HistoryEngine::CompiledRule* HistoryEngine::policyMatch(std::time_t timestamp, std::string_view command,
+                                                              ClassifyResult& result) const {
+    for (const CompiledRule& rule : rules_) {
+        if (timestamp < rule.startTimestamp || timestamp > rule.endTimestamp) continue;
+        bool matched = rule.keywords.empty() && rule.regexes->empty(); // The window alone decides
+        if (!matched && !rule.keywords.empty()) {
+            matched = timedMatch<Timed>(result.keywordTiming, command,
+                [&rule](std::string_view text) { return matchCommand<Multiline>(rule.keywords, text); });
+        }
+        if (!matched && !rule.regexes->empty()) {
+            matched = timedMatch<Timed>(result.regexTiming, command,
+                [&rule](std::string_view text) { return matchCommand<Multiline>(*rule.regexes, text); });
+        }
+        if (matched) {
+            result.ruleMatches[rule.index]++;
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+void HistoryEngine::reportDeletion(const FileJob& job, BufferedStreamWriter& output, const HistoryBlock& block,
+                                   std::time_t timestamp, DeleteReason reason, const CompiledRule* rule) const {
+    if (config_.report == ReportFormat::Text) {
+        output << "--- Would delete " << (reason == DeleteReason::Duplicate ? "duplicate " : "")
+               << "(Entry ending line " << block.lastLine << "): ---\n";
+        forEachNormalizedPiece(block.text, [&output](std::string_view piece) { output << piece; });
+        output << "-------------------------------------------\n";
+    } else if (config_.report == ReportFormat::Ndjson) {
+        // Where the entry is, not what it says: the history file has the text
+        output << "{\"type\":\"entry\",\"first_line\":" << block.firstLine << ",\"last_line\":" << block.lastLine
+               << ",\"offset\":" << job.reportOffset + static_cast<uintmax_t>(block.text.data() - job.reportBase)
+               << ",\"length\":" << block.text.size() << ",\"timestamp\":" << timestamp
+               << ",\"reason\":\"" << deleteReasonName(reason) << '"';
+        if (rule != nullptr) output << ",\"rule\":" << rule->reportName;
+        output << "}\n";
+    }
+}
+
+template <typename Policy>
+bool HistoryEngine::processCommandBlock(const FileJob& job, const HistoryBlock& block,
+                                       BufferedStreamWriter& output, BufferedStreamWriter& log,
+                                       ClassifyResult& result, std::string& scratch) const {
+    // Extract timestamp from the first line of the block
+    std::string_view firstLine = stripLineEnding(block.text.substr(0, block.firstLineLength));
+    HistoryHeader header;
+    if (!parseHistoryHeader(firstLine, header)) {
+        log << "Warning: Invalid history entry format near line " << block.lastLine << ". Keeping block.\n";
+        result.kept++;
+        return false;
+    }
+
+    if (!header.timestampInRange) {
+        log << "Warning: Timestamp out of range near line " << block.lastLine << ". Keeping entry.\n";
+        result.kept++;
+        return false;
+    }
+
+    std::time_t timestamp = header.timestamp;
+    if (!config_.dedupOnly && timestamp >= config_.startTimestamp && timestamp <= config_.endTimestamp) {
+        // Time matches, now check content filters (if any). Without filters, the entry
+        // is deleted based on time only.
+        bool shouldDelete = true;
+        DeleteReason reason = DeleteReason::Window;
+        const CompiledRule* rule = nullptr;
+        FilterVerdicts* verdicts = job.verdicts;
+        const size_t entry = verdicts != nullptr ? verdicts->entry++ : 0;
+
+        if (verdicts != nullptr && !verdicts->recording && entry < verdicts->decided.size()) {
+            // Keep-last's recording pass matched this entry already
+            shouldDelete = false;
+            if (verdicts->decided[entry]) {
+                const FilterVerdicts::Verdict& verdict = verdicts->verdicts[verdicts->next++];
+                shouldDelete = verdict.deleteEntry;
+                reason = verdict.reason;
+                if (verdict.rule != FilterVerdicts::NO_RULE) {
+                    rule = &rules_[verdict.rule];
+                    result.ruleMatches[rule->index]++;
+                }
+            }
+        } else if constexpr (Policy::rules) {
+            // The window above spans every rule's; each rule checks its own
+            rule = policyMatch<Policy::timed, Policy::multiline>(
+                timestamp, commandOf<Policy::multiline>(block, firstLine, header, scratch), result);
+            shouldDelete = rule != nullptr && rule->deleteMatches;
+            reason = DeleteReason::Rule;
+        } else if constexpr (Policy::keywords || Policy::regexes) {
+            // Extract command part (after the header's ';') for both keyword and regex matching
+            std::string_view command = commandOf<Policy::multiline>(block, firstLine, header, scratch);
+
+            // Check keywords (ANY keyword must match) in a single pass over the command
+            shouldDelete = false;
+            if constexpr (Policy::keywords) {
+                shouldDelete = timedMatch<Policy::timed>(result.keywordTiming, command,
+                    [this](std::string_view text) { return matchCommand<Policy::multiline>(keywordMatcher_, text); });
+                reason = DeleteReason::Keyword;
+            }
+
+            // Check regexes (ANY regex must match)
+            if constexpr (Policy::regexes) {
+                if (!shouldDelete) { // Only check if not already marked for deletion
+                    shouldDelete = timedMatch<Policy::timed>(result.regexTiming, command,
+                        [this](std::string_view text) { return matchCommand<Policy::multiline>(*regexMatcher_, text); });
+                    reason = DeleteReason::Regex;
+                }
+            }
+
+            // In whitelist mode, we keep matching entries instead of deleting them
+            if constexpr (Policy::whitelist) {
+                shouldDelete = !shouldDelete;
+                reason = DeleteReason::Whitelist;
+            }
+        }
+        if (verdicts != nullptr && verdicts->recording) {
+            const bool decided = shouldDelete || rule != nullptr;
+            verdicts->decided.push_back(decided);
+            if (decided) {
+                const uint32_t position = rule != nullptr ? static_cast<uint32_t>(rule - rules_.data()) : FilterVerdicts::NO_RULE;
+                verdicts->verdicts.push_back({position, reason, shouldDelete});
+            }
+        }
+
+        if (shouldDelete) {
+            result.deleted++;
+            result.reasons[static_cast<size_t>(reason)]++;
+            if constexpr (Policy::dryRun) {
+                reportDeletion(job, output, block, timestamp, reason, rule);
+            }
+            return true;
+        }
+    }
+
+    // Of the entries the filters keep, repeats of a command go too (--dedup). A repeat is
+    // the same command, continuation lines included, whatever its timestamp.
+    if (job.duplicates != nullptr && job.duplicates->isDuplicate(rawCommandOf<true>(block, firstLine, header))) {
+        result.deleted++;
+        result.duplicates++;
+        result.reasons[static_cast<size_t>(DeleteReason::Duplicate)]++;
+        if constexpr (Policy::dryRun) {
+            reportDeletion(job, output, block, timestamp, DeleteReason::Duplicate, nullptr);
+        }
+        return true;
+    }
+
+    result.kept++;
+    return false;
+}
+
+HistoryEngine::ClassifyResult HistoryEngine::classifyRange(const FileJob& job, std::string_view data, unsigned long long firstLineNum,
+                                                            std::ostream& output, std::ostream& log,
+                                                            const KeepFunction& keep, const DropFunction& drop) const {
+    return (this->*(job.stats ? timedClassifyKernel_ : classifyKernel_))(job, data, firstLineNum, output, log, keep, drop);
+}
+
+template <typename Policy>
+HistoryEngine::ClassifyResult HistoryEngine::classifyRangeWith(const FileJob& job, std::string_view data,
+                                                                unsigned long long firstLineNum,
+                                                                std::ostream& output, std::ostream& log,
+                                                                const KeepFunction& keep, const DropFunction& drop) const {
+    ClassifyResult result;
+    if constexpr (Policy::rules) {
+        result.ruleMatches.assign(rules_.size(), 0);
+    }
+    HistoryBlockReader reader(data, firstLineNum);
+    HistoryBlock block;
+    std::string scratch; // Unmetafied commands, reused across the range
+    // Listing and warnings reach their streams in large writes (one buffer if they share one)
+    BufferedStreamWriter listing(output, REPORT_BUFFER_SIZE);
+    BufferedStreamWriter warningsOwn(log, REPORT_BUFFER_SIZE);
+    BufferedStreamWriter& warnings = &log == &output ? listing : warningsOwn;
+    size_t unpublishedBytes = 0; // Classified since the progress counters were last updated
+    unsigned long long unpublishedEntries = 0;
+
+    while (reader.next(block)) {
+        // Check for interruption in the loop
+        if (interrupted(job)) {
+            result.interrupted = true;
+            break;
+        }
+
+        bool shouldDelete = false;
+        if (!block.hasHeader) {
+            // This line appears before the first valid timestamp entry
+            // Treat it as a block to be kept (cannot determine its timestamp)
+            warnings << "Warning: Line found before first valid history entry timestamp at line " << block.firstLine << ". Keeping line.\n";
+            result.kept++;
+        } else {
+            shouldDelete = processCommandBlock<Policy>(job, block, listing, warnings, result, scratch);
+        }
+
+        if (shouldDelete) {
+            if (drop) drop(block.text);
+        } else if (!keep(block.text)) {
+            result.writeFailed = true;
+            break;
+        }
+
+        unpublishedBytes += block.text.size();
+        ++unpublishedEntries;
+        if (unpublishedBytes >= PROGRESS_PUBLISH_BYTES) {
+            progressClassified(unpublishedBytes, unpublishedEntries);
+            unpublishedBytes = 0;
+            unpublishedEntries = 0;
+        }
+    }
+    if (unpublishedBytes != 0) progressClassified(unpublishedBytes, unpublishedEntries);
+
+    result.lines = reader.linesRead();
+    return result;
+}
+
+HistoryEngine::ClassifyResult HistoryEngine::classifyParallel(const FileJob& job, std::string_view data, unsigned long long firstLineNum,
+                                                               std::ostream& output, std::ostream& log,
+                                                               const KeepFunction& keep, const DropFunction& drop) const {
+    // Per-chunk results are buffered and replayed in file order, so the kept output,
+    // counters and dry-run/warning text are identical to a single-threaded run.
+    struct Chunk {
+        std::string_view data;
+        std::vector<std::string_view> keptSpans; // Adjacent kept blocks are coalesced
+        std::vector<std::string_view> droppedSpans; // Same for deleted blocks, if drop wants them
+        std::ostringstream output;
+        std::ostringstream log;
+        ClassifyResult result;
+    };
+
+    const size_t threadCount = static_cast<size_t>(config_.threads);
+    ClassifyResult totals;
+    unsigned long long nextLine = firstLineNum;
+    size_t pos = 0;
+
+    // Work proceeds in rounds of threadCount chunks so buffered results stay bounded
+    while (pos < data.size()) {
+        size_t roundSize = std::min(data.size() - pos, threadCount * CLASSIFY_CHUNK_SIZE);
+        size_t roundEnd = findEntryBoundary(data, pos + roundSize);
+
+        std::vector<Chunk> chunks(threadCount);
+        size_t chunkStart = pos;
+        for (size_t i = 0; i < threadCount; ++i) {
+            size_t chunkEnd = (i + 1 == threadCount) ? roundEnd
+                : std::min(roundEnd, findEntryBoundary(data, std::max(chunkStart, pos + (roundEnd - pos) * (i + 1) / threadCount)));
+            chunks[i].data = data.substr(chunkStart, chunkEnd - chunkStart);
+            chunkStart = chunkEnd;
+        }
+
+        // Line numbers in messages depend on all preceding chunks. Each worker counts its
+        // own lines first, then waits only for its predecessor's running total.
+        std::vector<std::promise<unsigned long long>> lineBases(threadCount + 1);
+        lineBases[0].set_value(nextLine);
+        std::vector<std::future<unsigned long long>> baseFutures;
+        for (auto& promise : lineBases) baseFutures.push_back(promise.get_future());
+
+        std::vector<std::thread> workers;
+        workers.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this, i, &job, &chunks, &lineBases, &baseFutures, &drop]() {
+                Chunk& chunk = chunks[i];
+                unsigned long long lines = countLines(chunk.data);
+                unsigned long long base = baseFutures[i].get();
+                lineBases[i + 1].set_value(base + lines);
+
+                auto coalesce = [](std::vector<std::string_view>& spans, std::string_view text) {
+                    if (!spans.empty() && spans.back().data() + spans.back().size() == text.data()) {
+                        std::string_view& last = spans.back();
+                        last = std::string_view(last.data(), last.size() + text.size());
+                    } else {
+                        spans.push_back(text);
+                    }
+                };
+                KeepFunction collect = [&chunk, &coalesce](std::string_view text) {
+                    coalesce(chunk.keptSpans, text);
+                    return true;
+                };
+                DropFunction collectDropped;
+                if (drop) {
+                    collectDropped = [&chunk, &coalesce](std::string_view text) { coalesce(chunk.droppedSpans, text); };
+                }
+                chunk.result = classifyRange(job, chunk.data, base, chunk.output, chunk.log, collect, collectDropped);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        nextLine = baseFutures[threadCount].get();
+
+        // Replay in order
+        for (auto& chunk : chunks) {
+            std::string text = chunk.output.str();
+            if (!text.empty()) output.write(text.data(), static_cast<std::streamsize>(text.size()));
+            text = chunk.log.str();
+            if (!text.empty()) log.write(text.data(), static_cast<std::streamsize>(text.size()));
+
+            totals.add(chunk.result);
+            if (chunk.result.interrupted) {
+                totals.interrupted = true;
+                return totals;
+            }
+            for (std::string_view span : chunk.droppedSpans) {
+                drop(span);
+            }
+            for (std::string_view span : chunk.keptSpans) {
+                if (!keep(span)) {
+                    totals.writeFailed = true;
+                    return totals;
+                }
+            }
+        }
+
+        pos = roundEnd;
+    }
+
+    return totals;
+}
+
+HistoryEngine::ClassifyResult HistoryEngine::classifyPipelined(const FileJob& job, std::string_view data,
+                                                                unsigned long long firstLineNum,
+                                                                std::ostream& output, std::ostream& log,
+                                                                const KeepFunction& keep, const DropFunction& drop) const {
+    // Every stage ends its stream with an empty descriptor and keeps draining its input
+    // until it sees one, so a stage that stops early never leaves the others blocked.
+    struct ReadChunk {
+        std::string_view data;
+        bool last = false;
+    };
+    struct KeptBatch {
+        std::vector<std::string_view> spans; // Adjacent kept blocks are coalesced
+        bool last = false;
+    };
+    SpscQueue<ReadChunk, PIPELINE_QUEUE_DEPTH> readQueue;
+    SpscQueue<KeptBatch, PIPELINE_QUEUE_DEPTH> writeQueue;
+    std::atomic<bool> stopReading{false};
+    std::atomic<bool> writeFailed{false};
+
+    // Reader: cuts the input at entry boundaries and touches every page of each chunk,
+    // so page faults (disk reads for a cold mapping) happen here, ahead of classification.
+    std::thread reader([&]() {
+        size_t pos = 0;
+        while (pos < data.size() && !stopReading.load(std::memory_order_relaxed)) {
+            size_t end = findEntryBoundary(data, std::min(data.size(), pos + PIPELINE_CHUNK_SIZE));
+            unsigned char touched = 0;
+            for (size_t page = pos; page < end; page += 4096) {
+                touched ^= static_cast<unsigned char>(data[page]);
+            }
+            volatile unsigned char sink = touched; // Keeps the loads from being optimized out
+            (void)sink;
+            readQueue.push(ReadChunk{data.substr(pos, end - pos), false});
+            pos = end;
+        }
+        readQueue.push(ReadChunk{std::string_view(), true});
+    });
+
+    // Writer: hands kept spans to keep in file order
+    std::thread writer([&]() {
+        KeptBatch batch;
+        for (writeQueue.pop(batch); !batch.last; writeQueue.pop(batch)) {
+            if (writeFailed.load(std::memory_order_relaxed)) continue;
+            for (std::string_view span : batch.spans) {
+                if (!keep(span)) {
+                    writeFailed.store(true, std::memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+    });
+
+    // Classifier
+    ClassifyResult totals;
+    unsigned long long nextLine = firstLineNum;
+    bool stopped = false;
+    ReadChunk chunk;
+    for (readQueue.pop(chunk); !chunk.last; readQueue.pop(chunk)) {
+        if (stopped) continue;
+        KeptBatch batch;
+        KeepFunction collect = [&batch](std::string_view text) {
+            if (!batch.spans.empty() && batch.spans.back().data() + batch.spans.back().size() == text.data()) {
+                std::string_view& last = batch.spans.back();
+                last = std::string_view(last.data(), last.size() + text.size());
+            } else {
+                batch.spans.push_back(text);
+            }
+            return true;
+        };
+        ClassifyResult result = classifyRange(job, chunk.data, nextLine, output, log, collect, drop);
+        nextLine += result.lines;
+        totals.add(result);
+        writeQueue.push(std::move(batch));
+        if (result.interrupted || writeFailed.load(std::memory_order_relaxed)) {
+            totals.interrupted = result.interrupted;
+            stopped = true;
+            stopReading.store(true, std::memory_order_relaxed);
+        }
+    }
+    writeQueue.push(KeptBatch{{}, true});
+
+    reader.join();
+    writer.join();
+    totals.writeFailed = writeFailed.load();
+    if (totals.interrupted) {
+        totals.writeFailed = false; // Report the interruption, as the other paths do
+    }
+    return totals;
+}
+
+HistoryEngine::ClassifyResult HistoryEngine::classifyStreamPipelined(FileJob& job, int inFd, std::ostream& output,
+                                                                      const KeepFunction& keep, const DropFunction& drop,
+                                                                      StreamRead& stream) const {
+    // PIPELINE_QUEUE_DEPTH buffers circulate reader -> classifier -> writer -> reader, so
+    // the kept spans the writer is handed stay valid until it gives their buffer back.
+    struct ReadChunk {
+        size_t slot = 0;
+        size_t length = 0;
+        uintmax_t offset = 0;      // Of the chunk's first byte in the input
+        bool last = false;
+    };
+    struct KeptBatch {
+        std::vector<std::string_view> spans; // Adjacent kept blocks are coalesced
+        size_t slot = 0;
+        bool last = false;
+    };
+    std::vector<std::vector<char>> ring(PIPELINE_QUEUE_DEPTH, std::vector<char>(PIPELINE_CHUNK_SIZE));
+    SpscQueue<size_t, PIPELINE_QUEUE_DEPTH> freeSlots;
+    SpscQueue<ReadChunk, PIPELINE_QUEUE_DEPTH> readQueue;
+    SpscQueue<KeptBatch, PIPELINE_QUEUE_DEPTH> writeQueue;
+    for (size_t slot = 0; slot < ring.size(); ++slot) freeSlots.push(slot);
+    std::atomic<bool> stopReading{false};
+    std::atomic<bool> writeFailed{false};
+
+    // Reader: fills a buffer with read() and hands on its complete entries; the entry
+    // still incomplete at the end is copied to the start of the next buffer. A buffer
+    // without an entry boundary (one entry longer than it) is grown instead.
+    std::thread reader([&]() {
+        size_t slot = 0;
+        freeSlots.pop(slot);
+        size_t used = 0;       // ring[slot][0, used) is input not handed on yet
+        size_t scanned = 0;    // Lines before scanned were checked for headers already
+        size_t boundary = 0;   // The last header after the first line
+        while (!stream.eof && !stopReading.load(std::memory_order_relaxed)) {
+            std::vector<char>& buffer = ring[slot];
+            if (used == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            // Waits in poll() so a stop is seen even while no input arrives
+            struct pollfd ready = {inFd, POLLIN, 0};
+            int polled = poll(&ready, 1, 100);
+            if (polled == 0 || (polled == -1 && errno == EINTR)) {
+                if (interrupted(job)) break;
+                continue;
+            }
+            ssize_t got = polled == -1 ? -1 : ::read(inFd, buffer.data() + used, buffer.size() - used);
+            if (got == -1) {
+                if (errno == EINTR && !interrupted(job)) continue;
+                if (errno != EINTR) stream.error = errno;
+                break;
+            }
+            stream.eof = got == 0;
+            used += static_cast<size_t>(got);
+            stream.bytes += static_cast<size_t>(got);
+            if (used < buffer.size() && !stream.eof) continue;
+
+            std::string_view data(buffer.data(), used);
+            for (size_t nl = data.find('\n', scanned); nl != std::string_view::npos; nl = data.find('\n', scanned)) {
+                if (scanned > 0 && isHistoryHeader(stripLineEnding(data.substr(scanned, nl + 1 - scanned)))) {
+                    boundary = scanned;
+                }
+                scanned = nl + 1;
+            }
+            const size_t end = stream.eof ? used : boundary;
+            if (end == 0) continue;
+
+            size_t next = 0;
+            freeSlots.pop(next);
+            if (ring[next].size() < used - end) ring[next].resize(used - end);
+            std::memcpy(ring[next].data(), buffer.data() + end, used - end);
+            readQueue.push(ReadChunk{slot, end, stream.bytes - used, false});
+            slot = next;
+            used -= end;
+            scanned -= std::min(scanned, end);
+            boundary = 0;
+        }
+        readQueue.push(ReadChunk{0, 0, 0, true});
+    });
+
+    // Writer: hands kept spans to keep in file order and returns each buffer to the reader
+    std::thread writer([&]() {
+        KeptBatch batch;
+        for (writeQueue.pop(batch); !batch.last; writeQueue.pop(batch)) {
+            if (!writeFailed.load(std::memory_order_relaxed)) {
+                for (std::string_view span : batch.spans) {
+                    if (!keep(span)) {
+                        writeFailed.store(true, std::memory_order_relaxed);
+                        break;
+                    }
+                }
+            }
+            freeSlots.push(batch.slot);
+        }
+    });
+
+    // Classifier
+    ClassifyResult totals;
+    bool stopped = false;
+    ReadChunk chunk;
+    for (readQueue.pop(chunk); !chunk.last; readQueue.pop(chunk)) {
+        KeptBatch batch;
+        batch.slot = chunk.slot;
+        if (!stopped) {
+            KeepFunction collect = [&batch](std::string_view text) {
+                if (!batch.spans.empty() && batch.spans.back().data() + batch.spans.back().size() == text.data()) {
+                    std::string_view& last = batch.spans.back();
+                    last = std::string_view(last.data(), last.size() + text.size());
+                } else {
+                    batch.spans.push_back(text);
+                }
+                return true;
+            };
+            job.reportBase = ring[chunk.slot].data();
+            job.reportOffset = chunk.offset;
+            ClassifyResult result = classifyRange(job, std::string_view(ring[chunk.slot].data(), chunk.length),
+                                                  totals.lines + 1, output, *job.log, collect, drop);
+            totals.add(result);
+            if (result.interrupted || writeFailed.load(std::memory_order_relaxed)) {
+                totals.interrupted = result.interrupted;
+                stopped = true;
+                stopReading.store(true, std::memory_order_relaxed);
+            }
+        }
+        writeQueue.push(std::move(batch)); // Even when stopped, to free the buffer
+    }
+    writeQueue.push(KeptBatch{{}, 0, true});
+
+    reader.join();
+    writer.join();
+    totals.writeFailed = writeFailed.load();
+    if (totals.interrupted) {
+        totals.writeFailed = false; // Report the interruption, as the other paths do
+    }
+    return totals;
+}
+
+bool HistoryEngine::createTempFile(FileJob& job, BufferedFileWriter& writer) const {
+    // Random name in the history file's directory so the final rename stays atomic.
+    // O_EXCL guards against clobbering an existing file; retry on the (unlikely) collision.
+    // The path is registered before the file exists, so the signal handler never misses it.
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        job.tempPath = job.historyPath.parent_path() / randomString(15);
+        job.tempSlot = registerTempFile(job.tempPath);
+        if (job.tempSlot == -1) {
+            *job.log << "Error: Too many temporary files in flight" << std::endl;
+            break;
+        }
+        if (writer.create(job.tempPath, *job.log)) {
+            return true;
+        }
+        int error = errno;
+        unregisterTempFile(job.tempSlot);
+        job.tempSlot = -1;
+        if (error != EEXIST) {
+            break;
+        }
+    }
+    job.tempPath.clear();
+    *job.log << "Error: Cannot create new history file" << std::endl;
+    return fail(job, "Cannot create new history file.");
+}
+
+HistoryEngine::ClassifyResult HistoryEngine::classifyRanges(const FileJob& job, std::string_view input,
+                                                             const std::vector<TimeWindowRange>& bodies,
+                                                             std::ostream& output, std::ostream& log,
+                                                             const KeepFunction& keep, const DropFunction& drop) const {
+    ClassifyResult totals;
+    size_t parsed = 0;
+    for (const TimeWindowRange& range : bodies) parsed += range.end - range.begin;
+    progressClassifyStart(parsed);
+
+    unsigned long long linesBefore = 0; // Lines of input before pos
+    size_t pos = 0;
+    for (const TimeWindowRange& range : bodies) {
+        std::string_view gap = input.substr(pos, range.begin - pos);
+        if (!gap.empty() && !keep(gap)) {
+            totals.writeFailed = true;
+            return totals;
+        }
+        linesBefore += countLines(gap);
+
+        std::string_view body = input.substr(range.begin, range.end - range.begin);
+        ClassifyResult result;
+        if (config_.pipeline && !job.readWhole) {
+            result = classifyPipelined(job, body, linesBefore + 1, output, log, keep, drop);
+        } else if (config_.threads <= 1) {
+            result = classifyRange(job, body, linesBefore + 1, output, log, keep, drop);
+        } else {
+            result = classifyParallel(job, body, linesBefore + 1, output, log, keep, drop);
+        }
+        totals.add(result);
+        linesBefore += result.lines;
+        if (result.interrupted || result.writeFailed) {
+            totals.interrupted = result.interrupted;
+            totals.writeFailed = result.writeFailed;
+            return totals;
+        }
+        pos = range.end;
+    }
+
+    std::string_view tail = input.substr(pos);
+    if (!tail.empty() && !keep(tail)) {
+        totals.writeFailed = true;
+    }
+    totals.lines = linesBefore + countLines(tail);
+    return totals;
+}
+
+void HistoryEngine::planIncremental(FileJob& job, std::string_view input, IncrementalStart& start,
+                                    std::vector<TimeWindowRange>& bodies) const {
+    HistoryCheckpoint checkpoint;
+    if (!loadCheckpoint(job.historyPath, checkpoint)) {
+        *job.info << "Incremental: no checkpoint found; classifying the whole history." << std::endl;
+        return;
+    }
+    if (checkpoint.filterFingerprint != filterFingerprint_) {
+        *job.info << "Incremental: filters differ from the checkpoint's; classifying the whole history." << std::endl;
+        return;
+    }
+    if (checkpoint.offset > input.size() ||
+        XxHash64::of(input.substr(0, checkpoint.offset)) != checkpoint.prefixHash) {
+        *job.info << "Incremental: history file was rewritten since the checkpoint; classifying the whole history." << std::endl;
+        return;
+    }
+    const size_t prefixEnd = static_cast<size_t>(checkpoint.offset);
+    start.hashed = prefixEnd;
+    start.hash.update(input.substr(0, prefixEnd));
+
+    // Every entry in the prefix was kept under the checkpoint's window. With the same
+    // filters, only entries timestamped inside the new window but outside the old one can
+    // be decided differently now; the same pass as --seek's finds where they are.
+    std::string_view prefix = input.substr(0, prefixEnd);
+    std::vector<std::pair<std::time_t, std::time_t>> slices;
+    const std::time_t windowStart = config_.startTimestamp;
+    const std::time_t windowEnd = config_.endTimestamp;
+    if (!rules_.empty()) {
+        // An entry's verdict depends on which rules' windows hold it. Entries that entered
+        // or left any rule's window since the checkpoint are classified again.
+        if (checkpoint.ruleWindows.size() != rules_.size()) {
+            *job.info << "Incremental: filters differ from the checkpoint's; classifying the whole history." << std::endl;
+            return;
+        }
+        for (size_t i = 0; i < rules_.size(); ++i) {
+            const std::time_t oldStart = checkpoint.ruleWindows[i].first;
+            const std::time_t oldEnd = checkpoint.ruleWindows[i].second;
+            const CompiledRule& rule = rules_[i];
+            if (rule.startTimestamp != oldStart) {
+                slices.emplace_back(std::min(rule.startTimestamp, oldStart), std::max(rule.startTimestamp, oldStart) - 1);
+            }
+            if (rule.endTimestamp != oldEnd) {
+                slices.emplace_back(std::min(rule.endTimestamp, oldEnd) + 1, std::max(rule.endTimestamp, oldEnd));
+            }
+        }
+    } else {
+        if (windowStart < checkpoint.startTimestamp) {
+            slices.emplace_back(windowStart, std::min(windowEnd, checkpoint.startTimestamp - 1));
+        }
+        if (windowEnd > checkpoint.endTimestamp) {
+            slices.emplace_back(std::max(windowStart, checkpoint.endTimestamp + 1), windowEnd);
+        }
+    }
+    std::vector<TimeWindowRange> ranges;
+    if (!slices.empty() && !locateTimeWindows(prefix, slices, SEEK_ORDER_SLACK_SECONDS, ranges)) {
+        *job.info << "Incremental: history timestamps are out of order; classifying the whole history." << std::endl;
+        return;
+    }
+    ranges.erase(std::remove_if(ranges.begin(), ranges.end(),
+                                [](const TimeWindowRange& range) { return range.begin >= range.end; }),
+                 ranges.end());
+
+    // Two slices may overlap once widened by the seek slack
+    ranges.push_back(TimeWindowRange{prefixEnd, input.size()});
+    std::sort(ranges.begin(), ranges.end(),
+              [](const TimeWindowRange& a, const TimeWindowRange& b) { return a.begin < b.begin; });
+    bodies.clear();
+    for (const TimeWindowRange& range : ranges) {
+        if (!bodies.empty() && range.begin <= bodies.back().end) {
+            bodies.back().end = std::max(bodies.back().end, range.end);
+        } else {
+            bodies.push_back(range);
+        }
+    }
+    start.usable = true;
+    *job.info << "Incremental: checkpoint covers " << prefixEnd << " of " << input.size() << " bytes." << std::endl;
+}
+
+HistoryCheckpoint HistoryEngine::checkpointFor(std::string_view content, XxHash64 hash, size_t hashed) const {
+    // A partial last line may still grow, so the checkpoint ends at the last newline
+    size_t lastNewline = content.rfind('\n');
+    size_t offset = (lastNewline == std::string_view::npos) ? 0 : lastNewline + 1;
+    if (hashed > offset) {
+        hash = XxHash64();
+        hashed = 0;
+    }
+    hash.update(content.substr(hashed, offset - hashed));
+
+    HistoryCheckpoint checkpoint;
+    checkpoint.offset = offset;
+    checkpoint.prefixHash = hash.digest();
+    checkpoint.startTimestamp = config_.startTimestamp;
+    checkpoint.endTimestamp = config_.endTimestamp;
+    checkpoint.filterFingerprint = filterFingerprint_;
+    for (const CompiledRule& rule : rules_) {
+        checkpoint.ruleWindows.emplace_back(rule.startTimestamp, rule.endTimestamp);
+    }
+    return checkpoint;
+}
+
+void HistoryEngine::saveCheckpointAfterRewrite(FileJob& job, uintmax_t cleanedSize) const {
+    // Only the bytes this run produced are vouched for, not anything appended since
+    HistoryFileView cleaned;
+    if (!cleaned.open(job.historyPath, *job.log) || cleaned.data().size() < cleanedSize) {
+        *job.log << "Warning: Cannot read back the history file; checkpoint not updated." << std::endl;
+        return;
+    }
+    std::string_view content = cleaned.data().substr(0, static_cast<size_t>(cleanedSize));
+    saveCheckpoint(job.historyPath, checkpointFor(content, XxHash64(), 0), *job.log);
+}
+
+bool HistoryEngine::processHistory(FileJob& job, std::ostream& output) const {
+    // Check for interruption before opening files
+    if (interrupted(job)) { *job.log << "Interrupted before processing history.\n"; return fail(job, "Interrupted."); }
+
+    // Covers mapping, seeking and every classification pass; the temp file writes happen
+    // during the pass and are also counted as the write phase.
+    PhaseTimer readTimer(job.stats, RunPhase::ReadParse);
+    HistoryFileView historyView;
+    if (!historyView.open(job.historyPath, *job.log)) {
+        return fail(job, "Cannot read the history file.");
+    }
+    // The pipeline's reader stage faults in pages of the mapping ahead of the classifier;
+    // the read() fallback has already copied the whole file, which leaves it nothing to do
+    if (config_.pipeline && !historyView.isMapped() && !historyView.data().empty()) {
+        *job.info << "Info: " << job.historyPath.string() << " cannot be memory-mapped (a pipe, special file"
+                  << " or failed mmap) and was read whole; classifying it without --pipeline." << std::endl;
+        job.readWhole = true;
+    }
+    job.scannedExists = historyView.exists();
+    job.scannedDevice = historyView.device();
+    job.scannedInode = historyView.inode();
+    job.scannedSize = historyView.data().size();
+    job.reportBase = historyView.data().data();
+    job.reportOffset = 0;
+
+    // With --seek, only the byte range that can hold entries inside the time window is
+    // parsed; the head and tail around it are copied through unchanged.
+    std::string_view input = historyView.data();
+    TimeWindowRange window{0, input.size()};
+    bool timeUnbounded = config_.startTimestamp == 0 && config_.endTimestamp == std::numeric_limits<std::time_t>::max();
+    if (config_.seekByTime && !timeUnbounded) {
+        if (!locateTimeWindow(input, config_.startTimestamp, config_.endTimestamp, SEEK_ORDER_SLACK_SECONDS, window)) {
+            *job.info << "Info: History timestamps are out of order; falling back to a full scan." << std::endl;
+            window = TimeWindowRange{0, input.size()};
+        }
+    }
+    std::vector<TimeWindowRange> bodies{window};
+
+    // With --incremental, a checkpoint from an earlier run lets the prefix it covers be
+    // copied through as well, apart from what the time window newly reaches
+    IncrementalStart incremental;
+    if (config_.incremental) {
+        planIncremental(job, input, incremental, bodies);
+    }
+
+    auto recordPass = [&](const ClassifyResult& totals) {
+        if (job.stats == nullptr) return;
+        (*job.stats)[RunPhase::ReadParse].bytes += input.size();
+        addMatchTiming(*job.stats, RunPhase::FilterKeyword, totals.keywordTiming);
+        addMatchTiming(*job.stats, RunPhase::FilterRegex, totals.regexTiming);
+    };
+
+    auto reportTotals = [&](const ClassifyResult& totals) {
+        job.totals = totals;
+        if (incremental.usable) {
+            size_t parsed = 0;
+            for (const TimeWindowRange& range : bodies) parsed += range.end - range.begin;
+            *job.info << "Incremental: parsed " << parsed << " of " << input.size()
+                      << " bytes; entries already cleaned by an earlier run were kept without being counted." << std::endl;
+        } else if (window.begin != 0 || window.end != input.size()) {
+            *job.info << "Seek: parsed " << (window.end - window.begin) << " of " << input.size()
+                      << " bytes; entries outside the time window were kept without being counted." << std::endl;
+        }
+        *job.info << "Processing complete. Lines read: " << totals.lines
+                  << ", Entries kept: " << totals.kept
+                  << ", Entries " << (config_.dryRun ? "to be deleted" : "deleted") << ": " << totals.deleted;
+        if (config_.dedup != DedupMode::None) {
+            *job.info << " (duplicates: " << totals.duplicates << ")";
+        }
+        *job.info << std::endl;
+    };
+
+    // --in-place: a planning pass records where the kept bytes are. When everything that
+    // goes is one contiguous range with at most IN_PLACE_MAX_SHIFT bytes after it (the newest
+    // entries, or the ones --watch just saw appended) only that range is shredded and cut
+    // out; otherwise the history is rewritten as usual. Shifting more down in place would
+    // leave a crash with a duplicated, torn history and no intact copy; the rewrite always
+    // has one. It normalizes line endings, so in-place is only used when that is a no-op.
+    // --incremental plans the same way, so a run that deletes nothing leaves the file alone.
+    std::ostream discard(nullptr); // Swallows the repeated warnings of a second pass
+    bool replaying = false;
+    bool normalized = input.empty() || input.back() == '\n';
+
+    // --dedup: the index refers to commands in the mapping, so it lives as long as the
+    // passes do. Under keep-last, which entry of a command comes last is only known at the
+    // end, so a recording pass over the same ranges goes first.
+    // So that only the recording pass matches, it also notes what the filters decided.
+    DuplicateIndex duplicates(config_.dedup);
+    FilterVerdicts verdicts;
+    job.duplicates = config_.dedup == DedupMode::None ? nullptr : &duplicates;
+    if (config_.dedup == DedupMode::KeepLast) {
+        if (!config_.keywords.empty() || !config_.regexes.empty() || !rules_.empty()) {
+            job.verdicts = &verdicts;
+            verdicts.recording = true;
+        }
+        duplicates.startRecording();
+        KeepFunction skip = [](std::string_view) { return true; };
+        ClassifyResult recorded = classifyRanges(job, input, bodies, discard, discard, skip, DropFunction());
+        recordPass(recorded);
+        if (recorded.interrupted) {
+            *job.log << "\nInterrupted during history processing.\n";
+            return fail(job, "Interrupted.");
+        }
+    }
+
+    // --archive: deleted entries go to the archive as the pass finds them, through a
+    // writer thread of its own. Only the pass that deletes gives them to it (a replaying
+    // pass deletes the same entries again); the archive is made durable before anything
+    // is destroyed.
+    std::unique_ptr<ArchiveWriter> archive;
+    DropFunction archiveDrop;
+    if (!openArchive(job, archive)) {
+        return false;
+    }
+    if (archive) {
+        archiveDrop = [&archive](std::string_view text) { archive->add(text); };
+    }
+
+    // With more than IN_PLACE_MAX_SHIFT after a single deleted range (the oldest entries,
+    // as a nightly older_than run deletes), the rewrite copies the rest as the planning
+    // pass found it, and only the range is shredded in the original.
+    ClassifyResult planned;
+    bool copyKept = false;
+    size_t gapBegin = 0, gapEnd = 0;
+    if ((config_.inPlace || config_.incremental) && !config_.dryRun) {
+        size_t expected = 0;   // End of the previous kept span
+        size_t gaps = 0;
+        KeepFunction plan = [&](std::string_view text) {
+            size_t offset = static_cast<size_t>(text.data() - input.data());
+            if (offset != expected && ++gaps == 1) {
+                gapBegin = expected;
+                gapEnd = offset;
+            }
+            if (normalized && text.find('\r') != std::string_view::npos) {
+                normalized = false;
+            }
+            expected = offset + text.size();
+            return true;
+        };
+        duplicates.startPass();
+        verdicts.startPass();
+        ClassifyResult totals = classifyRanges(job, input, bodies, output, *job.log, plan, archiveDrop);
+        recordPass(totals);
+        if (totals.interrupted) {
+            *job.log << "\nInterrupted during history processing.\n";
+            return fail(job, "Interrupted.");
+        }
+        if (expected != input.size() && ++gaps == 1) {
+            gapBegin = expected;
+            gapEnd = input.size();
+        }
+
+        const bool shortShift = input.size() - gapEnd <= IN_PLACE_MAX_SHIFT;
+        if ((gaps == 0 || (config_.inPlace && gaps == 1 && shortShift)) && normalized) {
+            readTimer.stop();
+            reportTotals(totals);
+            // The file is either left as it is or only loses the gap, so the checkpoint
+            // is known before the mapping goes away
+            HistoryCheckpoint checkpoint;
+            if (config_.incremental && gaps == 0) {
+                checkpoint = checkpointFor(input, incremental.hash, incremental.hashed);
+            }
+            historyView.close();
+            IoLimiter::Lease ioLease(job.ioLimiter);
+            if (!finishArchive(job, archive.get())) {
+                *job.log << "Archive failed. Aborting cleanup to preserve original file." << std::endl;
+                return false;
+            }
+            if (!removeInPlace(job, gapBegin, gapEnd - gapBegin, output)) {
+                return false;
+            }
+            if (config_.incremental && gaps == 0) {
+                saveCheckpoint(job.historyPath, checkpoint, *job.log);
+            } else if (config_.incremental) {
+                saveCheckpointAfterRewrite(job, input.size() - (gapEnd - gapBegin));
+            }
+            return true;
+        }
+        if (config_.inPlace && gaps == 1 && normalized) {
+            output << "In-place: " << (input.size() - gapEnd) << " bytes follow the deleted range, more than "
+                   << (IN_PLACE_MAX_SHIFT >> 10) << " KiB to move safely; rewriting the history file and shredding"
+                   << " only the deleted range." << std::endl;
+            planned = totals;
+            copyKept = true;
+            job.shredOffset = gapBegin;
+            job.shredLength = gapEnd - gapBegin;
+        } else if (config_.inPlace && gaps == 1 && !shortShift) {
+            output << "In-place: " << (input.size() - gapEnd) << " bytes follow the deleted range, more than "
+                   << (IN_PLACE_MAX_SHIFT >> 10) << " KiB to move safely; rewriting the history file." << std::endl;
+        } else if (config_.inPlace) {
+            output << "In-place: deleted entries are not one contiguous range; rewriting the history file." << std::endl;
+        }
+        replaying = true;
+    }
+
+    // Kept entries are streamed to the temp file as they are classified, so memory use
+    // stays flat regardless of history size. The temp path is registered in job.tempPath
+    // before the file is created, so cleanup() and the signal handler can always remove it.
+    BufferedFileWriter newFile(WRITE_BUFFER_SIZE);
+    if (!config_.dryRun) {
+        PhaseTimer writeTimer(job.stats, RunPhase::Write);
+        if (!createTempFile(job, newFile)) {
+            return false;
+        }
+        newFile.trackWrites(job.stats);
+    }
+
+    auto abortProcessing = [&]() {
+        newFile.close(false);
+        cleanup(job);  // This will handle removing the temp file
+        return false;
+    };
+
+    KeepFunction keepBlock = [&](std::string_view text) {
+        if (config_.dryRun) return true;
+        forEachNormalizedPiece(text, [&newFile](std::string_view piece) {
+            newFile.write(piece);
+        });
+        return !newFile.failed();
+    };
+
+    ClassifyResult totals;
+    if (copyKept) {
+        totals = planned;
+        totals.writeFailed = !keepBlock(input.substr(0, gapBegin)) || !keepBlock(input.substr(gapEnd));
+    } else {
+        duplicates.startPass();
+        verdicts.startPass();
+        totals = classifyRanges(job, input, bodies, output, replaying ? discard : *job.log,
+                                keepBlock, replaying ? DropFunction() : archiveDrop);
+        recordPass(totals);
+    }
+    readTimer.stop();
+
+    if (totals.interrupted) {
+        *job.log << "\nInterrupted during history processing.\n";
+        fail(job, "Interrupted.");
+        return abortProcessing();
+    }
+    if (totals.writeFailed) {
+        *job.log << "Error: Failed to write to new history file (" << std::strerror(newFile.lastError()) << ")" << std::endl;
+        fail(job, "Failed to write to new history file.");
+        return abortProcessing();
+    }
+
+    if (config_.dryRun) {
+        reportTotals(totals);
+        return true;
+    }
+
+    const bool wholeLines = input.empty() || input.back() == '\n';
+    if (job.duplicates == nullptr) {
+        historyView.close(); // Otherwise the duplicate index needs it for the appended tail
+    }
+    KeepFunction keepTail = [&](std::string_view text) {
+        if (text.find('\r') != std::string_view::npos) normalized = false;
+        return keepBlock(text);
+    };
+    if (!installRewrite(job, newFile, archive.get(), wholeLines, keepTail, archiveDrop, totals,
+                        [&]() { reportTotals(totals); }, output)) {
+        return false;
+    }
+    historyView.close();
+
+    // Entries whose line endings the rewrite changed can classify differently next
+    // time, so a checkpoint is only saved once the kept bytes came through unchanged
+    if (config_.incremental && normalized) {
+        saveCheckpointAfterRewrite(job, newFile.bytesWritten());
+    } else if (config_.incremental) {
+        *job.info << "Incremental: line endings were normalized; the next run classifies the whole history again." << std::endl;
+    }
+
+    return true;
+}
+
+bool HistoryEngine::installRewrite(FileJob& job, BufferedFileWriter& newFile, ArchiveWriter* archive, bool wholeLines,
+                                   const KeepFunction& keep, const DropFunction& drop, ClassifyResult& totals,
+                                   const std::function<void()>& report, std::ostream& output) const {
+    auto abortProcessing = [&]() {
+        newFile.close(false);
+        cleanup(job);  // This will handle removing the temp file
+        return false;
+    };
+
+    // Syncing, backing up and shredding are I/O bound; batch mode caps how many files do so at once
+    IoLimiter::Lease ioLease(job.ioLimiter);
+
+    // Everything expensive happens before zsh's lock is taken: the bulk of the new file is
+    // made durable and the backup made now, so shells only wait for the appended tail (if
+    // any), an fsync of it and the rename.
+    if (!newFile.sync()) {
+        *job.log << "Error: Failed to write to new history file (" << std::strerror(newFile.lastError()) << ")" << std::endl;
+        fail(job, "Failed to write to new history file.");
+        return abortProcessing();
+    }
+    if (config_.backup && job.scannedExists) { // Nothing to back up for a new file
+        if (!backupHistoryFile(job)) {
+            *job.log << "Backup failed. Aborting cleanup to preserve original file." << std::endl;
+            return abortProcessing();
+        }
+        if (interrupted(job)) {
+            *job.log << "Interrupted after backup.\n";
+            fail(job, "Interrupted.");
+            return abortProcessing();
+        }
+    }
+
+    HistoryLock lock;
+    uintmax_t currentSize = 0;
+    if (!lockHistory(job, lock, currentSize)) {
+        return abortProcessing();
+    }
+    PhaseTimer lockTimer(job.stats, RunPhase::Lock);
+
+    // Entries appended while the unlocked pass ran are classified now, as a continuation
+    if (currentSize > job.scannedSize) {
+        if (!wholeLines) {
+            // The pass ended inside a line that was still being written
+            lock.release();
+            job.replaced = true;
+            fail(job, "History file was still being written to.");
+            return abortProcessing();
+        }
+        std::string tail;
+        if (!readRange(lock.fd(), job.scannedSize, currentSize - job.scannedSize, tail)) {
+            *job.log << "Error: Cannot read the entries appended to the history file (" << std::strerror(errno) << ")" << std::endl;
+            fail(job, "Cannot read the history file.");
+            return abortProcessing();
+        }
+        ClassifyResult tailTotals = classifyRange(job, tail, totals.lines + 1, output, *job.log, keep, drop);
+        totals.add(tailTotals);
+        if (tailTotals.writeFailed) {
+            *job.log << "Error: Failed to write to new history file (" << std::strerror(newFile.lastError()) << ")" << std::endl;
+            fail(job, "Failed to write to new history file.");
+            return abortProcessing();
+        }
+        *job.info << "Lock: " << tail.size() << " bytes appended during the run were classified as well." << std::endl;
+    }
+
+    // Make the new file durable before the original is destroyed
+    if (!newFile.close(true)) {
+        *job.log << "Error: Failed to write to new history file (" << std::strerror(newFile.lastError()) << ")" << std::endl;
+        fail(job, "Failed to write to new history file.");
+        return abortProcessing();
+    }
+    if (job.stats != nullptr) {
+        (*job.stats)[RunPhase::Write].bytes += newFile.bytesWritten();
+    }
+    if (!finishArchive(job, archive)) {
+        *job.log << "Archive failed. Aborting cleanup to preserve original file." << std::endl;
+        return abortProcessing();
+    }
+
+    // Check for interruption
+    if (interrupted(job)) {
+        *job.log << "Interrupted before final cleanup steps.\n";
+        fail(job, "Interrupted.");
+        return abortProcessing();
+    }
+
+    // Once the rename (or shredding the original) starts, the temp file is the only copy
+    // of the kept entries: termination waits until the original is gone.
+    TerminationGuard guard;
+
+    // The original is kept reachable under a hidden temporary name across the rename, so it
+    // can be shredded after the lock is released. Without hard links it is shredded under
+    // the lock, before the rename, as it always used to be (secureDelete's own descriptor
+    // then drops the fcntl() lock early; $HISTFILE.LOCK is still held), unless the shred
+    // is deferred: then it is renamed out of the way, shells being locked out meanwhile.
+    // The hidden name is recorded before it exists, so a run killed before the original is
+    // shredded or queued leaves it for the next run to find (recoverPendingShred()).
+    const bool deferShred = !config_.shredQueue.empty();
+    fs::path original = job.historyPath.parent_path() / ("." + randomString(15));
+    PendingShred pending;
+    const bool recorded = job.scannedExists && pending.record(job.historyPath, original, job.scannedDevice,
+                                                              job.scannedInode, config_.shredPasses, *job.log);
+    const bool linked = recorded && link(job.historyPath.c_str(), original.c_str()) == 0;
+    const bool movedAside = !linked && recorded && deferShred &&
+                            std::rename(job.historyPath.c_str(), original.c_str()) == 0;
+    if (!linked && !movedAside) {
+        original.clear();
+        pending.clear();
+        if (job.scannedExists && !performCleanup(job, job.historyPath, output)) { // A new file replaces nothing
+            cleanup(job);  // This will handle removing the temp file
+            return false;
+        }
+    }
+
+    // Rename new file to original name
+    std::error_code ec;
+    PhaseTimer renameTimer(job.stats, RunPhase::Rename);
+    fs::rename(job.tempPath, job.historyPath, ec);
+    renameTimer.stop();
+    if (ec) {
+        *job.log << "Error: Failed to rename new history file" << std::endl;
+        if (movedAside) {
+            std::rename(original.c_str(), job.historyPath.c_str()); // Put the original back
+        } else if (!original.empty()) {
+            fs::remove(original, ec); // The history file is still in place
+        }
+        pending.clear();
+        cleanup(job);  // This will handle removing the temp file
+        return fail(job, "Failed to rename new history file.");
+    }
+    job.tempPath.clear();  // Successfully renamed, clear the path
+    unregisterTempFile(job.tempSlot);
+    job.tempSlot = -1;
+    // Queued only now: before the rename, shredding the original would have shredded the
+    // live history file. If queueing fails it is shredded right away.
+    if (deferShred && !original.empty() && enqueueShred(config_.shredQueue, original, config_.shredPasses, *job.log)) {
+        job.shredQueued = true;
+        pending.clear(); // The queue entry takes over
+    }
+    lock.release();
+    lockTimer.stop();
+
+    report();
+    if (job.shredQueued) {
+        output << "Original history file queued for secure deletion: " << original.string() << std::endl;
+    } else if (!original.empty()) {
+        if (!performCleanup(job, original, output)) {
+            return false; // Still recorded: the next run tries again
+        }
+        pending.clear();
+    }
+
+    return true;
+}
+
+bool HistoryEngine::filterStream(FileJob& job, int inFd, int outFd, std::ostream& output) const {
+    PhaseTimer readTimer(job.stats, RunPhase::ReadParse);
+    BufferedFileWriter out(WRITE_BUFFER_SIZE);
+    if (!config_.dryRun) {
+        out.attach(outFd);
+        out.trackWrites(job.stats);
+    }
+    std::unique_ptr<ArchiveWriter> archive;
+    DropFunction archiveDrop;
+    if (!openArchive(job, archive)) {
+        return false;
+    }
+    if (archive) {
+        archiveDrop = [&archive](std::string_view text) { archive->add(text); };
+    }
+    struct stat st;
+    if (fstat(inFd, &st) == 0 && S_ISREG(st.st_mode)) {
+        progressClassifyStart(static_cast<uint64_t>(st.st_size)); // A pipe's length is not known in advance
+    }
+    KeepFunction keepBlock = [&](std::string_view text) {
+        if (config_.dryRun) return true;
+        forEachNormalizedPiece(text, [&out](std::string_view piece) {
+            out.write(piece);
+        });
+        return !out.failed();
+    };
+
+    bool eof = false;
+    uintmax_t bytesRead = 0;
+    ClassifyResult totals;
+    if (config_.pipeline) {
+        StreamRead stream;
+        totals = classifyStreamPipelined(job, inFd, output, keepBlock, archiveDrop, stream);
+        if (stream.error != 0) {
+            *job.log << "Error: Cannot read the history (" << std::strerror(stream.error) << ")" << std::endl;
+            return fail(job, "Cannot read the history.");
+        }
+        eof = stream.eof;
+        bytesRead = stream.bytes;
+    } else {
+        // buffer[0, used) is input not classified yet. It starts at an entry boundary (or at
+        // the start of the input); lines before scanned were checked for headers already, and
+        // boundary is the last header after the first line, where the complete entries end.
+        std::vector<char> buffer(STREAM_BUFFER_SIZE);
+        size_t used = 0;
+        size_t scanned = 0;
+        size_t boundary = 0;
+        while (!eof) {
+            if (used == buffer.size()) {
+                buffer.resize(buffer.size() * 2); // One entry longer than the buffer
+            }
+            ssize_t got = read(inFd, buffer.data() + used, buffer.size() - used);
+            if (got == -1) {
+                if (errno == EINTR && !interrupted(job)) continue;
+                if (errno == EINTR) break;
+                *job.log << "Error: Cannot read the history (" << std::strerror(errno) << ")" << std::endl;
+                return fail(job, "Cannot read the history.");
+            }
+            eof = got == 0;
+            used += static_cast<size_t>(got);
+            bytesRead += static_cast<size_t>(got);
+
+            std::string_view data(buffer.data(), used);
+            for (size_t nl = data.find('\n', scanned); nl != std::string_view::npos; nl = data.find('\n', scanned)) {
+                if (scanned > 0 && isHistoryHeader(stripLineEnding(data.substr(scanned, nl + 1 - scanned)))) {
+                    boundary = scanned;
+                }
+                scanned = nl + 1;
+            }
+            const size_t end = eof ? used : boundary;
+            if (end == 0) continue;
+
+            job.reportBase = buffer.data();
+            job.reportOffset = bytesRead - used;
+            ClassifyResult result = classifyRange(job, data.substr(0, end), totals.lines + 1, output, *job.log,
+                                                  keepBlock, archiveDrop);
+            totals.add(result);
+            if (result.interrupted || result.writeFailed) {
+                totals.interrupted = result.interrupted;
+                totals.writeFailed = result.writeFailed && !result.interrupted;
+                break;
+            }
+            std::memmove(buffer.data(), buffer.data() + end, used - end);
+            used -= end;
+            scanned -= std::min(scanned, end);
+            boundary = 0;
+        }
+    }
+    if (!out.close(false)) {
+        totals.writeFailed = true;
+    }
+    readTimer.stop();
+    if (job.stats != nullptr) {
+        (*job.stats)[RunPhase::ReadParse].bytes += bytesRead;
+        addMatchTiming(*job.stats, RunPhase::FilterKeyword, totals.keywordTiming);
+        addMatchTiming(*job.stats, RunPhase::FilterRegex, totals.regexTiming);
+    }
+    job.totals = totals;
+
+    if (totals.interrupted || (!eof && !totals.writeFailed)) {
+        *job.log << "\nInterrupted during history processing.\n";
+        return fail(job, "Interrupted.");
+    }
+    if (totals.writeFailed) {
+        *job.log << "Error: Failed to write the filtered history (" << std::strerror(out.lastError()) << ")" << std::endl;
+        return fail(job, "Failed to write the filtered history.");
+    }
+    if (!finishArchive(job, archive.get())) {
+        return false;
+    }
+    *job.info << "Processing complete. Lines read: " << totals.lines
+              << ", Entries kept: " << totals.kept
+              << ", Entries " << (config_.dryRun ? "to be deleted" : "deleted") << ": " << totals.deleted << std::endl;
+    return true;
+}
+
+bool HistoryEngine::mergeHistories(FileJob& job, const std::vector<fs::path>& inputs, std::ostream& output) const {
+    if (interrupted(job)) { *job.log << "Interrupted before processing history.\n"; return fail(job, "Interrupted."); }
+    PhaseTimer readTimer(job.stats, RunPhase::ReadParse);
+
+    // The history file is only replaced if it is one of the inputs (or holds nothing); it
+    // is then checked again under zsh's lock like a rewrite's input.
+    struct stat st;
+    job.scannedExists = ::stat(job.historyPath.c_str(), &st) == 0;
+    job.scannedDevice = job.scannedExists ? static_cast<uint64_t>(st.st_dev) : 0;
+    job.scannedInode = job.scannedExists ? static_cast<uint64_t>(st.st_ino) : 0;
+    job.scannedSize = job.scannedExists ? static_cast<uintmax_t>(st.st_size) : 0;
+
+    std::vector<MergeSource> sources(inputs.size());
+    size_t historyInput = inputs.size();
+    uint64_t knownSize = 0;             // Of the regular files among the inputs, for --progress
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        MergeSource& source = sources[i];
+        source.path = inputs[i];
+        source.fd = ::open(inputs[i].c_str(), O_RDONLY | O_CLOEXEC);
+        if (source.fd == -1 || fstat(source.fd, &st) == -1) {
+            *job.log << "Error: Cannot read " << inputs[i].string() << " (" << std::strerror(errno) << ")" << std::endl;
+            return fail(job, "Cannot read a history to merge.");
+        }
+        if (S_ISDIR(st.st_mode)) {
+            *job.log << "Error: Cannot read " << inputs[i].string() << " (" << std::strerror(EISDIR) << ")" << std::endl;
+            return fail(job, "Cannot read a history to merge.");
+        }
+        bool repeated = false;
+        for (size_t j = 0; j < i && !repeated; ++j) {
+            struct stat other;
+            repeated = sources[j].fd != -1 && fstat(sources[j].fd, &other) == 0 && S_ISREG(st.st_mode) &&
+                       other.st_dev == st.st_dev && other.st_ino == st.st_ino;
+        }
+        if (repeated) {
+            *job.log << "Warning: " << inputs[i].string() << " was given more than once; merging it once." << std::endl;
+            close(source.fd);
+            source.fd = -1;
+            continue;
+        }
+        if (job.scannedExists && static_cast<uint64_t>(st.st_dev) == job.scannedDevice &&
+            static_cast<uint64_t>(st.st_ino) == job.scannedInode) {
+            historyInput = i;
+        }
+        if (S_ISREG(st.st_mode)) knownSize += static_cast<uint64_t>(st.st_size);
+        source.reader = std::make_unique<HistoryStreamReader>(source.fd, MERGE_BUFFER_SIZE);
+    }
+    if (job.scannedSize > 0 && historyInput == inputs.size()) {
+        *job.log << "Error: " << job.historyPath.string() << " is not one of the histories to merge; list it"
+                 << " among them to keep its entries, or merge into another file." << std::endl;
+        return fail(job, "The history file is not one of the histories to merge.");
+    }
+    progressClassifyStart(knownSize); // Pipes add to what is done, not to the total
+
+    // New entries only ever come from the merge, so --dedup keeps what it needs to compare
+    DuplicateIndex duplicates(config_.dedup, true);
+    job.duplicates = config_.dedup == DedupMode::None ? nullptr : &duplicates;
+    duplicates.startPass();
+
+    std::unique_ptr<ArchiveWriter> archive;
+    DropFunction archiveDrop;
+    if (!openArchive(job, archive)) {
+        return false;
+    }
+    if (archive) {
+        archiveDrop = [&archive](std::string_view text) { archive->add(text); };
+    }
+
+    BufferedFileWriter newFile(WRITE_BUFFER_SIZE);
+    if (!config_.dryRun) {
+        PhaseTimer writeTimer(job.stats, RunPhase::Write);
+        if (!createTempFile(job, newFile)) {
+            return false;
+        }
+        newFile.trackWrites(job.stats);
+    }
+    auto abortProcessing = [&]() {
+        newFile.close(false);
+        cleanup(job);  // This will handle removing the temp file
+        return false;
+    };
+    KeepFunction keepBlock = [&](std::string_view text) {
+        if (config_.dryRun) return true;
+        forEachNormalizedPiece(text, [&newFile](std::string_view piece) {
+            newFile.write(piece);
+        });
+        return !newFile.failed();
+    };
+
+    // Each input holds one entry in the heap, so the merge costs O(log k) per entry
+    std::vector<MergeHead> heap;
+    heap.reserve(sources.size());
+    bool readFailed = false;
+    auto advance = [&](size_t input) {
+        MergeSource& source = sources[input];
+        while (!source.reader->next(source.block)) {
+            const int error = source.reader->error();
+            if (error == 0) return true; // Exhausted
+            if (error == EINTR && !interrupted(job)) continue;
+            if (error != EINTR) {
+                *job.log << "Error: Cannot read " << source.path.string() << " (" << std::strerror(error) << ")" << std::endl;
+                fail(job, "Cannot read a history to merge.");
+            }
+            readFailed = true;
+            return false;
+        }
+        HistoryHeader header;
+        if (source.block.hasHeader &&
+            parseHistoryHeader(stripLineEnding(source.block.text.substr(0, source.block.firstLineLength)), header) &&
+            header.timestampInRange) {
+            if (header.timestamp < source.timestamp && !source.disordered) {
+                *job.log << "Warning: " << source.path.string() << " is not in timestamp order (line "
+                         << source.block.firstLine << "); the merged history will not be either." << std::endl;
+                source.disordered = true;
+            }
+            source.timestamp = header.timestamp;
+        }
+        heap.push_back(MergeHead{source.timestamp, input});
+        std::push_heap(heap.begin(), heap.end());
+        return true;
+    };
+
+    // Merged entries are classified in chunks of about STREAM_BUFFER_SIZE. A chunk only
+    // ends before an entry, so it splits into the same blocks as the merged file will.
+    std::string chunk;
+    chunk.reserve(STREAM_BUFFER_SIZE);
+    uintmax_t mergedBytes = 0;          // Merged history before chunk
+    ClassifyResult totals;
+    auto classifyChunk = [&]() {
+        job.reportBase = chunk.data();
+        job.reportOffset = mergedBytes;
+        ClassifyResult result = classifyRange(job, chunk, totals.lines + 1, output, *job.log, keepBlock, archiveDrop);
+        totals.add(result);
+        totals.interrupted = result.interrupted;
+        totals.writeFailed = result.writeFailed && !result.interrupted;
+        mergedBytes += chunk.size();
+        chunk.clear();
+        return !result.interrupted && !result.writeFailed;
+    };
+
+    bool merging = true;
+    for (size_t i = 0; i < sources.size() && merging; ++i) {
+        merging = sources[i].reader == nullptr || advance(i);
+    }
+    while (merging && !heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end());
+        const size_t input = heap.back().input;
+        heap.pop_back();
+        const HistoryBlock& block = sources[input].block;
+        if (block.hasHeader && chunk.size() >= STREAM_BUFFER_SIZE && !classifyChunk()) {
+            merging = false;
+            break;
+        }
+        chunk.append(block.text.data(), block.text.size());
+        if (chunk.back() != '\n') {
+            chunk.push_back('\n'); // An input's last line would run into the next entry
+        }
+        merging = advance(input);
+    }
+    if (merging && !chunk.empty()) {
+        classifyChunk();
+    }
+    readTimer.stop();
+
+    uint64_t bytesRead = 0;
+    for (const MergeSource& source : sources) {
+        if (source.reader) bytesRead += source.reader->bytesRead();
+    }
+    if (job.stats != nullptr) {
+        (*job.stats)[RunPhase::ReadParse].bytes += bytesRead;
+        addMatchTiming(*job.stats, RunPhase::FilterKeyword, totals.keywordTiming);
+        addMatchTiming(*job.stats, RunPhase::FilterRegex, totals.regexTiming);
+    }
+    job.totals = totals;
+
+    if (readFailed && !job.error.empty()) {
+        return abortProcessing();
+    }
+    if (totals.interrupted || readFailed) {
+        *job.log << "\nInterrupted during history processing.\n";
+        fail(job, "Interrupted.");
+        return abortProcessing();
+    }
+    if (totals.writeFailed) {
+        *job.log << "Error: Failed to write to new history file (" << std::strerror(newFile.lastError()) << ")" << std::endl;
+        fail(job, "Failed to write to new history file.");
+        return abortProcessing();
+    }
+
+    const size_t merged = static_cast<size_t>(std::count_if(sources.begin(), sources.end(),
+                                                            [](const MergeSource& source) { return source.reader != nullptr; }));
+    auto reportTotals = [&]() {
+        *job.info << "Merged " << merged << " histories (" << bytesRead << " bytes)." << std::endl;
+        *job.info << "Processing complete. Lines read: " << totals.lines
+                  << ", Entries kept: " << totals.kept
+                  << ", Entries " << (config_.dryRun ? "to be deleted" : "deleted") << ": " << totals.deleted;
+        if (config_.dedup != DedupMode::None) {
+            *job.info << " (duplicates: " << totals.duplicates << ")";
+        }
+        *job.info << std::endl;
+    };
+    if (config_.dryRun) {
+        reportTotals();
+        return true;
+    }
+
+    // What the merge read of the history file is what the lock has to find; anything a
+    // shell appended since goes after the merged entries
+    bool wholeLines = true;
+    if (historyInput != inputs.size()) {
+        job.scannedSize = sources[historyInput].reader->bytesRead();
+        wholeLines = sources[historyInput].reader->endsWithNewline();
+    }
+    sources.clear();
+    return installRewrite(job, newFile, archive.get(), wholeLines, keepBlock, archiveDrop, totals, reportTotals, output);
+}
+
+bool HistoryEngine::openArchive(FileJob& job, std::unique_ptr<ArchiveWriter>& archive) const {
+    if (config_.archive.empty() || config_.dryRun) return true;
+    archive = std::make_unique<ArchiveWriter>();
+    if (!archive->open(config_.archive, job.historyPath, *job.log)) {
+        archive.reset();
+        return fail(job, "Cannot open the archive.");
+    }
+    return true;
+}
+
+bool HistoryEngine::finishArchive(FileJob& job, ArchiveWriter* archive) const {
+    if (archive == nullptr) return true;
+    PhaseTimer archiveTimer(job.stats, RunPhase::Backup);
+    if (!archive->finish(*job.log)) {
+        return fail(job, "Archive failed.");
+    }
+    job.archived = archive->bytesAdded();
+    if (job.stats != nullptr) {
+        (*job.stats)[RunPhase::Backup].bytes += archive->bytesWritten();
+    }
+    // The codec is a build choice, so the line says which one this build used
+    *job.info << "Archive: " << job.archived << " bytes of deleted entries appended to " << config_.archive.string()
+              << " (" << (archiveCompresses() ? "zstd" : "stored uncompressed, built without libzstd") << ", "
+              << archive->bytesWritten() << " bytes written)" << std::endl;
+    return true;
+}
+
+bool HistoryEngine::lockHistory(FileJob& job, HistoryLock& lock, uintmax_t& currentSize) const {
+    if (!lock.acquire(job.historyPath, *job.log)) {
+        return fail(job, "Cannot take the history file lock.");
+    }
+    struct stat st;
+    bool same;
+    if (lock.fd() == -1) {
+        same = !job.scannedExists;
+        currentSize = 0;
+    } else {
+        same = fstat(lock.fd(), &st) == 0 && job.scannedExists &&
+               static_cast<uint64_t>(st.st_dev) == job.scannedDevice &&
+               static_cast<uint64_t>(st.st_ino) == job.scannedInode &&
+               static_cast<uintmax_t>(st.st_size) >= job.scannedSize;
+        currentSize = same ? static_cast<uintmax_t>(st.st_size) : 0;
+    }
+    if (!same) {
+        lock.release();
+        job.replaced = true;
+        return fail(job, "History file was replaced while it was being cleaned.");
+    }
+    return true;
+}
+
+bool HistoryEngine::removeInPlace(FileJob& job, uintmax_t offset, uintmax_t length, std::ostream& output) const {
+    // Check for interruption
+    if (interrupted(job)) { *job.log << "Interrupted before final cleanup steps.\n"; return fail(job, "Interrupted."); }
+
+    if (config_.backup) {
+        if (!backupHistoryFile(job)) {
+            *job.log << "Backup failed. Aborting cleanup to preserve original file." << std::endl;
+            return fail(job, "Backup failed.");
+        }
+        if (interrupted(job)) { *job.log << "Interrupted after backup.\n"; return fail(job, "Interrupted."); }
+    }
+
+    if (length == 0) {
+        output << "No entries deleted; history file left unchanged." << std::endl;
+        return true;
+    }
+
+    output << "Securely removing " << length << " bytes of deleted entries in place from: "
+           << job.historyPath.string() << std::endl;
+    bool ok;
+    {
+        // A signal halfway through would leave a corrupt file with no copy to fall back
+        // on, so termination is held off until the file is consistent again.
+        TerminationGuard guard;
+
+        // The range is overwritten before zsh's lock is taken: shells only append past it,
+        // and the passes may well outlast the HISTORY_LOCK_STALE_SECONDS after which a
+        // waiting shell breaks the lock and appends anyway.
+        int fd = ::open(job.historyPath.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd == -1) {
+            *job.log << "Error: Cannot open history file for writing: " << job.historyPath.string() << std::endl;
+            return fail(job, "Cannot open history file for writing.");
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_dev) != job.scannedDevice ||
+            static_cast<uint64_t>(st.st_ino) != job.scannedInode || static_cast<uintmax_t>(st.st_size) < job.scannedSize) {
+            ::close(fd);
+            job.replaced = true;
+            return fail(job, "History file was replaced while it was being cleaned.");
+        }
+        PhaseTimer shredTimer(job.stats, RunPhase::Shred);
+        ok = secureOverwriteRange(fd, offset, length, config_.shredPasses, *job.log);
+        shredTimer.stop();
+        ::close(fd); // Before the lock: closing any descriptor of the file drops its fcntl() lock
+
+        // Under the lock, only the bytes after the range move down, entries appended
+        // since the pass included, and the file is cut to the size it has by then
+        if (ok) {
+            HistoryLock lock;
+            uintmax_t currentSize = 0;
+            if (!lockHistory(job, lock, currentSize)) {
+                return false;
+            }
+            PhaseTimer lockTimer(job.stats, RunPhase::Lock);
+            ok = cutRange(lock.fd(), offset, length, *job.log);
+            lock.release();
+        }
+    }
+    if (ok && job.stats != nullptr) {
+        (*job.stats)[RunPhase::Shred].bytes += length * static_cast<uintmax_t>(config_.shredPasses);
+    }
+
+    if (!ok) {
+        *job.log << "Error: In-place removal from the history file failed." << std::endl;
+        *job.log << "The history file might be partially overwritten." << std::endl;
+        return fail(job, "In-place removal from the history file failed.");
+    }
+    output << "Deleted entries securely removed." << std::endl;
+    return true;
+}
+
+bool HistoryEngine::backupHistoryFile(FileJob& job) const {
+    // Check for interruption
+    if (interrupted(job)) { *job.log << "Interrupted before backup.\n"; return fail(job, "Interrupted."); }
+
+    PhaseTimer backupTimer(job.stats, RunPhase::Backup);
+
+    // Generate random filename for backup
+    std::string randomStr = randomString(15);
+    job.backupPath = job.historyPath.parent_path() / (job.historyPath.filename().string() + ".backup_" + randomStr);
+
+    // A reflink makes the backup nearly free where the file system supports it
+    CopyStrategy strategy;
+    uintmax_t size = 0;
+    if (!copyFile(job.historyPath, job.backupPath, strategy, size, *job.log)) {
+        *job.log << "Error: Failed to create backup file: " << job.backupPath.string() << std::endl;
+        job.backupPath.clear();  // Clear the path since backup failed
+        return fail(job, "Failed to create backup file.");
+    }
+    if (job.stats != nullptr) {
+        (*job.stats)[RunPhase::Backup].bytes += size;
+    }
+    *job.info << "Backup created: " << job.backupPath.string() << " (" << copyStrategyName(strategy) << ")" << std::endl;
+    return true;
+}
+
+bool HistoryEngine::performCleanup(FileJob& job, const fs::path& original, std::ostream& output) const {
+    // Securely delete the original history file: all of it, or the deleted range and
+    // whatever was appended during the run if the rest went into the new file unchanged
+    output << "Securely deleting original history file: " << job.historyPath.string() << std::endl;
+    PhaseTimer shredTimer(job.stats, RunPhase::Shred);
+    std::error_code ec;
+    uintmax_t shredBytes = job.stats ? fs::file_size(original, ec) : 0;
+    if (job.shredLength != 0 && !ec) {
+        shredBytes = job.shredLength + (shredBytes - std::min(shredBytes, job.scannedSize));
+    }
+    shredBytes *= static_cast<uintmax_t>(config_.shredPasses);
+    const bool deleted = job.shredLength == 0
+        ? secureDelete(original, config_.shredPasses, *job.log)
+        : secureDeletePart(original, job.shredOffset, job.shredLength, job.scannedSize, config_.shredPasses, *job.log);
+    if (!deleted) {
+        *job.log << "Error: Secure delete of original history file failed." << std::endl;
+        *job.log << "The original file might still exist (potentially overwritten or partially deleted)." << std::endl;
+        return fail(job, "Secure delete of original history file failed.");
+    }
+    shredTimer.stop();
+    if (job.stats != nullptr && !ec) {
+        (*job.stats)[RunPhase::Shred].bytes += shredBytes;
+    }
+    output << "Original history file securely deleted." << std::endl;
+
+    return true;
+}
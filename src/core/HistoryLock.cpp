@@ -0,0 +1,119 @@
+#include "../../include/zsh_history_cleaner/HistoryLock.h"
+#include "../../include/zsh_history_cleaner/Constants.h"
+#include "../../include/zsh_history_cleaner/CleanupRegistry.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>       // For std::this_thread::sleep_for
+#include <ctime>        // For time
+#include <cerrno>       // For errno
+#include <cstring>      // For strerror
+#include <fcntl.h>      // For open, fcntl, struct flock
+#include <unistd.h>     // For link, unlink, close, write, getpid, gethostname
+#include <sys/stat.h>   // For stat
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void waitBeforeRetry() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(HISTORY_LOCK_RETRY_MS));
+}
+
+} // namespace
+
+HistoryLock::~HistoryLock() {
+    release();
+}
+
+bool HistoryLock::acquire(const fs::path& historyFile, std::ostream& log) {
+    release();
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(HISTORY_LOCK_TIMEOUT_MS);
+    const fs::path lockPath = historyFile.parent_path() / (historyFile.filename().string() + ".LOCK");
+
+    // zsh's protocol: the owner ("pid host") is written to a file of our own, which is
+    // then linked to the lock name. link() fails if the lock exists, even over NFS.
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    const std::string owner = std::to_string(static_cast<long>(getpid())) + " " + host + "\n";
+    const fs::path ownPath = historyFile.parent_path() /
+        (historyFile.filename().string() + "." + host + "." + std::to_string(static_cast<long>(getpid())));
+    int ownSlot = registerTempFile(ownPath);
+    int ownFd = open(ownPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (ownFd == -1) {
+        log << "Error: Cannot create history lock file: " << ownPath.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        unregisterTempFile(ownSlot);
+        return false;
+    }
+    bool written = write(ownFd, owner.data(), owner.size()) == static_cast<ssize_t>(owner.size());
+    close(ownFd);
+
+    bool linked = false;
+    while (written) {
+        if (link(ownPath.c_str(), lockPath.c_str()) == 0) {
+            linked = true;
+            break;
+        }
+        if (errno != EEXIST) {
+            log << "Error: Cannot create history lock: " << lockPath.string() << " (" << std::strerror(errno) << ")" << std::endl;
+            break;
+        }
+        struct stat st;
+        if (stat(lockPath.c_str(), &st) == 0 && std::time(nullptr) - st.st_mtime >= HISTORY_LOCK_STALE_SECONDS) {
+            unlink(lockPath.c_str()); // Left behind by a shell that died; zsh breaks it the same way
+            continue;
+        }
+        if (Clock::now() >= deadline) {
+            log << "Error: Timed out waiting for the history lock: " << lockPath.string() << std::endl;
+            break;
+        }
+        waitBeforeRetry();
+    }
+    unlink(ownPath.c_str());
+    unregisterTempFile(ownSlot);
+    if (!linked) {
+        return false;
+    }
+    lockPath_ = lockPath;
+    lockSlot_ = registerTempFile(lockPath_); // Removed by the signal handler if terminated while held
+
+    // Then the fcntl() lock, for shells with HIST_FCNTL_LOCK set
+    fd_ = open(historyFile.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd_ == -1) {
+        if (errno == ENOENT) return true;
+        log << "Error: Cannot open history file for locking: " << historyFile.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        release();
+        return false;
+    }
+    struct flock lock = {};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;   // Whole file, as zsh locks it
+    while (fcntl(fd_, F_SETLK, &lock) == -1) {
+        if (errno != EACCES && errno != EAGAIN && errno != EINTR) {
+            log << "Error: Cannot lock history file: " << historyFile.string() << " (" << std::strerror(errno) << ")" << std::endl;
+            release();
+            return false;
+        }
+        if (Clock::now() >= deadline) {
+            log << "Error: Timed out waiting for the history file lock: " << historyFile.string() << std::endl;
+            release();
+            return false;
+        }
+        waitBeforeRetry();
+    }
+    return true;
+}
+
+void HistoryLock::release() {
+    if (fd_ != -1) {
+        close(fd_); // Drops the fcntl() lock
+        fd_ = -1;
+    }
+    if (!lockPath_.empty()) {
+        unlink(lockPath_.c_str());
+        unregisterTempFile(lockSlot_);
+        lockSlot_ = -1;
+        lockPath_.clear();
+    }
+}
@@ -0,0 +1,95 @@
+#include "../../include/zsh_history_cleaner/HistoryParser.h"
+
+#include <cstring>     // For memchr
+#include <limits>      // For numeric_limits
+
+namespace {
+
+// Same set as std::regex's \s under the classic "C" locale: ' ', \t, \n, \v, \f, \r
+inline bool isSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool isDigit(unsigned char c) {
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+inline const char* skipSpaces(const char* p, const char* end) {
+    while (p != end && isSpace(static_cast<unsigned char>(*p))) {
+        ++p;
+    }
+    return p;
+}
+
+// Accumulates a run of decimal digits into value (which must start at 0).
+// Sets overflow instead of wrapping if the value exceeds limit.
+inline const char* parseDigits(const char* p, const char* end, unsigned long long limit,
+                               unsigned long long& value, bool& overflow) {
+    while (p != end && isDigit(static_cast<unsigned char>(*p))) {
+        unsigned digit = static_cast<unsigned char>(*p) - '0';
+        if (!overflow) {
+            if (value > (limit - digit) / 10) {
+                overflow = true;
+            } else {
+                value = value * 10 + digit;
+            }
+        }
+        ++p;
+    }
+    return p;
+}
+
+} // namespace
+
+bool parseHistoryHeader(std::string_view line, HistoryHeader& header) {
+    const char* const begin = line.data();
+    const char* const end = begin + line.size();
+    const char* p = skipSpaces(begin, end);
+
+    // ':'
+    if (p == end || *p != ':') return false;
+    p = skipSpaces(p + 1, end);
+
+    // Timestamp: one or more digits. Out-of-range values still form a valid header;
+    // callers decide how to treat them (std::stoll used to throw out_of_range here).
+    if (p == end || !isDigit(static_cast<unsigned char>(*p))) return false;
+    unsigned long long timestamp = 0;
+    bool timestampOverflow = false;
+    p = parseDigits(p, end, static_cast<unsigned long long>(std::numeric_limits<long long>::max()),
+                    timestamp, timestampOverflow);
+
+    // ':' directly after the timestamp (no whitespace allowed here)
+    if (p == end || *p != ':') return false;
+    ++p;
+
+    // Duration: one or more digits
+    if (p == end || !isDigit(static_cast<unsigned char>(*p))) return false;
+    unsigned long long duration = 0;
+    bool durationOverflow = false;
+    p = parseDigits(p, end, static_cast<unsigned long long>(std::numeric_limits<long long>::max()),
+                    duration, durationOverflow);
+
+    // Optional whitespace, then ';'
+    p = skipSpaces(p, end);
+    if (p == end || *p != ';') return false;
+    ++p;
+
+    // ".*$": ECMAScript '.' does not match line terminators
+    size_t rest = static_cast<size_t>(end - p);
+    if (rest != 0 && (std::memchr(p, '\r', rest) != nullptr || std::memchr(p, '\n', rest) != nullptr)) {
+        return false;
+    }
+
+    header.timestampInRange = !timestampOverflow &&
+        timestamp <= static_cast<unsigned long long>(std::numeric_limits<std::time_t>::max());
+    header.timestamp = header.timestampInRange ? static_cast<std::time_t>(timestamp) : 0;
+    header.duration = durationOverflow ? std::numeric_limits<long long>::max()
+                                       : static_cast<long long>(duration);
+    header.commandOffset = static_cast<size_t>(p - begin);
+    return true;
+}
+
+bool isHistoryHeader(std::string_view line) {
+    HistoryHeader header;
+    return parseHistoryHeader(line, header);
+}
@@ -0,0 +1,257 @@
+#include "../../include/zsh_history_cleaner/HistoryReader.h"
+#include "../../include/zsh_history_cleaner/HistoryParser.h"
+
+#include <algorithm>   // For std::count
+#include <iostream>    // For std::ostream, std::endl
+#include <cerrno>      // For errno
+#include <cstring>     // For strerror, memchr, memmove
+#include <fcntl.h>     // For open, O_RDONLY
+#include <unistd.h>    // For read, close
+#include <sys/mman.h>  // For mmap, madvise, munmap
+#include <sys/stat.h>  // For fstat, S_ISREG
+
+// --- HistoryFileView ---
+
+HistoryFileView::~HistoryFileView() {
+    close();
+}
+
+void HistoryFileView::close() {
+    if (mapping_ != nullptr) {
+        munmap(mapping_, size_);
+        mapping_ = nullptr;
+    }
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = nullptr;
+    size_ = 0;
+    exists_ = false;
+    device_ = 0;
+    inode_ = 0;
+}
+
+bool HistoryFileView::open(const fs::path& path, std::ostream& log) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return true; // Nothing to read yet; treated as an empty history
+        }
+        log << "Error: Cannot open history file for reading: " << path.string()
+            << " (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        log << "Error: Cannot stat history file: " << path.string()
+            << " (" << std::strerror(errno) << ")" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    exists_ = true;
+    device_ = static_cast<uint64_t>(st.st_dev);
+    inode_ = static_cast<uint64_t>(st.st_ino);
+
+    bool ok = true;
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t length = static_cast<size_t>(st.st_size);
+        void* addr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            // The file is consumed front to back exactly once; let the kernel read ahead aggressively
+            madvise(addr, length, MADV_SEQUENTIAL);
+            mapping_ = addr;
+            data_ = static_cast<const char*>(addr);
+            size_ = length;
+        } else {
+            ok = readFallback(fd, log);
+        }
+    } else if (!S_ISREG(st.st_mode)) {
+        ok = readFallback(fd, log);
+    }
+
+    ::close(fd); // The mapping stays valid after the descriptor is closed
+    return ok;
+}
+
+bool HistoryFileView::readFallback(int fd, std::ostream& log) {
+    const size_t chunk = 1 << 20;
+    size_t used = 0;
+    while (true) {
+        if (buffer_.size() - used < chunk) {
+            buffer_.resize(used + chunk);
+        }
+        ssize_t n = ::read(fd, buffer_.data() + used, buffer_.size() - used);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            log << "Error reading history file: " << std::strerror(errno) << std::endl;
+            buffer_.clear();
+            return false;
+        }
+        if (n == 0) break;
+        used += static_cast<size_t>(n);
+    }
+    buffer_.resize(used);
+    data_ = buffer_.data();
+    size_ = used;
+    return true;
+}
+
+// --- HistoryStreamReader ---
+
+HistoryStreamReader::HistoryStreamReader(int fd, size_t bufferSize) : fd_(fd), buffer_(bufferSize) {}
+
+bool HistoryStreamReader::fill() {
+    if (pos_ > 0) {
+        std::memmove(buffer_.data(), buffer_.data() + pos_, used_ - pos_);
+        used_ -= pos_;
+        pos_ = 0;
+    }
+    if (used_ == buffer_.size()) {
+        buffer_.resize(buffer_.size() * 2); // One block longer than the buffer
+    }
+    ssize_t got = read(fd_, buffer_.data() + used_, buffer_.size() - used_);
+    if (got == -1) {
+        error_ = errno;
+        return false;
+    }
+    error_ = 0;
+    eof_ = got == 0;
+    used_ += static_cast<size_t>(got);
+    bytesRead_ += static_cast<uint64_t>(got);
+    if (got > 0) {
+        endsWithNewline_ = buffer_[used_ - 1] == '\n';
+    }
+    return true;
+}
+
+size_t HistoryStreamReader::lineAt(size_t offset) const {
+    const char* start = buffer_.data() + pos_ + offset;
+    size_t remaining = used_ - pos_ - offset;
+    const void* nl = std::memchr(start, '\n', remaining);
+    if (nl != nullptr) return static_cast<size_t>(static_cast<const char*>(nl) - start) + 1;
+    return eof_ ? remaining : 0;
+}
+
+bool HistoryStreamReader::next(HistoryBlock& block) {
+    // Offsets are relative to pos_, so they survive fill() moving the bytes
+    size_t firstLength;
+    while ((firstLength = lineAt(0)) == 0) {
+        if (eof_) return false; // Nothing left
+        if (!fill()) return false;
+    }
+    const std::string_view first(buffer_.data() + pos_, firstLength);
+    bool header = isHistoryHeader(stripLineEnding(first));
+    size_t length = firstLength;
+    unsigned long long lines = 1;
+    if (header || seenHeader_) {
+        // Absorb continuation lines until the next header (or end of input)
+        seenHeader_ = true;
+        for (;;) {
+            size_t lineLength = lineAt(length);
+            if (lineLength == 0) {
+                if (eof_) break;
+                if (!fill()) return false;
+                continue;
+            }
+            if (isHistoryHeader(stripLineEnding(std::string_view(buffer_.data() + pos_ + length, lineLength)))) break;
+            length += lineLength;
+            ++lines;
+        }
+    }
+
+    block.text = std::string_view(buffer_.data() + pos_, length);
+    block.firstLineLength = firstLength;
+    block.firstLine = lineNum_;
+    block.lastLine = lineNum_ + lines - 1;
+    block.hasHeader = header || seenHeader_;
+    lineNum_ += lines;
+    pos_ += length;
+    return true;
+}
+
+// --- Chunking ---
+
+size_t findEntryBoundary(std::string_view data, size_t offset) {
+    if (offset >= data.size()) return data.size();
+    size_t pos = offset;
+    // Move to the start of the next line unless already at one
+    if (pos > 0 && data[pos - 1] != '\n') {
+        size_t nl = data.find('\n', pos);
+        if (nl == std::string_view::npos) return data.size();
+        pos = nl + 1;
+    }
+    while (pos < data.size()) {
+        size_t nl = data.find('\n', pos);
+        size_t next = (nl == std::string_view::npos) ? data.size() : nl + 1;
+        if (isHistoryHeader(stripLineEnding(data.substr(pos, next - pos)))) {
+            return pos;
+        }
+        pos = next;
+    }
+    return data.size();
+}
+
+unsigned long long countLines(std::string_view data) {
+    unsigned long long lines = static_cast<unsigned long long>(std::count(data.begin(), data.end(), '\n'));
+    if (!data.empty() && data.back() != '\n') lines++;
+    return lines;
+}
+
+// --- HistoryBlockReader ---
+
+HistoryBlockReader::HistoryBlockReader(std::string_view data, unsigned long long firstLineNum)
+    : data_(data), firstLineNum_(firstLineNum), lineNum_(firstLineNum) {}
+
+std::string_view HistoryBlockReader::nextLine() {
+    const char* start = data_.data() + pos_;
+    size_t remaining = data_.size() - pos_;
+    const void* nl = std::memchr(start, '\n', remaining);
+    size_t length = nl ? static_cast<size_t>(static_cast<const char*>(nl) - start) + 1 : remaining;
+    pos_ += length;
+    ++lineNum_;
+    return {start, length};
+}
+
+bool HistoryBlockReader::next(HistoryBlock& block) {
+    std::string_view first;
+    if (pendingHeader_) {
+        first = pendingLine_;
+        pendingHeader_ = false;
+    } else {
+        if (pos_ >= data_.size()) {
+            return false;
+        }
+        first = nextLine();
+        if (!seenHeader_ && !isHistoryHeader(stripLineEnding(first))) {
+            // Stray line before the first entry: handed out on its own
+            block.text = first;
+            block.firstLineLength = first.size();
+            block.firstLine = block.lastLine = lineNum_ - 1;
+            block.hasHeader = false;
+            return true;
+        }
+        seenHeader_ = true;
+    }
+
+    block.firstLine = lineNum_ - 1;
+    block.firstLineLength = first.size();
+    const char* blockEnd = first.data() + first.size();
+
+    // Absorb continuation lines until the next header (or end of input)
+    while (pos_ < data_.size()) {
+        std::string_view line = nextLine();
+        if (isHistoryHeader(stripLineEnding(line))) {
+            pendingLine_ = line;
+            pendingHeader_ = true;
+            break;
+        }
+        blockEnd = line.data() + line.size();
+    }
+
+    block.text = std::string_view(first.data(), static_cast<size_t>(blockEnd - first.data()));
+    block.lastLine = lineNum_ - (pendingHeader_ ? 2 : 1);
+    block.hasHeader = true;
+    return true;
+}
@@ -0,0 +1,108 @@
+#include "../../include/zsh_history_cleaner/HistoryWatcher.h"
+#include "../../include/zsh_history_cleaner/Constants.h"
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>    // For std::min
+#include <cerrno>       // For errno
+#include <cstring>      // For strerror
+#include <climits>      // For NAME_MAX
+#include <poll.h>       // For poll
+#include <unistd.h>     // For read, close
+#include <sys/inotify.h>
+
+namespace {
+
+// Events that can mean new or rewritten history: appends, the close after them, and a
+// new file renamed (or created) under the history file's name
+const uint32_t WATCH_EVENT_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+} // namespace
+
+HistoryWatcher::~HistoryWatcher() {
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+bool HistoryWatcher::open(const fs::path& historyFile, std::ostream& log) {
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd_ == -1) {
+        log << "Error: Cannot initialize inotify: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    fs::path directory = historyFile.parent_path();
+    if (directory.empty()) directory = ".";
+    if (inotify_add_watch(fd_, directory.c_str(), WATCH_EVENT_MASK | IN_ONLYDIR) == -1) {
+        log << "Error: Cannot watch directory " << directory.string() << ": " << std::strerror(errno) << std::endl;
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    name_ = historyFile.filename().string();
+    return true;
+}
+
+bool HistoryWatcher::drain(bool& changed, std::ostream& log) {
+    alignas(struct inotify_event) char buffer[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)];
+    for (;;) {
+        ssize_t length = read(fd_, buffer, sizeof(buffer));
+        if (length == -1) {
+            if (errno == EAGAIN) return true;
+            if (errno == EINTR) continue;
+            log << "Error: Cannot read inotify events: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        for (ssize_t offset = 0; offset < length;) {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed = true; // Events were lost; one of them may have been ours
+            } else if (event->mask & IN_IGNORED) {
+                log << "Error: The history file's directory is no longer watched (removed or unmounted)." << std::endl;
+                return false;
+            } else if (event->len > 0 && name_ == event->name) {
+                changed = true;
+            }
+            offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+        }
+    }
+}
+
+bool HistoryWatcher::waitForChange(std::ostream& log) {
+    struct pollfd descriptor = {fd_, POLLIN, 0};
+
+    // Sleep in poll() until something happens to the history file itself
+    bool changed = false;
+    while (!changed) {
+        if (poll(&descriptor, 1, -1) == -1) {
+            if (errno == EINTR) continue;
+            log << "Error: Waiting for inotify events failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (!drain(changed, log)) return false;
+    }
+
+    // Coalesce the rest of the burst: wait until the file has been quiet for a moment,
+    // but not indefinitely while the shell keeps writing
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(WATCH_MAX_DELAY_MS);
+    Clock::time_point quietUntil = Clock::now() + std::chrono::milliseconds(WATCH_QUIET_MS);
+    for (;;) {
+        Clock::time_point until = std::min(quietUntil, deadline);
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(until - Clock::now()).count();
+        if (remaining <= 0) return true;
+        int ready = poll(&descriptor, 1, static_cast<int>(remaining));
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            log << "Error: Waiting for inotify events failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (ready == 0) return true;
+        bool more = false;
+        if (!drain(more, log)) return false;
+        if (more) {
+            quietUntil = Clock::now() + std::chrono::milliseconds(WATCH_QUIET_MS);
+        }
+    }
+}
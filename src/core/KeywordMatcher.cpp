@@ -0,0 +1,174 @@
+#include "../../include/zsh_history_cleaner/KeywordMatcher.h"
+#include "../../include/zsh_history_cleaner/EntryText.h"
+
+#include <algorithm>   // For std::min, std::fill
+#include <cstring>     // For memchr
+#include <deque>       // For std::deque (BFS queue)
+
+#if defined(__SSE2__)
+#include <emmintrin.h> // For the vectorized first-byte prefilter
+#endif
+
+namespace {
+// Above this many distinct first bytes the SIMD compare chain stops paying off
+const size_t MAX_SIMD_FIRST_BYTES = 8;
+}
+
+void KeywordMatcher::build(const std::vector<std::string>& keywords) {
+    byteClass_.fill(0);
+    isFirstByte_.fill(false);
+    firstBytes_.clear();
+    transitions_.clear();
+    acceptingStates_.clear();
+    classCount_ = 1;
+    minLength_ = 0;
+    matchesEverything_ = false;
+
+    if (keywords.empty()) {
+        return;
+    }
+
+    // 1. Alphabet compression: one class per byte value actually used by a keyword
+    for (const auto& keyword : keywords) {
+        if (keyword.empty()) {
+            matchesEverything_ = true;
+            continue;
+        }
+        for (unsigned char c : keyword) {
+            if (byteClass_[c] == 0) {
+                byteClass_[c] = static_cast<uint16_t>(classCount_++);
+            }
+        }
+        unsigned char first = static_cast<unsigned char>(keyword[0]);
+        if (!isFirstByte_[first]) {
+            isFirstByte_[first] = true;
+            firstBytes_.push_back(first);
+        }
+        minLength_ = (minLength_ == 0) ? keyword.size() : std::min(minLength_, keyword.size());
+    }
+    if (matchesEverything_) {
+        return; // Nothing else can change the answer
+    }
+
+    // 2. Trie of all keywords (-1 = no edge yet)
+    transitions_.assign(classCount_, -1);
+    acceptingStates_.assign(1, 0);
+    for (const auto& keyword : keywords) {
+        int32_t state = 0;
+        for (unsigned char c : keyword) {
+            size_t slot = static_cast<size_t>(state) * classCount_ + byteClass_[c];
+            if (transitions_[slot] == -1) {
+                int32_t next = static_cast<int32_t>(acceptingStates_.size());
+                transitions_[slot] = next;
+                transitions_.resize(transitions_.size() + classCount_, -1);
+                acceptingStates_.push_back(0);
+            }
+            state = transitions_[static_cast<size_t>(state) * classCount_ + byteClass_[c]];
+        }
+        acceptingStates_[static_cast<size_t>(state)] = 1;
+    }
+
+    // 3. Failure links in BFS order, folded directly into the transition table
+    std::vector<int32_t> failure(acceptingStates_.size(), 0);
+    std::deque<int32_t> queue;
+    for (size_t c = 0; c < classCount_; ++c) {
+        int32_t& next = transitions_[c];
+        if (next == -1) {
+            next = 0;
+        } else {
+            queue.push_back(next);
+        }
+    }
+    while (!queue.empty()) {
+        int32_t state = queue.front();
+        queue.pop_front();
+        int32_t fail = failure[static_cast<size_t>(state)];
+        if (acceptingStates_[static_cast<size_t>(fail)]) {
+            acceptingStates_[static_cast<size_t>(state)] = 1; // A keyword is a suffix of this path
+        }
+        for (size_t c = 0; c < classCount_; ++c) {
+            int32_t& next = transitions_[static_cast<size_t>(state) * classCount_ + c];
+            int32_t viaFail = transitions_[static_cast<size_t>(fail) * classCount_ + c];
+            if (next == -1) {
+                next = viaFail;
+            } else {
+                failure[static_cast<size_t>(next)] = viaFail;
+                queue.push_back(next);
+            }
+        }
+    }
+}
+
+size_t KeywordMatcher::nextCandidate(std::string_view text, size_t pos) const {
+    const size_t size = text.size();
+    const char* data = text.data();
+
+    if (firstBytes_.size() == 1) {
+        const void* hit = std::memchr(data + pos, firstBytes_[0], size - pos);
+        return hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : size;
+    }
+
+#if defined(__SSE2__)
+    if (firstBytes_.size() <= MAX_SIMD_FIRST_BYTES) {
+        __m128i needles[MAX_SIMD_FIRST_BYTES];
+        const size_t needleCount = firstBytes_.size();
+        for (size_t i = 0; i < needleCount; ++i) {
+            needles[i] = _mm_set1_epi8(static_cast<char>(firstBytes_[i]));
+        }
+        while (pos + 16 <= size) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            __m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+            for (size_t i = 1; i < needleCount; ++i) {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[i]));
+            }
+            int mask = _mm_movemask_epi8(hits);
+            if (mask != 0) {
+                return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+            }
+            pos += 16;
+        }
+    }
+#endif
+
+    while (pos < size && !isFirstByte_[static_cast<unsigned char>(data[pos])]) {
+        ++pos;
+    }
+    return pos;
+}
+
+int32_t KeywordMatcher::scan(std::string_view text, int32_t state) const {
+    const size_t size = text.size();
+    size_t pos = 0;
+    while (pos < size) {
+        if (state == 0) {
+            pos = nextCandidate(text, pos);
+            if (pos == size) break;
+        }
+        unsigned char c = static_cast<unsigned char>(text[pos]);
+        state = transitions_[static_cast<size_t>(state) * classCount_ + byteClass_[c]];
+        if (acceptingStates_[static_cast<size_t>(state)]) {
+            return -1;
+        }
+        ++pos;
+    }
+    return state;
+}
+
+bool KeywordMatcher::matchesAny(std::string_view text) const {
+    if (matchesEverything_) return true;
+    if (acceptingStates_.empty() || text.size() < minLength_) return false;
+    return scan(text, 0) < 0;
+}
+
+bool KeywordMatcher::matchesAnyJoined(std::string_view text) const {
+    if (matchesEverything_) return true;
+    if (acceptingStates_.empty() || text.size() < minLength_) return false;
+    // The automaton's state carries over from one piece to the next, so a keyword
+    // spanning a join is found as if the pieces were one string
+    int32_t state = 0;
+    forEachJoinedPiece(text, [this, &state](std::string_view piece) {
+        state = scan(piece, state);
+        return state >= 0;
+    });
+    return state < 0;
+}
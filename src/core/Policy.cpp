@@ -0,0 +1,128 @@
+#include "../../include/zsh_history_cleaner/Policy.h"
+#include "../../include/zsh_history_cleaner/RegexMatcher.h"
+
+#include <fstream>
+#include <string>
+#include <regex>
+#include <set>
+#include <cerrno>      // For errno
+#include <climits>     // For INT_MIN, INT_MAX
+#include <cstdlib>     // For strtol
+
+namespace {
+
+std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    if (first == std::string::npos) return std::string();
+    size_t last = text.find_last_not_of(" \t");
+    return text.substr(first, last - first + 1);
+}
+
+// Parses the whole of text as an int; false on anything else
+bool parseInt(const std::string& text, int& value) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX) return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+bool parseBool(const std::string& text, bool& value) {
+    if (text == "true" || text == "yes" || text == "1") {
+        value = true;
+    } else if (text == "false" || text == "no" || text == "0") {
+        value = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool loadPolicyFile(const fs::path& path, std::vector<PolicyRuleSpec>& rules, std::string& error) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "Cannot read policy file: " + path.string();
+        return false;
+    }
+
+    std::vector<PolicyRuleSpec> parsed;
+    std::set<std::string> names;
+    std::string line;
+    int lineNum = 0;
+    auto failAt = [&](const std::string& reason) {
+        error = path.string() + ":" + std::to_string(lineNum) + ": " + reason;
+        return false;
+    };
+    while (std::getline(in, line)) {
+        ++lineNum;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+
+        if (line[0] == '[') {
+            if (line.back() != ']') return failAt("Unterminated rule name.");
+            std::string name = trim(line.substr(1, line.size() - 2));
+            if (name.empty()) return failAt("Empty rule name.");
+            if (!names.insert(name).second) return failAt("Duplicate rule '" + name + "'.");
+            PolicyRuleSpec spec;
+            spec.rule.name = name;
+            spec.line = lineNum;
+            parsed.push_back(spec);
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) return failAt("Expected '[rule]' or 'key = value'.");
+        if (parsed.empty()) return failAt("Setting outside of a rule; start one with '[name]'.");
+        const std::string key = trim(line.substr(0, equals));
+        const std::string value = trim(line.substr(equals + 1));
+        PolicyRuleSpec& spec = parsed.back();
+
+        if (key == "action") {
+            if (value == "delete") spec.rule.deleteMatches = true;
+            else if (value == "keep") spec.rule.deleteMatches = false;
+            else return failAt("Invalid action: '" + value + "'. Use 'delete' or 'keep'.");
+        } else if (key == "priority") {
+            if (!parseInt(value, spec.rule.priority)) return failAt("Invalid priority: '" + value + "'.");
+        } else if (key == "mode") {
+            if (value.empty()) return failAt("'mode' requires a value.");
+            spec.mode = value;
+        } else if (key == "date") {
+            spec.date = value;
+        } else if (key == "start-date") {
+            spec.startDate = value;
+        } else if (key == "end-date") {
+            spec.endDate = value;
+        } else if (key == "days") {
+            if (!parseInt(value, spec.days) || spec.days <= 0) return failAt("'days' requires a positive integer.");
+        } else if (key == "precise") {
+            if (!parseBool(value, spec.precise)) return failAt("Invalid value for 'precise': '" + value + "'.");
+        } else if (key == "keyword") {
+            if (value.empty()) return failAt("'keyword' requires a value.");
+            spec.rule.keywords.push_back(value);
+        } else if (key == "regex") {
+            try {
+                RegexMatcher::validate(value);
+            } catch (const std::regex_error& e) {
+                return failAt(std::string("Invalid regex pattern: ") + e.what());
+            }
+            spec.rule.regexes.push_back(value);
+        } else {
+            return failAt("Unknown setting: '" + key + "'.");
+        }
+    }
+    if (in.bad()) {
+        error = "Cannot read policy file: " + path.string();
+        return false;
+    }
+    if (parsed.empty()) {
+        error = "Policy file defines no rules: " + path.string();
+        return false;
+    }
+    rules = std::move(parsed);
+    return true;
+}
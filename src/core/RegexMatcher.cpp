@@ -0,0 +1,330 @@
+#include "../../include/zsh_history_cleaner/RegexMatcher.h"
+#include "../../include/zsh_history_cleaner/EntryText.h"
+
+#include <algorithm>   // For std::min
+#include <cctype>      // For std::isalnum, std::isdigit
+
+#ifdef ZSH_HISTORY_CLEANER_USE_RE2
+#include <re2/re2.h>
+#include <re2/set.h>
+#endif
+
+namespace {
+
+// Skips a bracket expression starting at pattern[i] == '['; returns the index after ']'.
+size_t skipClass(const std::string& pattern, size_t i) {
+    size_t j = i + 1;
+    if (j < pattern.size() && pattern[j] == '^') ++j;
+    if (j < pattern.size() && pattern[j] == ']') ++j; // Leading ']' is literal
+    while (j < pattern.size() && pattern[j] != ']') {
+        j += (pattern[j] == '\\') ? 2 : 1;
+    }
+    return std::min(j + 1, pattern.size());
+}
+
+// Skips a parenthesized group starting at pattern[i] == '('; returns the index after ')'.
+size_t skipGroup(const std::string& pattern, size_t i) {
+    int depth = 0;
+    size_t j = i;
+    while (j < pattern.size()) {
+        char c = pattern[j];
+        if (c == '\\') { j += 2; continue; }
+        if (c == '[') { j = skipClass(pattern, j); continue; }
+        if (c == '(') depth++;
+        if (c == ')' && --depth == 0) return j + 1;
+        ++j;
+    }
+    return pattern.size();
+}
+
+// Returns true if the pattern has an alternation outside of any group.
+bool hasTopLevelAlternation(const std::string& pattern) {
+    for (size_t i = 0; i < pattern.size();) {
+        char c = pattern[i];
+        if (c == '\\') { i += 2; continue; }
+        if (c == '[') { i = skipClass(pattern, i); continue; }
+        if (c == '(') { i = skipGroup(pattern, i); continue; }
+        if (c == '|') return true;
+        ++i;
+    }
+    return false;
+}
+
+// Quantifier following an atom: 0 = none, 1 = atom may be absent (*, ?, {0...}),
+// 2 = atom required but repeatable (+, {n...} with n >= 1). Advances i past it.
+int readQuantifier(const std::string& pattern, size_t& i) {
+    if (i >= pattern.size()) return 0;
+    int kind = 0;
+    char c = pattern[i];
+    if (c == '*' || c == '?') {
+        kind = 1;
+        ++i;
+    } else if (c == '+') {
+        kind = 2;
+        ++i;
+    } else if (c == '{') {
+        size_t j = i + 1;
+        size_t digitsStart = j;
+        while (j < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[j]))) ++j;
+        if (j == digitsStart) return 0;
+        bool zero = pattern.find_first_not_of('0', digitsStart) >= j;
+        size_t close = pattern.find('}', j);
+        if (close == std::string::npos) return 0;
+        kind = zero ? 1 : 2;
+        i = close + 1;
+    } else {
+        return 0;
+    }
+    if (i < pattern.size() && pattern[i] == '?') ++i; // Lazy modifier
+    return kind;
+}
+
+} // namespace
+
+std::string RegexMatcher::requiredLiteral(const std::string& pattern) {
+    if (hasTopLevelAlternation(pattern)) {
+        return {};
+    }
+
+    std::string best;
+    std::string run;
+    auto endRun = [&]() {
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+
+    size_t i = 0;
+    while (i < pattern.size()) {
+        char c = pattern[i];
+        bool isLiteral = false;
+        char literal = 0;
+
+        if (c == '\\') {
+            if (i + 1 >= pattern.size()) break;
+            char e = pattern[i + 1];
+            i += 2;
+            switch (e) {
+                case 'n': isLiteral = true; literal = '\n'; break;
+                case 't': isLiteral = true; literal = '\t'; break;
+                case 'r': isLiteral = true; literal = '\r'; break;
+                case 'f': isLiteral = true; literal = '\f'; break;
+                case 'v': isLiteral = true; literal = '\v'; break;
+                default:
+                    // Escaped punctuation is literal; letters/digits are classes,
+                    // assertions, backreferences or code points
+                    if (!std::isalnum(static_cast<unsigned char>(e))) {
+                        isLiteral = true;
+                        literal = e;
+                    } else if (e == 'b' || e == 'B') {
+                        endRun(); // Zero-width, but keep it simple
+                        continue;
+                    } else {
+                        // Skip the operands of multi-character escapes so they are not
+                        // mistaken for literals: \xHH, \uHHHH, \cX, \NN (backreference)
+                        size_t operands = (e == 'x') ? 2 : (e == 'u') ? 4 : (e == 'c') ? 1 : 0;
+                        if (std::isdigit(static_cast<unsigned char>(e))) {
+                            while (i < pattern.size() && std::isdigit(static_cast<unsigned char>(pattern[i]))) ++i;
+                        }
+                        i = std::min(pattern.size(), i + operands);
+                    }
+                    break;
+            }
+        } else if (c == '[') {
+            i = skipClass(pattern, i);
+        } else if (c == '(') {
+            i = skipGroup(pattern, i);
+        } else if (c == '.' || c == '^' || c == '$') {
+            ++i;
+        } else {
+            isLiteral = true;
+            literal = c;
+            ++i;
+        }
+
+        int quantifier = readQuantifier(pattern, i);
+        if (isLiteral && quantifier != 1) {
+            run += literal;
+        }
+        if (!isLiteral || quantifier != 0) {
+            endRun();
+        }
+    }
+    endRun();
+    return best;
+}
+
+#ifdef ZSH_HISTORY_CLEANER_USE_RE2
+
+struct RegexMatcher::CombinedEngine {
+    explicit CombinedEngine(const RE2::Options& options) : set(options, RE2::UNANCHORED) {}
+    RE2::Set set;
+};
+
+namespace {
+
+// Rewrites an ECMAScript pattern so RE2 matches exactly the same bytes:
+// '.' excludes '\r' as well as '\n', and \s / \S include '\v'.
+std::string translateForRe2(const std::string& pattern) {
+    std::string out;
+    out.reserve(pattern.size() + 16);
+    bool inClass = false;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char e = pattern[++i];
+            if (e == 's') {
+                out += inClass ? "\\t\\n\\v\\f\\r " : "[\\t\\n\\v\\f\\r ]";
+            } else if (e == 'S' && !inClass) {
+                out += "[^\\t\\n\\v\\f\\r ]";
+            } else {
+                out += c;
+                out += e;
+            }
+            continue;
+        }
+        if (inClass) {
+            if (c == ']') inClass = false;
+            out += c;
+        } else if (c == '[') {
+            inClass = true;
+            out += c;
+            // A leading ']' (after optional '^') is literal in both dialects
+            if (i + 1 < pattern.size() && pattern[i + 1] == '^') out += pattern[++i];
+            if (i + 1 < pattern.size() && pattern[i + 1] == ']') out += pattern[++i];
+        } else if (c == '.') {
+            out += "[^\\n\\r]";
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+bool re2Supports(const std::string& pattern) {
+    // Only letter escapes with identical meaning in both dialects are passed to RE2.
+    // \S inside a class has no simple RE2 spelling; leave such patterns to std::regex.
+    static const std::string sharedEscapes = "dDsSwWbBntrfvx";
+    bool inClass = false;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char e = pattern[++i];
+            if (inClass && (e == 'S' || e == 'b' || e == 'B')) return false;
+            if (std::isalnum(static_cast<unsigned char>(e)) && sharedEscapes.find(e) == std::string::npos) {
+                return false; // Backreferences, \c, \u, \0, ...
+            }
+            continue;
+        }
+        if (c == '[') inClass = true;
+        else if (c == ']') inClass = false;
+    }
+    return true;
+}
+
+} // namespace
+
+const char* RegexMatcher::backendName() { return "re2"; }
+
+#else
+
+struct RegexMatcher::CombinedEngine {};
+
+const char* RegexMatcher::backendName() { return "std::regex"; }
+
+#endif
+
+RegexMatcher::RegexMatcher() = default;
+RegexMatcher::~RegexMatcher() = default;
+
+void RegexMatcher::validate(const std::string& pattern) {
+    std::regex(pattern, std::regex::ECMAScript); // Throws std::regex_error
+}
+
+void RegexMatcher::add(const std::string& pattern) {
+    Pattern entry;
+    entry.regex = std::regex(pattern, std::regex::ECMAScript); // Throws std::regex_error
+    entry.source = pattern;
+    entry.literal = requiredLiteral(pattern);
+    patterns_.push_back(std::move(entry));
+}
+
+void RegexMatcher::compile() {
+    combined_.reset();
+    combinedNeedsNoLiteral_ = false;
+    std::vector<std::string> literals;
+
+#ifdef ZSH_HISTORY_CLEANER_USE_RE2
+    RE2::Options options;
+    options.set_encoding(RE2::Options::EncodingLatin1); // Byte semantics, like std::regex on char
+    options.set_log_errors(false);
+    options.set_max_mem(64 << 20);
+    auto engine = std::make_unique<CombinedEngine>(options);
+    size_t added = 0;
+    for (auto& pattern : patterns_) {
+        pattern.inCombinedSet = false;
+        if (!re2Supports(pattern.source)) continue;
+        std::string error;
+        if (engine->set.Add(translateForRe2(pattern.source), &error) < 0) continue;
+        pattern.inCombinedSet = true;
+        ++added;
+        if (pattern.literal.empty()) {
+            combinedNeedsNoLiteral_ = true;
+        } else {
+            literals.push_back(pattern.literal);
+        }
+    }
+    if (added > 0) {
+        if (engine->set.Compile()) {
+            combined_ = std::move(engine);
+        } else {
+            for (auto& pattern : patterns_) pattern.inCombinedSet = false;
+            literals.clear();
+            combinedNeedsNoLiteral_ = false;
+        }
+    }
+#endif
+
+    combinedLiterals_.build(literals);
+}
+
+bool RegexMatcher::matchesAny(std::string_view text) const {
+#ifdef ZSH_HISTORY_CLEANER_USE_RE2
+    if (combined_ && (combinedNeedsNoLiteral_ || combinedLiterals_.matchesAny(text))) {
+        if (combined_->set.Match(re2::StringPiece(text.data(), text.size()), nullptr)) {
+            return true;
+        }
+    }
+#endif
+
+    for (const auto& pattern : patterns_) {
+        if (pattern.inCombinedSet) continue;
+        if (!pattern.literal.empty() && text.find(pattern.literal) == std::string_view::npos) {
+            continue; // Cannot match without its required literal
+        }
+        if (std::regex_search(text.begin(), text.end(), pattern.regex)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RegexMatcher::matchesAnyJoined(std::string_view text) const {
+    if (!hasLineJoins(text)) {
+        return matchesAny(text);
+    }
+    // The combined engine needs contiguous input, so every pattern runs on std::regex
+    // here, over an iterator that skips the joins
+    const JoinedTextIterator first = JoinedTextIterator::begin(text);
+    const JoinedTextIterator last = JoinedTextIterator::end(text);
+    for (const auto& pattern : patterns_) {
+        // A literal without a newline cannot span a join, so the raw bytes must contain it
+        if (!pattern.literal.empty() && pattern.literal.find('\n') == std::string::npos &&
+            text.find(pattern.literal) == std::string_view::npos) {
+            continue;
+        }
+        if (std::regex_search(first, last, pattern.regex)) {
+            return true;
+        }
+    }
+    return false;
+}
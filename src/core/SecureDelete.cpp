@@ -1,6 +1,13 @@
 #include "../../include/zsh_history_cleaner/SecureDelete.h"
-#include "../../include/zsh_history_cleaner/Constants.h" // For SHRED_PASSES, TMP_PREFIX, SHRED_BUFFER_SIZE
+#include "../../include/zsh_history_cleaner/Constants.h" // For SHRED_BUFFER_SIZE, SHRED_BUFFER_ALIGNMENT, SHIFT_BUFFER_SIZE
+#include "../../include/zsh_history_cleaner/ChaCha20.h"  // For the overwrite keystream
+#ifdef ZSH_HISTORY_CLEANER_USE_IO_URING
+#include "../../include/zsh_history_cleaner/IoUring.h"   // For the pipelined overwrite backend
+#include <linux/io_uring.h>                                // For IOSQE_IO_LINK, IOSQE_IO_DRAIN
+#include <memory>                                          // For std::unique_ptr
+#endif
 #include "../../include/zsh_history_cleaner/Utils.h"     // For nowEpoch()
+#include "../../include/zsh_history_cleaner/Progress.h"  // For the shred progress counters
 
 #include <iostream>    // For std::cerr, std::endl, std::ostream
 #include <vector>
@@ -8,67 +15,460 @@
 #include <algorithm>   // For std::min, std::fill
 #include <system_error>// For std::error_code
 #include <cerrno>      // For errno
-#include <cstring>     // For strerror
-#include <unistd.h>    // For open, write, lseek, fsync, close, unlink, truncate
-#include <fcntl.h>     // For O_WRONLY, O_SYNC
+#include <cstring>     // For strerror, memcpy, explicit_bzero
+#include <cstdlib>     // For posix_memalign, free
+#include <unistd.h>    // For open, pwrite, pread, fsync, fdatasync, close, ftruncate
+#include <fcntl.h>     // For O_WRONLY, O_DIRECT, fcntl
+#include <sys/random.h>// For getrandom
 #include <sys/stat.h>  // For S_ISREG (though filesystem::is_regular_file is used)
 
 namespace fs = std::filesystem;
 
-// Best-effort secure delete implementation
-bool secureDelete(const fs::path& filepath, int passes, std::ostream& log) {
-    // RAII class for file descriptor management
-    class FileHandle {
-    public:
-        explicit FileHandle(int fd) : fd_(fd) {}
-        ~FileHandle() { if (fd_ != -1) close(fd_); }
-        
-        int get() const { return fd_; }
-        bool isValid() const { return fd_ != -1; }
-        
-        // Prevent copying
-        FileHandle(const FileHandle&) = delete;
-        FileHandle& operator=(const FileHandle&) = delete;
-        // Allow moving
-        FileHandle(FileHandle&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
-        FileHandle& operator=(FileHandle&& other) noexcept {
-            if (this != &other) {
-                if (fd_ != -1) close(fd_);
-                fd_ = other.fd_;
-                other.fd_ = -1;
+namespace {
+
+// RAII class for file descriptor management
+class FileHandle {
+public:
+    explicit FileHandle(int fd) : fd_(fd) {}
+    ~FileHandle() { if (fd_ != -1) close(fd_); }
+
+    int get() const { return fd_; }
+    bool isValid() const { return fd_ != -1; }
+
+    // Prevent copying
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+    // Allow moving
+    FileHandle(FileHandle&& other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+    FileHandle& operator=(FileHandle&& other) noexcept {
+        if (this != &other) {
+            if (fd_ != -1) close(fd_);
+            fd_ = other.fd_;
+            other.fd_ = -1;
+        }
+        return *this;
+    }
+private:
+    int fd_;
+};
+
+// RAII class for the overwrite buffer: page aligned (as O_DIRECT requires) and wiped on release
+class SecureBuffer {
+public:
+    explicit SecureBuffer(size_t size) : size_(size) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, SHRED_BUFFER_ALIGNMENT, size) != 0) {
+            memory = nullptr;
+            size_ = 0;
+        }
+        buffer_ = static_cast<uint8_t*>(memory);
+    }
+    ~SecureBuffer() {
+        // Secure cleanup - overwrite buffer before destruction
+        if (buffer_ != nullptr) {
+            explicit_bzero(buffer_, size_);
+            std::free(buffer_);
+        }
+    }
+
+    SecureBuffer(const SecureBuffer&) = delete;
+    SecureBuffer& operator=(const SecureBuffer&) = delete;
+
+    uint8_t* data() { return buffer_; }
+    size_t size() const { return size_; }
+    bool isValid() const { return buffer_ != nullptr; }
+
+private:
+    uint8_t* buffer_ = nullptr;
+    size_t size_;
+};
+
+// Fills buf with length bytes from the kernel CSPRNG
+bool fillEntropy(uint8_t* buf, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t got = getrandom(buf + done, length - done, 0);
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// Switches O_DIRECT on or off for an open descriptor
+bool setDirectIO(int fd, bool enable) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) return false;
+    flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags) != -1;
+}
+
+// Writes length bytes of fresh keystream at [offset, offset + length). direct is
+// cleared (and O_DIRECT dropped from fd) if the filesystem turns out to reject it.
+bool writeKeystream(int fd, uintmax_t offset, uintmax_t length, ChaCha20& cipher,
+                    SecureBuffer& buffer, bool& direct, std::ostream& log) {
+    uintmax_t position = offset;
+    uintmax_t remaining = length;
+    while (remaining > 0) {
+        size_t writeSize = static_cast<size_t>(std::min(static_cast<uintmax_t>(buffer.size()), remaining));
+        cipher.keystream(buffer.data(), writeSize);
+
+        size_t done = 0;
+        while (done < writeSize) {
+            ssize_t written = pwrite(fd, buffer.data() + done, writeSize - done,
+                                     static_cast<off_t>(position + done));
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                if (direct && errno == EINVAL) {
+                    // Alignment not accepted after all: continue through the page cache
+                    direct = false;
+                    setDirectIO(fd, false);
+                    continue;
+                }
+                log << "Error: Write failed: " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            if (written == 0) {
+                log << "Error: Incomplete write" << std::endl;
+                return false;
+            }
+            done += static_cast<size_t>(written);
+            if (direct && done < writeSize && done % SHRED_BUFFER_ALIGNMENT != 0) {
+                direct = false;
+                setDirectIO(fd, false);
             }
-            return *this;
         }
-    private:
-        int fd_;
-    };
+        position += writeSize;
+        remaining -= writeSize;
+        progressShredded(writeSize);
+    }
+    return true;
+}
+
+// Draws a fresh ChaCha20 key from the kernel CSPRNG
+void drawKey(uint8_t (&key)[ChaCha20::KEY_SIZE]) {
+    if (!fillEntropy(key, sizeof(key))) {
+        // getrandom() unavailable: std::random_device is still a non-deterministic source
+        std::random_device rd;
+        for (size_t i = 0; i < sizeof(key); i += 4) {
+            uint32_t word = rd();
+            std::memcpy(key + i, &word, 4);
+        }
+    }
+}
+
+// Range split into unaligned head, aligned middle (O_DIRECT eligible) and unaligned tail
+using Segments = uintmax_t[4];
 
-    // RAII class for secure buffer management
-    class SecureBuffer {
-    public:
-        explicit SecureBuffer(size_t size) : buffer_(size) {}
-        ~SecureBuffer() {
-            // Secure cleanup - overwrite buffer before destruction
-            std::fill(buffer_.begin(), buffer_.end(), 0);
-        }
-        
-        unsigned char* data() { return buffer_.data(); }
-        size_t size() const { return buffer_.size(); }
-        
-        void fillPattern(unsigned char pattern) {
-            std::fill(buffer_.begin(), buffer_.end(), pattern);
-        }
-        
-        void fillRandom(std::mt19937& gen, std::uniform_int_distribution<unsigned int>& dist) {
-            for (auto& byte : buffer_) {
-                byte = static_cast<unsigned char>(dist(gen));
+// One overwrite pass with plain pwrite() calls, ending with an fdatasync
+bool writePassSync(int fd, const Segments& bounds, ChaCha20& cipher, SecureBuffer& buffer,
+                   bool& direct, std::ostream& log) {
+    for (int segment = 0; segment < 3; ++segment) {
+        uintmax_t segmentLength = bounds[segment + 1] - bounds[segment];
+        if (segmentLength == 0) continue;
+        bool segmentDirect = direct && segment == 1;
+        if (direct && !setDirectIO(fd, segmentDirect)) {
+            direct = segmentDirect = false;
+            setDirectIO(fd, false);
+        }
+        if (!writeKeystream(fd, bounds[segment], segmentLength, cipher, buffer, segmentDirect, log)) {
+            return false;
+        }
+        if (segment == 1 && !segmentDirect) {
+            direct = false;
+        }
+    }
+
+    // Make the pass durable before the next one starts
+    if (fdatasync(fd) == -1) {
+        log << "Warning: fdatasync failed: " << std::strerror(errno) << std::endl;
+    }
+    return true;
+}
+
+#ifdef ZSH_HISTORY_CLEANER_USE_IO_URING
+enum class UringPass { Done, Unsupported, Failed };
+
+// One overwrite pass through io_uring: up to buffers.size() writes stay in flight while
+// the keystream for the next chunk is generated, and the pass ends with an fdatasync
+// linked to the last write and drained behind all the others. Unsupported means the
+// kernel or filesystem rejected the writes (EINVAL/EOPNOTSUPP) before anything failed
+// for real; the caller may retry the pass another way.
+UringPass writePassUring(IoUring& ring, int fd, const Segments& bounds, ChaCha20& cipher,
+                         std::vector<std::unique_ptr<SecureBuffer>>& buffers, bool& direct,
+                         std::ostream& log) {
+    const uint64_t fsyncTag = UINT64_MAX;
+    std::vector<size_t> freeBuffers;
+    for (size_t i = buffers.size(); i-- > 0;) freeBuffers.push_back(i);
+    std::vector<unsigned> lengths(buffers.size(), 0);
+    size_t inFlight = 0;
+    int writeError = 0;      // errno of the first failed write
+    bool incomplete = false;
+
+    int lastSegment = -1;
+    for (int segment = 0; segment < 3; ++segment) {
+        if (bounds[segment + 1] > bounds[segment]) lastSegment = segment;
+    }
+
+    auto reap = [&]() {
+        uint64_t tag = 0;
+        int result = 0;
+        if (!ring.waitCompletion(tag, result)) {
+            log << "Error: io_uring wait failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        --inFlight;
+        if (tag == fsyncTag) {
+            // -ECANCELED: the linked write failed and is reported instead
+            if (result < 0 && result != -ECANCELED) {
+                log << "Warning: fdatasync failed: " << std::strerror(-result) << std::endl;
             }
+            return true;
+        }
+        if (result < 0) {
+            if (writeError == 0) writeError = -result;
+        } else if (static_cast<unsigned>(result) != lengths[tag]) {
+            incomplete = true;
         }
-        
-    private:
-        std::vector<unsigned char> buffer_;
+        freeBuffers.push_back(static_cast<size_t>(tag));
+        return true;
     };
+    auto drain = [&]() {
+        while (inFlight > 0) {
+            if (!reap()) return false;
+        }
+        return true;
+    };
+
+    bool ringOk = true;
+    for (int segment = 0; segment <= lastSegment && ringOk && writeError == 0 && !incomplete; ++segment) {
+        if (bounds[segment + 1] == bounds[segment]) continue;
+        bool segmentDirect = direct && segment == 1;
+        if (direct) {
+            // O_DIRECT is a per-descriptor flag, so nothing may be in flight while it changes
+            ringOk = drain();
+            if (ringOk && !setDirectIO(fd, segmentDirect)) {
+                direct = false;
+                setDirectIO(fd, false);
+            }
+        }
+
+        uintmax_t position = bounds[segment];
+        while (ringOk && writeError == 0 && !incomplete && position < bounds[segment + 1]) {
+            if (freeBuffers.empty()) {
+                ringOk = reap();
+                continue;
+            }
+            size_t index = freeBuffers.back();
+            freeBuffers.pop_back();
+            SecureBuffer& buffer = *buffers[index];
+            size_t chunk = static_cast<size_t>(std::min(static_cast<uintmax_t>(buffer.size()),
+                                                        bounds[segment + 1] - position));
+            cipher.keystream(buffer.data(), chunk);
+
+            bool lastChunk = segment == lastSegment && position + chunk == bounds[segment + 1];
+            lengths[index] = static_cast<unsigned>(chunk);
+            ring.prepareWrite(fd, buffer.data(), static_cast<unsigned>(chunk), position, index,
+                              lastChunk ? IOSQE_IO_LINK : 0);
+            ++inFlight;
+            if (lastChunk) {
+                ring.prepareFdatasync(fd, fsyncTag, IOSQE_IO_DRAIN);
+                ++inFlight;
+            }
+            if (!ring.submit()) {
+                log << "Error: io_uring submit failed: " << std::strerror(errno) << std::endl;
+                inFlight -= lastChunk ? 2 : 1;
+                ringOk = false;
+                break;
+            }
+            position += chunk;
+            progressShredded(chunk);
+        }
+    }
+
+    // Buffers must not be reused or freed while the kernel may still read them
+    if (!drain() || !ringOk) {
+        return UringPass::Failed;
+    }
+    if (writeError == EINVAL || writeError == EOPNOTSUPP) {
+        return UringPass::Unsupported;
+    }
+    if (writeError != 0) {
+        log << "Error: Write failed: " << std::strerror(writeError) << std::endl;
+        return UringPass::Failed;
+    }
+    if (incomplete) {
+        log << "Error: Incomplete write" << std::endl;
+        return UringPass::Failed;
+    }
+    return UringPass::Done;
+}
+#endif
 
+// Overwrites [offset, offset + length) of fd with passes rounds of random data.
+// Every pass draws a new ChaCha20 key from the kernel, so no block of output ever
+// repeats within or across passes, and ends with one fdatasync. If fd was opened with
+// O_DIRECT the aligned middle of the range bypasses the page cache and the unaligned
+// edges are written through it. With the io_uring backend (and a kernel that allows
+// it) several chunks are kept in flight; otherwise each chunk is a blocking pwrite().
+bool overwriteRange(int fd, uintmax_t offset, uintmax_t length, int passes, std::ostream& log) {
+    SecureBuffer buffer(SHRED_BUFFER_SIZE);
+    if (!buffer.isValid()) {
+        log << "Error: Failed to allocate overwrite buffer" << std::endl;
+        return false;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    bool direct = flags != -1 && (flags & O_DIRECT) != 0;
+    uintmax_t alignedBegin = (offset + SHRED_BUFFER_ALIGNMENT - 1) / SHRED_BUFFER_ALIGNMENT * SHRED_BUFFER_ALIGNMENT;
+    uintmax_t alignedEnd = (offset + length) / SHRED_BUFFER_ALIGNMENT * SHRED_BUFFER_ALIGNMENT;
+    if (alignedEnd <= alignedBegin) {
+        alignedBegin = alignedEnd = offset + length; // Too small to bother: all buffered
+    }
+    const Segments bounds = {offset, alignedBegin, alignedEnd, offset + length};
+
+#ifdef ZSH_HISTORY_CLEANER_USE_IO_URING
+    // The pass loop falls back to pwrite() if io_uring is unavailable at run time
+    IoUring ring;
+    bool useRing = ring.init(URING_QUEUE_DEPTH + 1);
+    std::vector<std::unique_ptr<SecureBuffer>> ringBuffers;
+    if (useRing) {
+        for (size_t i = 0; i < URING_QUEUE_DEPTH && useRing; ++i) {
+            ringBuffers.push_back(std::make_unique<SecureBuffer>(SHRED_BUFFER_SIZE));
+            useRing = ringBuffers.back()->isValid();
+        }
+    }
+#endif
+
+    progressShredStart(length, passes);
+    bool ok = true;
+    for (int pass = 1; pass <= passes && ok; ++pass) {
+        progressShredPass(pass);
+        uint8_t key[ChaCha20::KEY_SIZE];
+        uint8_t nonce[ChaCha20::NONCE_SIZE] = {};
+        drawKey(key);
+        ChaCha20 cipher(key, nonce);
+        explicit_bzero(key, sizeof(key));
+
+#ifdef ZSH_HISTORY_CLEANER_USE_IO_URING
+        if (useRing) {
+            UringPass result = writePassUring(ring, fd, bounds, cipher, ringBuffers, direct, log);
+            if (result == UringPass::Unsupported && direct) {
+                // Retry without O_DIRECT before giving up on the ring
+                direct = false;
+                setDirectIO(fd, false);
+                result = writePassUring(ring, fd, bounds, cipher, ringBuffers, direct, log);
+            }
+            if (result == UringPass::Done) continue;
+            if (result == UringPass::Failed) {
+                ok = false;
+                break;
+            }
+            useRing = false; // Redo this pass (and the rest) with pwrite()
+        }
+#endif
+        ok = writePassSync(fd, bounds, cipher, buffer, direct, log);
+    }
+
+    // Restore the descriptor's original mode for the caller
+    if (flags != -1) {
+        fcntl(fd, F_SETFL, flags);
+    }
+    return ok;
+}
+
+} // namespace
+
+bool secureOverwriteRange(int fd, uintmax_t offset, uintmax_t length, int passes, std::ostream& log) {
+    if (length == 0) return true;
+    return overwriteRange(fd, offset, length, passes, log);
+}
+
+bool secureRemoveRange(int fd, uintmax_t offset, uintmax_t length, int passes, std::ostream& log) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        log << "Error: Failed to get file size: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    uintmax_t fileSize = static_cast<uintmax_t>(st.st_size);
+    if (offset > fileSize || length > fileSize - offset) {
+        log << "Error: Range to remove lies outside the file" << std::endl;
+        return false;
+    }
+    if (length == 0) return true;
+
+    // Destroy the removed bytes where they are, then cut them out
+    if (!overwriteRange(fd, offset, length, passes, log)) {
+        return false;
+    }
+    if (fsync(fd) == -1) {
+        log << "Warning: fsync failed: " << std::strerror(errno) << std::endl;
+    }
+    return cutRange(fd, offset, length, log);
+}
+
+bool cutRange(int fd, uintmax_t offset, uintmax_t length, std::ostream& log) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        log << "Error: Failed to get file size: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    uintmax_t fileSize = static_cast<uintmax_t>(st.st_size);
+    if (offset > fileSize || length > fileSize - offset) {
+        log << "Error: Range to remove lies outside the file" << std::endl;
+        return false;
+    }
+    if (length == 0) return true;
+
+    // 1. Shift everything after the range down to close the gap. Moving towards lower
+    //    offsets in ascending order never overwrites bytes that are still to be read.
+    std::vector<char> buffer(SHIFT_BUFFER_SIZE);
+    uintmax_t source = offset + length;
+    uintmax_t target = offset;
+    while (source < fileSize) {
+        size_t chunk = static_cast<size_t>(std::min(static_cast<uintmax_t>(buffer.size()), fileSize - source));
+        ssize_t got = pread(fd, buffer.data(), chunk, static_cast<off_t>(source));
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            log << "Error: Read failed while compacting file: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (got == 0) break;
+        size_t done = 0;
+        while (done < static_cast<size_t>(got)) {
+            ssize_t written = pwrite(fd, buffer.data() + done, static_cast<size_t>(got) - done,
+                                     static_cast<off_t>(target + done));
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                log << "Error: Write failed while compacting file: " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            done += static_cast<size_t>(written);
+        }
+        source += static_cast<uintmax_t>(got);
+        target += static_cast<uintmax_t>(got);
+    }
+
+    // 2. Drop the now duplicated tail
+    if (ftruncate(fd, static_cast<off_t>(fileSize - length)) == -1) {
+        log << "Error: Failed to truncate file: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (fsync(fd) == -1) {
+        log << "Warning: fsync failed: " << std::strerror(errno) << std::endl;
+    }
+    return true;
+}
+
+// Best-effort secure delete implementation
+bool secureDelete(const fs::path& filepath, int passes, std::ostream& log) {
+    return secureDeletePart(filepath, 0, 0, 0, passes, log);
+}
+
+bool secureDeletePart(const fs::path& filepath, uintmax_t offset, uintmax_t length, uintmax_t tailOffset,
+                      int passes, std::ostream& log) {
     // 1. Validate file
     std::error_code ec;
     if (!fs::is_regular_file(filepath, ec)) {
@@ -96,59 +496,31 @@ bool secureDelete(const fs::path& filepath, int passes, std::ostream& log) {
         return fs::remove(filepath, ec);
     }
 
-    // 3. Open file with sync flags
-    FileHandle fd(open(filepath.c_str(), O_WRONLY | O_SYNC));
+    // 3. Open file for direct I/O where the filesystem supports it (each pass ends
+    //    with an fdatasync, so O_SYNC is not needed to make the overwrite durable)
+    FileHandle fd(open(filepath.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC));
     if (!fd.isValid() && (errno == EINVAL || errno == EOPNOTSUPP)) {
-        log << "Info: O_SYNC not supported, falling back to standard write mode" << std::endl;
-        fd = FileHandle(open(filepath.c_str(), O_WRONLY));
+        fd = FileHandle(open(filepath.c_str(), O_WRONLY | O_CLOEXEC));
     }
-    
+
     if (!fd.isValid()) {
         log << "Error: Failed to open file: " << std::strerror(errno) << std::endl;
         return fs::remove(filepath, ec);
     }
 
-    // 4. Initialize secure buffer and RNG
-    SecureBuffer buffer(SHRED_BUFFER_SIZE);
+    // 4. Perform overwrite passes over the range and the tail, clipped to the file
+    uintmax_t rangeEnd = std::min(offset + length, fileSize);
+    uintmax_t tailBegin = std::min(std::max(tailOffset, rangeEnd), fileSize);
+    if ((offset < rangeEnd && !overwriteRange(fd.get(), offset, rangeEnd - offset, passes, log)) ||
+        (tailBegin < fileSize && !overwriteRange(fd.get(), tailBegin, fileSize - tailBegin, passes, log))) {
+        return fs::remove(filepath, ec);
+    }
+
+    // 5. Random generator for the obscured file name
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_int_distribution<unsigned int> dist(0, 255);
 
-
-    // 5. Perform overwrite passes
-    for (int pass = 1; pass <= passes; ++pass) {
-        if (lseek(fd.get(), 0, SEEK_SET) == -1) {
-            log << "Error: Failed to seek to start of file: " << std::strerror(errno) << std::endl;
-            return fs::remove(filepath, ec);
-        }
-
-        // Always fill with random data
-        buffer.fillRandom(gen, dist);
-
-        // Write pattern to file
-        uintmax_t remaining = fileSize;
-        while (remaining > 0) {
-            size_t writeSize = std::min(static_cast<uintmax_t>(buffer.size()), remaining);
-            ssize_t written = write(fd.get(), buffer.data(), writeSize);
-
-            if (written == -1) {
-                if (errno == EINTR) continue;
-                log << "Error: Write failed: " << std::strerror(errno) << std::endl;
-                return fs::remove(filepath, ec);
-            }
-            if (static_cast<size_t>(written) != writeSize) {
-                log << "Error: Incomplete write" << std::endl;
-                return fs::remove(filepath, ec);
-            }
-            remaining -= written;
-        }
-
-        // Sync after each pass
-        if (fsync(fd.get()) == -1) {
-            log << "Warning: fsync failed: " << std::strerror(errno) << std::endl;
-        }
-    }
-
     // 6. Rename before delete - use random string for filename
     // Generate random filename
     std::string randomStr;
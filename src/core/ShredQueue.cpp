@@ -0,0 +1,353 @@
+#include "../../include/zsh_history_cleaner/ShredQueue.h"
+#include "../../include/zsh_history_cleaner/BufferedWriter.h"
+#include "../../include/zsh_history_cleaner/CleanupRegistry.h"
+#include "../../include/zsh_history_cleaner/SecureDelete.h"
+#include "../../include/zsh_history_cleaner/Utils.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>    // For std::sort
+#include <system_error>
+#include <cerrno>       // For errno
+#include <cstring>      // For strerror
+#include <cstdlib>      // For strtoull
+#include <fcntl.h>      // For open, O_* flags
+#include <unistd.h>     // For close, fsync
+#include <sys/file.h>   // For flock
+#include <sys/stat.h>   // For stat
+
+namespace {
+
+const char* const SHRED_ENTRY_MAGIC = "zsh_history_cleaner shred v1";
+const char* const SHRED_ENTRY_SUFFIX = ".shred";
+const char* const PENDING_MAGIC = "zsh_history_cleaner pending shred v1";
+const char* const PENDING_SUFFIX = ".cleaner-pending";
+
+struct ShredEntry {
+    int passes = 0;
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    fs::path file;
+};
+
+bool parseNumber(const std::string& text, uint64_t& value) {
+    if (text.empty() || text[0] == '-' || text[0] == '+') return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') return false;
+    value = parsed;
+    return true;
+}
+
+// A queue entry, or with PENDING_MAGIC a pending record: the same fields
+bool loadEntry(const fs::path& path, ShredEntry& entry, const char* expectedMagic = SHRED_ENTRY_MAGIC) {
+    std::ifstream in(path);
+    std::string magic, passes, device, inode, file;
+    if (!std::getline(in, magic) || magic != expectedMagic || !std::getline(in, passes) ||
+        !std::getline(in, device) || !std::getline(in, inode) || !std::getline(in, file) || file.empty()) {
+        return false;
+    }
+    uint64_t count = 0;
+    if (!parseNumber(passes, count) || count == 0 || count > 1000000 ||
+        !parseNumber(device, entry.device) || !parseNumber(inode, entry.inode)) {
+        return false;
+    }
+    entry.passes = static_cast<int>(count);
+    entry.file = file;
+    return true;
+}
+
+std::string entryText(const char* magic, int passes, uint64_t device, uint64_t inode, const fs::path& file) {
+    std::error_code ec;
+    return std::string(magic) + "\n" + std::to_string(passes) + "\n" + std::to_string(device) + "\n"
+        + std::to_string(inode) + "\n" + fs::absolute(file, ec).string() + "\n";
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t written = write(fd, data.data() + done, data.size() - done);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool sameFile(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+// Makes renames and unlinks in dir durable
+void syncDirectory(const fs::path& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// The queued entries, oldest first (their names start with the time they were queued)
+std::vector<fs::path> listEntries(const fs::path& queueDir) {
+    std::vector<fs::path> entries;
+    std::error_code ec;
+    for (fs::directory_iterator it(queueDir, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path& path = it->path();
+        if (path.extension() == SHRED_ENTRY_SUFFIX && path.filename().string()[0] != '.') {
+            entries.push_back(path);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+} // namespace
+
+fs::path defaultShredQueueDir() {
+    std::string state = getEnvVar("XDG_STATE_HOME", "");
+    if (state.empty()) {
+        state = getEnvVar("HOME", "") + "/.local/state";
+    }
+    return fs::path(state) / "zsh_history_cleaner" / "shred-queue";
+}
+
+bool enqueueShred(const fs::path& queueDir, const fs::path& file, int passes, std::ostream& log) {
+    std::error_code ec;
+    fs::create_directories(queueDir, ec);
+    if (ec) {
+        log << "Warning: Cannot create shred queue " << queueDir.string() << " (" << ec.message() << ")" << std::endl;
+        return false;
+    }
+    fs::permissions(queueDir, fs::perms::owner_all, fs::perm_options::replace, ec);
+
+    struct stat st;
+    if (::stat(file.c_str(), &st) == -1) {
+        log << "Warning: Cannot queue " << file.string() << " for shredding (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    const std::string text = entryText(SHRED_ENTRY_MAGIC, passes, static_cast<uint64_t>(st.st_dev),
+                                       static_cast<uint64_t>(st.st_ino), file);
+
+    // Written under a dot name the drainer ignores, synced, then renamed into the queue
+    const std::string name = std::to_string(static_cast<long long>(nowEpoch())) + "-" + randomString(12);
+    const fs::path tempPath = queueDir / ("." + name);
+    const fs::path entryPath = queueDir / (name + SHRED_ENTRY_SUFFIX);
+    int slot = registerTempFile(tempPath);
+    BufferedFileWriter writer(text.size());
+    if (slot == -1 || !writer.create(tempPath, log)) {
+        if (slot != -1) unregisterTempFile(slot);
+        log << "Warning: Cannot write to shred queue " << queueDir.string() << std::endl;
+        return false;
+    }
+    if (!writer.write(text) || !writer.close(true)) {
+        log << "Warning: Cannot write to shred queue " << queueDir.string()
+            << " (" << std::strerror(writer.lastError()) << ")" << std::endl;
+        fs::remove(tempPath, ec);
+        unregisterTempFile(slot);
+        return false;
+    }
+    fs::rename(tempPath, entryPath, ec);
+    if (ec) {
+        log << "Warning: Cannot write to shred queue " << queueDir.string() << " (" << ec.message() << ")" << std::endl;
+        fs::remove(tempPath, ec);
+        unregisterTempFile(slot);
+        return false;
+    }
+    unregisterTempFile(slot);
+    syncDirectory(queueDir);
+    return true;
+}
+
+bool drainShredQueue(const fs::path& queueDir, std::ostream& log, ShredQueueResult& result) {
+    std::error_code ec;
+    if (!fs::is_directory(queueDir, ec)) {
+        return true; // Nothing was ever queued
+    }
+
+    // Each entry is tried once per drain, so a file that cannot be shredded does not spin
+    std::set<fs::path> attempted;
+    auto pending = [&]() {
+        for (const fs::path& entry : listEntries(queueDir)) {
+            if (attempted.count(entry) == 0) return true;
+        }
+        return false;
+    };
+
+    // A drainer that finds the lock taken leaves its entries to the holder. The holder looks
+    // at the queue once more after unlocking, so an entry queued just as it finished is not
+    // stranded: either it sees the entry then, or the late drainer gets the lock.
+    const fs::path lockPath = queueDir / "lock";
+    do {
+        int lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (lockFd == -1) {
+            log << "Error: Cannot open " << lockPath.string() << " (" << std::strerror(errno) << ")" << std::endl;
+            return false;
+        }
+        if (flock(lockFd, LOCK_EX | LOCK_NB) == -1) {
+            int error = errno;
+            close(lockFd);
+            if (error == EWOULDBLOCK) {
+                result.busy = true;
+                return result.failed == 0;
+            }
+            log << "Error: Cannot lock " << lockPath.string() << " (" << std::strerror(error) << ")" << std::endl;
+            return false;
+        }
+
+        for (bool progress = true; progress && !terminationRequested();) {
+            progress = false;
+            for (const fs::path& entryPath : listEntries(queueDir)) {
+                if (terminationRequested()) break;
+                if (!attempted.insert(entryPath).second) continue;
+                progress = true;
+
+                ShredEntry entry;
+                if (!loadEntry(entryPath, entry)) {
+                    log << "Warning: Ignoring malformed shred queue entry " << entryPath.string() << std::endl;
+                    ++result.failed;
+                    continue;
+                }
+                struct stat st;
+                if (::lstat(entry.file.c_str(), &st) == -1 || !S_ISREG(st.st_mode) ||
+                    static_cast<uint64_t>(st.st_dev) != entry.device || static_cast<uint64_t>(st.st_ino) != entry.inode) {
+                    // Shredded before a crash let the entry be removed, or not the queued file any more
+                    ++result.stale;
+                } else if (secureDelete(entry.file, entry.passes, log)) {
+                    ++result.shredded;
+                } else {
+                    log << "Error: Secure delete of queued file " << entry.file.string() << " failed; it stays queued." << std::endl;
+                    ++result.failed;
+                    continue;
+                }
+                fs::remove(entryPath, ec);
+                syncDirectory(queueDir);
+            }
+        }
+        close(lockFd); // Releases the lock
+    } while (!terminationRequested() && pending());
+    return result.failed == 0;
+}
+
+fs::path pendingShredPath(const fs::path& historyFile) {
+    return historyFile.parent_path() / (historyFile.filename().string() + PENDING_SUFFIX);
+}
+
+PendingShred::~PendingShred() {
+    if (fd_ != -1) {
+        close(fd_); // The record stays; the next run finds it unlocked
+    }
+}
+
+bool PendingShred::record(const fs::path& historyFile, const fs::path& original, uint64_t device, uint64_t inode,
+                          int passes, std::ostream& log) {
+    // Written under a temporary name, synced and locked, then renamed into place: the
+    // record is complete whenever it can be seen, and locked for as long as this run lives
+    const fs::path path = pendingShredPath(historyFile);
+    const fs::path tempPath = path.parent_path() / (path.filename().string() + "." + randomString(8));
+    int slot = registerTempFile(tempPath);
+    if (slot == -1) {
+        log << "Warning: Cannot record " << original.string() << " for shredding" << std::endl;
+        return false;
+    }
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    bool ok = fd != -1 && writeAll(fd, entryText(PENDING_MAGIC, passes, device, inode, original)) &&
+              fsync(fd) == 0 && flock(fd, LOCK_EX) == 0 && ::rename(tempPath.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        log << "Warning: Cannot record " << original.string() << " for shredding in " << path.string()
+            << " (" << std::strerror(errno) << ")" << std::endl;
+        if (fd != -1) close(fd);
+        ::unlink(tempPath.c_str());
+        unregisterTempFile(slot);
+        return false;
+    }
+    unregisterTempFile(slot);
+    syncDirectory(path.parent_path());
+    path_ = path;
+    fd_ = fd;
+    return true;
+}
+
+void PendingShred::clear() {
+    if (fd_ == -1) return;
+    ::unlink(path_.c_str());
+    syncDirectory(path_.parent_path());
+    close(fd_);
+    fd_ = -1;
+}
+
+bool recoverPendingShred(const fs::path& historyFile, bool dryRun, std::ostream& info, std::ostream& log) {
+    const fs::path path = pendingShredPath(historyFile);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return true; // Nothing pending
+    }
+    // A record its run still holds is that run's business. One unlocked after it was
+    // cleared (the path gone or reused meanwhile) is not looked at either.
+    struct stat locked, current;
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &locked) == -1 ||
+        ::lstat(path.c_str(), &current) == -1 || !sameFile(locked, current)) {
+        close(fd);
+        return true;
+    }
+    auto finish = [&](bool ok) {
+        if (ok && !dryRun) {
+            ::unlink(path.c_str());
+            syncDirectory(path.parent_path());
+        }
+        close(fd);
+        return ok;
+    };
+
+    ShredEntry entry;
+    if (!loadEntry(path, entry, PENDING_MAGIC)) {
+        log << "Warning: Ignoring malformed pending shred record " << path.string() << std::endl;
+        return finish(true);
+    }
+    struct stat leftover;
+    if (::lstat(entry.file.c_str(), &leftover) == -1 || !S_ISREG(leftover.st_mode) ||
+        static_cast<uint64_t>(leftover.st_dev) != entry.device || static_cast<uint64_t>(leftover.st_ino) != entry.inode) {
+        return finish(true); // Shredded before the record could be removed, or not the recorded file
+    }
+    if (dryRun) {
+        info << "Info: " << entry.file.string() << " is a copy of the history left by an interrupted run;"
+             << " a run without --dry-run shreds it." << std::endl;
+        return finish(true);
+    }
+
+    struct stat history;
+    const bool historyExists = ::lstat(historyFile.c_str(), &history) == 0;
+    if (historyExists && sameFile(history, leftover)) {
+        // Linked before the cleaned file was renamed in: a second name of the history itself
+        if (::unlink(entry.file.c_str()) == -1) {
+            log << "Error: Cannot remove " << entry.file.string() << " (" << std::strerror(errno) << ")" << std::endl;
+            return finish(false);
+        }
+        info << "Recovered: an interrupted run left the history file in place; removed its second name "
+             << entry.file.string() << "." << std::endl;
+    } else if (!historyExists) {
+        // Moved aside before the cleaned file was renamed in: it is still the history
+        if (::link(entry.file.c_str(), historyFile.c_str()) == -1 || ::unlink(entry.file.c_str()) == -1) {
+            log << "Error: Cannot put " << entry.file.string() << " back as " << historyFile.string()
+                << " (" << std::strerror(errno) << ")" << std::endl;
+            return finish(false);
+        }
+        info << "Recovered: an interrupted run had moved the history file aside; put it back from "
+             << entry.file.string() << "." << std::endl;
+    } else {
+        info << "Recovered: securely deleting the original an interrupted run left at " << entry.file.string()
+             << std::endl;
+        if (!secureDelete(entry.file, entry.passes, log)) {
+            log << "Error: Secure delete of " << entry.file.string() << " failed; it stays recorded in "
+                << path.string() << "." << std::endl;
+            return finish(false);
+        }
+    }
+    syncDirectory(historyFile.parent_path());
+    return finish(true);
+}
@@ -0,0 +1,153 @@
+#include "../../include/zsh_history_cleaner/TimeSeek.h"
+#include "../../include/zsh_history_cleaner/HistoryParser.h"
+#include "../../include/zsh_history_cleaner/HistoryReader.h"
+
+#include <algorithm>   // For std::max, std::sort
+#include <cstring>     // For memchr
+#include <limits>      // For numeric_limits
+
+namespace {
+
+// Headers checked for order at each binary-search probe (the one it lands on included)
+// and past the end of a range
+const size_t PROBE_CHECK_HEADERS = 8;
+
+std::time_t saturatingAdd(std::time_t value, std::time_t delta) {
+    return (value > std::numeric_limits<std::time_t>::max() - delta) ? std::numeric_limits<std::time_t>::max()
+                                                                      : value + delta;
+}
+
+std::time_t saturatingSub(std::time_t value, std::time_t delta) {
+    return (value < std::numeric_limits<std::time_t>::min() + delta) ? std::numeric_limits<std::time_t>::min()
+                                                                      : value - delta;
+}
+
+// Binary search on the header timestamps of one buffer, probing at byte offsets and
+// resyncing to the next header line. Out-of-range timestamps are stepped over: such an
+// entry is kept in any window, wherever it is. Whatever disorder the probes and the
+// range checks come across clears ordered().
+class WindowSearch {
+public:
+    WindowSearch(std::string_view data, std::time_t slackSeconds) : data_(data), slack_(slackSeconds) {}
+
+    // Offset of the first entry whose timestamp is >= target (data.size() if none),
+    // assuming timestamps are non-decreasing through the buffer
+    size_t lowerBound(std::time_t target) {
+        size_t lo = 0;
+        size_t hi = data_.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            size_t headerOffset;
+            std::time_t timestamp;
+            if (!probe(mid, headerOffset, timestamp) || timestamp >= target) {
+                hi = mid;
+            } else {
+                lo = std::max(mid, headerOffset) + 1;
+            }
+        }
+        return findEntryBoundary(data_, lo);
+    }
+
+    // Checks every header in [begin, end), which is parsed anyway, and a few past it
+    void checkRange(size_t begin, size_t end) {
+        std::time_t maxSeen = std::numeric_limits<std::time_t>::min();
+        size_t past = 0;
+        forEachHeader(begin, [&](size_t pos, std::time_t timestamp) {
+            check(timestamp, maxSeen);
+            return pos < end || ++past < PROBE_CHECK_HEADERS;
+        });
+    }
+
+    // Also checks what the probes saw against each other
+    bool ordered() {
+        std::sort(probes_.begin(), probes_.end());
+        std::time_t maxSeen = std::numeric_limits<std::time_t>::min();
+        for (const auto& probe : probes_) check(probe.second, maxSeen);
+        return ordered_;
+    }
+
+private:
+    // The first header at or after offset with an in-range timestamp, checked with the
+    // ones after it. Returns false if there is none.
+    bool probe(size_t offset, size_t& headerOffset, std::time_t& timestamp) {
+        std::time_t maxSeen = std::numeric_limits<std::time_t>::min();
+        size_t seen = 0;
+        forEachHeader(findEntryBoundary(data_, offset), [&](size_t pos, std::time_t header) {
+            if (seen == 0) {
+                headerOffset = pos;
+                timestamp = header;
+                probes_.emplace_back(pos, header);
+            }
+            check(header, maxSeen);
+            return ++seen < PROBE_CHECK_HEADERS;
+        });
+        return seen != 0;
+    }
+
+    void check(std::time_t timestamp, std::time_t& maxSeen) {
+        if (timestamp < saturatingSub(maxSeen, slack_)) ordered_ = false;
+        if (timestamp > maxSeen) maxSeen = timestamp;
+    }
+
+    // Calls visit(offset, timestamp) for the in-range headers from pos (a line start)
+    // on, while it returns true. Lines are only parsed as far as the header.
+    template <typename Visit>
+    void forEachHeader(size_t pos, Visit visit) const {
+        const char* const base = data_.data();
+        while (pos < data_.size()) {
+            const void* nl = std::memchr(base + pos, '\n', data_.size() - pos);
+            size_t next = (nl == nullptr) ? data_.size() : static_cast<size_t>(static_cast<const char*>(nl) - base) + 1;
+            HistoryHeader header;
+            if (parseHistoryHeader(stripLineEnding(data_.substr(pos, next - pos)), header) && header.timestampInRange &&
+                !visit(pos, header.timestamp)) {
+                return;
+            }
+            pos = next;
+        }
+    }
+
+    std::string_view data_;
+    std::time_t slack_;
+    bool ordered_ = true;
+    std::vector<std::pair<size_t, std::time_t>> probes_;   // Offset and timestamp each probe landed on
+};
+
+} // namespace
+
+bool locateTimeWindows(std::string_view data, const std::vector<std::pair<std::time_t, std::time_t>>& windows,
+                       std::time_t slackSeconds, std::vector<TimeWindowRange>& ranges) {
+    // Both edges are widened by the slack, so small inversions at the boundaries are
+    // still classified
+    WindowSearch search(data, slackSeconds);
+    ranges.clear();
+    for (const auto& window : windows) {
+        TimeWindowRange range;
+        range.begin = (window.first == 0) ? 0 : search.lowerBound(saturatingSub(window.first, slackSeconds));
+        range.end = (window.second == std::numeric_limits<std::time_t>::max())
+            ? data.size()
+            : search.lowerBound(saturatingAdd(saturatingAdd(window.second, slackSeconds), 1));
+        if (range.end < range.begin) range.end = range.begin;
+        ranges.push_back(range);
+    }
+
+    // Everything inside the ranges is parsed anyway; make sure it is ordered too, once
+    // where ranges overlap
+    std::vector<TimeWindowRange> spans = ranges;
+    std::sort(spans.begin(), spans.end(), [](const TimeWindowRange& a, const TimeWindowRange& b) {
+        return a.begin < b.begin;
+    });
+    for (size_t i = 0; i < spans.size();) {
+        TimeWindowRange span = spans[i];
+        for (++i; i < spans.size() && spans[i].begin <= span.end; ++i) span.end = std::max(span.end, spans[i].end);
+        if (span.begin < span.end) search.checkRange(span.begin, span.end);
+    }
+    return search.ordered();
+}
+
+bool locateTimeWindow(std::string_view data, std::time_t start, std::time_t end,
+                      std::time_t slackSeconds, TimeWindowRange& range) {
+    std::vector<TimeWindowRange> ranges;
+    if (!locateTimeWindows(data, {{start, end}}, slackSeconds, ranges)) return false;
+    range = ranges[0];
+    return true;
+}
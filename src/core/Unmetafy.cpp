@@ -0,0 +1,58 @@
+#include "../../include/zsh_history_cleaner/Unmetafy.h"
+
+#include <cstring>     // For memchr
+
+#if defined(__AVX2__)
+#include <immintrin.h> // For the 32-byte compare
+#elif defined(__SSE2__)
+#include <emmintrin.h> // For the 16-byte compare
+#endif
+
+size_t findMeta(std::string_view text) {
+    const char* data = text.data();
+    const size_t size = text.size();
+    size_t pos = 0;
+
+#if defined(__AVX2__)
+    const __m256i meta = _mm256_set1_epi8(static_cast<char>(ZSH_META));
+    for (; pos + 64 <= size; pos += 64) {
+        __m256i low = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos)), meta);
+        __m256i high = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos + 32)), meta);
+        if (!_mm256_testz_si256(_mm256_or_si256(low, high), _mm256_or_si256(low, high))) break;
+    }
+#elif defined(__SSE2__)
+    // Four compares are OR-ed together so the common, Meta-free case costs one branch per 64 bytes
+    const __m128i meta = _mm_set1_epi8(static_cast<char>(ZSH_META));
+    for (; pos + 64 <= size; pos += 64) {
+        __m128i hits = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos)), meta);
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 16)), meta));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 32)), meta));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 48)), meta));
+        if (_mm_movemask_epi8(hits) != 0) break;
+    }
+#endif
+
+    // The rest (and the stride that had a hit) to the exact offset
+    const void* hit = std::memchr(data + pos, ZSH_META, size - pos);
+    return hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : size;
+}
+
+std::string_view unmetafy(std::string_view text, std::string& scratch) {
+    size_t meta = findMeta(text);
+    if (meta == text.size()) return text;
+
+    scratch.clear();
+    size_t pos = 0;
+    while (meta < text.size()) {
+        scratch.append(text.data() + pos, meta - pos);
+        if (meta + 1 == text.size()) { // Truncated pair: nothing to decode
+            pos = meta;
+            break;
+        }
+        scratch.push_back(static_cast<char>(text[meta + 1] ^ 0x20));
+        pos = meta + 2;
+        meta = pos + findMeta(text.substr(pos));
+    }
+    scratch.append(text.data() + pos, text.size() - pos);
+    return scratch;
+}
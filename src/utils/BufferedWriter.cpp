@@ -0,0 +1,120 @@
+#include "../../include/zsh_history_cleaner/BufferedWriter.h"
+#include "../../include/zsh_history_cleaner/RunStats.h"
+
+#include <iostream>    // For std::ostream, std::endl
+#include <cerrno>      // For errno
+#include <cstring>     // For strerror, memcpy
+#include <fcntl.h>     // For open, O_* flags
+#include <unistd.h>    // For write, fsync, close
+#include <sys/stat.h>  // For S_IRUSR, S_IWUSR
+
+BufferedFileWriter::BufferedFileWriter(size_t bufferSize) : buffer_(bufferSize) {}
+
+BufferedFileWriter::~BufferedFileWriter() {
+    if (fd_ != -1 && owned_) {
+        ::close(fd_);
+    }
+}
+
+bool BufferedFileWriter::create(const fs::path& path, std::ostream& log) {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd_ == -1) {
+        int savedErrno = errno;
+        if (savedErrno != EEXIST) {
+            log << "Error: Cannot create file: " << path.string()
+                << " (" << std::strerror(savedErrno) << ")" << std::endl;
+        }
+        errno = savedErrno;
+        return false;
+    }
+    owned_ = true;
+    used_ = 0;
+    failed_ = false;
+    lastError_ = 0;
+    bytesWritten_ = 0;
+    return true;
+}
+
+void BufferedFileWriter::attach(int fd) {
+    fd_ = fd;
+    owned_ = false;
+    used_ = 0;
+    failed_ = false;
+    lastError_ = 0;
+    bytesWritten_ = 0;
+}
+
+bool BufferedFileWriter::writeAll(const char* data, size_t size) {
+    PhaseTimer timer(stats_, RunPhase::Write);
+    while (size > 0) {
+        ssize_t written = ::write(fd_, data, size);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            lastError_ = errno;
+            failed_ = true;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool BufferedFileWriter::write(std::string_view data) {
+    if (failed_ || fd_ == -1) return false;
+    bytesWritten_ += data.size();
+
+    if (data.size() > buffer_.size() - used_) {
+        if (!flush()) return false;
+        // Large pieces bypass the buffer entirely
+        if (data.size() >= buffer_.size()) {
+            return writeAll(data.data(), data.size());
+        }
+    }
+    std::memcpy(buffer_.data() + used_, data.data(), data.size());
+    used_ += data.size();
+    return true;
+}
+
+bool BufferedFileWriter::flush() {
+    if (failed_ || fd_ == -1) return false;
+    if (used_ == 0) return true;
+    bool ok = writeAll(buffer_.data(), used_);
+    used_ = 0;
+    return ok;
+}
+
+bool BufferedFileWriter::sync() {
+    if (!flush()) return false;
+    PhaseTimer timer(stats_, RunPhase::Write);
+    if (fsync(fd_) == -1) {
+        lastError_ = errno;
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool BufferedFileWriter::close(bool sync) {
+    if (fd_ == -1) return !failed_;
+    bool ok = flush();
+    PhaseTimer timer(sync ? stats_ : nullptr, RunPhase::Write);
+    if (ok && sync && fsync(fd_) == -1) {
+        lastError_ = errno;
+        failed_ = true;
+        ok = false;
+    }
+    if (owned_ && ::close(fd_) == -1 && ok) {
+        lastError_ = errno;
+        failed_ = true;
+        ok = false;
+    }
+    fd_ = -1;
+    return ok;
+}
+
+void BufferedStreamWriter::flush() {
+    if (buffer_.empty()) return;
+    out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
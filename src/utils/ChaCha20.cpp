@@ -0,0 +1,160 @@
+#include "../../include/zsh_history_cleaner/ChaCha20.h"
+
+#include <cstring>     // For memcpy
+
+#if defined(__SSE2__)
+#include <emmintrin.h> // For the four-block keystream path
+#endif
+
+namespace {
+
+inline uint32_t load32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void store32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+inline uint32_t rotl32(uint32_t v, int n) {
+    return (v << n) | (v >> (32 - n));
+}
+
+inline void quarterRound(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+    a += b; d = rotl32(d ^ a, 16);
+    c += d; b = rotl32(b ^ c, 12);
+    a += b; d = rotl32(d ^ a, 8);
+    c += d; b = rotl32(b ^ c, 7);
+}
+
+#if defined(__SSE2__)
+template <int N>
+inline __m128i rotl128(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi32(v, N), _mm_srli_epi32(v, 32 - N));
+}
+
+inline void quarterRound4(__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+    a = _mm_add_epi32(a, b); d = rotl128<16>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d); b = rotl128<12>(_mm_xor_si128(b, c));
+    a = _mm_add_epi32(a, b); d = rotl128<8>(_mm_xor_si128(d, a));
+    c = _mm_add_epi32(c, d); b = rotl128<7>(_mm_xor_si128(b, c));
+}
+#endif
+
+} // namespace
+
+ChaCha20::ChaCha20(const uint8_t (&key)[KEY_SIZE], const uint8_t (&nonce)[NONCE_SIZE], uint64_t counter) {
+    // "expand 32-byte k"
+    state_[0] = 0x61707865;
+    state_[1] = 0x3320646e;
+    state_[2] = 0x79622d32;
+    state_[3] = 0x6b206574;
+    for (int i = 0; i < 8; ++i) {
+        state_[4 + i] = load32(key + 4 * i);
+    }
+    state_[12] = static_cast<uint32_t>(counter);
+    state_[13] = static_cast<uint32_t>(counter >> 32);
+    state_[14] = load32(nonce);
+    state_[15] = load32(nonce + 4);
+}
+
+ChaCha20::~ChaCha20() {
+    volatile uint32_t* p = state_;
+    for (size_t i = 0; i < 16; ++i) p[i] = 0;
+}
+
+void ChaCha20::block(uint8_t* out) {
+    uint32_t x[16];
+    std::memcpy(x, state_, sizeof(x));
+    for (int round = 0; round < 10; ++round) {
+        quarterRound(x[0], x[4], x[8],  x[12]);
+        quarterRound(x[1], x[5], x[9],  x[13]);
+        quarterRound(x[2], x[6], x[10], x[14]);
+        quarterRound(x[3], x[7], x[11], x[15]);
+        quarterRound(x[0], x[5], x[10], x[15]);
+        quarterRound(x[1], x[6], x[11], x[12]);
+        quarterRound(x[2], x[7], x[8],  x[13]);
+        quarterRound(x[3], x[4], x[9],  x[14]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        store32(out + 4 * i, x[i] + state_[i]);
+    }
+    if (++state_[12] == 0) ++state_[13];
+}
+
+void ChaCha20::blocks4(uint8_t* out) {
+#if defined(__SSE2__)
+    // Lane i of x[j] holds word j of block counter + i
+    __m128i x[16], initial[16];
+    for (int j = 0; j < 16; ++j) {
+        initial[j] = _mm_set1_epi32(static_cast<int>(state_[j]));
+    }
+    uint64_t counter = (static_cast<uint64_t>(state_[13]) << 32) | state_[12];
+    uint32_t low[4], high[4];
+    for (int i = 0; i < 4; ++i) {
+        low[i] = static_cast<uint32_t>(counter + i);
+        high[i] = static_cast<uint32_t>((counter + i) >> 32);
+    }
+    initial[12] = _mm_setr_epi32(static_cast<int>(low[0]), static_cast<int>(low[1]),
+                                 static_cast<int>(low[2]), static_cast<int>(low[3]));
+    initial[13] = _mm_setr_epi32(static_cast<int>(high[0]), static_cast<int>(high[1]),
+                                 static_cast<int>(high[2]), static_cast<int>(high[3]));
+    for (int j = 0; j < 16; ++j) x[j] = initial[j];
+
+    for (int round = 0; round < 10; ++round) {
+        quarterRound4(x[0], x[4], x[8],  x[12]);
+        quarterRound4(x[1], x[5], x[9],  x[13]);
+        quarterRound4(x[2], x[6], x[10], x[14]);
+        quarterRound4(x[3], x[7], x[11], x[15]);
+        quarterRound4(x[0], x[5], x[10], x[15]);
+        quarterRound4(x[1], x[6], x[11], x[12]);
+        quarterRound4(x[2], x[7], x[8],  x[13]);
+        quarterRound4(x[3], x[4], x[9],  x[14]);
+    }
+    for (int j = 0; j < 16; ++j) x[j] = _mm_add_epi32(x[j], initial[j]);
+
+    // Transpose each group of four words from word-major to block-major order
+    for (int g = 0; g < 16; g += 4) {
+        __m128i t0 = _mm_unpacklo_epi32(x[g], x[g + 1]);
+        __m128i t1 = _mm_unpacklo_epi32(x[g + 2], x[g + 3]);
+        __m128i t2 = _mm_unpackhi_epi32(x[g], x[g + 1]);
+        __m128i t3 = _mm_unpackhi_epi32(x[g + 2], x[g + 3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0 * BLOCK_SIZE + 4 * g), _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 1 * BLOCK_SIZE + 4 * g), _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * BLOCK_SIZE + 4 * g), _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3 * BLOCK_SIZE + 4 * g), _mm_unpackhi_epi64(t2, t3));
+    }
+
+    counter += 4;
+    state_[12] = static_cast<uint32_t>(counter);
+    state_[13] = static_cast<uint32_t>(counter >> 32);
+#else
+    for (int i = 0; i < 4; ++i) {
+        block(out + i * BLOCK_SIZE);
+    }
+#endif
+}
+
+void ChaCha20::keystream(uint8_t* out, size_t length) {
+    while (length >= 4 * BLOCK_SIZE) {
+        blocks4(out);
+        out += 4 * BLOCK_SIZE;
+        length -= 4 * BLOCK_SIZE;
+    }
+    while (length >= BLOCK_SIZE) {
+        block(out);
+        out += BLOCK_SIZE;
+        length -= BLOCK_SIZE;
+    }
+    if (length > 0) {
+        uint8_t last[BLOCK_SIZE];
+        block(last);
+        std::memcpy(out, last, length);
+        volatile uint8_t* p = last;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) p[i] = 0;
+    }
+}
@@ -0,0 +1,111 @@
+#include "../../include/zsh_history_cleaner/CleanupRegistry.h"
+
+#include <atomic>      // For std::atomic
+#include <csignal>     // For signal, raise, sig_atomic_t
+#include <cstring>     // For memcpy, strlen
+#include <climits>     // For PATH_MAX
+#include <unistd.h>    // For write, unlink, _Exit
+
+namespace {
+
+struct TempFileSlot {
+    std::atomic<bool> used{false};   // Claimed by a thread
+    std::atomic<bool> live{false};   // path is complete and should be removed on termination
+    char path[PATH_MAX];
+};
+
+TempFileSlot g_tempFiles[MAX_TRACKED_TEMP_FILES];
+std::atomic<int> g_criticalSections{0};
+std::atomic<int> g_pendingSignal{0};
+volatile sig_atomic_t g_terminationRequested = 0;
+
+static_assert(std::atomic<bool>::is_always_lock_free && std::atomic<int>::is_always_lock_free,
+              "The signal handler relies on lock-free atomics");
+
+void writeStderr(const char* text) {
+    ssize_t ignored = write(STDERR_FILENO, text, strlen(text));
+    (void)ignored;
+}
+
+[[noreturn]] void terminateNow(int signal) {
+    const char* signame = "Unknown";
+    switch (signal) {
+        case SIGINT:  signame = "SIGINT";  break;
+        case SIGTERM: signame = "SIGTERM"; break;
+        case SIGHUP:  signame = "SIGHUP";  break;
+        default: break;
+    }
+    // Use write() for signal safety
+    writeStderr("\nReceived signal: ");
+    writeStderr(signame);
+    writeStderr("\nCleaning up...\n");
+
+    for (TempFileSlot& slot : g_tempFiles) {
+        if (slot.live.load()) {
+            unlink(slot.path);
+        }
+    }
+
+    // Reset signal to default handler and re-raise
+    std::signal(signal, SIG_DFL);
+    raise(signal);
+    _Exit(128 + signal);
+}
+
+void terminationHandler(int signal) {
+    g_terminationRequested = 1;
+    g_pendingSignal.store(signal);
+    if (g_criticalSections.load() == 0) {
+        terminateNow(signal);
+    }
+    writeStderr("\nTermination requested; waiting for the history file to be consistent again...\n");
+}
+
+} // namespace
+
+void installTerminationHandlers() {
+    std::signal(SIGINT, terminationHandler);  // Ctrl+C
+    std::signal(SIGTERM, terminationHandler); // Termination request
+    std::signal(SIGHUP, terminationHandler);  // Hangup
+}
+
+bool terminationRequested() {
+    return g_terminationRequested != 0;
+}
+
+int registerTempFile(const fs::path& path) {
+    const std::string& native = path.native();
+    if (native.size() >= PATH_MAX) {
+        return -1;
+    }
+    for (size_t i = 0; i < MAX_TRACKED_TEMP_FILES; ++i) {
+        bool expected = false;
+        if (g_tempFiles[i].used.compare_exchange_strong(expected, true)) {
+            std::memcpy(g_tempFiles[i].path, native.c_str(), native.size() + 1);
+            g_tempFiles[i].live.store(true);
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void unregisterTempFile(int slot) {
+    if (slot < 0 || static_cast<size_t>(slot) >= MAX_TRACKED_TEMP_FILES) return;
+    g_tempFiles[slot].live.store(false);
+    g_tempFiles[slot].used.store(false);
+}
+
+TerminationGuard::TerminationGuard() {
+    g_criticalSections.fetch_add(1);
+}
+
+TerminationGuard::~TerminationGuard() {
+    // A signal that arrived while guarded is acted on by whoever leaves last. The
+    // handler stores the signal before checking the count, so one side always sees it.
+    if (g_criticalSections.fetch_sub(1) == 1) {
+        int signal = g_pendingSignal.load();
+        if (signal != 0) {
+            terminateNow(signal);
+        }
+    }
+}
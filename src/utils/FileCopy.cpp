@@ -0,0 +1,119 @@
+#include "../../include/zsh_history_cleaner/FileCopy.h"
+#include "../../include/zsh_history_cleaner/Constants.h"
+
+#include <iostream>
+#include <vector>
+#include <cerrno>       // For errno
+#include <cstring>      // For strerror
+#include <fcntl.h>      // For open, O_* flags
+#include <unistd.h>     // For read, write, close, fsync, unlink, copy_file_range
+#include <sys/ioctl.h>  // For ioctl
+#include <sys/stat.h>   // For fstat, fchmod
+#include <linux/fs.h>   // For FICLONE
+
+namespace {
+
+// copy_file_range() errors meaning "not here" rather than "failed": the kernel, the file
+// systems or the pair of them cannot do it, so a plain copy is tried instead
+bool unsupportedHere(int error) {
+    return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP ||
+           error == EBADF || error == ETXTBSY;
+}
+
+// Copies the rest of in to out through a buffer, from the current file positions
+bool bufferedCopy(int in, int out, uintmax_t& copied) {
+    std::vector<char> buffer(COPY_BUFFER_SIZE);
+    for (;;) {
+        ssize_t got = read(in, buffer.data(), buffer.size());
+        if (got == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (got == 0) return true;
+        size_t done = 0;
+        while (done < static_cast<size_t>(got)) {
+            ssize_t written = write(out, buffer.data() + done, static_cast<size_t>(got) - done);
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            done += static_cast<size_t>(written);
+        }
+        copied += static_cast<uintmax_t>(got);
+    }
+}
+
+} // namespace
+
+const char* copyStrategyName(CopyStrategy strategy) {
+    switch (strategy) {
+        case CopyStrategy::Reflink:       return "reflink";
+        case CopyStrategy::CopyFileRange: return "copy_file_range";
+        case CopyStrategy::Buffered:      return "buffered copy";
+    }
+    return "unknown";
+}
+
+bool copyFile(const fs::path& from, const fs::path& to, CopyStrategy& strategy, uintmax_t& bytes, std::ostream& log) {
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in == -1) {
+        log << "Error: Cannot open " << from.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(in, &st) == -1) {
+        log << "Error: Cannot stat " << from.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        close(in);
+        return false;
+    }
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (out == -1) {
+        log << "Error: Cannot create " << to.string() << " (" << std::strerror(errno) << ")" << std::endl;
+        close(in);
+        return false;
+    }
+
+    bool ok = fchmod(out, st.st_mode & 07777) == 0; // The source's permissions, umask aside
+    uintmax_t copied = 0;
+    CopyStrategy used = CopyStrategy::Reflink;
+    if (ok && ioctl(out, FICLONE, in) == 0) {
+        copied = static_cast<uintmax_t>(st.st_size);
+    } else if (ok) {
+        // No reflinks (other file system, or one without shared extents): copy in the
+        // kernel, as long as it can; whatever is left goes through a buffer
+        used = CopyStrategy::CopyFileRange;
+        for (;;) {
+            ssize_t moved = copy_file_range(in, nullptr, out, nullptr, COPY_BUFFER_SIZE * 16, 0);
+            if (moved > 0) {
+                copied += static_cast<uintmax_t>(moved);
+                continue;
+            }
+            if (moved == 0) break;
+            if (errno == EINTR) continue;
+            if (unsupportedHere(errno)) {
+                if (copied == 0) used = CopyStrategy::Buffered;
+                ok = bufferedCopy(in, out, copied);
+            } else {
+                ok = false;
+            }
+            break;
+        }
+    }
+    // The original is destroyed right after the backup, so the backup has to be on disk
+    if (ok && fsync(out) == -1) ok = false;
+    int error = errno;
+    if (close(out) == -1 && ok) {
+        ok = false;
+        error = errno;
+    }
+    close(in);
+
+    if (!ok) {
+        log << "Error: Copying " << from.string() << " to " << to.string() << " failed (" << std::strerror(error) << ")" << std::endl;
+        unlink(to.c_str());
+        return false;
+    }
+    strategy = used;
+    bytes = copied;
+    return true;
+}
@@ -0,0 +1,142 @@
+#include "../../include/zsh_history_cleaner/IoUring.h"
+
+#include <cerrno>          // For errno
+#include <cstring>         // For memset
+#include <linux/io_uring.h>
+#include <sys/mman.h>      // For mmap, munmap
+#include <sys/syscall.h>   // For __NR_io_uring_setup, __NR_io_uring_enter
+#include <unistd.h>        // For syscall, close
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* ringField(void* ring, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+IoUring::~IoUring() {
+    if (sqes_ != nullptr) munmap(sqes_, sqesSize_);
+    if (cqRing_ != nullptr && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+    if (sqRing_ != nullptr) munmap(sqRing_, sqRingSize_);
+    if (ringFd_ != -1) close(ringFd_);
+}
+
+bool IoUring::init(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ringFd_ = ioUringSetup(entries, &params);
+    if (ringFd_ == -1) return false;
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap && cqRingSize_ > sqRingSize_) sqRingSize_ = cqRingSize_;
+
+    void* sq = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ringFd_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) return false;
+    sqRing_ = sq;
+    if (singleMap) {
+        cqRing_ = sqRing_;
+    } else {
+        void* cq = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd_, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) return false;
+        cqRing_ = cq;
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_ = ringField<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = ringField<unsigned>(sqRing_, params.sq_off.tail);
+    sqMask_ = *ringField<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = ringField<unsigned>(sqRing_, params.sq_off.array);
+    cqHead_ = ringField<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = ringField<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *ringField<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = ringField<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* IoUring::nextSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail_ + pending_;
+    if (tail - head >= sqEntries_) return nullptr;
+    unsigned index = tail & sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++pending_;
+    return sqe;
+}
+
+bool IoUring::prepareWrite(int fd, const void* buf, unsigned length, uint64_t offset,
+                           uint64_t userData, unsigned flags) {
+    io_uring_sqe* sqe = nextSqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->flags = static_cast<__u8>(flags);
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::prepareFdatasync(int fd, uint64_t userData, unsigned flags) {
+    io_uring_sqe* sqe = nextSqe();
+    if (sqe == nullptr) return false;
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->flags = static_cast<__u8>(flags);
+    sqe->fd = fd;
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::submit() {
+    // Publish the queued entries to the kernel
+    __atomic_store_n(sqTail_, *sqTail_ + pending_, __ATOMIC_RELEASE);
+    unsigned toSubmit = pending_;
+    pending_ = 0;
+    while (toSubmit > 0) {
+        int ret = ioUringEnter(ringFd_, toSubmit, 0, 0);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        toSubmit -= static_cast<unsigned>(ret);
+    }
+    return true;
+}
+
+bool IoUring::waitCompletion(uint64_t& userData, int& result) {
+    while (true) {
+        unsigned head = *cqHead_;
+        if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            userData = cqe.user_data;
+            result = cqe.res;
+            __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+        if (ioUringEnter(ringFd_, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR) {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,239 @@
+#include "../../include/zsh_history_cleaner/Progress.h"
+#include "../../include/zsh_history_cleaner/Constants.h" // For PROGRESS_INTERVAL_MS
+
+#include <atomic>      // For std::atomic
+#include <chrono>      // For std::chrono::milliseconds
+#include <algorithm>   // For std::min
+#include <cerrno>      // For errno
+#include <csignal>     // For sigaction, SIGUSR1
+#include <ctime>       // For clock_gettime
+#include <unistd.h>    // For write
+
+namespace {
+
+std::atomic<uint64_t> g_classifyTotal{0};   // Bytes the classification passes started so far cover
+std::atomic<uint64_t> g_classifyDone{0};
+std::atomic<uint64_t> g_entries{0};
+std::atomic<uint64_t> g_classifyStartNs{0}; // When the first pass started; 0 before
+std::atomic<uint64_t> g_classifiedNs{0};    // When entries were last counted
+std::atomic<uint64_t> g_shredTotal{0};      // Bytes to overwrite, all passes of every shred started
+std::atomic<uint64_t> g_shredDone{0};
+std::atomic<uint64_t> g_shredStartNs{0};
+std::atomic<int> g_shredPass{0};
+std::atomic<int> g_shredPasses{0};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int>::is_always_lock_free,
+              "The signal handler relies on lock-free atomics");
+
+constexpr size_t LINE_SIZE = 256;
+
+// clock_gettime() is async-signal-safe; std::chrono's clocks are not guaranteed to be
+uint64_t nowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+void markStart(std::atomic<uint64_t>& start) {
+    uint64_t expected = 0;
+    start.compare_exchange_strong(expected, nowNs(), std::memory_order_relaxed);
+}
+
+// Builds the line in a caller's buffer without allocating (the signal handler uses it)
+class LineBuilder {
+public:
+    LineBuilder(char* buffer, size_t size) : buffer_(buffer), size_(size) {}
+
+    void text(const char* text) {
+        for (; *text != '\0' && length_ < size_; ++text) buffer_[length_++] = *text;
+    }
+
+    void number(uint64_t value) {
+        char digits[20];
+        size_t count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0 && length_ < size_) buffer_[length_++] = digits[--count];
+    }
+
+    // In MiB with one decimal
+    void mebibytes(uint64_t bytes) {
+        uint64_t tenths = bytes / (1024 * 1024 / 10);
+        number(tenths / 10);
+        text(".");
+        number(tenths % 10);
+    }
+
+    // h:mm:ss
+    void duration(uint64_t seconds) {
+        number(seconds / 3600);
+        text(seconds / 60 % 60 < 10 ? ":0" : ":");
+        number(seconds / 60 % 60);
+        text(seconds % 60 < 10 ? ":0" : ":");
+        number(seconds % 60);
+    }
+
+    // ", ETA h:mm:ss" for the rest of total at the rate done took elapsedNs
+    void eta(uint64_t done, uint64_t total, uint64_t elapsedNs) {
+        if (done == 0 || done >= total) return;
+        double seconds = static_cast<double>(total - done) * (static_cast<double>(elapsedNs) / 1e9) / static_cast<double>(done);
+        text(", ETA ");
+        duration(static_cast<uint64_t>(seconds));
+    }
+
+    size_t length() const { return length_; }
+
+private:
+    char* buffer_;
+    size_t size_;
+    size_t length_ = 0;
+};
+
+void writeStderr(const char* text, size_t length) {
+    ssize_t ignored = write(STDERR_FILENO, text, length);
+    (void)ignored;
+}
+
+void progressSignalHandler(int) {
+    int savedErrno = errno; // The interrupted code may be about to look at it
+    char line[LINE_SIZE];
+    line[0] = '\n';
+    size_t length = 1 + formatProgress(line + 1, sizeof(line) - 2);
+    line[length++] = '\n';
+    writeStderr(line, length);
+    errno = savedErrno;
+}
+
+} // namespace
+
+void progressClassifyStart(uint64_t bytes) {
+    markStart(g_classifyStartNs);
+    g_classifyTotal.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void progressClassified(uint64_t bytes, uint64_t entries) {
+    markStart(g_classifyStartNs); // A stream has no size to start with
+    g_classifyDone.fetch_add(bytes, std::memory_order_relaxed);
+    g_entries.fetch_add(entries, std::memory_order_relaxed);
+    g_classifiedNs.store(nowNs(), std::memory_order_relaxed);
+}
+
+void progressShredStart(uint64_t bytes, int passes) {
+    markStart(g_shredStartNs);
+    g_shredPasses.store(passes, std::memory_order_relaxed);
+    g_shredPass.store(0, std::memory_order_relaxed);
+    g_shredTotal.fetch_add(bytes * static_cast<uint64_t>(passes), std::memory_order_relaxed);
+}
+
+void progressShredPass(int pass) {
+    g_shredPass.store(pass, std::memory_order_relaxed);
+}
+
+void progressShredded(uint64_t bytes) {
+    g_shredDone.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+size_t formatProgress(char* buffer, size_t size) {
+    LineBuilder line(buffer, size);
+    const uint64_t now = nowNs();
+    const uint64_t classifyStart = g_classifyStartNs.load(std::memory_order_relaxed);
+    const uint64_t shredStart = g_shredStartNs.load(std::memory_order_relaxed);
+
+    line.text("Progress: ");
+    if (classifyStart == 0 && shredStart == 0) {
+        line.text("nothing processed yet");
+        return line.length();
+    }
+    if (classifyStart != 0) {
+        const uint64_t total = g_classifyTotal.load(std::memory_order_relaxed);
+        const uint64_t done = g_classifyDone.load(std::memory_order_relaxed);
+        const uint64_t entries = g_entries.load(std::memory_order_relaxed);
+        const uint64_t elapsed = now > classifyStart ? now - classifyStart : 0;
+        const uint64_t classified = g_classifiedNs.load(std::memory_order_relaxed);
+        const uint64_t counting = classified > classifyStart ? classified - classifyStart : 0; // Not after the last pass
+        line.text("read ");
+        line.mebibytes(std::min(done, total == 0 ? done : total));
+        if (total != 0) {
+            line.text(" of ");
+            line.mebibytes(total);
+            line.text(" MiB (");
+            line.number(std::min(done, total) * 100 / total);
+            line.text("%)");
+        } else {
+            line.text(" MiB");
+        }
+        line.text(", ");
+        line.number(entries);
+        line.text(" entries");
+        if (counting > 0) {
+            line.text(" (");
+            line.number(static_cast<uint64_t>(static_cast<double>(entries) * 1e9 / static_cast<double>(counting)));
+            line.text("/s)");
+        }
+        if (shredStart == 0) line.eta(done, total, elapsed);
+    }
+    if (shredStart != 0) {
+        const uint64_t total = g_shredTotal.load(std::memory_order_relaxed);
+        const uint64_t done = std::min(g_shredDone.load(std::memory_order_relaxed), total);
+        if (classifyStart != 0) line.text("; ");
+        line.text("shred pass ");
+        line.number(static_cast<uint64_t>(g_shredPass.load(std::memory_order_relaxed)));
+        line.text("/");
+        line.number(static_cast<uint64_t>(g_shredPasses.load(std::memory_order_relaxed)));
+        line.text(", ");
+        line.mebibytes(done);
+        line.text(" of ");
+        line.mebibytes(total);
+        line.text(" MiB written");
+        if (total != 0) {
+            line.text(" (");
+            line.number(done * 100 / total);
+            line.text("%)");
+        }
+        line.eta(done, total, now > shredStart ? now - shredStart : 0);
+    }
+    return line.length();
+}
+
+void installProgressHandler() {
+    struct sigaction action = {};
+    action.sa_handler = progressSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+ProgressReporter::ProgressReporter(bool enabled) {
+    if (enabled) {
+        thread_ = std::thread(&ProgressReporter::report, this);
+    }
+}
+
+ProgressReporter::~ProgressReporter() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+}
+
+void ProgressReporter::report() {
+    uint64_t reported = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, std::chrono::milliseconds(PROGRESS_INTERVAL_MS), [this]() { return stop_; })) {
+        // A line only when something moved, so an idle --watch or a prompt stays quiet
+        uint64_t moved = g_classifyDone.load(std::memory_order_relaxed) + g_shredDone.load(std::memory_order_relaxed)
+            + g_classifyTotal.load(std::memory_order_relaxed) + g_shredTotal.load(std::memory_order_relaxed);
+        if (moved == reported) continue;
+        reported = moved;
+        char line[LINE_SIZE];
+        size_t length = formatProgress(line, sizeof(line) - 1);
+        line[length++] = '\n';
+        writeStderr(line, length);
+    }
+}
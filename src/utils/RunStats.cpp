@@ -0,0 +1,140 @@
+#include "../../include/zsh_history_cleaner/RunStats.h"
+#include "../../include/zsh_history_cleaner/Utils.h" // For jsonString
+
+#include <iostream>
+#include <iomanip>         // For std::setw
+#include <cstdio>          // For snprintf
+#include <ctime>           // For clock_gettime
+#include <sys/resource.h>  // For getrusage
+
+namespace {
+
+const char* const PHASE_NAMES[RUN_PHASE_COUNT] = {
+    "resolve", "read_parse", "filter_keyword", "filter_regex", "write", "backup", "shred", "rename",
+    "lock",
+};
+
+double seconds(uint64_t ns) {
+    return static_cast<double>(ns) / 1e9;
+}
+
+// bytes per second in MiB/s, 0 when nothing was measured
+double mbPerSecond(uint64_t bytes, uint64_t ns) {
+    return ns == 0 ? 0.0 : static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds(ns);
+}
+
+long peakRssKb() {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+}
+
+// Fixed-point formatting, so the JSON never contains exponents, inf or nan
+std::string fixed(double value, int decimals) {
+    char text[64];
+    std::snprintf(text, sizeof(text), "%.*f", decimals, value);
+    return text;
+}
+
+} // namespace
+
+const char* runPhaseName(RunPhase phase) {
+    return PHASE_NAMES[static_cast<size_t>(phase)];
+}
+
+uint64_t processCpuNs() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) return 0;
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void PhaseTimer::begin() {
+    wallStart_ = monotonicNs();
+    cpuStart_ = processCpuNs();
+}
+
+void PhaseTimer::end() {
+    totals_->wallNs += monotonicNs() - wallStart_;
+    totals_->cpuNs += processCpuNs() - cpuStart_;
+    totals_->count++;
+}
+
+void RunStats::start() {
+    startWallNs_ = monotonicNs();
+    startCpuNs_ = processCpuNs();
+}
+
+void RunStats::finish() {
+    wallNs_ = monotonicNs() - startWallNs_;
+    cpuNs_ = processCpuNs() - startCpuNs_;
+}
+
+void RunStats::merge(const RunStats& other) {
+    for (size_t i = 0; i < RUN_PHASE_COUNT; ++i) {
+        phases_[i].wallNs += other.phases_[i].wallNs;
+        phases_[i].cpuNs += other.phases_[i].cpuNs;
+        phases_[i].bytes += other.phases_[i].bytes;
+        phases_[i].count += other.phases_[i].count;
+    }
+    files += other.files;
+    ok = ok && other.ok;
+    lines += other.lines;
+    kept += other.kept;
+    deleted += other.deleted;
+}
+
+void RunStats::writeText(std::ostream& out) const {
+    const PhaseTotals& readParse = (*this)[RunPhase::ReadParse];
+    const PhaseTotals& shred = (*this)[RunPhase::Shred];
+    uint64_t entries = kept + deleted;
+
+    out << "--- Stats" << (file.empty() ? std::string() : " for " + file) << " ---\n"
+        << std::left << std::setw(16) << "Phase" << std::right
+        << std::setw(12) << "Wall (s)" << std::setw(12) << "CPU (s)"
+        << std::setw(16) << "Bytes" << std::setw(12) << "Count" << "\n";
+    for (size_t i = 0; i < RUN_PHASE_COUNT; ++i) {
+        const PhaseTotals& phase = phases_[i];
+        out << std::left << std::setw(16) << PHASE_NAMES[i] << std::right
+            << std::setw(12) << fixed(seconds(phase.wallNs), 6)
+            << std::setw(12) << fixed(seconds(phase.cpuNs), 6)
+            << std::setw(16) << phase.bytes << std::setw(12) << phase.count << "\n";
+    }
+    out << "Total: " << fixed(seconds(wallNs_), 6) << " s wall, " << fixed(seconds(cpuNs_), 6)
+        << " s CPU, peak RSS " << peakRssKb() << " KiB\n"
+        << "Entries: " << entries << " ("
+        << fixed(readParse.wallNs == 0 ? 0.0 : static_cast<double>(entries) / seconds(readParse.wallNs), 1)
+        << "/s), shred: " << fixed(mbPerSecond(shred.bytes, shred.wallNs), 2) << " MB/s\n"
+        << "-------------" << std::endl;
+}
+
+void RunStats::writeJson(std::ostream& out) const {
+    const PhaseTotals& readParse = (*this)[RunPhase::ReadParse];
+    const PhaseTotals& shred = (*this)[RunPhase::Shred];
+    uint64_t entries = kept + deleted;
+
+    std::string json = "{\"stats_version\":1";
+    json += ",\"file\":" + (file.empty() ? std::string("null") : jsonString(file));
+    json += ",\"files\":" + std::to_string(files);
+    json += std::string(",\"ok\":") + (ok ? "true" : "false");
+    json += std::string(",\"dry_run\":") + (dryRun ? "true" : "false");
+    json += ",\"wall_s\":" + fixed(seconds(wallNs_), 6);
+    json += ",\"cpu_s\":" + fixed(seconds(cpuNs_), 6);
+    json += ",\"peak_rss_kb\":" + std::to_string(peakRssKb());
+    json += ",\"lines\":" + std::to_string(lines);
+    json += ",\"kept\":" + std::to_string(kept);
+    json += ",\"deleted\":" + std::to_string(deleted);
+    json += ",\"entries_per_s\":" +
+            fixed(readParse.wallNs == 0 ? 0.0 : static_cast<double>(entries) / seconds(readParse.wallNs), 1);
+    json += ",\"shred_mb_per_s\":" + fixed(mbPerSecond(shred.bytes, shred.wallNs), 3);
+    json += ",\"phases\":{";
+    for (size_t i = 0; i < RUN_PHASE_COUNT; ++i) {
+        const PhaseTotals& phase = phases_[i];
+        if (i > 0) json += ',';
+        json += std::string("\"") + PHASE_NAMES[i] + "\":{";
+        json += "\"wall_s\":" + fixed(seconds(phase.wallNs), 6);
+        json += ",\"cpu_s\":" + fixed(seconds(phase.cpuNs), 6);
+        json += ",\"bytes\":" + std::to_string(phase.bytes);
+        json += ",\"count\":" + std::to_string(phase.count) + "}";
+    }
+    json += "}}";
+    out << json << std::endl;
+}
@@ -9,6 +9,9 @@
 #include <stdexcept>    // For runtime_error
 #include <algorithm>    // For std::tolower
 #include <cctype>       // For std::tolower with unsigned char cast
+#include <random>       // For random_device, mt19937
+#include <limits>       // For numeric_limits
+#include <cstdio>       // For snprintf
 
 // Get environment variable safely
 std::string getEnvVar(const std::string& name, const std::string& defaultValue) {
@@ -139,6 +142,38 @@ std::string epochToString(std::time_t epoch) {
     }
 }
 
+// Random string of [0-9A-Z] characters, used for temp/backup file names
+std::string randomString(size_t length) {
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dist(0, 35); // 0-9, A-Z
+    const char charset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    std::string randomStr;
+    randomStr.reserve(length);
+    for (size_t i = 0; i < length; ++i) {
+        randomStr += charset[dist(gen)];
+    }
+    return randomStr;
+}
+
+// JSON string literal of value: quoted, with '"', '\\' and control characters escaped
+std::string jsonString(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (u < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", u);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
 
 // Ask Yes/No question
 bool askYesNo(const std::string& prompt, bool defaultYes) {
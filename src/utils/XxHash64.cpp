@@ -0,0 +1,124 @@
+#include "../../include/zsh_history_cleaner/XxHash64.h"
+
+#include <cstring>     // For memcpy
+
+namespace {
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ull;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian loads (the format is defined on little-endian words)
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+inline uint64_t read32(const unsigned char* p) {
+    return static_cast<uint64_t>(p[0]) | (static_cast<uint64_t>(p[1]) << 8) |
+           (static_cast<uint64_t>(p[2]) << 16) | (static_cast<uint64_t>(p[3]) << 24);
+}
+
+inline uint64_t accumulate(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= accumulate(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+inline void consumeStripe(uint64_t acc[4], const unsigned char* p) {
+    acc[0] = accumulate(acc[0], read64(p));
+    acc[1] = accumulate(acc[1], read64(p + 8));
+    acc[2] = accumulate(acc[2], read64(p + 16));
+    acc[3] = accumulate(acc[3], read64(p + 24));
+}
+
+} // namespace
+
+XxHash64::XxHash64(uint64_t seed) : seed_(seed) {
+    acc_[0] = seed + PRIME1 + PRIME2;
+    acc_[1] = seed + PRIME2;
+    acc_[2] = seed;
+    acc_[3] = seed - PRIME1;
+}
+
+void XxHash64::update(std::string_view data) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    size_t size = data.size();
+    totalLength_ += size;
+
+    if (pendingSize_ > 0) {
+        size_t take = sizeof(pending_) - pendingSize_;
+        if (size < take) {
+            std::memcpy(pending_ + pendingSize_, p, size);
+            pendingSize_ += size;
+            return;
+        }
+        std::memcpy(pending_ + pendingSize_, p, take);
+        consumeStripe(acc_, pending_);
+        pendingSize_ = 0;
+        p += take;
+        size -= take;
+    }
+    while (size >= sizeof(pending_)) {
+        consumeStripe(acc_, p);
+        p += sizeof(pending_);
+        size -= sizeof(pending_);
+    }
+    if (size > 0) {
+        std::memcpy(pending_, p, size);
+        pendingSize_ = size;
+    }
+}
+
+uint64_t XxHash64::digest() const {
+    uint64_t h;
+    if (totalLength_ >= sizeof(pending_)) {
+        h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+        for (uint64_t acc : acc_) h = mergeRound(h, acc);
+    } else {
+        h = seed_ + PRIME5;
+    }
+    h += totalLength_;
+
+    const unsigned char* p = pending_;
+    size_t size = pendingSize_;
+    for (; size >= 8; p += 8, size -= 8) {
+        h ^= accumulate(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (size >= 4) {
+        h ^= read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size > 0; ++p, --size) {
+        h ^= *p * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t XxHash64::of(std::string_view data, uint64_t seed) {
+    XxHash64 hash(seed);
+    hash.update(data);
+    return hash.digest();
+}
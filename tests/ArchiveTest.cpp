@@ -0,0 +1,134 @@
+// The ZHCA archive round trip: what ArchiveWriter appends (over several segments and
+// runs) comes back from extractArchive() by window and by source, segments outside the
+// window are skipped unread, and a damaged archive is reported rather than extracted.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/Archive.h"
+
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool append(const fs::path& archive, const std::string& source, const std::string& data) {
+    std::ostringstream log;
+    ArchiveWriter writer;
+    if (!writer.open(archive, source, log)) return false;
+    // In pieces, as the classifier hands them over
+    for (size_t pos = 0; pos < data.size();) {
+        size_t next = data.find('\n', pos + 4000);
+        next = next == std::string::npos ? data.size() : next + 1;
+        writer.add(std::string_view(data).substr(pos, next - pos));
+        pos = next;
+    }
+    return writer.finish(log) && writer.bytesAdded() == data.size();
+}
+
+bool extract(const fs::path& archive, std::time_t start, std::time_t end, const std::string& source,
+             std::string& out, ArchiveExtractResult& result) {
+    std::ostringstream text, log;
+    result = ArchiveExtractResult();
+    bool ok = extractArchive(archive, start, end, source, text, log, result);
+    out = text.str();
+    return ok;
+}
+
+void checkRoundTrip() {
+    testutil::TempDir dir;
+    const fs::path archive = dir / "archive";
+    const std::string first = testutil::entries(0, 60000, "export SECRET_TOKEN=");   // Several segments
+    const std::string second = testutil::entries(100000, 500, "curl -H 'Authorization: Bearer x'");
+    EXPECT(first.size() > 2 * ARCHIVE_SEGMENT_SIZE);
+    EXPECT(append(archive, "/home/a/.zsh_history", first));
+    EXPECT(append(archive, "/home/b/.zsh_history", second));
+
+    const std::string raw = testutil::readFile(archive);
+    EXPECT_EQ(raw.substr(0, 4), std::string("ZHCA"));
+    EXPECT_EQ(static_cast<int>(raw[4]), 1);
+    EXPECT_EQ(static_cast<int>(raw[5]), archiveCompresses() ? 1 : 0);
+
+    std::string out;
+    ArchiveExtractResult result;
+    EXPECT(extract(archive, 0, std::numeric_limits<std::time_t>::max(), "", out, result));
+    EXPECT(out == first + second);
+    EXPECT_EQ(result.entries, 60500ull);
+    EXPECT(result.segments >= 4);
+    EXPECT_EQ(result.segmentsRead, result.segments);
+
+    // A window inside the first run's entries: only the segments holding it are read
+    EXPECT(extract(archive, testutil::FIRST_TIMESTAMP + 30000, testutil::FIRST_TIMESTAMP + 30099, "", out, result));
+    EXPECT(out == testutil::entries(30000, 100, "export SECRET_TOKEN="));
+    EXPECT_EQ(result.segmentsRead, 1ull);
+
+    // By source
+    EXPECT(extract(archive, 0, std::numeric_limits<std::time_t>::max(), "/home/b/.zsh_history", out, result));
+    EXPECT(out == second);
+    EXPECT_EQ(result.segmentsRead, 1ull);
+    EXPECT(extract(archive, 0, std::numeric_limits<std::time_t>::max(), "/home/c/.zsh_history", out, result));
+    EXPECT(out.empty());
+}
+
+void checkDamage() {
+    testutil::TempDir dir;
+    const fs::path archive = dir / "archive";
+    EXPECT(append(archive, "/home/a/.zsh_history", testutil::entries(0, 1000, "ls")));
+    const std::string raw = testutil::readFile(archive);
+    std::string out;
+    ArchiveExtractResult result;
+
+    std::string flipped = raw;
+    flipped[raw.size() - 10] ^= 0x20;   // In the payload
+    testutil::writeFile(archive, flipped);
+    EXPECT(!extract(archive, 0, std::numeric_limits<std::time_t>::max(), "", out, result));
+
+    testutil::writeFile(archive, raw.substr(0, raw.size() - 100));
+    EXPECT(!extract(archive, 0, std::numeric_limits<std::time_t>::max(), "", out, result));
+    testutil::writeFile(archive, raw.substr(0, 20));
+    EXPECT(!extract(archive, 0, std::numeric_limits<std::time_t>::max(), "", out, result));
+
+    std::string magic = raw;
+    magic[0] = 'X';
+    testutil::writeFile(archive, magic);
+    EXPECT(!extract(archive, 0, std::numeric_limits<std::time_t>::max(), "", out, result));
+
+    // An empty archive holds nothing, and is not an error
+    testutil::writeFile(archive, "");
+    EXPECT(extract(archive, 0, std::numeric_limits<std::time_t>::max(), "", out, result));
+    EXPECT_EQ(result.segments, 0ull);
+}
+
+// Through the engine: exactly the deleted entries are archived, and the summary line
+// names the codec this build used
+void checkEngine() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path archive = dir / "archive";
+    const std::string secrets = testutil::entries(0, 200, "export SECRET_TOKEN=");
+    const std::string kept = testutil::entries(1000, 200, "ls");
+    testutil::writeFile(history, secrets + kept);
+
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.archive = archive;
+    testutil::EngineRun run = testutil::cleanHistory(config, history);
+    EXPECT(run.result.ok);
+    EXPECT_EQ(run.result.archived, static_cast<uintmax_t>(secrets.size()));
+    EXPECT_EQ(testutil::readFile(history), kept);
+    EXPECT(run.info.find(archiveCompresses() ? "(zstd, " : "(stored uncompressed") != std::string::npos);
+
+    std::string out;
+    ArchiveExtractResult extracted;
+    EXPECT(extract(archive, 0, std::numeric_limits<std::time_t>::max(), history.string(), out, extracted));
+    EXPECT(out == secrets);
+}
+
+} // namespace
+
+int main() {
+    checkRoundTrip();
+    checkDamage();
+    checkEngine();
+    return testutil::testResult("ArchiveTest");
+}
@@ -0,0 +1,101 @@
+// The secure-delete keystream: RFC 8439 vectors (as Bernstein's 64-bit counter and nonce
+// layout sees them), and the four-block path (SSE2 where available, taken by requests of
+// 256 bytes or more) byte-exact with the one-block path, across a carry of the counter's
+// low word.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/ChaCha20.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string hex(const std::vector<uint8_t>& bytes, size_t offset, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = offset; i < offset + length; ++i) {
+        out += digits[bytes[i] >> 4];
+        out += digits[bytes[i] & 15];
+    }
+    return out;
+}
+
+// length bytes, either in one request or block by block (which never takes the four-block path)
+std::vector<uint8_t> keystream(const uint8_t (&key)[ChaCha20::KEY_SIZE], const uint8_t (&nonce)[ChaCha20::NONCE_SIZE],
+                               uint64_t counter, size_t length, bool blockByBlock) {
+    ChaCha20 cipher(key, nonce, counter);
+    std::vector<uint8_t> out(length);
+    if (!blockByBlock) {
+        cipher.keystream(out.data(), length);
+        return out;
+    }
+    for (size_t pos = 0; pos < length; pos += ChaCha20::BLOCK_SIZE) {
+        cipher.keystream(out.data() + pos, std::min(ChaCha20::BLOCK_SIZE, length - pos));
+    }
+    return out;
+}
+
+// RFC 8439 A.1 test vectors 1 and 2: the all-zero key and nonce, blocks 0 and 1
+void checkZeroKey() {
+    const uint8_t key[ChaCha20::KEY_SIZE] = {};
+    const uint8_t nonce[ChaCha20::NONCE_SIZE] = {};
+    const std::string block0 = "76b8e0ada0f13d90405d6ae55386bd28bdd219b8a08ded1aa836efcc8b770dc7"
+                               "da41597c5157488d7724e03fb8d84a376a43b8f41518a11cc387b669b2ee6586";
+    const std::string block1 = "9f07e7be5551387a98ba977c732d080dcb0f29a048e3656912c6533e32ee7aed"
+                               "29b721769ce64e43d57133b074d839d531ed1f28510afb45ace10a1f4b794d6f";
+    for (bool blockByBlock : {false, true}) {
+        std::vector<uint8_t> out = keystream(key, nonce, 0, 4 * ChaCha20::BLOCK_SIZE, blockByBlock);
+        EXPECT_EQ(hex(out, 0, 64), block0);
+        EXPECT_EQ(hex(out, 64, 64), block1);
+    }
+}
+
+// RFC 8439 2.3.2: its 96-bit nonce 000000090000004a00000000 with block count 1 is the
+// 64-bit counter 0x0900000000000001 and the nonce 0000004a00000000 here
+void checkBlockFunctionVector() {
+    uint8_t key[ChaCha20::KEY_SIZE];
+    for (size_t i = 0; i < ChaCha20::KEY_SIZE; ++i) key[i] = static_cast<uint8_t>(i);
+    const uint8_t nonce[ChaCha20::NONCE_SIZE] = {0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00};
+    const uint64_t counter = 0x0900000000000001ull;
+    const std::string expected = "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+                                 "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e";
+    for (bool blockByBlock : {false, true}) {
+        EXPECT_EQ(hex(keystream(key, nonce, counter, 4 * ChaCha20::BLOCK_SIZE, blockByBlock), 0, 64), expected);
+    }
+}
+
+// The four-block path against the one-block path, with the counter's low word wrapping
+// inside a group of four, at a group edge and between groups; odd lengths keep a tail
+void checkPathsAgree() {
+    uint8_t key[ChaCha20::KEY_SIZE];
+    uint8_t nonce[ChaCha20::NONCE_SIZE];
+    for (size_t i = 0; i < ChaCha20::KEY_SIZE; ++i) key[i] = static_cast<uint8_t>(0xa5 ^ (i * 7));
+    for (size_t i = 0; i < ChaCha20::NONCE_SIZE; ++i) nonce[i] = static_cast<uint8_t>(i * 31 + 1);
+    for (uint64_t counter : {0ull, 0xfffffffeull, 0xfffffffcull, 0xfffffff9ull, 0x1fffffffdull, ~0ull - 5}) {
+        for (size_t length : {size_t(256), size_t(1024), size_t(64 * 13 + 17)}) {
+            const std::vector<uint8_t> fast = keystream(key, nonce, counter, length, false);
+            const std::vector<uint8_t> slow = keystream(key, nonce, counter, length, true);
+            EXPECT_EQ(hex(fast, 0, length), hex(slow, 0, length));
+        }
+    }
+
+    // Requests continue the stream where the last one stopped, whatever their sizes
+    ChaCha20 cipher(key, nonce, 0xfffffffdull);
+    std::vector<uint8_t> pieces(64 * 12);
+    cipher.keystream(pieces.data(), 64);
+    cipher.keystream(pieces.data() + 64, 64 * 4);
+    cipher.keystream(pieces.data() + 64 * 5, 64 * 7);
+    EXPECT_EQ(hex(pieces, 0, pieces.size()), hex(keystream(key, nonce, 0xfffffffdull, pieces.size(), true), 0, pieces.size()));
+}
+
+} // namespace
+
+int main() {
+    checkZeroKey();
+    checkBlockFunctionVector();
+    checkPathsAgree();
+    return testutil::testResult("ChaCha20Test");
+}
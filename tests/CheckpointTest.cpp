@@ -0,0 +1,177 @@
+// --incremental checkpoints: the sidecar round trip, the filter fingerprint, and each change
+// that must make a later run classify more than the appended bytes (filters, a rewritten
+// or truncated history, a wider time window, a damaged sidecar).
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/Checkpoint.h"
+
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace {
+
+const std::time_t FIRST = testutil::FIRST_TIMESTAMP;
+
+void checkSidecar() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    HistoryCheckpoint checkpoint;
+    EXPECT(!loadCheckpoint(history, checkpoint));
+
+    checkpoint.offset = 12345;
+    checkpoint.prefixHash = 0xfedcba9876543210ull;
+    checkpoint.startTimestamp = -5;
+    checkpoint.endTimestamp = std::numeric_limits<std::time_t>::max();
+    checkpoint.filterFingerprint = 0x0123456789abcdefull;
+    checkpoint.ruleWindows = {{0, 100}, {FIRST, FIRST + 86399}};
+    std::ostringstream log;
+    EXPECT(saveCheckpoint(history, checkpoint, log));
+    EXPECT_EQ(checkpointPath(history), fs::path(history.string() + ".cleaner-checkpoint"));
+
+    HistoryCheckpoint loaded;
+    EXPECT(loadCheckpoint(history, loaded));
+    EXPECT_EQ(loaded.offset, checkpoint.offset);
+    EXPECT_EQ(loaded.prefixHash, checkpoint.prefixHash);
+    EXPECT_EQ(loaded.startTimestamp, checkpoint.startTimestamp);
+    EXPECT_EQ(loaded.endTimestamp, checkpoint.endTimestamp);
+    EXPECT_EQ(loaded.filterFingerprint, checkpoint.filterFingerprint);
+    EXPECT(loaded.ruleWindows == checkpoint.ruleWindows);
+
+    // A missing, repeated or unknown field voids the whole sidecar
+    const std::string saved = testutil::readFile(checkpointPath(history));
+    for (const std::string& damaged : {saved.substr(0, saved.find("filters")),
+                                       saved + "offset 1\n",
+                                       saved + "colour blue\n",
+                                       "x" + saved}) {
+        testutil::writeFile(checkpointPath(history), damaged);
+        EXPECT(!loadCheckpoint(history, loaded));
+    }
+}
+
+void checkFingerprint() {
+    const std::vector<std::string> none;
+    const std::vector<PolicyRule> noRules;
+    const uint64_t base = filterFingerprint({"ab", "c"}, none, false, noRules, false);
+    EXPECT_EQ(filterFingerprint({"ab", "c"}, none, false, noRules, false), base);
+    EXPECT(filterFingerprint({"a", "bc"}, none, false, noRules, false) != base);
+    EXPECT(filterFingerprint({"abc"}, none, false, noRules, false) != base);
+    EXPECT(filterFingerprint(none, {"ab", "c"}, false, noRules, false) != base);
+    EXPECT(filterFingerprint({"ab", "c"}, none, true, noRules, false) != base);
+    EXPECT(filterFingerprint({"ab", "c"}, none, false, noRules, true) != base);
+
+    // Rules count with their action and filters, not with their windows
+    PolicyRule rule;
+    rule.keywords = {"ab"};
+    const uint64_t withRule = filterFingerprint(none, none, false, {rule}, false);
+    PolicyRule moved = rule;
+    moved.startTimestamp = FIRST;
+    EXPECT_EQ(filterFingerprint(none, none, false, {moved}, false), withRule);
+    PolicyRule keep = rule;
+    keep.deleteMatches = false;
+    EXPECT(filterFingerprint(none, none, false, {keep}, false) != withRule);
+    EXPECT(filterFingerprint(none, none, false, {rule, rule}, false) != withRule);
+}
+
+bool usedCheckpoint(const testutil::EngineRun& run) {
+    return run.info.find("Incremental: checkpoint covers") != std::string::npos;
+}
+
+testutil::EngineRun cleanIncremental(const fs::path& history, const std::vector<std::string>& keywords,
+                     std::time_t start = 0, std::time_t end = std::numeric_limits<std::time_t>::max()) {
+    EngineConfig config = testutil::engineConfig(keywords);
+    config.incremental = true;
+    config.startTimestamp = start;
+    config.endTimestamp = end;
+    testutil::EngineRun run = testutil::cleanHistory(config, history);
+    EXPECT(run.result.ok);
+    return run;
+}
+
+void checkEngine() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    std::string kept = testutil::entries(0, 1000, "ls");
+    testutil::writeFile(history, kept + testutil::entry(FIRST + 1000, "export SECRET_TOKEN=1"));
+
+    testutil::EngineRun run = cleanIncremental(history, {"SECRET_TOKEN"});
+    EXPECT(!usedCheckpoint(run));
+    EXPECT_EQ(run.result.deleted, 1ull);
+    EXPECT(fs::exists(checkpointPath(history)));
+
+    // Appended entries only
+    const std::string appended = testutil::entry(FIRST + 2000, "echo SECRET_TOKEN") + testutil::entry(FIRST + 2001, "pwd");
+    testutil::writeFile(history, kept + appended);
+    run = cleanIncremental(history, {"SECRET_TOKEN"});
+    EXPECT(usedCheckpoint(run));
+    EXPECT_EQ(run.result.deleted, 1ull);
+    EXPECT_EQ(run.result.kept, 1ull);   // The prefix is not counted
+    kept += testutil::entry(FIRST + 2001, "pwd");
+    EXPECT_EQ(testutil::readFile(history), kept);
+
+    // Other filters: "ls 5" entries in the prefix are now secrets
+    run = cleanIncremental(history, {"SECRET_TOKEN", "ls 5"});
+    EXPECT(!usedCheckpoint(run));
+    EXPECT(run.info.find("filters differ") != std::string::npos);
+    EXPECT_EQ(run.result.deleted, 111ull);   // ls 5, ls 50-59, ls 500-599
+
+    // A prefix byte changed behind the checkpoint's back
+    std::string edited = testutil::readFile(history);
+    edited.replace(edited.find("ls 1"), 4, "SECRET_TOKEN");
+    testutil::writeFile(history, edited);
+    run = cleanIncremental(history, {"SECRET_TOKEN", "ls 5"});
+    EXPECT(!usedCheckpoint(run));
+    EXPECT(run.info.find("rewritten") != std::string::npos);
+    EXPECT_EQ(run.result.deleted, 1ull);
+
+    // Truncated below the checkpoint
+    const std::string current = testutil::readFile(history);
+    testutil::writeFile(history, current.substr(0, current.size() / 2 - current.size() / 2 % 30));
+    run = cleanIncremental(history, {"SECRET_TOKEN", "ls 5"});
+    EXPECT(!usedCheckpoint(run));
+
+    // A damaged sidecar is ignored, not trusted
+    testutil::writeFile(checkpointPath(history), "garbage\n");
+    run = cleanIncremental(history, {"SECRET_TOKEN", "ls 5"});
+    EXPECT(!usedCheckpoint(run));
+    EXPECT(run.info.find("no checkpoint") != std::string::npos);
+}
+
+// A secret outside the first run's window is kept and sits in the checkpointed prefix; a
+// later run whose window reaches it must still classify it
+void checkWiderWindow() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    std::string data;
+    for (std::time_t i = 0; i < 3000; ++i) {
+        data += testutil::entry(FIRST + i, i % 500 == 100 ? "export SECRET_TOKEN=" + std::to_string(i) : "ls " + std::to_string(i));
+    }
+    testutil::writeFile(history, data);
+
+    testutil::EngineRun run = cleanIncremental(history, {"SECRET_TOKEN"}, FIRST + 2000, FIRST + 2999);
+    EXPECT_EQ(run.result.deleted, 2ull);    // 2100 and 2600
+
+    run = cleanIncremental(history, {"SECRET_TOKEN"}, FIRST + 2000, FIRST + 2999);
+    EXPECT(usedCheckpoint(run));
+    EXPECT_EQ(run.result.deleted, 0ull);
+
+    run = cleanIncremental(history, {"SECRET_TOKEN"}, FIRST + 1000, FIRST + 2999);
+    EXPECT(usedCheckpoint(run));
+    EXPECT_EQ(run.result.deleted, 2ull);    // 1100 and 1600
+
+    run = cleanIncremental(history, {"SECRET_TOKEN"});
+    EXPECT(usedCheckpoint(run));
+    EXPECT_EQ(run.result.deleted, 2ull);    // 100 and 600
+    EXPECT(testutil::readFile(history).find("SECRET_TOKEN") == std::string::npos);
+}
+
+} // namespace
+
+int main() {
+    checkSidecar();
+    checkFingerprint();
+    checkEngine();
+    checkWiderWindow();
+    return testutil::testResult("CheckpointTest");
+}
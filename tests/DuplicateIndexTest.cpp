@@ -0,0 +1,207 @@
+// --dedup: DuplicateIndex keeps the first or (after a recording pass) the last entry of a
+// command, keeps entries appended past the recorded ones, survives growing its table and,
+// keeping copies, the text it was fed being reused. The engine's keep-last passes match
+// each entry once, in the recording pass, and decide as a single pass would.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/DuplicateIndex.h"
+#include "zsh_history_cleaner/RunStats.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<bool> feed(DuplicateIndex& index, const std::vector<std::string>& commands) {
+    std::vector<bool> repeats;
+    for (const std::string& command : commands) repeats.push_back(index.isDuplicate(command));
+    return repeats;
+}
+
+void checkKeepFirst() {
+    const std::vector<std::string> commands = {"ls", "make", "ls", "", "make", "ls", ""};
+    DuplicateIndex index(DedupMode::KeepFirst);
+    index.startPass();
+    EXPECT(feed(index, commands) == (std::vector<bool>{false, false, true, false, true, true, true}));
+    EXPECT_EQ(index.size(), 3u);
+    EXPECT(index.isDuplicate(std::string_view()));    // No text at all is the empty command
+
+    index.startPass();      // Forgets
+    EXPECT_EQ(index.size(), 0u);
+    EXPECT(feed(index, commands) == (std::vector<bool>{false, false, true, false, true, true, true}));
+}
+
+void checkKeepLast() {
+    const std::vector<std::string> commands = {"ls", "make", "ls", "pwd", "make", "ls x"};
+    DuplicateIndex index(DedupMode::KeepLast);
+    index.startRecording();
+    EXPECT(feed(index, commands) == std::vector<bool>(commands.size(), false));   // Only records
+    EXPECT_EQ(index.size(), 4u);
+
+    for (int pass = 0; pass < 2; ++pass) {     // Every pass after the recording decides the same
+        index.startPass();
+        EXPECT(feed(index, commands) == (std::vector<bool>{true, true, false, false, false, false}));
+        // Appended since the recording pass: kept, new command or not, and so is the newest
+        // recorded entry of its command
+        EXPECT(feed(index, {"ls", "make", "new", "new"}) == std::vector<bool>(4, false));
+        EXPECT_EQ(index.size(), 4u);
+    }
+}
+
+// Far more commands than DEDUP_INITIAL_SLOTS, so the table doubles several times
+void checkGrow() {
+    const size_t count = DEDUP_INITIAL_SLOTS * 5;
+    std::vector<std::string> commands;
+    for (size_t i = 0; i < count; ++i) commands.push_back("command " + std::to_string(i));
+
+    DuplicateIndex first(DedupMode::KeepFirst);
+    first.startPass();
+    EXPECT(feed(first, commands) == std::vector<bool>(count, false));
+    EXPECT_EQ(first.size(), count);
+    EXPECT(feed(first, commands) == std::vector<bool>(count, true));
+    EXPECT_EQ(first.size(), count);
+
+    // The recorded last entries move with the slots
+    DuplicateIndex last(DedupMode::KeepLast);
+    last.startRecording();
+    feed(last, commands);
+    feed(last, std::vector<std::string>(commands.begin(), commands.begin() + count / 2));
+    last.startPass();
+    std::vector<bool> expected(count, false);
+    std::fill(expected.begin(), expected.begin() + count / 2, true);
+    EXPECT(feed(last, commands) == expected);
+    EXPECT(feed(last, std::vector<std::string>(commands.begin(), commands.begin() + count / 2)) ==
+           std::vector<bool>(count / 2, false));
+}
+
+// Keeping copies: each command is fed from one buffer that is overwritten right after, as
+// a merge reuses its read buffers; commands long enough to get arena blocks of their own
+// are mixed in, and enough text to fill several shared blocks
+void checkCopies() {
+    std::vector<std::string> commands;
+    for (size_t i = 0; i < 4000; ++i) {
+        const size_t length = i % 500 == 7 ? DEDUP_ARENA_BLOCK_SIZE / 2 + i : 600 + i % 300;
+        std::string command(length, static_cast<char>('a' + i % 26));
+        command += std::to_string(i);
+        commands.push_back(command);
+    }
+
+    DuplicateIndex index(DedupMode::KeepFirst, true);
+    index.startPass();
+    std::string buffer;
+    auto feedThroughBuffer = [&](const std::string& command) {
+        buffer.assign(command);
+        const bool repeat = index.isDuplicate(buffer);
+        buffer.assign(buffer.size(), '#');
+        return repeat;
+    };
+    for (const std::string& command : commands) EXPECT(!feedThroughBuffer(command));
+    EXPECT(!feedThroughBuffer(std::string(600, '#')));    // What the buffer was left holding is new
+    for (const std::string& command : commands) EXPECT(feedThroughBuffer(command));
+    EXPECT(!feedThroughBuffer(""));
+    EXPECT(feedThroughBuffer(""));
+    EXPECT_EQ(index.size(), commands.size() + 2);
+}
+
+std::string command(size_t i) {
+    return i % 5 == 0 ? "export SECRET_TOKEN=" + std::to_string(i % 3) : "cmd " + std::to_string(i % 37);
+}
+
+// The entries of the history that keep-last keeps after keep decided: the last of each command
+std::string keptLast(size_t count, const std::function<bool(const std::string&)>& keep) {
+    std::map<std::string, size_t> lastOf;
+    for (size_t i = 0; i < count; ++i) {
+        if (keep(command(i))) lastOf[command(i)] = i;
+    }
+    std::string data;
+    for (size_t i = 0; i < count; ++i) {
+        if (keep(command(i)) && lastOf[command(i)] == i) {
+            data += testutil::entry(testutil::FIRST_TIMESTAMP + static_cast<std::time_t>(i), command(i));
+        }
+    }
+    return data;
+}
+
+void checkEngine() {
+    const size_t count = 2000;
+    std::string data;
+    for (size_t i = 0; i < count; ++i) {
+        data += testutil::entry(testutil::FIRST_TIMESTAMP + static_cast<std::time_t>(i), command(i));
+    }
+    const std::string expected = keptLast(count, [](const std::string& text) {
+        return text.find("SECRET_TOKEN") == std::string::npos;
+    });
+
+    for (bool inPlace : {false, true}) {
+        for (bool dryRun : {false, true}) {
+            testutil::TempDir dir;
+            const fs::path history = dir / "history";
+            testutil::writeFile(history, data);
+            EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+            config.dedup = DedupMode::KeepLast;
+            config.inPlace = inPlace;
+            config.dryRun = dryRun;
+            RunStats stats;
+            CleanResult result = testutil::cleanHistory(config, history, &stats).result;
+            EXPECT(result.ok);
+            EXPECT_EQ(result.deleted, count / 5 + (count - count / 5 - 37));
+            EXPECT_EQ(result.duplicates, count - count / 5 - 37);
+            EXPECT_EQ(result.reasons[static_cast<size_t>(DeleteReason::Keyword)], count / 5);
+            EXPECT_EQ(stats[RunPhase::FilterKeyword].count, count);      // Matched in the recording pass only
+            EXPECT_EQ(testutil::readFile(history), dryRun ? data : expected);
+        }
+    }
+}
+
+// Under a policy the recorded verdicts carry their rule: the counts per rule are a single
+// pass's, and a keep rule's entries are still deduplicated
+void checkPolicy() {
+    const size_t count = 2000;
+    std::string data;
+    for (size_t i = 0; i < count; ++i) {
+        data += testutil::entry(testutil::FIRST_TIMESTAMP + static_cast<std::time_t>(i), command(i));
+    }
+    PolicyRule keep;
+    keep.name = "keep";
+    keep.deleteMatches = false;
+    keep.priority = 1;
+    keep.keywords = {"cmd 1", "=1"};
+    PolicyRule secrets;
+    secrets.name = "secrets";
+    secrets.keywords = {"SECRET_TOKEN"};
+
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    testutil::writeFile(history, data);
+    EngineConfig config = testutil::engineConfig();
+    config.rules = {secrets, keep};
+    config.dryRun = true;
+    CleanResult single = testutil::cleanHistory(config, history).result;
+
+    config.dedup = DedupMode::KeepLast;
+    config.dryRun = false;
+    CleanResult result = testutil::cleanHistory(config, history).result;
+    EXPECT(result.ok);
+    EXPECT(single.ruleMatches.size() == 2 && single.ruleMatches[0] > 0 && single.ruleMatches[1] > 0);
+    EXPECT(result.ruleMatches == single.ruleMatches);
+    EXPECT_EQ(result.reasons[static_cast<size_t>(DeleteReason::Rule)], single.deleted);
+    EXPECT_EQ(testutil::readFile(history), keptLast(count, [](const std::string& text) {
+        return text.find("SECRET_TOKEN") == std::string::npos || text.find("=1") != std::string::npos;
+    }));
+}
+
+} // namespace
+
+int main() {
+    checkKeepFirst();
+    checkKeepLast();
+    checkGrow();
+    checkCopies();
+    checkEngine();
+    checkPolicy();
+    return testutil::testResult("DuplicateIndexTest");
+}
@@ -0,0 +1,115 @@
+// parseHistoryHeader() against the regex it replaced: every line must be accepted or
+// rejected the same way, with the timestamp, duration and command offset the match implies.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/HistoryParser.h"
+
+#include <limits>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The former header regex, and the same language with the fields captured
+const std::regex HEADER_REGEX("^\\s*:\\s*(\\d+):\\d+\\s*;.*$");
+const std::regex FIELDS_REGEX("^\\s*:\\s*(\\d+):(\\d+)\\s*;(.*)$");
+
+// Digits as the parser reports them: false (and 0) if they do not fit in limit
+bool digitsValue(const std::string& digits, unsigned long long limit, unsigned long long& value) {
+    value = 0;
+    for (char c : digits) {
+        unsigned digit = static_cast<unsigned>(c - '0');
+        if (value > (limit - digit) / 10) {
+            value = 0;
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+void checkLine(const std::string& line) {
+    HistoryHeader header;
+    const bool parsed = parseHistoryHeader(line, header);
+    const bool matched = std::regex_match(line, HEADER_REGEX);
+    if (parsed != matched) {
+        testutil::fail(__FILE__, __LINE__, "parser and regex disagree on " + testutil::show(line) +
+                       ": parser " + testutil::show(parsed) + ", regex " + testutil::show(matched));
+        return;
+    }
+    EXPECT_EQ(isHistoryHeader(line), matched);
+    if (!matched) return;
+
+    std::smatch fields;
+    EXPECT(std::regex_match(line, fields, FIELDS_REGEX));
+    const unsigned long long llongMax = static_cast<unsigned long long>(std::numeric_limits<long long>::max());
+    unsigned long long timestamp = 0;
+    bool inRange = digitsValue(fields[1].str(), llongMax, timestamp) &&
+        timestamp <= static_cast<unsigned long long>(std::numeric_limits<std::time_t>::max());
+    EXPECT_EQ(header.timestampInRange, inRange);
+    EXPECT_EQ(static_cast<unsigned long long>(header.timestamp), inRange ? timestamp : 0ull);
+    unsigned long long duration = 0;
+    if (!digitsValue(fields[2].str(), llongMax, duration)) duration = llongMax;
+    EXPECT_EQ(static_cast<unsigned long long>(header.duration), duration);
+    EXPECT_EQ(header.commandOffset, static_cast<size_t>(fields.position(3)));
+}
+
+void checkEdgeCases() {
+    const std::vector<std::string> lines = {
+        // Plain headers and an empty command
+        ": 1700000000:0;ls -la", ":1:0;", ": 0:0;", ": 1700000000:12;echo ;;",
+        // Every kind of whitespace before ':', after ':' and before ';'
+        " : 1:0;x", "\t: 1:0;x", "\v: 1:0;x", "\f: 1:0;x", "\r: 1:0;x", "\n: 1:0;x",
+        ":\t1:0;x", ":\v1:0;x", ":\f1:0;x", ":\r1:0;x", ":\n1:0;x", ": \t \f1:0;x",
+        ": 1:0 ;x", ": 1:0\t;x", ": 1:0\v;x", ": 1:0\f;x", ": 1:0\r;x", ": 1:0\n;x", " \t: \t1:0 \t; x",
+        // Whitespace where none is allowed: around the inner ':' or inside the digits
+        ": 1 :0;x", ": 1: 0;x", ": 1\t:0;x", ": 1 2:0;x", ": 1:0 0;x",
+        // Missing or malformed fields
+        ": 1:;x", ": 1;x", ": :0;x", ":;x", ": 1:0", ": 1:0 ", "1:0;x", ": -1:0;x", ": +1:0;x",
+        ": 1:-0;x", ": 1::0;x", ":: 1:0;x", ": a:0;x", ": 1:a;x", "", ":", " ", "x: 1:0;x",
+        // Line terminators in the command part, a trailing '\r' included
+        ": 1:0;cmd\r", ": 1:0;cmd\rmore", ": 1:0;cmd\n", ": 1:0;\r", ": 1:0;a\nb",
+        // Digit overflow: time_t and long long limits, and far beyond them
+        ": 9223372036854775807:0;x", ": 9223372036854775808:0;x", ": 18446744073709551615:0;x",
+        ": 18446744073709551616:0;x", ": 99999999999999999999999999:0;x", ": 0000000000000000000000001:0;x",
+        ": 1:9223372036854775807;x", ": 1:9223372036854775808;x", ": 1:99999999999999999999999;x",
+    };
+    for (const std::string& line : lines) checkLine(line);
+}
+
+// Random lines from the bytes that matter to the grammar, and mutated valid headers
+void checkRandomLines() {
+    std::mt19937 random(12345);
+    const std::string alphabet = " \t\v\f\r\n:;0123456789ax-";
+    for (int i = 0; i < 100000; ++i) {
+        std::string line;
+        if (i % 2 == 0) {
+            const size_t length = random() % 16;
+            for (size_t j = 0; j < length; ++j) line += alphabet[random() % alphabet.size()];
+        } else {
+            line = ": " + std::to_string(random() % 2000000000u) + ":" + std::to_string(random() % 100) + ";cmd";
+            const int edits = 1 + static_cast<int>(random() % 3);
+            for (int e = 0; e < edits; ++e) {
+                const size_t at = random() % (line.size() + 1);
+                const char c = alphabet[random() % alphabet.size()];
+                switch (random() % 3) {
+                case 0: line.insert(line.begin() + static_cast<std::ptrdiff_t>(at), c); break;
+                case 1: if (at < line.size()) line.erase(at, 1); break;
+                default: if (at < line.size()) line[at] = c; break;
+                }
+            }
+        }
+        checkLine(line);
+    }
+}
+
+} // namespace
+
+int main() {
+    checkEdgeCases();
+    checkRandomLines();
+    return testutil::testResult("HistoryParserTest");
+}
@@ -0,0 +1,145 @@
+// --in-place: a contiguous deleted range is cut out of the file itself only when little
+// follows it (a crash mid-shift has no other copy to fall back on); otherwise the history
+// is rewritten, and with a single range only that range of the original is shredded.
+// Which one happened shows in the inode. A shell appending while the range is
+// overwritten, before the lock is taken, keeps its entry.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/RunStats.h"
+#include "zsh_history_cleaner/SecureDelete.h"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <fcntl.h>      // For open
+#include <sys/stat.h>   // For stat
+#include <unistd.h>     // For close
+
+namespace {
+
+ino_t inodeOf(const fs::path& path) {
+    struct stat st {};
+    EXPECT(::stat(path.c_str(), &st) == 0);
+    return st.st_ino;
+}
+
+// Cleans history (kept + secret + tail) and returns whether it was cut in place
+bool cleanInPlace(const std::string& kept, const std::string& secret, const std::string& tail,
+                  RunStats* stats = nullptr) {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    testutil::writeFile(history, kept + secret + tail);
+    const ino_t before = inodeOf(history);
+
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.inPlace = true;
+    EXPECT(testutil::cleanHistory(config, history, stats).result.ok);
+    EXPECT_EQ(testutil::readFile(history), kept + tail);
+    return inodeOf(history) == before;
+}
+
+void checkEngine() {
+    const std::string secrets = testutil::entries(0, 50, "export SECRET_TOKEN=");
+    // The newest entries, or a range with a few entries after it: cut in place
+    EXPECT(cleanInPlace(testutil::entries(100, 20000, "ls"), secrets, ""));
+    EXPECT(cleanInPlace(testutil::entries(100, 20000, "ls"), secrets, testutil::entries(30000, 100, "make")));
+    // The oldest entries of a large history: everything after would have to move, so the
+    // history is rewritten, and only the deleted range of the original is shredded
+    const std::string large = testutil::entries(100, 20000, "ls");
+    EXPECT(large.size() > IN_PLACE_MAX_SHIFT);
+    RunStats stats;
+    EXPECT(!cleanInPlace("", secrets, large, &stats));
+    EXPECT_EQ(stats[RunPhase::Shred].bytes, static_cast<uint64_t>(secrets.size()));
+    EXPECT(!cleanInPlace(testutil::entries(30000, 100, "make"), secrets, large, &stats));
+    EXPECT_EQ(stats[RunPhase::Shred].bytes, static_cast<uint64_t>(secrets.size()) * 2);
+}
+
+// A shell that appends while the deleted range is being overwritten (as one that broke a
+// stale lock would): its entry is shifted along and survives the cut
+void checkAppendDuringOverwrite() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const std::string kept = testutil::entries(0, 100, "ls");
+    const std::string secrets = testutil::entries(100, 400000, "export SECRET_TOKEN=");
+    const std::string tail = testutil::entries(400100, 10, "make");
+    const std::string appended = testutil::entry(testutil::FIRST_TIMESTAMP + 500000, "appended meanwhile");
+    testutil::writeFile(history, kept + secrets + tail);
+
+    // Appends as soon as the first bytes of the range no longer read as they were
+    bool sawOverwrite = false;
+    std::thread shell([&]() {
+        int fd = ::open(history.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+        if (fd == -1) return;
+        char head[16];
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (::pread(fd, head, sizeof(head), static_cast<off_t>(kept.size())) == static_cast<ssize_t>(sizeof(head)) &&
+                secrets.compare(0, sizeof(head), head, sizeof(head)) != 0) {
+                sawOverwrite = ::write(fd, appended.data(), appended.size()) == static_cast<ssize_t>(appended.size());
+                break;
+            }
+        }
+        ::close(fd);
+    });
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.inPlace = true;
+    config.shredPasses = 4;
+    const ino_t before = inodeOf(history);
+    CleanResult result = testutil::cleanHistory(config, history).result;
+    shell.join();
+    EXPECT(result.ok);
+    EXPECT(sawOverwrite);
+    EXPECT_EQ(inodeOf(history), before);
+    EXPECT_EQ(testutil::readFile(history), kept + tail + appended);
+}
+
+void checkRemoveRange() {
+    testutil::TempDir dir;
+    const fs::path file = dir / "file";
+    std::string data;
+    for (int i = 0; i < 300000; ++i) data += static_cast<char>('a' + i % 26);
+    testutil::writeFile(file, data);
+    int fd = ::open(file.c_str(), O_RDWR | O_CLOEXEC);
+    EXPECT(fd != -1);
+    std::ostringstream log;
+    EXPECT(secureRemoveRange(fd, 1000, 5000, 2, log));
+    EXPECT(secureRemoveRange(fd, 0, 0, 2, log));
+    EXPECT(!secureRemoveRange(fd, data.size(), 1, 2, log)); // Outside the file now
+    ::close(fd);
+    EXPECT_EQ(testutil::readFile(file), data.substr(0, 1000) + data.substr(6000));
+
+    // cutRange() shifts what the file holds when it is called, appended bytes included
+    testutil::writeFile(file, data);
+    fd = ::open(file.c_str(), O_RDWR | O_CLOEXEC);
+    EXPECT(fd != -1);
+    EXPECT(secureOverwriteRange(fd, 1000, 5000, 1, log));
+    EXPECT(::pwrite(fd, "appended", 8, static_cast<off_t>(data.size())) == 8);
+    EXPECT(cutRange(fd, 1000, 5000, log));
+    ::close(fd);
+    EXPECT_EQ(testutil::readFile(file), data.substr(0, 1000) + data.substr(6000) + "appended");
+
+    // secureDeletePart() overwrites the range and the tail and nothing else, as a second
+    // link to the file shows once the name is gone
+    testutil::writeFile(file, data);
+    const fs::path link = dir / "link";
+    fs::create_hard_link(file, link);
+    EXPECT(secureDeletePart(file, 1000, 5000, 200000, 1, log));
+    EXPECT(!fs::exists(file));
+    const std::string left = testutil::readFile(link);
+    EXPECT_EQ(left.size(), data.size());
+    EXPECT(left.substr(0, 1000) == data.substr(0, 1000));
+    EXPECT(left.substr(1000, 5000) != data.substr(1000, 5000));
+    EXPECT(left.substr(6000, 194000) == data.substr(6000, 194000));
+    EXPECT(left.substr(200000) != data.substr(200000));
+}
+
+} // namespace
+
+int main() {
+    checkEngine();
+    checkAppendDuringOverwrite();
+    checkRemoveRange();
+    return testutil::testResult("InPlaceTest");
+}
@@ -0,0 +1,159 @@
+// The Aho-Corasick DFA against std::string::find: random keyword sets over a small alphabet
+// (so keywords overlap and share prefixes and suffixes), texts long enough to take the
+// first-byte prefilter's SIMD path, bytes outside every keyword, and the empty keyword.
+// matchesAnyJoined() carries the DFA state across the pieces of a multiline entry, so it
+// must agree with matchesAny() on the entry's logical form.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/KeywordMatcher.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool naiveMatch(const std::vector<std::string>& keywords, const std::string& text) {
+    for (const std::string& keyword : keywords) {
+        if (text.find(keyword) != std::string::npos) return true;
+    }
+    return false;
+}
+
+std::string randomString(std::mt19937& rng, const std::string& alphabet, size_t length) {
+    std::string text;
+    for (size_t i = 0; i < length; ++i) text += alphabet[rng() % alphabet.size()];
+    return text;
+}
+
+void checkExamples() {
+    KeywordMatcher matcher;
+    matcher.build({"SECRET", "password", "ECR"});
+    EXPECT(matcher.matchesAny("export SECRET=1"));
+    EXPECT(matcher.matchesAny("ECR"));
+    EXPECT(matcher.matchesAny("xxpasswordxx"));
+    EXPECT(!matcher.matchesAny("export SEC_RET"));
+    EXPECT(!matcher.matchesAny("passwor"));
+    EXPECT(!matcher.matchesAny(""));
+
+    matcher.build({});
+    EXPECT(matcher.empty());
+    EXPECT(!matcher.matchesAny("anything"));
+
+    matcher.build({"x", ""});
+    EXPECT(matcher.matchesAny(""));
+    EXPECT(matcher.matchesAny("no x here"));
+    EXPECT(matcher.matchesAny("none"));
+
+    // Bytes above 0x7f, NUL and a keyword that is a suffix of another
+    matcher.build({std::string("\xc3\xa9t\xc3\xa9"), std::string("a\0b", 3), "abcabd", "bd"});
+    EXPECT(matcher.matchesAny("summer \xc3\xa9t\xc3\xa9"));
+    EXPECT(matcher.matchesAny(std::string("xa\0bx", 5)));
+    EXPECT(matcher.matchesAny("abcabcabd"));
+    EXPECT(matcher.matchesAny("abd"));
+    EXPECT(!matcher.matchesAny("abcab"));
+}
+
+void checkRandom() {
+    std::mt19937 rng(2024);
+    const std::string alphabet = "abc\xa1\n";
+    KeywordMatcher matcher;
+    for (int round = 0; round < 2000; ++round) {
+        std::vector<std::string> keywords(1 + rng() % 6);
+        for (std::string& keyword : keywords) keyword = randomString(rng, alphabet, 1 + rng() % 5);
+        matcher.build(keywords);
+        for (int i = 0; i < 20; ++i) {
+            std::string text = randomString(rng, alphabet, rng() % 40);
+            EXPECT_EQ(matcher.matchesAny(text), naiveMatch(keywords, text));
+        }
+    }
+}
+
+// Long runs of bytes no keyword starts with, so the prefilter skips most of the text
+void checkPrefilter() {
+    std::mt19937 rng(7);
+    KeywordMatcher matcher;
+    for (int round = 0; round < 300; ++round) {
+        std::vector<std::string> keywords(1 + rng() % 4);
+        for (std::string& keyword : keywords) keyword = randomString(rng, "QRS", 2 + rng() % 3);
+        matcher.build(keywords);
+        std::string text = randomString(rng, "abcdefgh -=", 1 + rng() % 600);
+        for (size_t n = rng() % 4; n > 0; --n) {
+            text[rng() % text.size()] = "QRS"[rng() % 3];
+        }
+        EXPECT_EQ(matcher.matchesAny(text), naiveMatch(keywords, text));
+        text.insert(rng() % (text.size() + 1), keywords[rng() % keywords.size()]);
+        EXPECT(matcher.matchesAny(text));
+    }
+}
+
+// What zsh reads back: each backslash-newline join (with an optional '\r' before the
+// newline) and each CRLF become a plain newline
+std::string logicalForm(const std::string& text) {
+    std::string joined;
+    size_t pos = 0;
+    for (size_t eol = text.find('\n'); eol != std::string::npos; eol = text.find('\n', pos)) {
+        std::string line = text.substr(pos, eol - pos);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line.back() == '\\') line.pop_back();
+        joined += line + "\n";
+        pos = eol + 1;
+    }
+    return joined + text.substr(pos);
+}
+
+void checkJoined() {
+    KeywordMatcher matcher;
+    matcher.build({"TOKEN=\nabc"});
+    EXPECT(matcher.matchesAnyJoined("export TOKEN=\\\nabc"));
+    EXPECT(matcher.matchesAnyJoined("export TOKEN=\\\r\nabc"));
+    EXPECT(matcher.matchesAnyJoined("export TOKEN=\r\nabc"));
+    EXPECT(!matcher.matchesAny("export TOKEN=\\\nabc"));
+    EXPECT(!matcher.matchesAnyJoined("export TOKEN\\\n=\nabc"));
+    EXPECT(!matcher.matchesAnyJoined("export TOKEN=\\\\\nabc"));  // An escaped backslash stays
+    matcher.build({"SECRET_TOKEN"});
+    EXPECT(matcher.matchesAnyJoined("cat <<EOF\\\nSECRET_TOKEN=1\\\nEOF"));
+    EXPECT(!matcher.matchesAnyJoined("export SEC\\\nRET_TOKEN=1"));
+
+    std::mt19937 rng(99);
+    const std::string alphabet = "ab\\\r\n";
+    for (int round = 0; round < 3000; ++round) {
+        std::vector<std::string> keywords(1 + rng() % 4);
+        for (std::string& keyword : keywords) keyword = randomString(rng, "ab\n", 1 + rng() % 4);
+        matcher.build(keywords);
+        for (int i = 0; i < 20; ++i) {
+            std::string text = randomString(rng, alphabet, rng() % 30);
+            EXPECT_EQ(matcher.matchesAnyJoined(text), matcher.matchesAny(logicalForm(text)));
+        }
+    }
+}
+
+// Through the engine: --multiline also deletes an entry whose secret is on a continuation
+// line; a keyword a join splits does not match, as zsh reads a newline there
+void checkEngineMultiline() {
+    const std::string continued = ": 1700000000:0;cat <<EOF\\\nSECRET_TOKEN=1\\\nEOF\n";
+    const std::string kept = ": 1700000001:0;echo SECRET\\\n_TOKEN\n: 1700000002:0;ls\n";
+    for (bool multiline : {false, true}) {
+        testutil::TempDir dir;
+        const fs::path history = dir / "history";
+        testutil::writeFile(history, continued + kept);
+        EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+        config.multiline = multiline;
+        CleanResult result = testutil::cleanHistory(config, history).result;
+        EXPECT(result.ok);
+        EXPECT_EQ(result.deleted, multiline ? 1ull : 0ull);
+        EXPECT_EQ(testutil::readFile(history), multiline ? kept : continued + kept);
+    }
+}
+
+} // namespace
+
+int main() {
+    checkExamples();
+    checkRandom();
+    checkPrefilter();
+    checkJoined();
+    checkEngineMultiline();
+    return testutil::testResult("KeywordMatcherTest");
+}
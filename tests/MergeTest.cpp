@@ -0,0 +1,130 @@
+// --merge: the k-way merge orders entries by timestamp with ties in input order, keeps each
+// entry's continuation lines (and a headerless line before the first entry) with it, keeps
+// each input's own order when an input is out of order, cleans as it merges, and only
+// replaces a history file that is one of its inputs.
+
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+struct Block {
+    std::time_t timestamp;
+    size_t input;
+    size_t sequence;
+    std::string text;
+};
+
+testutil::EngineRun merge(const std::vector<fs::path>& inputs, const fs::path& history,
+                          const std::vector<std::string>& keywords = {}) {
+    EngineConfig config = testutil::engineConfig(keywords);
+    config.dedupOnly = keywords.empty();
+    return testutil::mergeHistories(config, inputs, history);
+}
+
+// Random time-ordered inputs with many equal timestamps and multiline entries; the merged
+// file must be the blocks sorted by (timestamp, input, position in input)
+void checkOrder() {
+    std::mt19937 rng(4242);
+    for (int round = 0; round < 40; ++round) {
+        testutil::TempDir dir;
+        const size_t count = 2 + rng() % 4;
+        std::vector<fs::path> inputs;
+        std::vector<Block> blocks;
+        for (size_t input = 0; input < count; ++input) {
+            std::string data;
+            size_t sequence = 0;
+            if (rng() % 3 == 0) {   // A line before the first header goes first
+                std::string stray = "stray line of input " + std::to_string(input) + "\n";
+                blocks.push_back({std::numeric_limits<std::time_t>::min(), input, sequence++, stray});
+                data += stray;
+            }
+            std::time_t timestamp = testutil::FIRST_TIMESTAMP;
+            for (size_t n = rng() % 200; n > 0; --n) {
+                timestamp += static_cast<std::time_t>(rng() % 3);
+                std::string command = "cmd " + std::to_string(input) + "." + std::to_string(sequence);
+                if (rng() % 8 == 0) command += "\\\ncontinued\\\nagain";
+                const std::string text = testutil::entry(timestamp, command);
+                blocks.push_back({timestamp, input, sequence++, text});
+                data += text;
+            }
+            inputs.push_back(dir / ("host" + std::to_string(input)));
+            if (!data.empty() && rng() % 4 == 0) data.pop_back();   // No final newline
+            testutil::writeFile(inputs.back(), data);
+        }
+
+        std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b) {
+            return std::tie(a.timestamp, a.input, a.sequence) < std::tie(b.timestamp, b.input, b.sequence);
+        });
+        std::string expected;
+        for (const Block& block : blocks) expected += block.text;
+
+        const fs::path history = dir / "merged";
+        EXPECT(merge(inputs, history).result.ok);
+        EXPECT_EQ(testutil::readFile(history), expected);
+    }
+}
+
+void checkCleaning() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path other = dir / "laptop";
+    testutil::writeFile(history, ": 1700000000:0;ls\n: 1700000004:0;export SECRET_TOKEN=1\n");
+    testutil::writeFile(other, ": 1700000002:0;make\n: 1700000004:0;pwd\n: 1700000006:0;curl SECRET_TOKEN\n");
+
+    CleanResult result = merge({history, other}, history, {"SECRET_TOKEN"}).result;
+    EXPECT(result.ok);
+    EXPECT_EQ(result.deleted, 2ull);
+    EXPECT_EQ(result.kept, 3ull);
+    EXPECT_EQ(testutil::readFile(history), std::string(": 1700000000:0;ls\n: 1700000002:0;make\n: 1700000004:0;pwd\n"));
+    EXPECT(testutil::readFile(other).find("SECRET_TOKEN") != std::string::npos);   // Only read
+}
+
+// Out of order: a warning, and the input's entries stay in the order it has them
+void checkDisordered() {
+    testutil::TempDir dir;
+    const fs::path first = dir / "first";
+    const fs::path second = dir / "second";
+    testutil::writeFile(first, ": 1700000005:0;a\n: 1700000001:0;b\n: 1700000009:0;c\n");
+    testutil::writeFile(second, ": 1700000003:0;x\n: 1700000007:0;y\n");
+    testutil::EngineRun run = merge({first, second}, dir / "merged");
+    EXPECT(run.result.ok);
+    EXPECT(run.log.find("is not in timestamp order") != std::string::npos);
+    EXPECT_EQ(testutil::readFile(dir / "merged"),
+              std::string(": 1700000003:0;x\n: 1700000005:0;a\n: 1700000001:0;b\n: 1700000007:0;y\n: 1700000009:0;c\n"));
+}
+
+void checkHistoryFile() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path other = dir / "laptop";
+    const std::string original = ": 1700000000:0;ls\n";
+    testutil::writeFile(history, original);
+    testutil::writeFile(other, ": 1700000001:0;make\n");
+
+    // Not among the inputs: its entries would be lost, so nothing happens
+    EXPECT(!merge({other}, history).result.ok);
+    EXPECT_EQ(testutil::readFile(history), original);
+
+    // The same input twice is merged once
+    testutil::EngineRun run = merge({history, other, other}, history);
+    EXPECT(run.result.ok);
+    EXPECT(run.log.find("more than once") != std::string::npos);
+    EXPECT_EQ(testutil::readFile(history), original + ": 1700000001:0;make\n");
+}
+
+} // namespace
+
+int main() {
+    checkOrder();
+    checkCleaning();
+    checkDisordered();
+    checkHistoryFile();
+    return testutil::testResult("MergeTest");
+}
@@ -0,0 +1,155 @@
+// $HISTFILE.cleaner-pending: each state a run killed during the swap can leave (the
+// original linked or moved aside before the cleaned file was renamed in, or replaced and
+// not shredded yet) must be resolved without losing or keeping a copy of the history.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/ShredQueue.h"
+
+#include <sstream>
+#include <string>
+#include <sys/stat.h>   // For stat
+#include <unistd.h>     // For link
+
+namespace {
+
+const std::string ORIGINAL = ": 1700000000:0;export SECRET_TOKEN=1\n: 1700000001:0;ls\n";
+const std::string CLEANED = ": 1700000001:0;ls\n";
+
+// What a run leaves when it is killed with the record written: the record unlocked
+void recordAndDie(const fs::path& history, const fs::path& original, const struct stat& st) {
+    PendingShred pending;
+    std::ostringstream log;
+    EXPECT(pending.record(history, original, static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), 1, log));
+    EXPECT(fs::exists(pendingShredPath(history)));
+}
+
+bool recover(const fs::path& history, bool dryRun = false) {
+    std::ostringstream info, log;
+    bool ok = recoverPendingShred(history, dryRun, info, log);
+    return ok && log.str().empty();
+}
+
+struct stat statOf(const fs::path& path) {
+    struct stat st {};
+    EXPECT(::stat(path.c_str(), &st) == 0);
+    return st;
+}
+
+// Linked, killed before the rename: the hidden name is the live history; only it goes
+void checkLinked() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path hidden = dir / ".hiddenoriginal";
+    testutil::writeFile(history, ORIGINAL);
+    EXPECT(::link(history.c_str(), hidden.c_str()) == 0);
+    recordAndDie(history, hidden, statOf(history));
+
+    EXPECT(recover(history));
+    EXPECT_EQ(testutil::readFile(history), ORIGINAL);
+    EXPECT(!fs::exists(hidden));
+    EXPECT(!fs::exists(pendingShredPath(history)));
+}
+
+// Moved aside (--defer-shred), killed before the rename: the history is put back
+void checkMovedAside() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path hidden = dir / ".hiddenoriginal";
+    testutil::writeFile(history, ORIGINAL);
+    const struct stat st = statOf(history);
+    fs::rename(history, hidden);
+    recordAndDie(history, hidden, st);
+
+    EXPECT(recover(history));
+    EXPECT_EQ(testutil::readFile(history), ORIGINAL);
+    EXPECT(!fs::exists(hidden));
+    EXPECT(!fs::exists(pendingShredPath(history)));
+}
+
+// Killed after the rename, before the shred: the original is shredded; a dry run only tells
+void checkReplaced() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path hidden = dir / ".hiddenoriginal";
+    testutil::writeFile(history, ORIGINAL);
+    EXPECT(::link(history.c_str(), hidden.c_str()) == 0);
+    recordAndDie(history, hidden, statOf(history));
+    testutil::writeFile(dir / "cleaned", CLEANED);
+    fs::rename(dir / "cleaned", history);
+
+    EXPECT(recover(history, true));
+    EXPECT(fs::exists(hidden));
+    EXPECT(fs::exists(pendingShredPath(history)));
+
+    EXPECT(recover(history));
+    EXPECT_EQ(testutil::readFile(history), CLEANED);
+    EXPECT(!fs::exists(hidden));
+    EXPECT(!fs::exists(pendingShredPath(history)));
+}
+
+// A record a live run holds is not touched; one naming another file is just dropped
+void checkLockedAndStale() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path hidden = dir / ".hiddenoriginal";
+    testutil::writeFile(history, ORIGINAL);
+    EXPECT(::link(history.c_str(), hidden.c_str()) == 0);
+    const struct stat st = statOf(history);
+    {
+        PendingShred live;
+        std::ostringstream log;
+        EXPECT(live.record(history, hidden, static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), 1, log));
+        EXPECT(recover(history));
+        EXPECT(fs::exists(hidden));
+        EXPECT(fs::exists(pendingShredPath(history)));
+        live.clear();
+        EXPECT(!fs::exists(pendingShredPath(history)));
+    }
+
+    recordAndDie(history, hidden, st);
+    fs::remove(hidden);
+    testutil::writeFile(hidden, "someone else's file\n");
+    EXPECT(recover(history));
+    EXPECT_EQ(testutil::readFile(hidden), std::string("someone else's file\n"));
+    EXPECT(!fs::exists(pendingShredPath(history)));
+}
+
+// A run that completes leaves neither a record nor a hidden copy, deferred or not; the
+// next run resolves what a killed one left
+void checkEngine() {
+    for (bool defer : {false, true}) {
+        testutil::TempDir dir;
+        const fs::path history = dir / "history";
+        testutil::writeFile(history, ORIGINAL);
+        EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+        if (defer) config.shredQueue = dir / "queue";
+
+        const fs::path hidden = dir / ".leftover";
+        testutil::writeFile(hidden, ORIGINAL);
+        recordAndDie(history, hidden, statOf(hidden));
+
+        CleanResult result = testutil::cleanHistory(config, history).result;
+        EXPECT(result.ok);
+        EXPECT_EQ(result.shredQueued, defer);
+        EXPECT_EQ(testutil::readFile(history), CLEANED);
+        EXPECT(!fs::exists(hidden));
+        EXPECT(!fs::exists(pendingShredPath(history)));
+        size_t hiddenFiles = 0;
+        for (const auto& file : fs::directory_iterator(dir.path())) {
+            if (file.path().filename().string()[0] == '.') ++hiddenFiles;
+        }
+        EXPECT_EQ(hiddenFiles, static_cast<size_t>(defer ? 1 : 0)); // The queued original
+    }
+}
+
+} // namespace
+
+int main() {
+    checkLinked();
+    checkMovedAside();
+    checkReplaced();
+    checkLockedAndStale();
+    checkEngine();
+    return testutil::testResult("PendingShredTest");
+}
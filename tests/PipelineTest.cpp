@@ -0,0 +1,148 @@
+// --pipeline: the three-stage classification writes what the sequential path writes, for
+// a mapped history file and for a stream (read ahead into a ring of buffers, with entries
+// longer than one), and a history that cannot be mapped (here a FIFO) is still cleaned.
+
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>      // For open
+#include <sys/stat.h>   // For mkfifo
+#include <unistd.h>     // For write, close, pipe
+
+namespace {
+
+std::string history() {
+    std::string data;
+    for (size_t i = 0; i < 100000; ++i) {
+        data += testutil::entry(testutil::FIRST_TIMESTAMP + static_cast<std::time_t>(i),
+                                (i % 7 == 3 ? "export SECRET_TOKEN=" : "ls ") + std::to_string(i));
+        if (i % 1000 == 5) data += "continued line\n";
+    }
+    return data;
+}
+
+testutil::EngineRun clean(const fs::path& file, bool pipeline, bool dryRun) {
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.pipeline = pipeline;
+    config.dryRun = dryRun;
+    return testutil::cleanHistory(config, file);
+}
+
+void checkSameOutput() {
+    testutil::TempDir dir;
+    const std::string data = history();
+    testutil::writeFile(dir / "sequential", data);
+    testutil::writeFile(dir / "pipelined", data);
+    CleanResult sequential = clean(dir / "sequential", false, false).result;
+    CleanResult pipelined = clean(dir / "pipelined", true, false).result;
+    EXPECT(sequential.ok && pipelined.ok);
+    EXPECT_EQ(pipelined.deleted, sequential.deleted);
+    EXPECT_EQ(pipelined.kept, sequential.kept);
+    EXPECT(sequential.deleted > 0);
+    EXPECT(testutil::readFile(dir / "pipelined") == testutil::readFile(dir / "sequential"));
+}
+
+// Writes data into fifo once a reader opens it; gives up after a few seconds so a run
+// that never opens the FIFO cannot hang the test
+void feedFifo(const fs::path& fifo, const std::string& data) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    int fd = -1;
+    while (fd == -1 && std::chrono::steady_clock::now() < deadline) {
+        fd = ::open(fifo.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1 && errno == ENXIO) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        else if (fd == -1) return;
+    }
+    if (fd == -1) return;
+    ::fcntl(fd, F_SETFL, 0);    // Blocking from here on
+    for (size_t pos = 0; pos < data.size();) {
+        ssize_t written = ::write(fd, data.data() + pos, data.size() - pos);
+        if (written <= 0) break;
+        pos += static_cast<size_t>(written);
+    }
+    ::close(fd);
+}
+
+void checkUnmappedSequential() {
+    testutil::TempDir dir;
+    const fs::path fifo = dir / "history";
+    EXPECT(::mkfifo(fifo.c_str(), 0600) == 0);
+    const std::string data = testutil::entry(testutil::FIRST_TIMESTAMP, "export SECRET_TOKEN=1") +
+                             testutil::entry(testutil::FIRST_TIMESTAMP + 1, "ls");
+
+    // Read with read(), as without --pipeline, and classified sequentially with a notice
+    std::thread feeder(feedFifo, fifo, data);
+    testutil::EngineRun run = clean(fifo, true, true);
+    feeder.join();
+    EXPECT(run.result.ok);
+    EXPECT_EQ(run.result.deleted, 1ull);
+    EXPECT_EQ(run.result.kept, 1ull);
+    EXPECT(run.info.find("without --pipeline") != std::string::npos);
+}
+
+// Filters in into out (a file, or a pipe fed in small writes) and returns the result
+CleanResult filter(const fs::path& in, const fs::path& out, bool pipeline, bool throughPipe) {
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.pipeline = pipeline;
+    HistoryEngine engine;
+    std::string error;
+    EXPECT(engine.configure(config, error));
+    int inFd = ::open(in.c_str(), O_RDONLY | O_CLOEXEC);
+    int outFd = ::open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    EXPECT(inFd != -1 && outFd != -1);
+    std::thread feeder;
+    if (throughPipe) {
+        int fds[2];
+        EXPECT(::pipe(fds) == 0);
+        const std::string data = testutil::readFile(in);
+        feeder = std::thread([data, fd = fds[1]]() {
+            for (size_t pos = 0; pos < data.size();) {
+                ssize_t written = ::write(fd, data.data() + pos, std::min<size_t>(data.size() - pos, 5000));
+                if (written <= 0) break;
+                pos += static_cast<size_t>(written);
+            }
+            ::close(fd);
+        });
+        ::close(inFd);
+        inFd = fds[0];
+    }
+    CleanResult result = engine.filter(inFd, outFd, in);
+    if (feeder.joinable()) feeder.join();
+    ::close(inFd);
+    ::close(outFd);
+    return result;
+}
+
+void checkStream() {
+    testutil::TempDir dir;
+    // Several ring buffers' worth, with an entry longer than two of them in the middle
+    std::string data = history();
+    const size_t middle = data.find("\n: ", data.size() / 2) + 1;
+    data.insert(middle, testutil::entry(testutil::FIRST_TIMESTAMP, "echo " + std::string(PIPELINE_CHUNK_SIZE * 5 / 2, 'x')));
+    testutil::writeFile(dir / "history", data);
+
+    CleanResult sequential = filter(dir / "history", dir / "sequential", false, false);
+    EXPECT(sequential.ok);
+    EXPECT(sequential.deleted > 0);
+    const std::string expected = testutil::readFile(dir / "sequential");
+    for (bool throughPipe : {false, true}) {
+        CleanResult pipelined = filter(dir / "history", dir / "pipelined", true, throughPipe);
+        EXPECT(pipelined.ok);
+        EXPECT_EQ(pipelined.lines, sequential.lines);
+        EXPECT_EQ(pipelined.deleted, sequential.deleted);
+        EXPECT_EQ(pipelined.kept, sequential.kept);
+        EXPECT(testutil::readFile(dir / "pipelined") == expected);
+    }
+}
+
+} // namespace
+
+int main() {
+    checkSameOutput();
+    checkUnmappedSequential();
+    checkStream();
+    return testutil::testResult("PipelineTest");
+}
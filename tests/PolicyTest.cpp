@@ -0,0 +1,169 @@
+// --policy: loadPolicyFile() parses rules and reports malformed files as FILE:LINE, and the
+// engine lets the first matching rule decide, by descending priority and then file order,
+// so a keep rule ranked above a delete rule saves what both match.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/Policy.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// The error of a policy file that must not load, empty if it loaded
+std::string loadError(const testutil::TempDir& dir, const std::string& text) {
+    const fs::path path = dir / "policy";
+    testutil::writeFile(path, text);
+    std::vector<PolicyRuleSpec> rules;
+    std::string error;
+    if (loadPolicyFile(path, rules, error)) return std::string();
+    return error;
+}
+
+void checkParse() {
+    testutil::TempDir dir;
+    const fs::path path = dir / "policy";
+    testutil::writeFile(path, "# Comment\n"
+                              "; Another\n"
+                              "\n"
+                              "[secrets]\n"
+                              "action = delete\n"
+                              "priority = 10\n"
+                              "keyword = SECRET_TOKEN\n"
+                              "regex = ^curl .*-u \r\n"
+                              "  [ work ]  \n"
+                              "action = keep\n"
+                              "priority = -2\n"
+                              "mode = older_than\n"
+                              "days = 30\n"
+                              "precise = yes\n");
+    std::vector<PolicyRuleSpec> rules;
+    std::string error;
+    EXPECT(loadPolicyFile(path, rules, error));
+    EXPECT_EQ(rules.size(), 2u);
+    if (rules.size() != 2) return;
+    EXPECT_EQ(rules[0].rule.name, std::string("secrets"));
+    EXPECT_EQ(rules[0].line, 4);
+    EXPECT(rules[0].rule.deleteMatches);
+    EXPECT_EQ(rules[0].rule.priority, 10);
+    EXPECT(rules[0].rule.keywords == std::vector<std::string>{"SECRET_TOKEN"});
+    EXPECT(rules[0].rule.regexes == std::vector<std::string>{"^curl .*-u"});
+    EXPECT_EQ(rules[0].mode, std::string("all"));
+    EXPECT_EQ(rules[1].rule.name, std::string("work"));
+    EXPECT_EQ(rules[1].line, 9);
+    EXPECT(!rules[1].rule.deleteMatches);
+    EXPECT_EQ(rules[1].rule.priority, -2);
+    EXPECT_EQ(rules[1].mode, std::string("older_than"));
+    EXPECT_EQ(rules[1].days, 30);
+    EXPECT(rules[1].precise);
+}
+
+void checkErrors() {
+    testutil::TempDir dir;
+    const std::string at = (dir / "policy").string() + ":";
+    EXPECT_EQ(loadError(dir, "[a]\nkeyword = x\n\n[a]\n"), at + "4: Duplicate rule 'a'.");
+    EXPECT_EQ(loadError(dir, "# Header\nkeyword = x\n[a]\n"), at + "2: Setting outside of a rule; start one with '[name]'.");
+    EXPECT_EQ(loadError(dir, "[a]\naction = drop\n"), at + "2: Invalid action: 'drop'. Use 'delete' or 'keep'.");
+    EXPECT_EQ(loadError(dir, "[a]\npriority = high\n"), at + "2: Invalid priority: 'high'.");
+    EXPECT_EQ(loadError(dir, "[a]\npriority = 99999999999\n"), at + "2: Invalid priority: '99999999999'.");
+    EXPECT_EQ(loadError(dir, "[a]\ndays = 0\n"), at + "2: 'days' requires a positive integer.");
+    EXPECT_EQ(loadError(dir, "[a]\nprecise = maybe\n"), at + "2: Invalid value for 'precise': 'maybe'.");
+    EXPECT_EQ(loadError(dir, "[a]\nkeyword =\n"), at + "2: 'keyword' requires a value.");
+    EXPECT_EQ(loadError(dir, "[a]\ncolour = red\n"), at + "2: Unknown setting: 'colour'.");
+    EXPECT_EQ(loadError(dir, "[a]\njust words\n"), at + "2: Expected '[rule]' or 'key = value'.");
+    EXPECT_EQ(loadError(dir, "[a\n"), at + "1: Unterminated rule name.");
+    EXPECT_EQ(loadError(dir, "[ ]\n"), at + "1: Empty rule name.");
+    EXPECT(loadError(dir, "[a]\nregex = (unclosed\n").rfind(at + "2: Invalid regex pattern: ", 0) == 0);
+    EXPECT_EQ(loadError(dir, "# Nothing here\n"), "Policy file defines no rules: " + (dir / "policy").string());
+    EXPECT_EQ(loadError(dir, "[a]\nkeyword = x\n"), std::string());
+
+    std::vector<PolicyRuleSpec> rules;
+    std::string error;
+    EXPECT(!loadPolicyFile(dir / "missing", rules, error));
+    EXPECT_EQ(error, "Cannot read policy file: " + (dir / "missing").string());
+}
+
+PolicyRule rule(const std::string& name, bool deleteMatches, int priority, const std::vector<std::string>& keywords) {
+    PolicyRule result;
+    result.name = name;
+    result.deleteMatches = deleteMatches;
+    result.priority = priority;
+    result.keywords = keywords;
+    return result;
+}
+
+testutil::EngineRun cleanWithRules(const fs::path& history, const std::vector<PolicyRule>& rules) {
+    EngineConfig config = testutil::engineConfig();
+    config.rules = rules;
+    return testutil::cleanHistory(config, history);
+}
+
+// The first rule to match decides: higher priority first, equal priorities in file order;
+// ruleMatches counts the entries each rule decided, by its place in config().rules
+void checkOrder() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const std::string data = testutil::entry(testutil::FIRST_TIMESTAMP, "curl -u admin:SECRET_TOKEN work.example") +
+                             testutil::entry(testutil::FIRST_TIMESTAMP + 1, "ssh work.example") +
+                             testutil::entry(testutil::FIRST_TIMESTAMP + 2, "export SECRET_TOKEN=1") +
+                             testutil::entry(testutil::FIRST_TIMESTAMP + 3, "ls");
+
+    // Keep above delete: the work entry with the token survives
+    testutil::writeFile(history, data);
+    testutil::EngineRun run = cleanWithRules(history, {rule("secrets", true, 0, {"SECRET_TOKEN"}),
+                                                       rule("work", false, 5, {"work.example"})});
+    EXPECT(run.result.ok);
+    EXPECT_EQ(run.result.deleted, 1ull);
+    EXPECT(run.result.ruleMatches == (std::vector<unsigned long long>{1, 2}));
+    EXPECT_EQ(testutil::readFile(history), testutil::entry(testutil::FIRST_TIMESTAMP, "curl -u admin:SECRET_TOKEN work.example") +
+                                           testutil::entry(testutil::FIRST_TIMESTAMP + 1, "ssh work.example") +
+                                           testutil::entry(testutil::FIRST_TIMESTAMP + 3, "ls"));
+
+    // Delete above keep: it goes after all
+    testutil::writeFile(history, data);
+    run = cleanWithRules(history, {rule("secrets", true, 5, {"SECRET_TOKEN"}), rule("work", false, 0, {"work.example"})});
+    EXPECT(run.result.ok);
+    EXPECT_EQ(run.result.deleted, 2ull);
+    EXPECT(run.result.ruleMatches == (std::vector<unsigned long long>{2, 1}));
+
+    // Equal priorities: file order, whichever action comes first
+    testutil::writeFile(history, data);
+    run = cleanWithRules(history, {rule("work", false, 1, {"work.example"}), rule("secrets", true, 1, {"SECRET_TOKEN"})});
+    EXPECT_EQ(run.result.deleted, 1ull);
+    EXPECT(run.result.ruleMatches == (std::vector<unsigned long long>{2, 1}));
+    testutil::writeFile(history, data);
+    run = cleanWithRules(history, {rule("secrets", true, 1, {"SECRET_TOKEN"}), rule("work", false, 1, {"work.example"})});
+    EXPECT_EQ(run.result.deleted, 2ull);
+    EXPECT(run.result.ruleMatches == (std::vector<unsigned long long>{2, 1}));
+}
+
+// A keep rule shields the entries in its window from a delete rule without filters, and
+// a rule only decides for entries inside its own window
+void checkKeepOverridesDelete() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    testutil::writeFile(history, testutil::entries(0, 10, "make"));
+
+    PolicyRule everything = rule("everything", true, 0, {});
+    PolicyRule recent = rule("recent", false, 1, {});
+    recent.startTimestamp = testutil::FIRST_TIMESTAMP + 6;
+    PolicyRule unreached = rule("unreached", false, 2, {"make"});
+    unreached.endTimestamp = testutil::FIRST_TIMESTAMP - 1;
+    testutil::EngineRun run = cleanWithRules(history, {everything, recent, unreached});
+    EXPECT(run.result.ok);
+    EXPECT_EQ(run.result.deleted, 6ull);
+    EXPECT_EQ(run.result.kept, 4ull);
+    EXPECT(run.result.ruleMatches == (std::vector<unsigned long long>{6, 4, 0}));
+    EXPECT_EQ(testutil::readFile(history), testutil::entries(6, 4, "make"));
+}
+
+} // namespace
+
+int main() {
+    checkParse();
+    checkErrors();
+    checkOrder();
+    checkKeepOverridesDelete();
+    return testutil::testResult("PolicyTest");
+}
@@ -0,0 +1,137 @@
+// --defer-shred / --shred-queue: queued files are shredded and their entries removed; an
+// entry whose file is gone or was replaced is dropped without touching the new file; a
+// malformed entry stays queued; a second drainer leaves the queue to the first.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/ShredQueue.h"
+
+#include <sstream>
+#include <string>
+#include <fcntl.h>      // For open
+#include <sys/file.h>   // For flock
+#include <unistd.h>     // For close
+
+namespace {
+
+size_t queuedEntries(const fs::path& queue) {
+    size_t count = 0;
+    for (const auto& file : fs::directory_iterator(queue)) {
+        if (file.path().extension() == ".shred") ++count;
+    }
+    return count;
+}
+
+ShredQueueResult drain(const fs::path& queue, bool expectOk = true) {
+    std::ostringstream log;
+    ShredQueueResult result;
+    EXPECT_EQ(drainShredQueue(queue, log, result), expectOk);
+    return result;
+}
+
+void checkDrain() {
+    testutil::TempDir dir;
+    const fs::path queue = dir / "queue";
+    std::ostringstream log;
+
+    ShredQueueResult result = drain(queue);     // Never created: nothing to do
+    EXPECT_EQ(result.shredded, 0ull);
+    EXPECT(!fs::exists(queue));
+
+    for (const char* name : {"first", "second", "gone", "replaced"}) {
+        testutil::writeFile(dir / name, std::string("secret contents of ") + name + "\n");
+        EXPECT(enqueueShred(queue, dir / name, 1, log));
+    }
+    EXPECT((fs::status(queue).permissions() & fs::perms::all) == fs::perms::owner_all);
+    EXPECT_EQ(queuedEntries(queue), 4u);
+
+    fs::remove(dir / "gone");
+    fs::remove(dir / "replaced");
+    testutil::writeFile(dir / "replaced", "a new file under the old name\n");
+
+    result = drain(queue);
+    EXPECT_EQ(result.shredded, 2ull);
+    EXPECT_EQ(result.stale, 2ull);
+    EXPECT_EQ(result.failed, 0ull);
+    EXPECT(!fs::exists(dir / "first"));
+    EXPECT(!fs::exists(dir / "second"));
+    EXPECT_EQ(testutil::readFile(dir / "replaced"), std::string("a new file under the old name\n"));
+    EXPECT_EQ(queuedEntries(queue), 0u);
+}
+
+void checkMalformed() {
+    testutil::TempDir dir;
+    const fs::path queue = dir / "queue";
+    std::ostringstream log;
+    testutil::writeFile(dir / "file", "secret\n");
+    EXPECT(enqueueShred(queue, dir / "file", 1, log));
+    testutil::writeFile(queue / "0-garbage.shred", "not a queue entry\n");
+    testutil::writeFile(queue / "0-unfinished.shred.tmp", "half written\n");   // Never renamed in
+
+    ShredQueueResult result = drain(queue, false);
+    EXPECT_EQ(result.shredded, 1ull);
+    EXPECT_EQ(result.failed, 1ull);
+    EXPECT(!fs::exists(dir / "file"));
+    EXPECT(fs::exists(queue / "0-garbage.shred"));      // Kept for a look, not guessed at
+    EXPECT_EQ(queuedEntries(queue), 1u);
+}
+
+void checkBusy() {
+    testutil::TempDir dir;
+    const fs::path queue = dir / "queue";
+    std::ostringstream log;
+    testutil::writeFile(dir / "file", "secret\n");
+    EXPECT(enqueueShred(queue, dir / "file", 1, log));
+
+    int lockFd = ::open((queue / "lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    EXPECT(lockFd != -1);
+    EXPECT(::flock(lockFd, LOCK_EX | LOCK_NB) == 0);
+    ShredQueueResult result = drain(queue);
+    EXPECT(result.busy);
+    EXPECT_EQ(result.shredded, 0ull);
+    EXPECT(fs::exists(dir / "file"));
+    ::close(lockFd);
+
+    result = drain(queue);
+    EXPECT(!result.busy);
+    EXPECT_EQ(result.shredded, 1ull);
+    EXPECT(!fs::exists(dir / "file"));
+}
+
+// A deferred run leaves its original hidden and queued; draining the queue removes it
+void checkEngine() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const fs::path queue = dir / "queue";
+    testutil::writeFile(history, ": 1700000000:0;export SECRET_TOKEN=1\n: 1700000001:0;ls\n");
+
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.shredQueue = queue;
+    CleanResult cleaned = testutil::cleanHistory(config, history).result;
+    EXPECT(cleaned.ok);
+    EXPECT(cleaned.shredQueued);
+    EXPECT_EQ(queuedEntries(queue), 1u);
+
+    auto hiddenFiles = [&dir]() {
+        size_t count = 0;
+        for (const auto& file : fs::directory_iterator(dir.path())) {
+            if (file.path().filename().string()[0] == '.') ++count;
+        }
+        return count;
+    };
+    EXPECT_EQ(hiddenFiles(), 1u);
+    ShredQueueResult result = drain(queue);
+    EXPECT_EQ(result.shredded, 1ull);
+    EXPECT_EQ(hiddenFiles(), 0u);
+    EXPECT_EQ(testutil::readFile(history), std::string(": 1700000001:0;ls\n"));
+}
+
+} // namespace
+
+int main() {
+    checkDrain();
+    checkMalformed();
+    checkBusy();
+    checkEngine();
+    return testutil::testResult("ShredQueueTest");
+}
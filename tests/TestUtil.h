@@ -0,0 +1,190 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <filesystem>   // Requires C++17
+#include <unistd.h>     // For getpid
+
+#include "zsh_history_cleaner/HistoryEngine.h"
+
+// Helpers shared by the test executables. Each executable is one ctest test: the checks
+// print what failed and where, and main() returns testResult(), non-zero if any did.
+
+namespace testutil {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline void fail(const char* file, int line, const std::string& what) {
+    std::fprintf(stderr, "%s:%d: FAILED: %s\n", file, line, what.c_str());
+    ++failures();
+}
+
+// Printable form of a value for a failed EXPECT_EQ; strings are escaped so control bytes show
+template <typename T>
+std::string show(const T& value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+inline std::string show(std::string_view value) {
+    std::string out = "\"";
+    for (unsigned char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7f) {
+            char hex[5];
+            std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+            out += hex;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    return out + "\"";
+}
+inline std::string show(const std::string& value) { return show(std::string_view(value)); }
+inline std::string show(const char* value) { return show(std::string_view(value)); }
+inline std::string show(bool value) { return value ? "true" : "false"; }
+
+inline int testResult(const char* name) {
+    if (failures() != 0) {
+        std::fprintf(stderr, "%s: %d check(s) failed\n", name, failures());
+        return 1;
+    }
+    std::printf("%s: ok\n", name);
+    return 0;
+}
+
+// A fresh directory under the system temp directory, removed with everything in it
+class TempDir {
+public:
+    TempDir() {
+        std::error_code ec;
+        static int serial = 0;
+        path_ = std::filesystem::temp_directory_path(ec) /
+            ("zsh_history_cleaner_test_" + std::to_string(getpid()) + "_" + std::to_string(serial++));
+        std::filesystem::remove_all(path_, ec);
+        std::filesystem::create_directories(path_, ec);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        std::filesystem::remove_all(path_, ec);
+    }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    const std::filesystem::path& path() const { return path_; }
+    std::filesystem::path operator/(const std::string& name) const { return path_ / name; }
+
+private:
+    std::filesystem::path path_;
+};
+
+inline void writeFile(const std::filesystem::path& path, std::string_view data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+inline std::string readFile(const std::filesystem::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Timestamp of the first entry entries() generates
+const std::time_t FIRST_TIMESTAMP = 1700000000;
+
+// One history entry as zsh writes it
+inline std::string entry(std::time_t timestamp, const std::string& command) {
+    return ": " + std::to_string(static_cast<long long>(timestamp)) + ":0;" + command + "\n";
+}
+
+// Entries first to first + count - 1: entry i is stamped FIRST_TIMESTAMP + i and runs "command i"
+inline std::string entries(size_t first, size_t count, const std::string& command) {
+    std::string data;
+    for (size_t i = first; i < first + count; ++i) {
+        data += entry(FIRST_TIMESTAMP + static_cast<std::time_t>(i), command + " " + std::to_string(i));
+    }
+    return data;
+}
+
+// Engine settings for a test: these keywords, and one shred pass so that runs stay quick
+inline EngineConfig engineConfig(const std::vector<std::string>& keywords = {}) {
+    EngineConfig config;
+    config.keywords = keywords;
+    config.shredPasses = 1;
+    return config;
+}
+
+// One engine call: its result and what it wrote to its info and log streams
+struct EngineRun {
+    CleanResult result;
+    std::string info;
+    std::string log;
+};
+
+// Configures an engine with config (an error there is a failed check) and has it clean
+// history (timing the call into stats, if given), or merge inputs into it
+inline EngineRun cleanHistory(const EngineConfig& config, const std::filesystem::path& history,
+                              RunStats* stats = nullptr) {
+    HistoryEngine engine;
+    std::string error;
+    if (!engine.configure(config, error)) fail(__FILE__, __LINE__, "configure: " + error);
+    std::ostringstream info, log;
+    CleanOptions options;
+    options.info = &info;
+    options.log = &log;
+    options.stats = stats;
+    EngineRun run;
+    run.result = engine.clean(history, options);
+    run.info = info.str();
+    run.log = log.str();
+    return run;
+}
+
+inline EngineRun mergeHistories(const EngineConfig& config, const std::vector<std::filesystem::path>& inputs,
+                                const std::filesystem::path& history) {
+    HistoryEngine engine;
+    std::string error;
+    if (!engine.configure(config, error)) fail(__FILE__, __LINE__, "configure: " + error);
+    std::ostringstream info, log;
+    CleanOptions options;
+    options.info = &info;
+    options.log = &log;
+    EngineRun run;
+    run.result = engine.merge(inputs, history, options);
+    run.info = info.str();
+    run.log = log.str();
+    return run;
+}
+
+} // namespace testutil
+
+#define EXPECT(cond) \
+    do { \
+        if (!(cond)) testutil::fail(__FILE__, __LINE__, #cond); \
+    } while (0)
+
+#define EXPECT_EQ(actual, expected) \
+    do { \
+        const auto& actualValue_ = (actual); \
+        const auto& expectedValue_ = (expected); \
+        if (!(actualValue_ == expectedValue_)) { \
+            testutil::fail(__FILE__, __LINE__, std::string(#actual " == " #expected ": got ") + \
+                           testutil::show(actualValue_) + ", expected " + testutil::show(expectedValue_)); \
+        } \
+    } while (0)
+
+#endif // TEST_UTIL_H
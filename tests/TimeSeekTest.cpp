@@ -0,0 +1,151 @@
+// locateTimeWindow(): the range it returns must hold every entry inside the window, and
+// an entry out of order inside that range, just past it or where a probe lands must force
+// the full scan (disorder anywhere else goes unseen). Also checked through the engine, for
+// --seek and for --incremental's prefix slices.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/TimeSeek.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::time_t FIRST = 1400000000;          // Start of the generated history
+const std::time_t STEP = 1578;                 // About 200000 entries over ten years
+const size_t ENTRIES = 200000;
+const std::time_t TODAY = FIRST + STEP * static_cast<std::time_t>(ENTRIES) + 86400 * 3;
+const std::time_t SLACK = 86400;
+
+// An ordered history with count secrets stamped at when inserted after entry at; offsets
+// gets where each secret starts
+std::string history(size_t at, size_t count, std::time_t when, std::vector<size_t>* offsets = nullptr) {
+    std::string data;
+    for (size_t i = 0; i < ENTRIES; ++i) {
+        if (i == at) {
+            for (size_t j = 0; j < count; ++j) {
+                if (offsets != nullptr) offsets->push_back(data.size());
+                data += testutil::entry(when, "export SECRET_TOKEN=" + std::to_string(j));
+            }
+        }
+        data += testutil::entry(FIRST + STEP * static_cast<std::time_t>(i), "ls " + std::to_string(i));
+    }
+    return data;
+}
+
+// The entry holding the middle byte of the ordered history, where the first probe lands
+size_t middleEntry() {
+    const std::string data = history(ENTRIES, 0, 0);
+    return static_cast<size_t>(std::count(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(data.size() / 2), '\n'));
+}
+
+void checkOrderedRange() {
+    const std::string data = history(ENTRIES, 0, 0);
+    const std::time_t start = FIRST + STEP * 1000;
+    const std::time_t end = FIRST + STEP * 2000;
+    TimeWindowRange range;
+    EXPECT(locateTimeWindow(data, start, end, SLACK, range));
+    // Exactly the slack-widened span: headers are the only lines, so the edges are exact
+    const size_t slackEntries = static_cast<size_t>(SLACK / STEP) + 1;
+    EXPECT_EQ(range.begin, data.find(testutil::entry(FIRST + STEP * static_cast<std::time_t>(1000 - slackEntries + 1), "ls " +
+                                           std::to_string(1000 - slackEntries + 1))));
+    EXPECT_EQ(range.end, data.find(testutil::entry(FIRST + STEP * static_cast<std::time_t>(2000 + slackEntries), "ls " +
+                                         std::to_string(2000 + slackEntries))));
+
+    // Open edges
+    EXPECT(locateTimeWindow(data, 0, end, SLACK, range));
+    EXPECT_EQ(range.begin, static_cast<size_t>(0));
+    EXPECT(locateTimeWindow(data, start, std::numeric_limits<std::time_t>::max(), SLACK, range));
+    EXPECT_EQ(range.end, data.size());
+    // A window after everything is empty
+    EXPECT(locateTimeWindow(data, TODAY, TODAY + 86399, SLACK, range));
+    EXPECT_EQ(range.begin, range.end);
+
+    // Several windows at once give what one call each does
+    const std::vector<std::pair<std::time_t, std::time_t>> windows = {
+        {start, end}, {0, start}, {end, std::numeric_limits<std::time_t>::max()}, {TODAY, TODAY}};
+    std::vector<TimeWindowRange> ranges;
+    EXPECT(locateTimeWindows(data, windows, SLACK, ranges));
+    EXPECT_EQ(ranges.size(), windows.size());
+    for (size_t i = 0; i < windows.size() && i < ranges.size(); ++i) {
+        EXPECT(locateTimeWindow(data, windows[i].first, windows[i].second, SLACK, range));
+        EXPECT_EQ(ranges[i].begin, range.begin);
+        EXPECT_EQ(ranges[i].end, range.end);
+    }
+}
+
+void checkDisorder() {
+    TimeWindowRange range;
+    // Secrets stamped today where the first probe lands
+    EXPECT(!locateTimeWindow(history(middleEntry(), 20, TODAY), TODAY, TODAY + 86399, SLACK, range));
+
+    // A single entry going back more than the slack inside the range, at its edges, and
+    // among the few headers checked past its end
+    const std::time_t start = FIRST + STEP * 1000;
+    const std::time_t end = FIRST + STEP * 2000;
+    const size_t slackEntries = static_cast<size_t>(SLACK / STEP) + 1;
+    for (size_t at : {size_t(1000 - slackEntries + 2), size_t(1500), size_t(2000), 2000 + slackEntries + 2}) {
+        const std::time_t back = FIRST + STEP * static_cast<std::time_t>(at) - SLACK - STEP - 1;
+        EXPECT(!locateTimeWindow(history(at, 1, back), start, end, SLACK, range));
+    }
+
+    // Secrets stamped today 37% of the way in, where no probe for today's window goes,
+    // are not seen: the history is taken to be ordered and the window is empty
+    EXPECT(locateTimeWindow(history(ENTRIES * 37 / 100, 20, TODAY), TODAY, TODAY + 86399, SLACK, range));
+    EXPECT_EQ(range.begin, range.end);
+
+    // Disorder within the slack is tolerated, and the entry stays inside its window's range
+    std::vector<size_t> offsets;
+    const size_t at = ENTRIES / 2;
+    const std::time_t late = FIRST + STEP * static_cast<std::time_t>(at) - SLACK / 2;
+    const std::string close = history(at, 1, late, &offsets);
+    EXPECT(locateTimeWindow(close, late, late, SLACK, range));
+    EXPECT(range.begin <= offsets[0] && offsets[0] < range.end);
+}
+
+// The engine deletes every secret with --seek and with --incremental once a probe finds them
+CleanResult cleanWith(const std::string& path, std::time_t start, std::time_t end, bool seek, bool incremental,
+                      bool dryRun) {
+    EngineConfig config = testutil::engineConfig({"SECRET_TOKEN"});
+    config.startTimestamp = start;
+    config.endTimestamp = end;
+    config.seekByTime = seek;
+    config.incremental = incremental;
+    config.dryRun = dryRun;
+    return testutil::cleanHistory(config, path).result;
+}
+
+void checkEngine() {
+    testutil::TempDir dir;
+    const std::string path = (dir / "history").string();
+    testutil::writeFile(path, history(middleEntry(), 20, TODAY));
+
+    CleanResult full = cleanWith(path, TODAY, TODAY + 86399, false, false, true);
+    CleanResult seek = cleanWith(path, TODAY, TODAY + 86399, true, false, true);
+    EXPECT(full.ok && seek.ok);
+    EXPECT_EQ(full.deleted, 20ull);
+    EXPECT_EQ(seek.deleted, 20ull);
+
+    // The first run's window ends before the secrets, so the checkpoint covers them
+    // kept; the second reaches them, and the search for its prefix slice lands among them
+    // and classifies the whole history
+    CleanResult first = cleanWith(path, 0, TODAY - 86400 * 2, false, true, false);
+    EXPECT(first.ok);
+    EXPECT_EQ(first.deleted, 0ull);
+    EXPECT(fs::exists(path + ".cleaner-checkpoint"));
+    CleanResult second = cleanWith(path, 0, TODAY + 86399, false, true, false);
+    EXPECT(second.ok);
+    EXPECT_EQ(second.deleted, 20ull);
+    EXPECT_EQ(testutil::readFile(path).find("SECRET_TOKEN"), std::string::npos);
+}
+
+} // namespace
+
+int main() {
+    checkOrderedRange();
+    checkDisorder();
+    checkEngine();
+    return testutil::testResult("TimeSeekTest");
+}
@@ -0,0 +1,90 @@
+// Metafied history bytes: findMeta() at every alignment of its 64-byte stride, unmetafy()
+// undoing zsh's metafication of random bytes, a Meta byte cut off at the end, and the
+// engine matching keywords against the decoded command.
+
+#include "TestUtil.h"
+
+#include "zsh_history_cleaner/Unmetafy.h"
+
+#include <random>
+#include <string>
+
+namespace {
+
+// As zsh writes it: NUL and the token bytes 0x83-0xa2 become Meta, byte ^ 0x20
+std::string metafy(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte == 0 || (byte >= 0x83 && byte <= 0xa2)) {
+            out += static_cast<char>(ZSH_META);
+            out += static_cast<char>(byte ^ 0x20);
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+void checkFindMeta() {
+    const std::string plain(300, 'x');
+    EXPECT_EQ(findMeta(""), 0u);
+    EXPECT_EQ(findMeta(plain), plain.size());
+    for (size_t length = 1; length <= 200; ++length) {
+        for (size_t at = 0; at < length; at += (length > 70 ? 7 : 1)) {
+            std::string text = plain.substr(0, length);
+            text[at] = static_cast<char>(ZSH_META);
+            if (at + 3 < length) text[at + 3] = static_cast<char>(ZSH_META);
+            EXPECT_EQ(findMeta(text), at);
+            EXPECT_EQ(findMeta(std::string_view(text).substr(at + 1)), at + 3 < length ? 2u : length - at - 1);
+        }
+    }
+}
+
+void checkUnmetafy() {
+    std::string scratch;
+    const std::string plain = "ls -la /tmp";
+    std::string_view same = unmetafy(plain, scratch);
+    EXPECT(same.data() == plain.data());     // No Meta: no copy
+
+    EXPECT_EQ(std::string(unmetafy("voil\xc3\x83\x80", scratch)), std::string("voil\xc3\xa0"));
+    EXPECT_EQ(std::string(unmetafy(std::string("a\x83 b", 4), scratch)), std::string("a\0b", 3));
+    EXPECT_EQ(std::string(unmetafy("ab\x83", scratch)), std::string("ab\x83"));   // Truncated pair
+    EXPECT_EQ(std::string(unmetafy("\x83\xa3\x83", scratch)), std::string("\x83\x83"));
+
+    std::mt19937 rng(31);
+    for (int round = 0; round < 20000; ++round) {
+        std::string text;
+        for (size_t n = rng() % 150; n > 0; --n) {
+            // Mostly ASCII, with UTF-8 lead and continuation bytes and NULs
+            unsigned value = rng() % 4 == 0 ? 0x80 + rng() % 0x50 : rng() % 0x80;
+            text += static_cast<char>(value);
+        }
+        const std::string metafied = metafy(text);
+        EXPECT_EQ(std::string(unmetafy(metafied, scratch)), text);
+    }
+}
+
+// The keyword is what the user typed; the history holds it metafied
+void checkEngine() {
+    testutil::TempDir dir;
+    const fs::path history = dir / "history";
+    const std::string secret = testutil::entry(testutil::FIRST_TIMESTAMP, metafy("export MOT_DE_PASSE_voil\xc3\xa0=1"));
+    const std::string kept = testutil::entry(testutil::FIRST_TIMESTAMP + 1, metafy("echo voil\xc3\xa0"));
+    testutil::writeFile(history, secret + kept);
+    EXPECT(secret.find('\x83') != std::string::npos);
+
+    CleanResult result = testutil::cleanHistory(testutil::engineConfig({"PASSE_voil\xc3\xa0"}), history).result;
+    EXPECT(result.ok);
+    EXPECT_EQ(result.deleted, 1ull);
+    EXPECT_EQ(testutil::readFile(history), kept);   // Kept entries stay metafied
+}
+
+} // namespace
+
+int main() {
+    checkFindMeta();
+    checkUnmetafy();
+    checkEngine();
+    return testutil::testResult("UnmetafyTest");
+}